@@ -55,6 +55,8 @@
 
 #include "CompressMovie.h"
 #include "DTSQTUtilities.h"
+
+#include <math.h>
 	
 	
 // GLOBALS
@@ -63,6 +65,59 @@ static 	Boolean				gShowWindow = true;
 static	SCTemporalSettings		gTemporalSettings;
 static	SCSpatialSettings			gSpatialSettings;
 static	SCDataRateSettings		aDataRateSetting;
+static	RecompressOptions		gOptions = { true, 0, true, 500, 1024L * 1024L, false, 1024, false, false, 0, 0, kQTUResampleLanczos, false, { 0, 0, 0, 0 }, 0, false, 8, 0, 4, 2000, 8192, 0, 0, 0, false, 0, 12, false, 2.0 };
+static	RecompressStatistics	gStatistics;
+static	RecompressProfile		gProfiles[kMaxRecompressProfiles];
+static	short					gProfileCount = 0;
+
+// Frame GWorlds and the compressed data buffers are kept between the movies of a batch, most of the time the movies
+// have the same size and we can use them again. Enough GWorlds for the largest ring plus the render GWorld.
+#define	kMaxCachedGWorlds		72
+static	GWorldPtr				gCachedGWorlds[kMaxCachedGWorlds];
+static	QTUBufferPool			gPayloadPool = NULL;
+static	Handle					gStagingHandle = NULL;		// for AddMediaSample when the data is not in a handle
+static	long					gStagingHandleGrowths = 0;
+static	long					gFirstFrameAllocations = 0;
+static	QTUPrefetcher			gPrefetcher = NULL;			// reads the source video ahead of RenderSourceFrame
+static	QTUWindowLoader			gWindowLoader = NULL;		// keeps the source movie ahead of RenderSourceFrame in RAM
+static	double					gMemoryAtStart = 0;			// QTUGetMemoryInUse when the movie was started
+static	double					gMemoryPeak = 0;
+static	double					gMemoryPooled = 0;			// kept from the movies before when the movie was started
+static	double					gMemoryCorrection = 1.0;	// what the movies so far really took, over what was predicted
+static	double					gAdmittedEstimate = 0;		// the uncorrected prediction for the next movie
+static	Boolean					gAdmitAfterSettings = false;	// RecompressMovieFile admits the movie once the settings are known
+static	QTUQualityMeter			gQualityMeter = NULL;		// scores the compressed frames when verifyQuality is set
+static	ImageSequence			gQualitySequence = 0;		// decodes them into gQualityGWorld
+static	GWorldPtr				gQualityGWorld = NULL;
+static	short					gQualityFileRefNum = 0;		// the per-frame scores
+static	long					gQualityFrameNum = 0;
+static	double					gQualityCompressMicroseconds = 0;	// compressing the frames, the check gets a share of it
+static	double					gQualityDecodeMicroseconds = 0;	// decoding the frames for the check
+static	Boolean					gQualityWaitsForKeyFrame = false;	// frames were skipped, decoding starts again at a key frame
+
+// The output cache lives in a folder of its own in the Caches (or Preferences) folder.
+#define	kOutputCacheFolderName	"\pCompressMovies Cache"
+#define	kOutputCacheEntryBlock	64			// the entries TrimOutputCache collects grow in blocks of this many
+#define	kOutputCacheSampledCount	8			// samples of every media read for the key
+static	RecompressCacheStatistics	gCacheStatistics;
+
+
+// Every frame that is in flight in the parallel intra-frame compressor owns one of these. The rendered frame is
+// copied into the slot's GWorld, a worker compresses it into the slot's compressed data handle, and the main
+// thread appends the slots to the media in frame order.
+typedef struct IntraFrameSlot {
+	long					frameNum;
+	TimeValue				duration;
+	Boolean					isDone;								// a worker has finished this frame
+	OSStatus				result;
+	GWorldPtr				gWorld;
+	Rect					bounds;
+	ImageDescriptionHandle	imageDescription;
+	Ptr						compressedData;						// from gPayloadPool
+	long					compressedDataCapacity;
+	long					compressedDataSize;
+	double					compressMicroseconds;
+} IntraFrameSlot;
 
 
 // ______________________________________________________________________
@@ -80,429 +135,4859 @@ pascal void SetFirstRecompressState(Boolean state)
 
 
 // ______________________________________________________________________
-// RecompressMovieFile is a long and windy function, a lot of it is from the ConvertToMovie Jr. 
-// sample (SDK CDs). Many parts have been extracted into the DTSQTLibrary file. Anyway, 
-// this function could be taken out and implemented in other tools and parts as it's very much 
-// self-contained (if you add the DTSQTUtilities files to your project as well).
+// SetRecompressOptions and GetRecompressOptions give the outside control over how RecompressMovieFile does its
+// work (not what the compressed movie looks like, that's what the standard compression settings are for).
+pascal void SetRecompressOptions(const RecompressOptions *theOptions)
+{
+	gOptions = *theOptions;
+}
 
-pascal OSErr RecompressMovieFile(FSSpec* theMovieFile)
+pascal void GetRecompressOptions(RecompressOptions *theOptions)
 {
-	OSErr 			anErr = noErr;
-	Boolean			abort;
+	*theOptions = gOptions;
+}
+
+
+// ______________________________________________________________________
+// SetRecompressProfiles makes RecompressMovieFile write one output file per profile instead of a single one, a count
+// of zero goes back to a single output with the size from the options.
+pascal OSErr SetRecompressProfiles(const RecompressProfile *theProfiles, short theCount)
+{
+	short index;
 	
-	ComponentInstance 	ci = NULL;
+	if(theCount < 0 || theCount > kMaxRecompressProfiles)
+		return paramErr;
 	
-	long				ciFlags;
-	long				nFrames;
-	long				aFrameNum;
-	TimeValue			currentMovieTime;
+	for(index = 0; index < theCount; index++)
+		gProfiles[index] = theProfiles[index];
+	gProfileCount = theCount;
+	
+	return noErr;
+}
 
-	short				aMovieRefNum;
-	FSSpec 			newFileFSSpec;
 
-	Movie				aSourceMovie = NULL;
-	Rect				 aMovieRect;
-	GWorldPtr			srcGWorld = NULL;
-	ImageDescription		**anImageDescription;
-	ImageSequence		anImageSequence;
-	Movie				aDestinationMovie = NULL;
-	Track				aDestinationTrack = NULL;
-	Media				aDestinationMedia = NULL;
+// ______________________________________________________________________
+// GetRecompressStatistics returns the counters and timings collected while the last movie was recompressed. Run the
+// same movie with and without batchSampleWrites to compare the two ways of appending samples.
+pascal void GetRecompressStatistics(RecompressStatistics *theStatistics)
+{
+	*theStatistics = gStatistics;
+}
+
+
+// ______________________________________________________________________
+// GetRecompressCacheStatistics returns the output cache counters, these add up over all the movies since the 
+// application started.
+pascal void GetRecompressCacheStatistics(RecompressCacheStatistics *theStatistics)
+{
+	*theStatistics = gCacheStatistics;
+}
+
+
+// ______________________________________________________________________
+// OUTPUT CACHE
+// With useOutputCache set, every movie we compress is also kept in the output cache (as a hard link when possible, so
+// it doesn't cost disk space), named after a hash of the source movie and of the compression settings. The movie counts
+// by its content: the sample tables and a few samples of every media, reading all of it for the key would cost as much
+// as a pass over the movie. A copy of a movie we did before hits as well as the movie itself. If the same movie comes
+// again with the same settings, the earlier output is used and nothing is compressed. The entries used least recently
+// are removed when the cache is bigger than outputCacheMegabytes. The cache is off by default: a linked output is the
+// same file as its cache entry, changing one in place changes the other.
+
+// ______________________________________________________________________
+// GetOutputCacheFolder returns the FSSpec and the directory ID of the cache folder, the folder is created if needed.
+static OSErr GetOutputCacheFolder(FSSpec *theFolder, long *theDirID)
+{
+	OSErr			anErr = noErr;
+	short			aVRefNum;
+	long			aDirID;
+	FSRef			aFolderRef;
+	FSCatalogInfo	aCatalogInfo;
 	
-// if we use a window, the following variables are used
-	Point				where;
-	WindowRef			progressWindow;
+	// Mac OS 9 has no Caches folder.
+	anErr = FindFolder(kOnSystemDisk, kCachedDataFolderType, kCreateFolder, &aVRefNum, &aDirID);
+	if(anErr != noErr)
+		anErr = FindFolder(kOnSystemDisk, kPreferencesFolderType, kCreateFolder, &aVRefNum, &aDirID);
+	if(anErr != noErr) return anErr;
 	
+	anErr = FSMakeFSSpec(aVRefNum, aDirID, kOutputCacheFolderName, theFolder);
+	if(anErr == fnfErr)
+		return FSpDirCreate(theFolder, smSystemScript, theDirID);
+	if(anErr != noErr) return anErr;
 	
-	// Open the standard compression component
-	ci = OpenDefaultComponent(StandardCompressionType, StandardCompressionSubType);
-         DebugAssert(ci != NULL);
-	if (ci == NULL) 
-            return couldntGetRequiredComponent; 
+	anErr = FSpMakeFSRef(theFolder, &aFolderRef);
+	if(anErr != noErr) return anErr;
 	
-	// Adjust the user settings, we will operate in 32-bit depth (always), and make it possible to leave the
-	// data rate field zero (this indicates to use the existing data rate in the movie)
-	SCGetInfo(ci, scPreferenceFlagsType, &ciFlags);
-	ciFlags &=~scShowBestDepth;
-	ciFlags |= scAllowZeroFrameRate;
-	SCSetInfo(ci, scPreferenceFlagsType, &ciFlags);
+	anErr = FSGetCatalogInfo(&aFolderRef, kFSCatInfoNodeID, &aCatalogInfo, NULL, NULL, NULL);
+	if(anErr != noErr) return anErr;
 	
-	// Open the movie file, make sure it contains a movie.
-	anErr = OpenMovieFile(theMovieFile, &aMovieRefNum, 0); ReturnIfError(anErr);
+	*theDirID = aCatalogInfo.nodeID;
+	return noErr;
+}
+
+
+// ______________________________________________________________________
+// GetOutputCacheEntry returns the FSSpec of the cache entry for the key, fnfErr means there's no such entry (yet).
+static OSErr GetOutputCacheEntry(const UInt32 theKey[2], FSSpec *theEntry)
+{
+	static const char	kHexDigits[] = "0123456789ABCDEF";
+	OSErr				anErr = noErr;
+	FSSpec				aFolder;
+	long				aDirID;
+	Str255				anEntryName;
+	long				index;
 	
-	anErr = NewMovieFromFile(&aSourceMovie, aMovieRefNum, NULL, NULL, newMovieActive, NULL);  ReturnIfError(anErr);
+	anErr = GetOutputCacheFolder(&aFolder, &aDirID);
+	if(anErr != noErr) return anErr;
 	
-	CloseMovieFile(aMovieRefNum);
+	anEntryName[0] = 0;
+	for(index = 0; index < 16; index++)
+		anEntryName[++anEntryName[0]] = kHexDigits[(theKey[index / 8] >> (28 - 4 * (index % 8))) & 0x0F];
 	
-	// If the movie does not contain any video tracks, bail out (we don't re-compress sound or other tracks at this point 
-	// of time.
-	if(! QTUMediaTypeInTrack(aSourceMovie, VideoMediaType))
+	BlockMoveData(".mov", &anEntryName[anEntryName[0] + 1], 4);
+	anEntryName[0] += 4;
+	
+	return FSMakeFSSpec(aFolder.vRefNum, aDirID, anEntryName, theEntry);
+}
+
+
+// ______________________________________________________________________
+// MakeOutputCacheKey hashes the content of the source movie and everything in the standard compression settings that
+// changes the compressed movie, including the codec specific settings. The settings are hashed field by field, the
+// padding between the fields is not part of the key. A specific codec counts by its manufacturer, its component ID
+// changes from launch to launch.
+static OSErr MakeOutputCacheKey(ComponentInstance theCompressor, Movie theMovie, UInt32 theKey[2])
+{
+	OSErr					anErr = noErr;
+	Handle					aCodecSettings = NULL;
+	ComponentDescription	aCodecDescription;
+	
+	anErr = QTUHashMovieContent(theMovie, kOutputCacheSampledCount, theKey); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	
+	QTUHashData(theKey, &gTemporalSettings.temporalQuality, sizeof(gTemporalSettings.temporalQuality));
+	QTUHashData(theKey, &gTemporalSettings.frameRate, sizeof(gTemporalSettings.frameRate));
+	QTUHashData(theKey, &gTemporalSettings.keyFrameRate, sizeof(gTemporalSettings.keyFrameRate));
+	
+	QTUHashData(theKey, &gSpatialSettings.codecType, sizeof(gSpatialSettings.codecType));
+	QTUHashData(theKey, &gSpatialSettings.depth, sizeof(gSpatialSettings.depth));
+	QTUHashData(theKey, &gSpatialSettings.spatialQuality, sizeof(gSpatialSettings.spatialQuality));
+	if(gSpatialSettings.codec != anyCodec && GetComponentInfo((Component)gSpatialSettings.codec, &aCodecDescription, NULL, NULL, NULL) == noErr)
+		QTUHashData(theKey, &aCodecDescription.componentManufacturer, sizeof(aCodecDescription.componentManufacturer));
+	
+	QTUHashData(theKey, &aDataRateSetting.dataRate, sizeof(aDataRateSetting.dataRate));
+	QTUHashData(theKey, &aDataRateSetting.frameDuration, sizeof(aDataRateSetting.frameDuration));
+	QTUHashData(theKey, &aDataRateSetting.minSpatialQuality, sizeof(aDataRateSetting.minSpatialQuality));
+	QTUHashData(theKey, &aDataRateSetting.minTemporalQuality, sizeof(aDataRateSetting.minTemporalQuality));
+	
+	QTUHashData(theKey, &gOptions.smartRender, sizeof(gOptions.smartRender));
+	QTUHashData(theKey, &gOptions.nativeRenderDepth, sizeof(gOptions.nativeRenderDepth));
+	QTUHashData(theKey, &gOptions.outputWidth, sizeof(gOptions.outputWidth));
+	QTUHashData(theKey, &gOptions.outputHeight, sizeof(gOptions.outputHeight));
+	QTUHashData(theKey, &gOptions.scaleFilter, sizeof(gOptions.scaleFilter));
+	QTUHashData(theKey, &gOptions.detectCrop, sizeof(gOptions.detectCrop));
+	QTUHashData(theKey, &gOptions.cropRect, sizeof(gOptions.cropRect));
+	QTUHashData(theKey, &gOptions.sceneCutKeyFrames, sizeof(gOptions.sceneCutKeyFrames));
+	QTUHashData(theKey, &gOptions.minKeyFrameInterval, sizeof(gOptions.minKeyFrameInterval));
+	QTUHashData(theKey, &gOptions.maxKeyFrameInterval, sizeof(gOptions.maxKeyFrameInterval));
+	QTUHashData(theKey, &gOptions.targetPSNR, sizeof(gOptions.targetPSNR));
+	QTUHashData(theKey, &gOptions.searchFrames, sizeof(gOptions.searchFrames));
+	
+	if(SCGetInfo(theCompressor, scCodecSettingsType, &aCodecSettings) == noErr && aCodecSettings)
 	{
-		DebugAssert("No video tracks in movie");
-		return 	invalidMovie;
+		QTUHashData(theKey, *aCodecSettings, GetHandleSize(aCodecSettings));
+		DisposeHandle(aCodecSettings);
 	}
 	
-	// Count the amount of video frames in the movie
-	nFrames = QTUCountMediaSamples(aSourceMovie, VideoMediaType); DebugAssert(nFrames != -1);
+	return noErr;
+}
+
+
+// ______________________________________________________________________
+// GetCacheFileInfo returns the size (both forks) of a file, and its modification date which we use as the time the 
+// cache entry was last used.
+static OSErr GetCacheFileInfo(const FSRef *theFile, double *theSize, UTCDateTime *theLastUsed)
+{
+	OSErr			anErr = noErr;
+	FSCatalogInfo	aCatalogInfo;
 	
-	// Given the movie's bounding rect, create a 32-bit GWorld we will use for rendering movie frames and for possible test images.
+	anErr = FSGetCatalogInfo(theFile, kFSCatInfoDataSizes | kFSCatInfoRsrcSizes | kFSCatInfoContentMod, &aCatalogInfo, NULL, NULL, NULL);
+	if(anErr != noErr) return anErr;
+	
+	*theSize = (double)aCatalogInfo.dataLogicalSize + (double)aCatalogInfo.rsrcLogicalSize;
+	if(theLastUsed) *theLastUsed = aCatalogInfo.contentModDate;
+	
+	return noErr;
+}
+
+
+// ______________________________________________________________________
+// UseCachedOutput makes theOutputFile the cached output for the key, if we have one. The entry is marked as used now.
+static Boolean UseCachedOutput(const UInt32 theKey[2], const FSSpec *theOutputFile)
+{
+	FSSpec			anEntry;
+	FSRef			anEntryRef;
+	FSCatalogInfo	aCatalogInfo;
+	double			aSize;
+	
+	if(GetOutputCacheEntry(theKey, &anEntry) != noErr || FSpMakeFSRef(&anEntry, &anEntryRef) != noErr)
 	{
-		CGrafPtr		aSavedPort = NULL;
-		GDHandle		aGDHandle = NULL ;
-		PicHandle 		aPicHandle = NULL; 
-		
-		GetMovieBox(aSourceMovie, &aMovieRect);
-		
-		anErr = NewGWorld(&srcGWorld, 32, &aMovieRect, NULL, NULL, 0);   DebugAssert(anErr == noErr);
-		if(anErr != noErr) goto CleanupMemory;
-		
-		aPicHandle = GetMoviePosterPict(aSourceMovie); 	// don't need to test if the PicHandle was created or not.
-		
-		if(aPicHandle)
+		gCacheStatistics.misses++;
+		return false;
+	}
+	
+	if(QTULinkOrCopyFile(&anEntry, theOutputFile) != noErr)
+	{
+		gCacheStatistics.misses++;
+		return false;
+	}
+	
+	if(GetCacheFileInfo(&anEntryRef, &aSize, NULL) == noErr)
+		gCacheStatistics.bytesReused += aSize;
+	
+	GetUTCDateTime(&aCatalogInfo.contentModDate, kUTCDefaultOptions);
+	FSSetCatalogInfo(&anEntryRef, kFSCatInfoContentMod, &aCatalogInfo);
+	
+	gCacheStatistics.hits++;
+	return true;
+}
+
+
+// ______________________________________________________________________
+// TrimOutputCache removes the entries used least recently until the cache is no bigger than theMaxMegabytes.
+typedef struct OutputCacheEntry {
+	FSRef			ref;
+	double			size;
+	UTCDateTime		lastUsed;
+} OutputCacheEntry;
+
+static void TrimOutputCache(long theMaxMegabytes)
+{
+	OSErr				anErr = noErr;
+	FSSpec				aFolder;
+	FSRef				aFolderRef;
+	long				aDirID;
+	FSIterator			anIterator = NULL;
+	OutputCacheEntry	**anEntries = NULL;
+	long				anEntryCount = 0;
+	double				aTotalSize = 0;
+	double				aMaxSize = (double)theMaxMegabytes * 1024.0 * 1024.0;
+	
+	anErr = GetOutputCacheFolder(&aFolder, &aDirID);
+	if(anErr == noErr) anErr = FSpMakeFSRef(&aFolder, &aFolderRef);
+	if(anErr != noErr) return;
+	
+	anEntries = (OutputCacheEntry **)NewHandle(kOutputCacheEntryBlock * sizeof(OutputCacheEntry)); DebugAssert(anEntries != NULL);
+	if(anEntries == NULL) return;
+	
+	// Collect the size and the last use of all the entries, however many there are.
+	if(FSOpenIterator(&aFolderRef, kFSIterateFlat, &anIterator) == noErr)
+	{
+		for(;;)
 		{
-			GetGWorld(&aSavedPort, &aGDHandle);
-			SetGWorld(srcGWorld, NULL);
-			EraseRect(&aMovieRect);
+			OutputCacheEntry	anEntry;
+			ItemCount			aCount;
 			
-			DrawPicture(aPicHandle, &aMovieRect);
-			KillPicture(aPicHandle);
-			SetGWorld(aSavedPort, aGDHandle);
+			if(FSGetCatalogInfoBulk(anIterator, 1, &aCount, NULL, kFSCatInfoNone, NULL, &anEntry.ref, NULL, NULL) != noErr)
+				break;
+			if(GetCacheFileInfo(&anEntry.ref, &anEntry.size, &anEntry.lastUsed) != noErr)
+				continue;
 			
-			// Use the image now in the GWorld as the initial image inside the dialog box for compression.
-            
-#if TARGET_OS_WIN32
-			anErr = SCSetTestImagePixMap(ci, srcGWorld->portPixMap, NULL, 0);  DebugAssert(anErr == noErr);
-#else
-			anErr = SCSetTestImagePixMap(ci, GetPortPixMap(srcGWorld), NULL, 0);  DebugAssert(anErr == noErr);
-#endif
-			if(anErr != noErr) goto CleanupMemory;
+			if((anEntryCount + 1) * sizeof(OutputCacheEntry) > GetHandleSize((Handle)anEntries))
+			{
+				SetHandleSize((Handle)anEntries, (anEntryCount + kOutputCacheEntryBlock) * sizeof(OutputCacheEntry));
+				if(MemError() != noErr) break;				// trim what we have
+			}
+			
+			(*anEntries)[anEntryCount++] = anEntry;
+			aTotalSize += anEntry.size;
 		}
-	}	
-	// Set default settings for the compression dialog, and also get the temporal settings we need for further
-	// calculations.
-
-	if(gFirstTime)
+		FSCloseIterator(anIterator);
+	}
+	
+	// Remove the oldest entry until we are below the limit.
+	while(aTotalSize > aMaxSize && anEntryCount > 0)
 	{
-#if TARGET_OS_WIN32
-		anErr = SCDefaultPixMapSettings(ci, srcGWorld->portPixMap, true);   DebugAssert(anErr == noErr);
-#else
-		anErr = SCDefaultPixMapSettings(ci, GetPortPixMap(srcGWorld), true);   DebugAssert(anErr == noErr);
-#endif
-		if(anErr != noErr) goto CleanupMemory;
-
-		anErr = SCGetInfo(ci, scTemporalSettingsType, &gTemporalSettings);   DebugAssert(anErr == noErr);
-		if(anErr != noErr) goto CleanupMemory;
+		long	anOldest = 0;
+		long	index;
 		
-		gTemporalSettings.frameRate = 0;
+		for(index = 1; index < anEntryCount; index++)
+		{
+			if((*anEntries)[index].lastUsed.highSeconds < (*anEntries)[anOldest].lastUsed.highSeconds ||
+				((*anEntries)[index].lastUsed.highSeconds == (*anEntries)[anOldest].lastUsed.highSeconds &&
+				(*anEntries)[index].lastUsed.lowSeconds < (*anEntries)[anOldest].lastUsed.lowSeconds))
+				anOldest = index;
+		}
 		
-		anErr = SCSetInfo(ci, scTemporalSettingsType, &gTemporalSettings);   DebugAssert(anErr == noErr);
-		if(anErr != noErr) goto CleanupMemory;
+		if(FSDeleteObject(&(*anEntries)[anOldest].ref) == noErr)
+		{
+			aTotalSize -= (*anEntries)[anOldest].size;
+			gCacheStatistics.evictions++;
+		}
 		
-	}	
+		(*anEntries)[anOldest] = (*anEntries)[--anEntryCount];
+	}
 	
+	DisposeHandle((Handle)anEntries);
+}
+
 
+// ______________________________________________________________________
+// AddOutputCacheEntry puts a freshly compressed movie in the cache, and trims the cache if it got too big.
+static void AddOutputCacheEntry(const UInt32 theKey[2], const FSSpec *theOutputFile)
+{
+	OSErr	anErr = noErr;
+	FSSpec	anEntry;
 	
-	// Clear out the default frame rate at the first pass selected by the standard compression. 0 means that we
-	// need to use the data rate of the movie.
-	if(gFirstTime)
-	{
-		// ask the first time from the end user about the default settings we will use with any other movies passed
-		// along to this batch of movies (dragged to the app).
-		anErr = SCRequestSequenceSettings(ci); DebugAssert(anErr == noErr);
-		if(anErr != noErr) return anErr; // eventually scUserCancelled as the error
+	anErr = GetOutputCacheEntry(theKey, &anEntry);
+	if(anErr != noErr && anErr != fnfErr) return;
 	
-		// Get a copy of the temporal settings we got from the user interaction, we need the values later for
-		// other calculations (new frame amount and so on).
+	anErr = QTULinkOrCopyFile(theOutputFile, &anEntry); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return;
 	
-		anErr = SCGetInfo(ci, scTemporalSettingsType, &gTemporalSettings);  DebugAssert(anErr == noErr);
-		if(anErr != noErr) goto CleanupMemory;
-		
-		anErr = SCGetInfo(ci, scSpatialSettingsType, &gSpatialSettings); DebugAssert(anErr == noErr);
-		if(anErr != noErr) goto CleanupMemory;
-	}
+	TrimOutputCache(gOptions.outputCacheMegabytes);
+}
 
-	if(!gFirstTime)	// We need to set the temporal and the spatial settings the following times.
+
+// ______________________________________________________________________
+// AcquireFrameGWorld returns a locked GWorld with the given bounds and depth, one left over from an earlier movie if we
+// have it. ReleaseFrameGWorld puts it back in the cache, and FlushRecompressCaches disposes everything we keep. Indexed
+// GWorlds are not kept, the next movie most likely has another color table.
+static OSErr AcquireFrameGWorld(const Rect *theBounds, short theDepth, CTabHandle theColorTable, GWorldPtr *theGWorld)
+{
+	OSErr	anErr = noErr;
+	long	index;
+	
+	for(index = 0; index < kMaxCachedGWorlds; index++)
 	{
-		anErr = SCSetInfo(ci, scTemporalSettingsType, &gTemporalSettings);   DebugAssert(anErr == noErr);
-		if(anErr != noErr) goto CleanupMemory;
+		Rect aBounds;
 		
-		anErr = SCSetInfo(ci, scSpatialSettingsType, &gSpatialSettings); DebugAssert(anErr == noErr);
-		if(anErr != noErr) goto CleanupMemory;  
+		if(gCachedGWorlds[index] == NULL)
+			continue;
+		
+		GetPortBounds(gCachedGWorlds[index], &aBounds);
+		if(EqualRect(&aBounds, theBounds) && GetPixDepth(GetGWorldPixMap(gCachedGWorlds[index])) == theDepth)
+		{
+			*theGWorld = gCachedGWorlds[index];
+			gCachedGWorlds[index] = NULL;
+			return noErr;
+		}
 	}
 	
-	// Calculate the max sound rate, so we know the overall data rate for the video (total = video + sound).
-	{
-		long soundDataRate;
+	anErr = NewGWorld(theGWorld, theDepth, theBounds, theColorTable, NULL, 0); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
 	
-                if(gFirstTime)
-                {	
-                    anErr = SCGetInfo(ci, scDataRateSettingsType, &aDataRateSetting);  DebugAssert(anErr == noErr);
-                    if(anErr != noErr) goto CleanupMemory;
-                }
-		
-		if(aDataRateSetting.dataRate)
+	LockPixels(GetGWorldPixMap(*theGWorld));
+	
+	return noErr;
+}
+
+static void ReleaseFrameGWorld(GWorldPtr theGWorld)
+{
+	long index;
+	
+	if(theGWorld == NULL)
+		return;
+	
+	for(index = 0; index < kMaxCachedGWorlds && GetPixDepth(GetGWorldPixMap(theGWorld)) > 8; index++)
+	{
+		if(gCachedGWorlds[index] == NULL)
 		{
-			anErr = QTUCountMaxSoundRate(aSourceMovie, &soundDataRate);  DebugAssert(anErr == noErr);
-			if(anErr != noErr) goto CleanupMemory;
-		
-			aDataRateSetting.dataRate  -= soundDataRate;
+			gCachedGWorlds[index] = theGWorld;
+			return;
 		}
-		
-		anErr = SCSetInfo(ci, scDataRateSettingsType, &aDataRateSetting);  DebugAssert(anErr == noErr);
-		if(anErr != noErr) goto CleanupMemory;
 	}
 	
-	// Calculate the new amount of frames based on the possible new re-defined frame rate.
-	if(gTemporalSettings.frameRate)
-		nFrames = QTUGetMovieFrameCount(aSourceMovie, gTemporalSettings.frameRate);
+	DisposeGWorld(theGWorld);
+}
+
+pascal void FlushRecompressCaches(void)
+{
+	long index;
 	
-	// If we want to show a windows when processing the movie, do this here...
-	if(gShowWindow)
+	for(index = 0; index < kMaxCachedGWorlds; index++)
 	{
-		Rect aRect = aMovieRect;
-		where.h = where.v = -2;
-		
-		anErr = SCPositionRect(ci, &aRect, &where);  ReturnIfError(anErr);
-		
-		progressWindow = NewCWindow(0,&aRect, theMovieFile->name, true, 0, (WindowPtr)-1, false, 0);
+		if(gCachedGWorlds[index]) DisposeGWorld(gCachedGWorlds[index]);
+		gCachedGWorlds[index] = NULL;
 	}
 	
-	// Create a new file for the re-compressed movie.
+	if(gPayloadPool) QTUDisposeBufferPool(gPayloadPool);
+	gPayloadPool = NULL;
+	
+	if(gStagingHandle) DisposeHandle(gStagingHandle);
+	gStagingHandle = NULL;
+}
+
+
+// ______________________________________________________________________
+// PreparePayloadPool makes sure gPayloadPool has buffers of at least theBufferSize bytes, and enough of them for
+// theBufferCount frames in flight so that the frame loop does not make the pool grow.
+static OSErr PreparePayloadPool(long theBufferSize, long theBufferCount)
+{
+	if(gPayloadPool && QTUBufferPoolGetBufferSize(gPayloadPool) >= theBufferSize)
+		return noErr;
+	
+	if(gPayloadPool) QTUDisposeBufferPool(gPayloadPool);
+	gPayloadPool = NULL;
+	
+	// 16 byte alignment keeps the buffers usable for AltiVec code.
+	return QTUNewBufferPool(theBufferSize, theBufferCount, 16, &gPayloadPool);
+}
+
+
+// ______________________________________________________________________
+// CountBufferAllocations returns how many times our own buffers for compressed frames (the payload pool and the
+// staging handle) needed new memory so far. What the codec allocates inside SCCompressSequenceFrame is not counted.
+static long CountBufferAllocations(void)
+{
+	long aCount = gStagingHandleGrowths;
+	
+	if(gPayloadPool)
 	{
-		Str255 newFileName;
+		QTUBufferPoolStatistics aPoolStatistics;
 		
-		// First fix the name FSSpec and name for this new movie.
-		BlockMove(theMovieFile->name, newFileName, sizeof(theMovieFile->name));	 
-		newFileName[++newFileName[0]] = '*';			// add this character to the beginning of the new file name
-	
-		// Then create a new FSSpec.
-		anErr = FSMakeFSSpec(theMovieFile->vRefNum, theMovieFile->parID, newFileName, &newFileFSSpec);
-		
-		// Then create a movie file.
-		anErr = CreateMovieFile(&newFileFSSpec, 'TVOD', 0, createMovieFileDeleteCurFile, &aMovieRefNum, &aDestinationMovie); DebugAssert(anErr == noErr);
-		if(anErr != noErr) goto CleanupGeneral;
+		QTUBufferPoolGetStatistics(gPayloadPool, &aPoolStatistics);
+		aCount += aPoolStatistics.heapAllocations;
 	}
-		
-	// Copy and create various media and tracks for the new movie.
+	
+	return aCount;
+}
+
+
+// ______________________________________________________________________
+// CountPooledMemory returns the bytes of the GWorlds and buffers we keep between movies. A movie that reuses them
+// doesn't make the process grow, but it takes that memory all the same.
+static double CountPooledMemory(void)
+{
+	double	aBytes = 0;
+	long	index;
+	
+	for(index = 0; index < kMaxCachedGWorlds; index++)
 	{
-		MatrixRecord aMatrix;
-		// Create a new video movie track with the same dimensions as the entire source movie.
-		aDestinationTrack = NewMovieTrack(aDestinationMovie, (long)(aMovieRect.right - aMovieRect.left) << 16, (long)(aMovieRect.bottom - aMovieRect.top) << 16, 0);
-		
+		if(gCachedGWorlds[index])
+		{
+			Rect aBounds;
 			
-		// Create a media for the new track with the same time scale as the source movie. If the time scales are the same,
-		// we don't need to adjust the time scales with scale conversions.
-		aDestinationMedia = NewTrackMedia(aDestinationTrack, VIDEO_TYPE, GetMovieTimeScale(aSourceMovie), 0, 0);
-		anErr = GetMoviesError();DebugAssert(anErr == noErr);
-		if(anErr != noErr) goto CleanupGeneral;
-		
-		// Copy the user data and settings from the source to the destination movie.
-		CopyMovieSettings(aSourceMovie, aDestinationMovie);
-		
-		// Set the movie matrix to identity and clear the movie clip region so that conversion process transforms and composites
-		// *all* video tracks into one untransformed video track.
-		SetIdentityMatrix(&aMatrix);
-		SetMovieMatrix(aDestinationMovie, &aMatrix);
-		SetMovieClipRgn(aDestinationMovie, NULL);
-		
-		// Prepare for adding frames to the movie.
-		anErr = BeginMediaEdits(aDestinationMedia); DebugAssert(anErr == noErr);
-		if(anErr != noErr) goto CleanupGeneral;
+			GetPortBounds(gCachedGWorlds[index], &aBounds);
+			aBytes += (double)GetPixRowBytes(GetGWorldPixMap(gCachedGWorlds[index])) * (aBounds.bottom - aBounds.top);
+		}
 	}
 	
-	// Start a compression sequence using the parameters chosen earlier (not these are true for all the other movies passed
-	// along with the AE. Pass nil for the source rect to use the entire image. We will get an imagedescription as well. Note
-	// that the image description handle is disposed by SCCompressSequenceEnd.
-#if TARGET_OS_WIN32
-	anErr = SCCompressSequenceBegin(ci, srcGWorld->portPixMap, NULL, &anImageDescription); 
-#else
-	anErr = SCCompressSequenceBegin(ci, GetPortPixMap(srcGWorld), NULL, &anImageDescription); 
-#endif
-         DebugAssert(anErr == noErr);
-	if(anErr != noErr) goto CleanupGeneral;
+	if(gPayloadPool)
+	{
+		QTUBufferPoolStatistics aPoolStatistics;
 		
-	// Clear out the GWorld and set the movie to draw into this one.
-	SetGWorld(srcGWorld, NULL);
-#if TARGET_OS_WIN32
-	EraseRect(&srcGWorld->portRect);
-#else
-         {
-         Rect portRect;
-            GetPortBounds(srcGWorld, &portRect);
-            EraseRect(&portRect);
-         }
-#endif
-	SetMovieGWorld(aSourceMovie, srcGWorld, GetGWorldDevice(srcGWorld));
+		QTUBufferPoolGetStatistics(gPayloadPool, &aPoolStatistics);
+		aBytes += (double)aPoolStatistics.buffersHeld * aPoolStatistics.bufferSize;
+	}
 	
-	currentMovieTime = 0;			// set current time value to beginning of movie
-		
+	if(gStagingHandle)
+		aBytes += GetHandleSize(gStagingHandle);
 	
-	// Loop through all the interesting times counted earlier
-	for(aFrameNum = 0; aFrameNum < nFrames; aFrameNum++)
+	return aBytes;
+}
+
+
+// ______________________________________________________________________
+// StartMemoryTracking remembers how much memory we used before the movie, TrackMemoryPeak is called every few frames
+// to catch the most we used while working on it.
+#define kMemoryTrackingFrames	16
+
+static void StartMemoryTracking(void)
+{
+	gMemoryPooled = CountPooledMemory();
+	gMemoryAtStart = QTUGetMemoryInUse();
+	gMemoryPeak = gMemoryAtStart;
+	gStatistics.predictedMemory = gAdmittedEstimate * gMemoryCorrection;
+	gStatistics.peakMemory = 0;
+	gAdmittedEstimate = 0;
+}
+
+static void TrackMemoryPeak(void)
+{
+	double aMemoryInUse = QTUGetMemoryInUse();
+	
+	if(aMemoryInUse > gMemoryPeak)
+		gMemoryPeak = aMemoryInUse;
+}
+
+
+// ______________________________________________________________________
+// FinishMemoryTracking stores the peak of the movie in the statistics, what the process grew by plus the pooled memory
+// it started with, and corrects the estimates of the next movies by the ratio of what this one really took to what was
+// predicted for it. The correction moves half way each time, so one odd movie doesn't throw it off. A movie from the
+// output cache took nothing to compress, a dry run compresses a few frames only, and a movie that did not make the
+// process grow tells us nothing (the memory the system gave back to us before is not seen), none of them is counted.
+static void FinishMemoryTracking(void)
+{
+	TrackMemoryPeak();
+	gStatistics.peakMemory = gMemoryPooled + gMemoryPeak - gMemoryAtStart;
+	
+	if(gStatistics.predictedMemory > 0 && gMemoryPeak > gMemoryAtStart && !gStatistics.outputFromCache && !gOptions.dryRun)
 	{
-		short		syncFlag;
-		TimeValue	duration;
-		long		dataSize;
-		Handle	compressedData;
-		
-		// Abort if the end user clicked the mouse or pressed a key.
-		{
-			EventRecord anEvent;
-			
-			abort = false;
-			if(EventAvail(keyDownMask | mDownMask, &anEvent))
-			{
-				abort = true;
-				break;
-			}
-		}
+		double aRatio = gStatistics.peakMemory * gMemoryCorrection / gStatistics.predictedMemory;
 		
-		// Get the next frame from the movie.
-		{
-			// If we are resampling the movie, step to the next frame
-			if(gTemporalSettings.frameRate)
-			{
-				// This could could be much smarter about its calculations. The srcMovie duration and destination movie
-				// frame durations are both constant and could be calculated outside this loop.
-				
-				long dur = GetMovieDuration(aSourceMovie);
-				currentMovieTime = aFrameNum * dur / (nFrames - 1);
-				duration = dur / nFrames;
-			}
-			else
-			{
-				short flags = nextTimeMediaSample;
-				OSType whichMediaType = VIDEO_TYPE;
-				
-				// If this is the first frame, include the frame we are currently on.
-				if(aFrameNum == 0)
-					flags |= nextTimeEdgeOK;
-				
-				// If we are maintaining the frame durations of the source movie, skip to the next interesting
-				// time and get the duration of that frame.
-				GetMovieNextInterestingTime(aSourceMovie, flags, 1, &whichMediaType, currentMovieTime, 0, &currentMovieTime, &duration);
-			}
-			
-			SetMovieTimeValue(aSourceMovie, currentMovieTime);
-			MoviesTask(aSourceMovie, 0); MoviesTask(aSourceMovie,0); MoviesTask(aSourceMovie,0);
-		} //end stepping to next frame from the movie
+		if(aRatio < 0.5) aRatio = 0.5;
+		if(aRatio > 4.0) aRatio = 4.0;
+		gMemoryCorrection = (gMemoryCorrection + aRatio) / 2;
+	}
+}
+
+
+// ______________________________________________________________________
+// FitRecompressJob estimates theMovieFile with gOptions. If the estimate doesn't fit memoryLimitMegabytes, the caches
+// kept between the movies of the batch are flushed, and gOptions get one worker, one write in flight and no read-ahead,
+// the parts that take memory but that we can do without. kRecompressNotAdmittedErr means it doesn't fit even then.
+static OSErr FitRecompressJob(FSSpec *theMovieFile, RecompressMemoryEstimate *theEstimate)
+{
+	OSErr	anErr = noErr;
+	double	aLimit = gOptions.memoryLimitMegabytes * 1024.0 * 1024.0;
+	
+	anErr = EstimateRecompressMemory(theMovieFile, theEstimate);
+	if(anErr != noErr) return anErr;
+	
+	if(theEstimate->total <= aLimit)
+		return noErr;
+	
+	FlushRecompressCaches();
+	
+	gOptions.parallelIntraFrames = false;
+	gOptions.workerCount = 1;
+	if(gOptions.writesInFlight > 1)
+		gOptions.writesInFlight = 1;
+	gOptions.prefetchMilliseconds = 0;
+	gOptions.ramWindowMilliseconds = 0;
+	
+	anErr = EstimateRecompressMemory(theMovieFile, theEstimate);
+	if(anErr != noErr) return anErr;
+	
+	if(theEstimate->total > aLimit)
+	{
+		gAdmittedEstimate = 0;
+		return kRecompressNotAdmittedErr;
+	}
+	
+	return noErr;
+}
 
+
+// ______________________________________________________________________
+// AppendCompressedFrame is the one place where compressed video frames are added to the destination media. If we
+// have a sample writer the frame goes into the current chunk, otherwise we call AddMediaSample directly. AddMediaSample
+// wants a handle, so if the data is not in one (theDataHandle is NULL) it's copied into a staging handle we keep.
+static OSErr AppendCompressedFrame(QTUSampleWriter theWriter, Media theMedia, Handle theDataHandle, Ptr theData, long theDataSize,
+										TimeValue theDuration, SampleDescriptionHandle theDescription, short theSyncFlag)
+{
+	OSErr			anErr = noErr;
+	UnsignedWide	aTimer;
+	
+	QTUStartTimer(&aTimer);
+	
+	if(theWriter)
+	{
+		anErr = QTUSampleWriterAddSample(theWriter, theData, theDataSize, theDuration, theDescription, theSyncFlag);
+	}
+	else
+	{
+		if(theDataHandle == NULL)
 		{
-			// If data rate constraining is being done, tell Standard Compression the duration of the current frame in
-			// milliseconds. We only need to do this if the frames have variable durations.
-			SCDataRateSettings datarate;
-			if(!SCGetInfo(ci, scDataRateSettingsType, &datarate))
+			if(gStagingHandle == NULL || GetHandleSize(gStagingHandle) < theDataSize)
 			{
-				datarate.frameDuration = duration * 1000 / GetMovieTimeScale(aSourceMovie);
-				SCSetInfo(ci, scDataRateSettingsType, &datarate);
+				if(gStagingHandle) DisposeHandle(gStagingHandle);
+				gStagingHandle = NewHandle(theDataSize); DebugAssert(gStagingHandle != NULL);
+				if(gStagingHandle == NULL) return memFullErr;
+				gStagingHandleGrowths++;
 			}
+			
+			BlockMoveData(theData, *gStagingHandle, theDataSize);
+			theDataHandle = gStagingHandle;
 		}
 		
-		// Compress the frame, compressedData will hold a handle to the newly compressed image data. dataSize is
-		// the size of the compressed data, which will usually be different than the size of the compressData handle.
-		// syncFlag is a value that is a key frame. Note that we don't have to dispose the compressedData handle.
-		// It will be disposed for us when we call SCCompressSequenceEnd.
-#if TARGET_OS_WIN32
-		anErr = SCCompressSequenceFrame(ci,srcGWorld->portPixMap, &aMovieRect, &compressedData, &dataSize, &syncFlag);
-#else
-		anErr = SCCompressSequenceFrame(ci,GetPortPixMap(srcGWorld), &aMovieRect, &compressedData, &dataSize, &syncFlag);
-#endif
-		ReturnIfError(anErr);
-		
-		// Append the compressed image data to the media.
-		anErr = AddMediaSample(aDestinationMedia, compressedData, 0, dataSize, duration, (SampleDescriptionHandle)anImageDescription, 1, syncFlag, NULL); DebugAssert(anErr == noErr);
-		if(anErr != noErr) goto CleanupGeneral;
-		
-		// Decompress the compressed frame into the progress window.
-		if(gShowWindow)
-		{
-			char hState;
+		anErr = AddMediaSample(theMedia, theDataHandle, 0, theDataSize, theDuration, theDescription, 1, theSyncFlag, NULL);
+		gStatistics.sampleWrites++;
+	}
+	DebugAssert(anErr == noErr);
+	
+	gStatistics.sampleWriteMicroseconds += QTUElapsedMicroseconds(&aTimer);
+	gStatistics.framesCompressed++;
+	
+	if(gStatistics.framesCompressed % kMemoryTrackingFrames == 0)
+		TrackMemoryPeak();
+	
+	// Anything allocated from here on is counted against the frame loop.
+	if(gStatistics.framesCompressed == 1)
+		gFirstFrameAllocations = CountBufferAllocations();
+	
+	return anErr;
+}
 
-#if TARGET_OS_WIN32			
-			SetGWorld((CGrafPtr)progressWindow, NULL); 	// set port to progress window
-#else
-			SetGWorld(GetWindowPort(progressWindow),NULL);
-#endif			
-			// If this is the first frame, start up a decompression sequence.
-			if(aFrameNum == 0)
-			{
-				anErr = DecompressSequenceBegin(&anImageSequence, anImageDescription, NULL, NULL, &aMovieRect,
-										NULL, ditherCopy, NULL, 0, codecNormalQuality, anyCodec);  					DebugAssert(anErr == noErr);
-				if(anErr != noErr) goto CleanupGeneral;
-			}
-			
-			// Save the locked state of the compressed data and then lock it. We want it locked but standard compression may or 
-			// may not.
-			hState = HGetState(compressedData);
-			HLock(compressedData);
-			
-			// Decompress the frame to the progress window. Note that we StripAddress the compressedData pointer 
-			// because it must be 32-bit clean.
-			anErr = DecompressSequenceFrame(anImageSequence, *compressedData, 0, NULL, NULL); 						DebugAssert(anErr == noErr);
-			if(anErr != noErr) goto CleanupGeneral;
-			
-			// Restore the locked state of the data handle.
-			HSetState(compressedData, hState);
-			if(anErr != noErr) return anErr;
-		} // end gShowWindow
-	} // end big for loop!
 
-	// Close the compression sequence. This will dispose of the image description and compressed data handles allocated by
-	// SCCompressSequenceBegin.
-	SCCompressSequenceEnd(ci);
+// ______________________________________________________________________
+// FinishSampleWriter writes the last chunk, waits until all the chunks are on the disk and disposes the sample writer,
+// the timing of the last write is part of the statistics as well. This is the point where the media's data file is
+// complete, the sound tracks and the movie resource are written after it.
+static OSErr FinishSampleWriter(QTUSampleWriter theWriter)
+{
+	OSErr						anErr = noErr;
+	UnsignedWide				aTimer;
+	QTUSampleWriterStatistics	aWriterStatistics;
 	
-	// Close the decompression sequence. Note that this is an Image Compression Manager call, not Standard Compression.
-	CDSequenceEnd(anImageSequence);
+	if(theWriter == NULL)
+		return noErr;
 	
-	// Copy all sound tracks from the source to the destination movie. Note that we are currently not copying any other
-	// tracks here (text tracks, alternate tracks and so on). We need to provide more options here later.
-	anErr = QTUCopySoundTracks(aSourceMovie, aDestinationMovie);  DebugAssert(anErr == noErr);
-	if(anErr != noErr) goto CleanupGeneral;
-		
-	// We have now finished compressing video data. Next, make this data part of our movie.
-	if(aDestinationTrack)	// we have a valid destination track
+	QTUStartTimer(&aTimer);
+	
+	anErr = QTUSampleWriterFlush(theWriter); DebugAssert(anErr == noErr);
+	if(anErr == noErr)
 	{
-		short resID = 128;
+		anErr = QTUSampleWriterSync(theWriter); DebugAssert(anErr == noErr);
+	}
+	QTUSampleWriterGetStatistics(theWriter, &aWriterStatistics);
+	QTUDisposeSampleWriter(theWriter);
+	
+	gStatistics.sampleWriteMicroseconds += QTUElapsedMicroseconds(&aTimer);
+	gStatistics.sampleWrites += aWriterStatistics.chunksWritten;
+	gStatistics.sampleWriteWaits += aWriterStatistics.writeWaits;
+	
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// GetSpatialCodecFlags returns the format and compress flags of the codec we compress to. That's one GetCodecInfo per
+// movie, too cheap to build the capability registry for.
+static OSErr GetSpatialCodecFlags(long *theFormatFlags, long *theCompressFlags)
+{
+	CodecInfo			aCodecInfo;
+	OSErr				anErr = noErr;
+	
+	anErr = GetCodecInfo(&aCodecInfo, gSpatialSettings.codecType, gSpatialSettings.codec);
+	if(anErr != noErr) return anErr;
+	
+	*theFormatFlags = aCodecInfo.formatFlags;
+	*theCompressFlags = aCodecInfo.compressFlags;
+	return noErr;
+}
+
+
+// ______________________________________________________________________
+// ChooseRenderDepth returns the depth to render the movie frames in. Rendering deeper than the source is only a waste
+// of memory bandwidth, so 8-bit and 16-bit movies are rendered at their own depth if the codec we compress to takes
+// that depth, everything else at 32 bits. For indexed (and gray) movies theColorTable gets the color table to use,
+// dispose it when done. This is off by default, the codec sees other pixels than before. Scene cut detection and the
+// quality check only look at 32-bit frames, with either of them on the frames stay 32-bit.
+static short ChooseRenderDepth(Movie theMovie, CTabHandle *theColorTable)
+{
+	QTUTrackCatalog			*aCatalog;
+	QTUTrackInfo			*aTrackInfo;
+	Track					aRenderTrack = NULL;
+	ImageDescriptionHandle	anImageDescription = NULL;
+	long					aFormatFlags, aCompressFlags;
+	short					aDepth = 0;
+	short					aRenderDepth;
+	long					aTrackCount = 0;
+	long					index;
+	
+	*theColorTable = NULL;
+	
+	if(!gOptions.nativeRenderDepth || gOptions.sceneCutKeyFrames || gOptions.verifyQuality)
+		return 32;
+	
+	if(QTUGetTrackCatalog(theMovie, &aCatalog) != noErr)
+		return 32;
+	
+	// The deepest enabled video track decides, gray depths (33 to 40) count as 8-bit.
+	for(index = 1; (aTrackInfo = QTUFindTrackInfo(aCatalog, VideoMediaType, index)) != NULL; index++)
+	{
+		short aTrackDepth;
 		
-		anErr = EndMediaEdits(aDestinationMedia); ReturnIfError(anErr);
+		if(!aTrackInfo->enabled)
+			continue;
 		
-		// Insert the newly created media into the newly created track at the beginning of the track and lasting
-		// for the entire duration of the media. The media rate is 1.0 for normal playback rate.
-		InsertMediaIntoTrack(aDestinationTrack, 0, 0, GetMediaDuration(aDestinationMedia), fixed1);
+		aTrackDepth = aTrackInfo->depth;
+		if(aTrackDepth > 32)
+			aTrackDepth = 8;
 		
-		// Add the movie resource into the destination movie file.
-		anErr = AddMovieResource(aDestinationMovie, aMovieRefNum, &resID, "\pMovie 1"); DebugAssert(anErr == noErr);
-		if(anErr != noErr) goto CleanupGeneral;
+		if(aTrackDepth > aDepth)
+			aDepth = aTrackDepth;
+		aRenderTrack = aTrackInfo->track;
+		aTrackCount++;
+	}
+	
+	// Indexed frames can't be composited without losing colors, only a single track is rendered in 8 bits.
+	if(aDepth == 0 || aDepth > 16 || (aDepth <= 8 && aTrackCount > 1))
+		aRenderDepth = 32;
+	else if(aDepth > 8)
+		aRenderDepth = 16;
+	else
+		aRenderDepth = 8;
+	
+	// The codec has to take frames of this depth, otherwise we have to convert anyway.
+	if(aRenderDepth != 32)
+	{
+		if(GetSpatialCodecFlags(&aFormatFlags, &aCompressFlags) != noErr)
+			return 32;
 		
-		// Flatten the movie file just created for performance purposes. Make it crossplatform at the same time.
-		CloseMovieFile(aMovieRefNum);	// note: we need to close this file as we will delete this and swap it with a temp file 
-															// in the function below.
-		anErr = QTUFlattenMovieFile(aDestinationMovie, &newFileFSSpec);
+		if((aRenderDepth == 16 && !(aFormatFlags & codecInfoDepth16)) ||
+			(aRenderDepth == 8 && !(aFormatFlags & (codecInfoDepth8 | codecInfoDepth40))))
+			return 32;
 	}
+	
+	// Use the color table of the movie (there's only one video track), or the standard one for the depth.
+	if(aRenderDepth == 8)
+	{
+		aDepth = QTUGetVideoMediaPixelDepth(GetTrackMedia(aRenderTrack), 1);
+		
+		anImageDescription = (ImageDescriptionHandle)NewHandle(0);
+		if(anImageDescription && aDepth <= 8)
+		{
+			GetMediaSampleDescription(GetTrackMedia(aRenderTrack), 1, (SampleDescriptionHandle)anImageDescription);
+			if(GetMoviesError() != noErr || GetImageDescriptionCTable(anImageDescription, theColorTable) != noErr)
+				*theColorTable = NULL;
+		}
+		if(anImageDescription) DisposeHandle((Handle)anImageDescription);
 		
+		if(*theColorTable == NULL)
+			*theColorTable = GetCTable(aDepth > 32 ? 40 : 8);
+		if(*theColorTable == NULL)
+			return 32;
+	}
+	
+	return aRenderDepth;
+}
 
-// CleanupGeneral is our main entry point if we want to get rid of the window and clean up memory.	
-CleanupGeneral:			
-	// POSTFIX
+
+// ______________________________________________________________________
+// StopPrefetching waits for the reads in flight and disposes the prefetcher and the window loader, call it before the
+// source movie is disposed.
+static void StopPrefetching(void)
+{
+	QTUPrefetcherStatistics		aPrefetchStatistics;
+	QTUWindowLoaderStatistics	aWindowStatistics;
 	
-	// Get Rid of the progress window
-	if(gShowWindow)
+	if(gWindowLoader)
 	{
-		DisposeWindow(progressWindow);
-		progressWindow = NULL;
+		QTUWindowLoaderGetStatistics(gWindowLoader, &aWindowStatistics);
+		gStatistics.ramWindowHits = aWindowStatistics.hits;
+		gStatistics.ramWindowMisses = aWindowStatistics.misses;
+		
+		QTUDisposeWindowLoader(gWindowLoader);
+		gWindowLoader = NULL;
 	}
-
-        // CleanUpMemory is the entry point if we don't have the window displayed, but we still want to clean up memory.
-        CleanupMemory:	
-	// Get Rid of any buffers, handles, and other resources allocated earlier
-	if(srcGWorld) DisposeGWorld(srcGWorld);		// Get rid of the GWorld handle.
 	
-	// Clear the test image because we disposed the pixmap it depended upon.
-	SCSetTestImagePixMap(ci, NULL, NULL, 0);
+	if(gPrefetcher == NULL)
+		return;
 	
-	CloseComponent(ci);										// Close the component after use.
+	QTUPrefetcherGetStatistics(gPrefetcher, &aPrefetchStatistics);
+	gStatistics.prefetchReads = aPrefetchStatistics.reads;
+	gStatistics.prefetchSeeks = aPrefetchStatistics.seeks;
+	
+	QTUDisposePrefetcher(gPrefetcher);
+	gPrefetcher = NULL;
+}
 
-	return anErr;
+
+// ______________________________________________________________________
+// StartPrefetching reads the first video track of the source movie ahead of the frames RenderSourceFrame asks for, so
+// the samples are not read one by one as they are drawn. With ramWindowMilliseconds the movie ahead of the frames is
+// kept in RAM as well. Any error only means we don't read ahead. Reads an earlier movie left in flight are waited for.
+static void StartPrefetching(Movie theMovie)
+{
+	Track aTrack;
+	
+	StopPrefetching();
+	
+	gStatistics.prefetchReads = 0;
+	gStatistics.prefetchSeeks = 0;
+	gStatistics.ramWindowHits = 0;
+	gStatistics.ramWindowMisses = 0;
+	
+	if(gOptions.ramWindowMilliseconds > 0 && gOptions.ramWindowKilobytes > 0)
+		QTUNewWindowLoader(theMovie, GetMovieTimeScale(theMovie) * gOptions.ramWindowMilliseconds / 1000, 
+								gOptions.ramWindowKilobytes * 1024L, &gWindowLoader);
+	
+	if(gOptions.prefetchMilliseconds <= 0 || gOptions.prefetchKilobytes <= 0)
+		return;
+	
+	aTrack = GetMovieIndTrackType(theMovie, 1, VideoMediaType, movieTrackMediaType);
+	if(aTrack == NULL)
+		return;
+	
+	QTUNewPrefetcher(aTrack, GetMovieTimeScale(theMovie) * gOptions.prefetchMilliseconds / 1000, gOptions.prefetchKilobytes * 1024L,
+							&gPrefetcher);
 }
 
+
+// ______________________________________________________________________
+// QUALITY CHECK
+// With verifyQuality every compressed frame is decoded again and scored against the frame it was compressed from,
+// the PSNR and SSIM of each frame go into a text file next to the output, the summary into the statistics. Decoding and
+// scoring together are kept to kQualityTimeShare of the time compressing the frames took: if they fall behind, frames
+// are neither decoded nor scored until they catch up. A temporal codec needs the frames before a frame decoded, so
+// after a skip the check starts again at the next key frame.
+#define kQualityTimeShare		0.15
+#define	kQualityFileSuffix		"\p Quality"
+
+// ______________________________________________________________________
+// AppendText adds a Pascal string to a line, AppendDecimal a number with theDecimals digits after the point. The sign
+// is written by itself and the digits are the rounded size of the number (SSIM can be below 0).
+static void AppendText(Str255 theLine, ConstStr255Param theText)
+{
+	short aLength = theText[0];
+	
+	if(theLine[0] + aLength > 255)
+		aLength = 255 - theLine[0];
+	BlockMoveData(theText + 1, theLine + 1 + theLine[0], aLength);
+	theLine[0] += aLength;
+}
+
+static void AppendDecimal(Str255 theLine, double theValue, short theDecimals)
+{
+	Str255	aNumber;
+	long	aScale = 1;
+	long	aFraction;
+	short	index;
+	
+	for(index = 0; index < theDecimals; index++)
+		aScale *= 10;
+	
+	aFraction = (long)((theValue < 0 ? -theValue : theValue) * aScale + 0.5);
+	if(theValue < 0 && aFraction > 0)
+		AppendText(theLine, "\p-");
+	NumToString(aFraction / aScale, aNumber);
+	AppendText(theLine, aNumber);
+	
+	NumToString(aScale + aFraction % aScale, aNumber);		// leading zeroes, the 1 becomes the point
+	aNumber[1] = '.';
+	AppendText(theLine, aNumber);
+}
+
+// ______________________________________________________________________
+// WriteQualityLine writes a line of the score file, a label and the PSNR and SSIM separated by tabs.
+static void WriteQualityLine(ConstStr255Param theLabel, double thePSNR, double theSSIM)
+{
+	Str255	aLine;
+	long	aCount;
+	
+	if(gQualityFileRefNum == 0)
+		return;
+	
+	aLine[0] = 0;
+	AppendText(aLine, theLabel);
+	AppendText(aLine, "\p\t");
+	AppendDecimal(aLine, thePSNR, 2);
+	AppendText(aLine, "\p\t");
+	AppendDecimal(aLine, theSSIM, 4);
+	AppendText(aLine, "\p\r");
+	
+	aCount = aLine[0];
+	if(FSWrite(gQualityFileRefNum, &aCount, aLine + 1) != noErr)
+	{
+		FSClose(gQualityFileRefNum);
+		gQualityFileRefNum = 0;
+	}
+}
+
+
+// ______________________________________________________________________
+// FinishQualityCheck writes the summary at the end of the score file and into the statistics.
+static void FinishQualityCheck(void)
+{
+	QTUQualityStatistics aQualityStatistics;
+	
+	if(gQualitySequence) CDSequenceEnd(gQualitySequence);
+	gQualitySequence = 0;
+	
+	if(gQualityMeter)
+	{
+		QTUQualityMeterGetStatistics(gQualityMeter, &aQualityStatistics);
+		gStatistics.qualityFrames = aQualityStatistics.frames;
+		gStatistics.meanPSNR = aQualityStatistics.meanPSNR;
+		gStatistics.minPSNR = aQualityStatistics.minPSNR;
+		gStatistics.meanSSIM = aQualityStatistics.meanSSIM;
+		gStatistics.minSSIM = aQualityStatistics.minSSIM;
+		gStatistics.qualityMicroseconds = aQualityStatistics.microseconds + gQualityDecodeMicroseconds;
+		
+		if(aQualityStatistics.frames > 0)
+		{
+			WriteQualityLine("\pmean", aQualityStatistics.meanPSNR, aQualityStatistics.meanSSIM);
+			WriteQualityLine("\pmin", aQualityStatistics.minPSNR, aQualityStatistics.minSSIM);
+		}
+		
+		QTUDisposeQualityMeter(gQualityMeter);
+		gQualityMeter = NULL;
+	}
+	
+	if(gQualityFileRefNum) FSClose(gQualityFileRefNum);
+	gQualityFileRefNum = 0;
+	
+	ReleaseFrameGWorld(gQualityGWorld);
+	gQualityGWorld = NULL;
+}
+
+
+// ______________________________________________________________________
+// StartQualityCheck sets up the meter for frames of theFrameRect and the score file for the output theOutputFile. Only
+// 32-bit frames are scored, theSource is where they are compressed from. The movie is compressed anyway if something 
+// is missing, only without the scores. A check an earlier movie left open is finished first, its scores are not ours.
+static void StartQualityCheck(const FSSpec *theOutputFile, GWorldPtr theSource, const Rect *theFrameRect)
+{
+	Rect	aBounds = *theFrameRect;
+	FSSpec	aScoreFile;
+	Str255	aFileName;
+	short	aNameLength = theOutputFile->name[0];
+	
+	if(gQualityMeter || gQualityFileRefNum)
+	{
+		RecompressStatistics aStatistics = gStatistics;
+		
+		FinishQualityCheck();
+		gStatistics = aStatistics;
+	}
+	
+	if(!gOptions.verifyQuality || GetPixDepth(GetGWorldPixMap(theSource)) != 32)
+		return;
+	
+	OffsetRect(&aBounds, -aBounds.left, -aBounds.top);
+	if(QTUNewQualityMeter(aBounds.right, aBounds.bottom, gOptions.workerCount > 0 ? gOptions.workerCount - 1 : 0, &gQualityMeter) != noErr)
+		return;
+	
+	if(AcquireFrameGWorld(&aBounds, 32, NULL, &gQualityGWorld) != noErr)
+	{
+		QTUDisposeQualityMeter(gQualityMeter);
+		gQualityMeter = NULL;
+		return;
+	}
+	
+	// The score file is named after the output, with kQualityFileSuffix.
+	if(aNameLength + kQualityFileSuffix[0] > 31)
+		aNameLength = 31 - kQualityFileSuffix[0];
+	BlockMoveData(theOutputFile->name + 1, aFileName + 1, aNameLength);
+	aFileName[0] = aNameLength;
+	AppendText(aFileName, kQualityFileSuffix);
+	
+	if(FSMakeFSSpec(theOutputFile->vRefNum, theOutputFile->parID, aFileName, &aScoreFile) != fnfErr)
+		FSpDelete(&aScoreFile);
+	if(FSpCreate(&aScoreFile, 'ttxt', 'TEXT', smSystemScript) != noErr || FSpOpenDF(&aScoreFile, fsWrPerm, &gQualityFileRefNum) != noErr)
+		gQualityFileRefNum = 0;
+	
+	gQualityFrameNum = 0;
+	gQualityCompressMicroseconds = 0;
+	gQualityDecodeMicroseconds = 0;
+	gQualityWaitsForKeyFrame = false;
+}
+
+// ______________________________________________________________________
+// CheckFrameQuality decodes a compressed frame and scores it against theSource, the frame that was compressed in
+// theCompressMicroseconds. If it can't be decoded the check stops, that's no reason to fail the movie.
+static void CheckFrameQuality(ImageDescriptionHandle theDescription, Ptr theData, long theDataSize, Boolean isKeyFrame,
+									double theCompressMicroseconds, GWorldPtr theSource, const Rect *theSourceRect)
+{
+	OSErr					anErr = noErr;
+	QTUFrameQuality			aQuality;
+	QTUQualityStatistics	aQualityStatistics;
+	Rect					aBounds;
+	Str255					aLabel;
+	UnsignedWide			aDecodeTimer;
+	
+	if(gQualityMeter == NULL)
+		return;
+	
+	gQualityFrameNum++;
+	gQualityCompressMicroseconds += theCompressMicroseconds;
+	
+	// A frame over the budget is not decoded either. The frames after it can't be decoded until the next key frame.
+	QTUQualityMeterGetStatistics(gQualityMeter, &aQualityStatistics);
+	if(aQualityStatistics.microseconds + gQualityDecodeMicroseconds > kQualityTimeShare * gQualityCompressMicroseconds)
+		gQualityWaitsForKeyFrame = true;
+	else if(isKeyFrame)
+		gQualityWaitsForKeyFrame = false;
+	
+	if(gQualityWaitsForKeyFrame)
+	{
+		gStatistics.qualityFramesSkipped++;
+		return;
+	}
+	
+	QTUStartTimer(&aDecodeTimer);
+	if(gQualitySequence == 0)
+	{
+		anErr = DecompressSequenceBegin(&gQualitySequence, theDescription, gQualityGWorld, NULL, NULL, NULL,
+											srcCopy, NULL, 0, codecMaxQuality, anyCodec); DebugAssert(anErr == noErr);
+	}
+	if(anErr == noErr)
+	{
+		anErr = DecompressSequenceFrameS(gQualitySequence, theData, theDataSize, 0, NULL, NULL); DebugAssert(anErr == noErr);
+	}
+	gQualityDecodeMicroseconds += QTUElapsedMicroseconds(&aDecodeTimer);
+	if(anErr != noErr)
+	{
+		QTUDisposeQualityMeter(gQualityMeter);
+		gQualityMeter = NULL;
+		return;
+	}
+	
+	GetPortBounds(gQualityGWorld, &aBounds);
+	if(QTUQualityMeterCompare(gQualityMeter, GetGWorldPixMap(theSource), theSourceRect, GetGWorldPixMap(gQualityGWorld), &aBounds, 
+									&aQuality) != noErr)
+		return;
+	
+	NumToString(gQualityFrameNum, aLabel);
+	WriteQualityLine(aLabel, aQuality.psnr, aQuality.ssim);
+}
+
+
+// ______________________________________________________________________
+// RenderSourceFrame moves the source movie to theMovieTime and lets it draw the frame into its GWorld.
+static void RenderSourceFrame(Movie theMovie, TimeValue theMovieTime)
+{
+	UnsignedWide aTimer;
+	
+	QTUStartTimer(&aTimer);
+	
+	if(gWindowLoader)
+		QTUWindowLoaderUpdate(gWindowLoader, theMovieTime);
+	if(gPrefetcher)
+		QTUPrefetcherUpdate(gPrefetcher, theMovieTime);
+	
+	SetMovieTimeValue(theMovie, theMovieTime);
+	MoviesTask(theMovie, 0); MoviesTask(theMovie,0); MoviesTask(theMovie,0);
+	
+	gStatistics.renderMicroseconds += QTUElapsedMicroseconds(&aTimer);
+}
+
+
+// ______________________________________________________________________
+// GetNextSourceFrame moves the source movie to the next frame we want to compress, and draws it into the movie's
+// GWorld. The duration of the frame is returned in theDuration, currentMovieTime is updated.
+static void GetNextSourceFrame(Movie theMovie, long theFrameNum, long theFrameCount, TimeValue *theMovieTime, TimeValue *theDuration)
+{
+	// If we are resampling the movie, step to the next frame
+	if(gTemporalSettings.frameRate)
+	{
+		// This could could be much smarter about its calculations. The srcMovie duration and destination movie
+		// frame durations are both constant and could be calculated outside this loop.
+		
+		long dur = GetMovieDuration(theMovie);
+		*theMovieTime = theFrameNum * dur / (theFrameCount - 1);
+		*theDuration = dur / theFrameCount;
+	}
+	else
+	{
+		short flags = nextTimeMediaSample;
+		OSType whichMediaType = VIDEO_TYPE;
+		
+		// If this is the first frame, include the frame we are currently on.
+		if(theFrameNum == 0)
+			flags |= nextTimeEdgeOK;
+		
+		// If we are maintaining the frame durations of the source movie, skip to the next interesting
+		// time and get the duration of that frame.
+		GetMovieNextInterestingTime(theMovie, flags, 1, &whichMediaType, *theMovieTime, 0, theMovieTime, theDuration);
+	}
+	
+	RenderSourceFrame(theMovie, *theMovieTime);
+}
+
+
+// ______________________________________________________________________
+// DetectActiveRect looks for black borders around the picture of the movie. A few sync frames spread over the movie
+// are rendered into theSrcGWorld and scanned, the active rect is the union of their pictures so that no frame loses
+// any of it. Bars thinner than kMinCropMargin are left alone, and the crop keeps an even size and origin.
+#define kCropSampleFrames		8
+#define kCropBlackLevel			16
+#define kMinCropMargin			4
+
+static void DetectActiveRect(Movie theMovie, GWorldPtr theSrcGWorld, const Rect *theMovieRect, Rect *theActiveRect)
+{
+	OSType		aMediaType = VIDEO_TYPE;
+	TimeValue	aDuration = GetMovieDuration(theMovie);
+	TimeValue	aLastTime = -1;
+	Rect		aFrameRect;
+	Rect		anActiveRect = { 0, 0, 0, 0 };
+	long		index;
+	
+	*theActiveRect = *theMovieRect;
+	if(aDuration <= 0) return;
+	
+	SetMovieGWorld(theMovie, theSrcGWorld, GetGWorldDevice(theSrcGWorld));
+	
+	for(index = 0; index < kCropSampleFrames; index++)
+	{
+		TimeValue aTime = (TimeValue)((double)aDuration * (2 * index + 1) / (2 * kCropSampleFrames));
+		TimeValue aSyncTime = -1;
+		
+		// Sync samples are the cheapest frames to get at, take the one at or before the time.
+		GetMovieNextInterestingTime(theMovie, nextTimeSyncSample | nextTimeEdgeOK, 1, &aMediaType, aTime, -fixed1, &aSyncTime, NULL);
+		if(aSyncTime < 0) aSyncTime = aTime;
+		if(aSyncTime == aLastTime) continue;
+		aLastTime = aSyncTime;
+		
+		RenderSourceFrame(theMovie, aSyncTime);
+		
+		if(QTUFindActiveRect(GetGWorldPixMap(theSrcGWorld), theMovieRect, kCropBlackLevel, &aFrameRect) != noErr)
+			return;
+		
+		// A frame that is all black (a fade) says nothing about the borders.
+		if(EmptyRect(&aFrameRect))
+			continue;
+		if(EmptyRect(&anActiveRect))
+			anActiveRect = aFrameRect;
+		else
+			UnionRect(&anActiveRect, &aFrameRect, &anActiveRect);
+	}
+	
+	if(EmptyRect(&anActiveRect))
+		return;
+	
+	if(anActiveRect.left - theMovieRect->left < kMinCropMargin) anActiveRect.left = theMovieRect->left;
+	if(anActiveRect.top - theMovieRect->top < kMinCropMargin) anActiveRect.top = theMovieRect->top;
+	if(theMovieRect->right - anActiveRect.right < kMinCropMargin) anActiveRect.right = theMovieRect->right;
+	if(theMovieRect->bottom - anActiveRect.bottom < kMinCropMargin) anActiveRect.bottom = theMovieRect->bottom;
+	
+	// Grow the rect to even coordinates, rather lose a column at the edge of an odd sized movie than have an odd size.
+	anActiveRect.left -= (anActiveRect.left - theMovieRect->left) & 1;
+	anActiveRect.top -= (anActiveRect.top - theMovieRect->top) & 1;
+	if((anActiveRect.right - anActiveRect.left) & 1)
+		anActiveRect.right += (anActiveRect.right < theMovieRect->right) ? 1 : -1;
+	if((anActiveRect.bottom - anActiveRect.top) & 1)
+		anActiveRect.bottom += (anActiveRect.bottom < theMovieRect->bottom) ? 1 : -1;
+	
+	*theActiveRect = anActiveRect;
+}
+
+
+// ______________________________________________________________________
+// GetSourceRect returns the part of the movie box we compress. A crop rect in the options (relative to the movie box)
+// wins over the detection of black borders.
+static void GetSourceRect(Movie theMovie, GWorldPtr theSrcGWorld, const Rect *theMovieRect, Rect *theSourceRect)
+{
+	*theSourceRect = *theMovieRect;
+	
+	if(!EmptyRect(&gOptions.cropRect))
+	{
+		Rect aCropRect = gOptions.cropRect;
+		
+		OffsetRect(&aCropRect, theMovieRect->left, theMovieRect->top);
+		if(!SectRect(&aCropRect, theMovieRect, theSourceRect))
+			*theSourceRect = *theMovieRect;
+	}
+	else if(gOptions.detectCrop)
+		DetectActiveRect(theMovie, theSrcGWorld, theMovieRect, theSourceRect);
+}
+
+
+// ______________________________________________________________________
+// GetOutputRect returns the size of a destination video track, with its origin at 0,0. Without an output size (from 
+// the options or a profile) it's the size of the source rect, if only the width or the height is given the other one
+// keeps the aspect ratio of the source. The result is true if the frames have to be scaled.
+static Boolean GetOutputRect(const Rect *theMovieRect, long theWidth, long theHeight, Rect *theOutputRect)
+{
+	long	aMovieWidth = theMovieRect->right - theMovieRect->left;
+	long	aMovieHeight = theMovieRect->bottom - theMovieRect->top;
+	long	anOutputWidth = theWidth;
+	long	anOutputHeight = theHeight;
+	
+	SetRect(theOutputRect, 0, 0, (short)aMovieWidth, (short)aMovieHeight);
+	
+	if((anOutputWidth <= 0 && anOutputHeight <= 0) || aMovieWidth <= 0 || aMovieHeight <= 0)
+		return false;
+	
+	if(anOutputWidth <= 0)
+		anOutputWidth = anOutputHeight * aMovieWidth / aMovieHeight;
+	if(anOutputHeight <= 0)
+		anOutputHeight = anOutputWidth * aMovieHeight / aMovieWidth;
+	
+	// Most codecs work in 2x2 blocks at least, keep the sizes even.
+	anOutputWidth = (anOutputWidth + 1) & ~1;
+	anOutputHeight = (anOutputHeight + 1) & ~1;
+	
+	if(anOutputWidth == aMovieWidth && anOutputHeight == aMovieHeight)
+		return false;
+	
+	SetRect(theOutputRect, 0, 0, (short)anOutputWidth, (short)anOutputHeight);
+	return true;
+}
+
+
+// ______________________________________________________________________
+// ScaleSourceFrame scales the rendered frame into the GWorld we compress from.
+static OSErr ScaleSourceFrame(QTUResampler theResampler, GWorldPtr theSrcGWorld, const Rect *theSourceRect, GWorldPtr theDestinationGWorld,
+								const Rect *theDestinationRect)
+{
+	OSErr			anErr = noErr;
+	UnsignedWide	aTimer;
+	
+	QTUStartTimer(&aTimer);
+	
+	anErr = QTUResamplePixMap(theResampler, GetGWorldPixMap(theSrcGWorld), theSourceRect, GetGWorldPixMap(theDestinationGWorld), theDestinationRect);
+	DebugAssert(anErr == noErr);
+	
+	gStatistics.scaleMicroseconds += QTUElapsedMicroseconds(&aTimer);
+	
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// UseParallelIntraCompression decides if the frames of this sequence could be compressed independently of each
+// other. That's the case when every frame is a key frame, either because the codec does not do temporal compression
+// at all (JPEG, PNG and so on) or because the key frame rate is 1. Data rate constraining needs to see the frames
+// one after another, so we don't do this when a data rate is set. The codec runs on MP tasks then, so this is only
+// done where the Movie Toolbox is thread safe.
+static Boolean UseParallelIntraCompression(void)
+{
+	long		aFormatFlags, aCompressFlags;
+	Boolean		isIntraOnly;
+	
+	if(!gOptions.parallelIntraFrames)
+		return false;
+	
+	if(aDataRateSetting.dataRate != 0)
+		return false;
+	
+	if(QTUCountProcessors() < 2 && gOptions.workerCount < 2)
+		return false;
+	
+	if(!QTUCanUseMoviesOnThreads())
+		return false;
+	
+	isIntraOnly = (gTemporalSettings.keyFrameRate == 1);
+	if(!isIntraOnly && GetSpatialCodecFlags(&aFormatFlags, &aCompressFlags) == noErr)
+		isIntraOnly = !(aCompressFlags & codecInfoDoesTemporal) || gTemporalSettings.temporalQuality == 0;
+	
+	return isIntraOnly;
+}
+
+
+// ______________________________________________________________________
+// CompressIntraFrame is the work function for the worker pool. It compresses the frame in the slot GWorld into the
+// slot's compressed data handle, using the spatial settings picked in the standard compression dialog.
+static OSStatus CompressIntraFrame(void *theWorkItem)
+{
+	IntraFrameSlot	*aSlot = (IntraFrameSlot *)theWorkItem;
+	OSErr			anErr;
+	UnsignedWide	aTimer;
+	
+	QTUStartTimer(&aTimer);
+	
+	anErr = FCompressImage(GetGWorldPixMap(aSlot->gWorld), &aSlot->bounds, gSpatialSettings.depth, 
+								gSpatialSettings.spatialQuality, gSpatialSettings.codecType, gSpatialSettings.codec, NULL, 0, 
+								aSlot->compressedDataCapacity, NULL, NULL, aSlot->imageDescription, aSlot->compressedData);
+	if(anErr == noErr)
+		aSlot->compressedDataSize = (**aSlot->imageDescription).dataSize;
+	
+	aSlot->compressMicroseconds = QTUElapsedMicroseconds(&aTimer);
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// CompressIntraFramesInParallel is the frame loop used when every frame is a key frame. The main thread keeps on 
+// rendering frames from the source movie into a ring of GWorlds while the worker pool compresses them, and the 
+// compressed frames are appended to the media in presentation order as soon as the oldest one is done. If a worker
+// can't compress a frame (the codec might not be thread safe), we compress it again on the main thread. The source
+// rect of every frame is copied (or scaled with a resampler) to theFrameRect on its way into the ring.
+static OSErr CompressIntraFramesInParallel(Movie theSourceMovie, GWorldPtr theSrcGWorld, const Rect *theSourceRect, QTUResampler theResampler,
+											const Rect *theFrameRect, long theFrameCount, Media theDestinationMedia, QTUSampleWriter theWriter, 
+											WindowRef theProgressWindow, Boolean *theAbortFlag)
+{
+	OSErr					anErr = noErr;
+	QTUWorkerPool			aPool = NULL;
+	IntraFrameSlot			*aRing = NULL;
+	long					aRingSize;
+	long					aNextToRender = 0;
+	long					aNextToAppend = 0;
+	long					anOutstandingCount = 0;
+	long					aMaxCompressedSize;
+	long					index;
+	TimeValue				currentMovieTime = 0;
+	ImageDescriptionHandle	aSampleDescription = NULL;
+	ImageSequence			anImageSequence = 0;
+	
+	*theAbortFlag = false;
+	
+	anErr = QTUNewMoviesWorkerPool(gOptions.workerCount, &aPool); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	
+	// Two frames per worker keeps everybody busy while the main thread is rendering the next one.
+	aRingSize = 2 * (gOptions.workerCount > 0 ? gOptions.workerCount : QTUCountProcessors());
+	
+	aRing = (IntraFrameSlot *)NewPtrClear(aRingSize * sizeof(IntraFrameSlot)); DebugAssert(aRing != NULL);
+	if(aRing == NULL) { anErr = memFullErr; goto Closure; }
+	
+	anErr = GetMaxCompressionSize(GetGWorldPixMap(theSrcGWorld), theFrameRect, gSpatialSettings.depth, gSpatialSettings.spatialQuality,
+											gSpatialSettings.codecType, gSpatialSettings.codec, &aMaxCompressedSize); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+	
+	// All the memory the ring needs is taken here, the frame loop itself only reuses it.
+	anErr = PreparePayloadPool(aMaxCompressedSize, aRingSize); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+	
+	for(index = 0; index < aRingSize; index++)
+	{
+		IntraFrameSlot *aSlot = &aRing[index];
+		
+		aSlot->bounds = *theFrameRect;
+		anErr = AcquireFrameGWorld(theFrameRect, GetPixDepth(GetGWorldPixMap(theSrcGWorld)), (**GetGWorldPixMap(theSrcGWorld)).pmTable,
+										&aSlot->gWorld); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+		
+		aSlot->imageDescription = (ImageDescriptionHandle)NewHandleClear(sizeof(ImageDescription)); DebugAssert(aSlot->imageDescription != NULL);
+		aSlot->compressedData = QTUBufferPoolGet(gPayloadPool); DebugAssert(aSlot->compressedData != NULL);
+		if(aSlot->imageDescription == NULL || aSlot->compressedData == NULL) { anErr = memFullErr; goto Closure; }
+		aSlot->compressedDataCapacity = aMaxCompressedSize;
+	}
+	
+	while(aNextToAppend < theFrameCount)
+	{
+		IntraFrameSlot	*aSlot;
+		
+		// Render and submit frames as long as there's a free slot in the ring.
+		while(aNextToRender < theFrameCount && aNextToRender - aNextToAppend < aRingSize)
+		{
+			EventRecord 	anEvent;
+			TimeValue		duration;
+			
+			// Abort if the end user clicked the mouse or pressed a key.
+			if(EventAvail(keyDownMask | mDownMask, &anEvent))
+			{
+				*theAbortFlag = true;
+				goto Closure;
+			}
+			
+			aSlot = &aRing[aNextToRender % aRingSize];
+			
+			GetNextSourceFrame(theSourceMovie, aNextToRender, theFrameCount, &currentMovieTime, &duration);
+			if(theResampler)
+			{
+				anErr = ScaleSourceFrame(theResampler, theSrcGWorld, theSourceRect, aSlot->gWorld, theFrameRect);
+				if(anErr != noErr) goto Closure;
+			}
+			else
+				CopyBits((BitMap *)*GetGWorldPixMap(theSrcGWorld), (BitMap *)*GetGWorldPixMap(aSlot->gWorld), theSourceRect, theFrameRect, srcCopy, NULL);
+			
+			aSlot->frameNum = aNextToRender;
+			aSlot->duration = duration;
+			aSlot->isDone = false;
+			
+			anErr = QTUWorkerPoolSubmit(aPool, CompressIntraFrame, aSlot); DebugAssert(anErr == noErr);
+			if(anErr != noErr) goto Closure;
+			
+			anOutstandingCount++;
+			aNextToRender++;
+		}
+		
+		// Collect finished frames until the oldest one is done, this is our reorder buffer.
+		aSlot = &aRing[aNextToAppend % aRingSize];
+		while(!aSlot->isDone)
+		{
+			IntraFrameSlot	*aFinishedSlot;
+			OSStatus		aResult;
+			
+			anErr = QTUWorkerPoolWaitForItem(aPool, (void **)&aFinishedSlot, &aResult); DebugAssert(anErr == noErr);
+			if(anErr != noErr) goto Closure;
+			
+			anOutstandingCount--;
+			aFinishedSlot->result = aResult;
+			aFinishedSlot->isDone = true;
+		}
+		
+		if(aSlot->result != noErr)
+		{
+			aSlot->result = CompressIntraFrame(aSlot);
+			anErr = aSlot->result; DebugAssert(anErr == noErr);
+			if(anErr != noErr) goto Closure;
+		}
+		
+		// All the frames share one sample description, the first one we get. The data size is the only field that
+		// changes from frame to frame, so clear it.
+		if(aSampleDescription == NULL)
+		{
+			aSampleDescription = aSlot->imageDescription;
+			anErr = HandToHand((Handle *)&aSampleDescription); DebugAssert(anErr == noErr);
+			if(anErr != noErr) { aSampleDescription = NULL; goto Closure; }
+			(**aSampleDescription).dataSize = 0;
+		}
+		
+		// Every frame is a key frame, so the sample flags are always zero.
+		anErr = AppendCompressedFrame(theWriter, theDestinationMedia, NULL, aSlot->compressedData, aSlot->compressedDataSize, aSlot->duration,
+											(SampleDescriptionHandle)aSampleDescription, 0);
+		if(anErr != noErr) goto Closure;
+		
+		CheckFrameQuality(aSampleDescription, aSlot->compressedData, aSlot->compressedDataSize, true, aSlot->compressMicroseconds,
+							aSlot->gWorld, theFrameRect);
+		
+		// Decompress the compressed frame into the progress window.
+		if(theProgressWindow)
+		{
+			SetGWorld(GetWindowPort(theProgressWindow), NULL);
+			
+			if(anImageSequence == 0)
+			{
+				anErr = DecompressSequenceBegin(&anImageSequence, aSampleDescription, NULL, NULL, theFrameRect,
+										NULL, ditherCopy, NULL, 0, codecNormalQuality, anyCodec); DebugAssert(anErr == noErr);
+				if(anErr != noErr) goto Closure;
+			}
+			
+			anErr = DecompressSequenceFrame(anImageSequence, aSlot->compressedData, 0, NULL, NULL); DebugAssert(anErr == noErr);
+			if(anErr != noErr) goto Closure;
+			
+			SetGWorld(theSrcGWorld, NULL);
+		}
+		
+		aNextToAppend++;
+	}
+
+Closure:
+	// Wait for the frames still being compressed before we pull the GWorlds away from the workers.
+	while(anOutstandingCount > 0)
+	{
+		void		*unused;
+		OSStatus	aResult;
+		
+		if(QTUWorkerPoolWaitForItem(aPool, &unused, &aResult) != noErr)
+			break;
+		anOutstandingCount--;
+	}
+	QTUDisposeWorkerPool(aPool);
+	
+	if(anImageSequence) CDSequenceEnd(anImageSequence);
+	if(aSampleDescription) DisposeHandle((Handle)aSampleDescription);
+	
+	if(aRing)
+	{
+		for(index = 0; index < aRingSize; index++)
+		{
+			ReleaseFrameGWorld(aRing[index].gWorld);
+			if(aRing[index].imageDescription) DisposeHandle((Handle)aRing[index].imageDescription);
+			QTUBufferPoolRelease(gPayloadPool, aRing[index].compressedData);
+		}
+		DisposePtr((Ptr)aRing);
+	}
+	
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// SCENE CUTS
+// With sceneCutKeyFrames (off by default, it changes the GOPs of the output) the serial frame loop places the key
+// frames itself instead of leaving it to the fixed key frame rate. A frame that looks nothing like the one before
+// starts a new GOP, as long as the GOP before it has at least minKeyFrameInterval frames, and no GOP gets longer than
+// maxKeyFrameInterval frames (the key frame rate of the settings if that's 0). Frames are compared by their scene
+// signatures, a small luma picture and a histogram.
+#define kSceneCutLumaDifference				30
+#define kSceneCutHistogramDifference		150
+#define kSceneCutSureHistogramDifference	400
+
+typedef struct SceneCutDetector {
+	QTUSceneSignature	signatures[2];
+	short				current;				// the signature of the last frame
+	Boolean				hasPrevious;
+	long				framesSinceKeyFrame;	// frames in the current GOP
+	long				minInterval;
+	long				maxInterval;
+} SceneCutDetector;
+
+
+// ______________________________________________________________________
+// StartSceneCutDetection gets a detector ready for the first frame of a movie.
+static void StartSceneCutDetection(SceneCutDetector *theDetector)
+{
+	theDetector->current = 0;
+	theDetector->hasPrevious = false;
+	theDetector->framesSinceKeyFrame = 0;
+	theDetector->minInterval = (gOptions.minKeyFrameInterval > 0) ? gOptions.minKeyFrameInterval : 1;
+	theDetector->maxInterval = (gOptions.maxKeyFrameInterval > 0) ? gOptions.maxKeyFrameInterval : gTemporalSettings.keyFrameRate;
+}
+
+
+// ______________________________________________________________________
+// WantKeyFrame looks at the frame about to be compressed, and returns true if it has to be a key frame.
+static Boolean WantKeyFrame(SceneCutDetector *theDetector, PixMapHandle thePixMap, const Rect *theRect)
+{
+	short	aNext = 1 - theDetector->current;
+	Boolean	isSceneCut = false;
+	
+	if(QTUGetSceneSignature(thePixMap, theRect, &theDetector->signatures[aNext]) == noErr)
+	{
+		if(theDetector->hasPrevious)
+		{
+			long aLumaDifference, aHistogramDifference;
+			
+			QTUCompareSceneSignatures(&theDetector->signatures[theDetector->current], &theDetector->signatures[aNext],
+											&aLumaDifference, &aHistogramDifference);
+			isSceneCut = (aLumaDifference >= kSceneCutLumaDifference && aHistogramDifference >= kSceneCutHistogramDifference) ||
+							aHistogramDifference >= kSceneCutSureHistogramDifference;
+		}
+		
+		theDetector->current = aNext;
+		theDetector->hasPrevious = true;
+	}
+	
+	if(isSceneCut)
+		gStatistics.sceneCuts++;
+	
+	return (isSceneCut && theDetector->framesSinceKeyFrame >= theDetector->minInterval) ||
+			(theDetector->maxInterval > 0 && theDetector->framesSinceKeyFrame >= theDetector->maxInterval);
+}
+
+
+// ______________________________________________________________________
+// CountKeyFrame keeps track of the GOP length with the sync flag of every compressed frame.
+static void CountKeyFrame(SceneCutDetector *theDetector, short theSyncFlag)
+{
+	if(theSyncFlag & mediaSampleNotSync)
+		theDetector->framesSinceKeyFrame++;
+	else
+		theDetector->framesSinceKeyFrame = 1;
+}
+
+
+// ______________________________________________________________________
+// QUALITY SEARCH
+// With a targetPSNR the spatial quality of the settings is not used as it is, we search for the lowest quality that
+// still meets the target. Up to searchFrames key frames of different scenes are taken from the movie, each one is
+// compressed at all the kSearchQualities side by side on the worker pool, decoded and scored. The mean PSNR and size
+// of every quality make a rate-quality curve, and the quality where the curve crosses the target is used for the
+// whole movie. The search compresses at most kSearchCostShare of the frames the movie has.
+#define kSearchQualityCount		5
+#define kSearchCostShare		0.05
+#define kSearchCandidates		3			// key frames looked at for every one that is compressed
+
+static const CodecQ kSearchQualities[kSearchQualityCount] = 
+	{ codecMinQuality, codecLowQuality, codecNormalQuality, codecHighQuality, codecMaxQuality };
+
+// One of these per quality, the frame is the same for all of them.
+typedef struct SearchSlot {
+	GWorldPtr				source;
+	Rect					sourceRect;
+	CodecQ					quality;
+	ImageDescriptionHandle	imageDescription;
+	Ptr						compressedData;
+	long					compressedDataCapacity;
+	long					compressedDataSize;
+	GWorldPtr				decoded;			// the compressed frame decoded again, at the size of the frame
+	OSStatus				result;
+} SearchSlot;
+
+
+// ______________________________________________________________________
+// CompressSearchFrame is the work function of the search, it compresses the frame at the quality of the slot and
+// decodes it again for the meter.
+static OSStatus CompressSearchFrame(void *theWorkItem)
+{
+	SearchSlot	*aSlot = (SearchSlot *)theWorkItem;
+	Rect		aBounds;
+	OSErr		anErr;
+	
+	anErr = FCompressImage(GetGWorldPixMap(aSlot->source), &aSlot->sourceRect, gSpatialSettings.depth, aSlot->quality,
+								gSpatialSettings.codecType, gSpatialSettings.codec, NULL, 0, aSlot->compressedDataCapacity,
+								NULL, NULL, aSlot->imageDescription, aSlot->compressedData);
+	if(anErr != noErr) return anErr;
+	
+	aSlot->compressedDataSize = (**aSlot->imageDescription).dataSize;
+	
+	GetPortBounds(aSlot->decoded, &aBounds);
+	return DecompressImage(aSlot->compressedData, aSlot->imageDescription, GetGWorldPixMap(aSlot->decoded), NULL, &aBounds, srcCopy, NULL);
+}
+
+
+// ______________________________________________________________________
+// IsNewSearchScene returns true if the frame looks different enough from all the frames the search took so far,
+// by the same measures the scene cut detection uses. The signature of a new scene is added to theSignatures.
+static Boolean IsNewSearchScene(PixMapHandle thePixMap, const Rect *theRect, QTUSceneSignature *theSignatures, long *theSceneCount)
+{
+	long index;
+	
+	if(QTUGetSceneSignature(thePixMap, theRect, &theSignatures[*theSceneCount]) != noErr)
+		return true;
+	
+	for(index = 0; index < *theSceneCount; index++)
+	{
+		long aLumaDifference, aHistogramDifference;
+		
+		QTUCompareSceneSignatures(&theSignatures[index], &theSignatures[*theSceneCount], &aLumaDifference, &aHistogramDifference);
+		if(aLumaDifference < kSceneCutLumaDifference && aHistogramDifference < kSceneCutHistogramDifference)
+			return false;
+	}
+	
+	(*theSceneCount)++;
+	return true;
+}
+
+
+// ______________________________________________________________________
+// FitSearchQuality finds the lowest quality whose mean PSNR meets theTarget on the curve through the measured
+// qualities. Between two of them the curve is a straight line, a quality that's better but scored worse than a
+// lower one is taken to score as the lower one. If even the best quality misses the target, that's the one we get.
+static CodecQ FitSearchQuality(const double thePSNR[], const double theBytes[], double theTarget, double *thePredictedPSNR, 
+									double *thePredictedBytes)
+{
+	double	aPSNR[kSearchQualityCount];
+	double	aFraction;
+	long	aStep;
+	short	index;
+	
+	for(index = 0; index < kSearchQualityCount; index++)
+		aPSNR[index] = (index > 0 && thePSNR[index] < aPSNR[index - 1]) ? aPSNR[index - 1] : thePSNR[index];
+	
+	for(index = 0; index < kSearchQualityCount && aPSNR[index] < theTarget; index++)
+		;
+	
+	if(index == 0 || index == kSearchQualityCount)
+	{
+		if(index == kSearchQualityCount) index--;
+		*thePredictedPSNR = aPSNR[index];
+		*thePredictedBytes = theBytes[index];
+		return kSearchQualities[index];
+	}
+	
+	aFraction = (aPSNR[index] > aPSNR[index - 1]) ? (theTarget - aPSNR[index - 1]) / (aPSNR[index] - aPSNR[index - 1]) : 1.0;
+	*thePredictedPSNR = theTarget;
+	*thePredictedBytes = theBytes[index - 1] + aFraction * (theBytes[index] - theBytes[index - 1]);
+	
+	// Round up, the quality must not end up below the target.
+	aStep = (long)(aFraction * (kSearchQualities[index] - kSearchQualities[index - 1]));
+	if(aStep < aFraction * (kSearchQualities[index] - kSearchQualities[index - 1]))
+		aStep++;
+	
+	return kSearchQualities[index - 1] + aStep;
+}
+
+
+// ______________________________________________________________________
+// SearchSpatialQuality runs the search on theMovie, the frames are rendered into theSrcGWorld and scaled with
+// theResampler (if there's one) to theFrameRect of theCompressGWorld, the way the frame loop will do it. The quality
+// found goes into theQuality, it stays as it is if the search can't be done. Only 32-bit frames can be scored, frames
+// rendered in another depth are copied into a 32-bit GWorld first. The codec gets the copy then, with the same colors.
+static OSErr SearchSpatialQuality(Movie theMovie, GWorldPtr theSrcGWorld, const Rect *theSourceRect, QTUResampler theResampler,
+									GWorldPtr theCompressGWorld, const Rect *theFrameRect, long theFrameCount, CodecQ *theQuality)
+{
+	OSErr				anErr = noErr;
+	QTUWorkerPool		aPool = NULL;
+	QTUQualityMeter		aMeter = NULL;
+	QTUSceneSignature	*aSignatures = NULL;
+	SearchSlot			*aSlots = NULL;
+	GWorldPtr			aDeepGWorld = NULL;
+	GWorldPtr			aFrameGWorld = theCompressGWorld;
+	GWorldPtr			aSceneGWorld = theSrcGWorld;
+	double				aPSNR[kSearchQualityCount];
+	double				aBytes[kSearchQualityCount];
+	long				aFrameCount = gOptions.searchFrames;
+	long				aSceneCount = 0;
+	long				anOutstandingCount = 0;
+	long				aCandidateNum;
+	TimeValue			aDuration = GetMovieDuration(theMovie);
+	TimeValue			aLastTime = -1;
+	Rect				aBounds = *theFrameRect;
+	Rect				aFrameRect = *theFrameRect;
+	Rect				aSceneRect = *theSourceRect;
+	UnsignedWide		aTimer;
+	short				index;
+	
+	QTUStartTimer(&aTimer);
+	
+	// The search must stay a small part of the work.
+	if(aFrameCount > kSearchCostShare * theFrameCount / kSearchQualityCount)
+		aFrameCount = (long)(kSearchCostShare * theFrameCount / kSearchQualityCount);
+	if(aFrameCount < 1)
+		return noErr;
+	
+	OffsetRect(&aBounds, -aBounds.left, -aBounds.top);
+	anErr = QTUNewQualityMeter(aBounds.right, aBounds.bottom, gOptions.workerCount > 0 ? gOptions.workerCount - 1 : 0, &aMeter); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+	
+	// Only frames rendered in the depth of the source aren't 32-bit, they are never scaled.
+	if(GetPixDepth(GetGWorldPixMap(theCompressGWorld)) != 32)
+	{
+		DebugAssert(theResampler == NULL);
+		
+		anErr = AcquireFrameGWorld(&aBounds, 32, NULL, &aDeepGWorld); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+		
+		aFrameGWorld = aSceneGWorld = aDeepGWorld;
+		aFrameRect = aSceneRect = aBounds;
+	}
+	
+	// The qualities are compressed side by side where the codecs could run on workers, else on the main thread.
+	anErr = QTUNewMoviesWorkerPool(gOptions.workerCount, &aPool);
+	if(anErr != noErr) aPool = NULL;
+	
+	aSignatures = (QTUSceneSignature *)NewPtr((aFrameCount + 1) * sizeof(QTUSceneSignature)); DebugAssert(aSignatures != NULL);
+	if(aSignatures == NULL) { anErr = memFullErr; goto Closure; }
+	
+	aSlots = (SearchSlot *)NewPtrClear(kSearchQualityCount * sizeof(SearchSlot)); DebugAssert(aSlots != NULL);
+	if(aSlots == NULL) { anErr = memFullErr; goto Closure; }
+	
+	for(index = 0; index < kSearchQualityCount; index++)
+	{
+		SearchSlot *aSlot = &aSlots[index];
+		
+		aSlot->source = aFrameGWorld;
+		aSlot->sourceRect = aFrameRect;
+		aSlot->quality = kSearchQualities[index];
+		
+		anErr = GetMaxCompressionSize(GetGWorldPixMap(aFrameGWorld), &aFrameRect, gSpatialSettings.depth, aSlot->quality,
+											gSpatialSettings.codecType, gSpatialSettings.codec, &aSlot->compressedDataCapacity); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+		
+		aSlot->imageDescription = (ImageDescriptionHandle)NewHandleClear(sizeof(ImageDescription)); DebugAssert(aSlot->imageDescription != NULL);
+		aSlot->compressedData = NewPtr(aSlot->compressedDataCapacity); DebugAssert(aSlot->compressedData != NULL);
+		if(aSlot->imageDescription == NULL || aSlot->compressedData == NULL) { anErr = memFullErr; goto Closure; }
+		
+		anErr = AcquireFrameGWorld(&aBounds, 32, NULL, &aSlot->decoded); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+		
+		aPSNR[index] = 0;
+		aBytes[index] = 0;
+	}
+	
+	SetMovieGWorld(theMovie, theSrcGWorld, GetGWorldDevice(theSrcGWorld));
+	
+	// The candidates are key frames spread over the movie, a frame of a scene we already have is passed over.
+	for(aCandidateNum = 0; aCandidateNum < aFrameCount * kSearchCandidates && aSceneCount < aFrameCount; aCandidateNum++)
+	{
+		OSType		aMediaType = VideoMediaType;
+		TimeValue	aTime = (TimeValue)(((double)aCandidateNum + 0.5) * aDuration / (aFrameCount * kSearchCandidates));
+		TimeValue	aSyncTime = -1;
+		
+		GetMovieNextInterestingTime(theMovie, nextTimeSyncSample | nextTimeEdgeOK, 1, &aMediaType, aTime, fixed1, &aSyncTime, NULL);
+		if(aSyncTime >= 0 && aSyncTime < aDuration)
+			aTime = aSyncTime;
+		if(aTime == aLastTime)
+			continue;
+		aLastTime = aTime;
+		
+		RenderSourceFrame(theMovie, aTime);
+		if(aDeepGWorld)
+			CopyBits((BitMap *)*GetGWorldPixMap(theCompressGWorld), (BitMap *)*GetGWorldPixMap(aDeepGWorld), theFrameRect, &aBounds, srcCopy, NULL);
+		if(!IsNewSearchScene(GetGWorldPixMap(aSceneGWorld), &aSceneRect, aSignatures, &aSceneCount))
+			continue;
+		
+		if(theResampler)
+		{
+			anErr = ScaleSourceFrame(theResampler, theSrcGWorld, theSourceRect, theCompressGWorld, theFrameRect);
+			if(anErr != noErr) goto Closure;
+		}
+		
+		for(index = 0; index < kSearchQualityCount; index++)
+		{
+			if(aPool == NULL)
+			{
+				aSlots[index].result = unimpErr;			// compressed on the main thread below
+				continue;
+			}
+			
+			anErr = QTUWorkerPoolSubmit(aPool, CompressSearchFrame, &aSlots[index]); DebugAssert(anErr == noErr);
+			if(anErr != noErr) goto Closure;
+			anOutstandingCount++;
+		}
+		
+		while(anOutstandingCount > 0)
+		{
+			SearchSlot	*aFinishedSlot;
+			OSStatus	aResult;
+			
+			anErr = QTUWorkerPoolWaitForItem(aPool, (void **)&aFinishedSlot, &aResult); DebugAssert(anErr == noErr);
+			if(anErr != noErr) goto Closure;
+			
+			anOutstandingCount--;
+			aFinishedSlot->result = aResult;
+		}
+		
+		// Without workers, or when the codec can't work on a worker, the frame is compressed on the main thread.
+		for(index = 0; index < kSearchQualityCount; index++)
+		{
+			SearchSlot		*aSlot = &aSlots[index];
+			QTUFrameQuality	aQuality;
+			
+			if(aSlot->result != noErr)
+			{
+				aSlot->result = CompressSearchFrame(aSlot);
+				anErr = aSlot->result; DebugAssert(anErr == noErr);
+				if(anErr != noErr) goto Closure;
+			}
+			
+			anErr = QTUQualityMeterCompare(aMeter, GetGWorldPixMap(aFrameGWorld), &aFrameRect, GetGWorldPixMap(aSlot->decoded), 
+												&aBounds, &aQuality); DebugAssert(anErr == noErr);
+			if(anErr != noErr) goto Closure;
+			
+			aPSNR[index] += aQuality.psnr;
+			aBytes[index] += aSlot->compressedDataSize;
+		}
+	}
+	
+	if(aSceneCount > 0)
+	{
+		for(index = 0; index < kSearchQualityCount; index++)
+		{
+			aPSNR[index] /= aSceneCount;
+			aBytes[index] /= aSceneCount;
+		}
+		
+		*theQuality = FitSearchQuality(aPSNR, aBytes, gOptions.targetPSNR, &gStatistics.searchPSNR, &gStatistics.searchBytesPerFrame);
+		gStatistics.searchFrames = aSceneCount;
+		gStatistics.searchQuality = *theQuality;
+	}
+
+Closure:
+	while(anOutstandingCount > 0)
+	{
+		void		*unused;
+		OSStatus	aResult;
+		
+		if(QTUWorkerPoolWaitForItem(aPool, &unused, &aResult) != noErr)
+			break;
+		anOutstandingCount--;
+	}
+	if(aPool) QTUDisposeWorkerPool(aPool);
+	if(aMeter) QTUDisposeQualityMeter(aMeter);
+	if(aSignatures) DisposePtr((Ptr)aSignatures);
+	ReleaseFrameGWorld(aDeepGWorld);
+	
+	if(aSlots)
+	{
+		for(index = 0; index < kSearchQualityCount; index++)
+		{
+			ReleaseFrameGWorld(aSlots[index].decoded);
+			if(aSlots[index].imageDescription) DisposeHandle((Handle)aSlots[index].imageDescription);
+			if(aSlots[index].compressedData) DisposePtr(aSlots[index].compressedData);
+		}
+		DisposePtr((Ptr)aSlots);
+	}
+	
+	gStatistics.searchMicroseconds = QTUElapsedMicroseconds(&aTimer);
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// DRY RUN
+// With dryRun RecompressMovieFile writes no movie, it compresses dryRunPercent of the frames and predicts the size of
+// the output, the frames per second and the time it would take. The movie is cut into strata of equal length and a
+// short run of frames from a random place in every stratum goes through the real compression sequence, the first
+// frame of a run is a key frame and the others tell what the difference frames of a GOP cost. The spread between the
+// strata gives a 95% confidence interval. The time of a movie also counts what the frames don't show: setting up the
+// sequence, and writing the output and copying it again when it's flattened, at the pace a probe file in the folder of
+// the movie is written and read. There's one kEstimateFileName for the batch, in the folder of its first movie. Every
+// movie gets a line in it, and FinishRecompressEstimates adds the batch at the end. A dry run is not admitted against
+// the memory limit, it's the movies of the whole batch that are estimated.
+#define kDryRunRunFrames		6			// frames of one run at most, fewer when the key frames are closer
+#define kDryRunMaxTQuantiles	30
+#define kDryRunProbeBytes		(1024L * 1024L)
+#define kSampleTableEntryBytes	16			// per sample, in the sample tables we build
+#define	kEstimateFileName		"\pCompressMovies Estimate"
+#define	kProbeFileName			"\pCompressMovies Probe"
+
+static RecompressOutputEstimate	gMovieEstimate;
+static RecompressOutputEstimate	gBatchEstimate;
+static short					gEstimateFileRefNum = 0;
+
+// The 97.5% quantiles of Student's t for 1 to kDryRunMaxTQuantiles degrees of freedom, the normal one after that.
+static const double kDryRunTQuantiles[kDryRunMaxTQuantiles] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+
+// ______________________________________________________________________
+// GetConfidenceRange returns half the width of the 95% confidence interval of the mean of theCount values, from their
+// sum and sum of squares.
+static double GetConfidenceRange(double theSum, double theSumOfSquares, long theCount)
+{
+	double aMean, aVariance;
+	
+	if(theCount < 2)
+		return 0;
+	
+	aMean = theSum / theCount;
+	aVariance = (theSumOfSquares - theCount * aMean * aMean) / (theCount - 1);
+	if(aVariance <= 0)
+		return 0;
+	
+	return (theCount - 1 <= kDryRunMaxTQuantiles ? kDryRunTQuantiles[theCount - 2] : 1.960) * sqrt(aVariance / theCount);
+}
+
+
+// ______________________________________________________________________
+// MeasureFileMicroseconds writes kDryRunProbeBytes into a probe file in the folder of theMovieFile and reads them back,
+// and returns the microseconds per byte of either. The probe file is deleted again.
+static OSErr MeasureFileMicroseconds(const FSSpec *theMovieFile, double *theWriteMicroseconds, double *theReadMicroseconds)
+{
+	OSErr			anErr = noErr;
+	FSSpec			aFile;
+	Boolean			isCreated = false;
+	short			aRefNum = 0;
+	Ptr				aBuffer;
+	long			aCount;
+	UnsignedWide	aTimer;
+	
+	*theWriteMicroseconds = 0;
+	*theReadMicroseconds = 0;
+	
+	aBuffer = NewPtrClear(kDryRunProbeBytes); DebugAssert(aBuffer != NULL);
+	if(aBuffer == NULL) return memFullErr;
+	
+	anErr = FSMakeFSSpec(theMovieFile->vRefNum, theMovieFile->parID, kProbeFileName, &aFile);
+	if(anErr == noErr)
+		FSpDelete(&aFile);
+	if(anErr == noErr || anErr == fnfErr)
+		anErr = FSpCreate(&aFile, kUnknownType, kUnknownType, smSystemScript);
+	isCreated = (anErr == noErr);
+	if(anErr == noErr)
+		anErr = FSpOpenDF(&aFile, fsRdWrPerm, &aRefNum);
+	
+	if(anErr == noErr)
+	{
+		aCount = kDryRunProbeBytes;
+		QTUStartTimer(&aTimer);
+		anErr = FSWrite(aRefNum, &aCount, aBuffer);
+		*theWriteMicroseconds = QTUElapsedMicroseconds(&aTimer) / kDryRunProbeBytes;
+	}
+	if(anErr == noErr)
+		anErr = SetFPos(aRefNum, fsFromStart, 0);
+	if(anErr == noErr)
+	{
+		aCount = kDryRunProbeBytes;
+		QTUStartTimer(&aTimer);
+		anErr = FSRead(aRefNum, &aCount, aBuffer);
+		*theReadMicroseconds = QTUElapsedMicroseconds(&aTimer) / kDryRunProbeBytes;
+	}
+	
+	if(aRefNum) FSClose(aRefNum);
+	if(isCreated) FSpDelete(&aFile);
+	DisposePtr(aBuffer);
+	
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// WriteEstimateLine writes a line of the estimate file, theLabel and the bytes, frames per second and seconds with
+// their confidence intervals, separated by tabs. The file is created in the folder of theMovieFile when it's not
+// open yet, the first movie of the batch.
+static void WriteEstimateLine(const FSSpec *theMovieFile, ConstStr255Param theLabel, const RecompressOutputEstimate *theEstimate)
+{
+	Str255	aLine;
+	long	aCount;
+	
+	if(gEstimateFileRefNum == 0 && theMovieFile)
+	{
+		FSSpec aFile;
+		
+		if(FSMakeFSSpec(theMovieFile->vRefNum, theMovieFile->parID, kEstimateFileName, &aFile) != fnfErr)
+			FSpDelete(&aFile);
+		if(FSpCreate(&aFile, 'ttxt', 'TEXT', smSystemScript) != noErr || FSpOpenDF(&aFile, fsWrPerm, &gEstimateFileRefNum) != noErr)
+			gEstimateFileRefNum = 0;
+	}
+	if(gEstimateFileRefNum == 0)
+		return;
+	
+	aLine[0] = 0;
+	AppendText(aLine, theLabel);
+	AppendText(aLine, "\p\t");
+	AppendDecimal(aLine, theEstimate->outputBytes / (1024.0 * 1024.0), 2);
+	AppendText(aLine, "\p MB (");
+	AppendDecimal(aLine, theEstimate->outputBytesLow / (1024.0 * 1024.0), 2);
+	AppendText(aLine, "\p-");
+	AppendDecimal(aLine, theEstimate->outputBytesHigh / (1024.0 * 1024.0), 2);
+	AppendText(aLine, "\p)\t");
+	AppendDecimal(aLine, theEstimate->framesPerSecond, 1);
+	AppendText(aLine, "\p fps (");
+	AppendDecimal(aLine, theEstimate->framesPerSecondLow, 1);
+	AppendText(aLine, "\p-");
+	AppendDecimal(aLine, theEstimate->framesPerSecondHigh, 1);
+	AppendText(aLine, "\p)\t");
+	AppendDecimal(aLine, theEstimate->seconds, 1);
+	AppendText(aLine, "\p s (");
+	AppendDecimal(aLine, theEstimate->secondsLow, 1);
+	AppendText(aLine, "\p-");
+	AppendDecimal(aLine, theEstimate->secondsHigh, 1);
+	AppendText(aLine, "\p)\r");
+	
+	aCount = aLine[0];
+	if(FSWrite(gEstimateFileRefNum, &aCount, aLine + 1) != noErr)
+	{
+		FSClose(gEstimateFileRefNum);
+		gEstimateFileRefNum = 0;
+	}
+}
+
+
+// ______________________________________________________________________
+// AddToBatchEstimate adds the estimate of a movie to the batch. The movies are independent, so the widths of their
+// intervals add up like standard deviations.
+static void AddToBatchEstimate(const RecompressOutputEstimate *theEstimate)
+{
+	double aBytesRange = gBatchEstimate.outputBytesHigh - gBatchEstimate.outputBytes;
+	double aSecondsRange = gBatchEstimate.secondsHigh - gBatchEstimate.seconds;
+	double aMovieBytesRange = theEstimate->outputBytesHigh - theEstimate->outputBytes;
+	double aMovieSecondsRange = theEstimate->secondsHigh - theEstimate->seconds;
+	
+	aBytesRange = sqrt(aBytesRange * aBytesRange + aMovieBytesRange * aMovieBytesRange);
+	aSecondsRange = sqrt(aSecondsRange * aSecondsRange + aMovieSecondsRange * aMovieSecondsRange);
+	
+	gBatchEstimate.movies++;
+	gBatchEstimate.frameCount += theEstimate->frameCount;
+	gBatchEstimate.framesSampled += theEstimate->framesSampled;
+	gBatchEstimate.outputBytes += theEstimate->outputBytes;
+	gBatchEstimate.seconds += theEstimate->seconds;
+	
+	gBatchEstimate.outputBytesLow = gBatchEstimate.outputBytes - aBytesRange;
+	gBatchEstimate.outputBytesHigh = gBatchEstimate.outputBytes + aBytesRange;
+	gBatchEstimate.secondsLow = gBatchEstimate.seconds - aSecondsRange;
+	gBatchEstimate.secondsHigh = gBatchEstimate.seconds + aSecondsRange;
+	if(gBatchEstimate.secondsLow < 0)
+		gBatchEstimate.secondsLow = 0;
+	
+	if(gBatchEstimate.seconds > 0)
+	{
+		gBatchEstimate.framesPerSecond = gBatchEstimate.frameCount / gBatchEstimate.seconds;
+		gBatchEstimate.framesPerSecondLow = gBatchEstimate.frameCount / gBatchEstimate.secondsHigh;
+		gBatchEstimate.framesPerSecondHigh = gBatchEstimate.secondsLow > 0 ? gBatchEstimate.frameCount / gBatchEstimate.secondsLow : 0;
+	}
+}
+
+
+// ______________________________________________________________________
+// DryRunMovie compresses the sample of theMovie with the compressor ci the way the frame loop would, and puts its
+// predictions into gMovieEstimate and the batch. The frames are rendered into theSrcGWorld and scaled with
+// theResampler (if there's one) into theCompressGWorld, theFrameRect is what is compressed of that.
+static OSErr DryRunMovie(ComponentInstance ci, const FSSpec *theMovieFile, Movie theMovie, GWorldPtr theSrcGWorld, const Rect *theSourceRect, 
+							QTUResampler theResampler, GWorldPtr theCompressGWorld, const Rect *theFrameRect, long theFrameCount)
+{
+	OSErr				anErr = noErr;
+	QTUTrackCatalog		*aCatalog;
+	QTUTrackInfo		*aTrackInfo;
+	ImageDescription	**anImageDescription;
+	long				aKeyInterval;
+	long				aRunFrames;
+	long				aStrataCount;
+	long				aStratum;
+	long				aWorkerCount = 1;
+	double				aBytesSum = 0, aBytesSquares = 0;
+	double				aTimeSum = 0, aTimeSquares = 0;
+	double				aBytesPerFrame, aBytesRange;
+	double				aFrameMicroseconds, aTimeRange;
+	double				aFixedBytes = 0;
+	double				aSetupMicroseconds = 0;
+	double				aWriteMicroseconds, aReadMicroseconds;
+	double				aByteMicroseconds = 0;
+	unsigned long		aSeed = 1;
+	
+	BlockZero(&gMovieEstimate, sizeof(gMovieEstimate));
+	gMovieEstimate.movies = 1;
+	gMovieEstimate.frameCount = theFrameCount;
+	gMovieEstimate.framesSampled = 0;
+	if(theFrameCount < 1)
+		return noErr;
+	
+	// What a run of frames stands for depends on how far the key frames are apart.
+	if(UseParallelIntraCompression())
+	{
+		aKeyInterval = 1;
+		aWorkerCount = gOptions.workerCount > 0 ? gOptions.workerCount : QTUCountProcessors();
+	}
+	else if(gOptions.sceneCutKeyFrames && gOptions.maxKeyFrameInterval > 0)
+		aKeyInterval = gOptions.maxKeyFrameInterval;
+	else
+		aKeyInterval = gTemporalSettings.keyFrameRate;
+	if(aKeyInterval <= 0 || aKeyInterval > theFrameCount)
+		aKeyInterval = theFrameCount;
+	
+	aRunFrames = aKeyInterval < kDryRunRunFrames ? aKeyInterval : kDryRunRunFrames;
+	aStrataCount = (long)(gOptions.dryRunPercent / 100.0 * theFrameCount / aRunFrames + 0.5);
+	if(aStrataCount < 2)
+		aStrataCount = 2;
+	if(aStrataCount > theFrameCount / aRunFrames)
+		aStrataCount = theFrameCount / aRunFrames;
+	if(aStrataCount < 1)
+	{
+		aStrataCount = 1;
+		aRunFrames = theFrameCount;
+	}
+	
+	SetMovieGWorld(theMovie, theSrcGWorld, GetGWorldDevice(theSrcGWorld));
+	
+	for(aStratum = 0; aStratum < aStrataCount; aStratum++)
+	{
+		long			aStratumFrames = theFrameCount / aStrataCount;
+		long			aFrameNum = aStratum * aStratumFrames;
+		long			anIndex;
+		double			aKeyBytes = 0, aDifferenceBytes = 0;
+		double			aRenderMicroseconds = 0, aCompressMicroseconds = 0;
+		double			aStratumBytes, aStratumTime;
+		TimeValue		aMovieTime;
+		TimeValue		aDuration;
+		EventRecord 	anEvent;
+		UnsignedWide	aSetupTimer;
+		
+		if(EventAvail(keyDownMask | mDownMask, &anEvent))
+			return userCanceledErr;
+		
+		// A random start within the stratum, the same one every time for the same movie.
+		aSeed = aSeed * 1103515245 + 12345;
+		if(aStratumFrames > aRunFrames)
+			aFrameNum += (aSeed >> 16) % (aStratumFrames - aRunFrames + 1);
+		
+		aMovieTime = (TimeValue)((double)aFrameNum * GetMovieDuration(theMovie) / theFrameCount);
+		if(aMovieTime > 0)
+			aMovieTime--;
+		
+		QTUStartTimer(&aSetupTimer);
+		anErr = SCCompressSequenceBegin(ci, GetGWorldPixMap(theCompressGWorld), theFrameRect, &anImageDescription); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+		if(aStratum == 0)
+			aSetupMicroseconds = QTUElapsedMicroseconds(&aSetupTimer);		// the movie has one sequence
+		
+		for(anIndex = 0; anIndex < aRunFrames; anIndex++)
+		{
+			UnsignedWide	aTimer;
+			Handle			aCompressedData;
+			long			aDataSize;
+			short			aSyncFlag;
+			
+			QTUStartTimer(&aTimer);
+			GetNextSourceFrame(theMovie, aFrameNum + anIndex, theFrameCount, &aMovieTime, &aDuration);
+			if(theResampler)
+				anErr = ScaleSourceFrame(theResampler, theSrcGWorld, theSourceRect, theCompressGWorld, theFrameRect);
+			aRenderMicroseconds += QTUElapsedMicroseconds(&aTimer);
+			
+			QTUStartTimer(&aTimer);
+			if(anErr == noErr)
+				anErr = SCCompressSequenceFrame(ci, GetGWorldPixMap(theCompressGWorld), theFrameRect, &aCompressedData, &aDataSize, &aSyncFlag);
+			DebugAssert(anErr == noErr);
+			if(anErr != noErr) break;
+			aCompressMicroseconds += QTUElapsedMicroseconds(&aTimer);
+			
+			if(anIndex == 0)
+				aKeyBytes = aDataSize;
+			else
+				aDifferenceBytes += aDataSize;
+		}
+		SCCompressSequenceEnd(ci);
+		if(anErr != noErr) return anErr;
+		
+		// A GOP is a key frame and aKeyInterval - 1 difference frames, the run tells what either costs.
+		if(aRunFrames > 1)
+			aStratumBytes = (aKeyBytes + (aKeyInterval - 1) * aDifferenceBytes / (aRunFrames - 1)) / aKeyInterval;
+		else
+			aStratumBytes = aKeyBytes;
+		aStratumTime = (aRenderMicroseconds + aCompressMicroseconds / aWorkerCount) / aRunFrames;
+		
+		aBytesSum += aStratumBytes;
+		aBytesSquares += aStratumBytes * aStratumBytes;
+		aTimeSum += aStratumTime;
+		aTimeSquares += aStratumTime * aStratumTime;
+		gMovieEstimate.framesSampled += aRunFrames;
+	}
+	
+	// The sound is copied as it is, and every frame takes its sample table entry.
+	if(QTUGetTrackCatalog(theMovie, &aCatalog) == noErr)
+	{
+		long index;
+		
+		for(index = 1; (aTrackInfo = QTUFindTrackInfo(aCatalog, SoundMediaType, index)) != NULL; index++)
+			aFixedBytes += aTrackInfo->dataSize;
+	}
+	aFixedBytes += (double)theFrameCount * kSampleTableEntryBytes;
+	
+	aBytesPerFrame = aBytesSum / aStrataCount;
+	aBytesRange = GetConfidenceRange(aBytesSum, aBytesSquares, aStrataCount) * theFrameCount;
+	gMovieEstimate.outputBytes = aFixedBytes + aBytesPerFrame * theFrameCount;
+	gMovieEstimate.outputBytesLow = gMovieEstimate.outputBytes - aBytesRange;
+	gMovieEstimate.outputBytesHigh = gMovieEstimate.outputBytes + aBytesRange;
+	if(gMovieEstimate.outputBytesLow < aFixedBytes)
+		gMovieEstimate.outputBytesLow = aFixedBytes;
+	
+	aFrameMicroseconds = aTimeSum / aStrataCount;
+	aTimeRange = GetConfidenceRange(aTimeSum, aTimeSquares, aStrataCount);
+	gMovieEstimate.seconds = aFrameMicroseconds * theFrameCount / 1000000.0;
+	gMovieEstimate.secondsLow = (aFrameMicroseconds > aTimeRange ? aFrameMicroseconds - aTimeRange : 0) * theFrameCount / 1000000.0;
+	gMovieEstimate.secondsHigh = (aFrameMicroseconds + aTimeRange) * theFrameCount / 1000000.0;
+	gMovieEstimate.framesPerSecond = aFrameMicroseconds > 0 ? 1000000.0 / aFrameMicroseconds : 0;
+	gMovieEstimate.framesPerSecondLow = 1000000.0 / (aFrameMicroseconds + aTimeRange);
+	gMovieEstimate.framesPerSecondHigh = aFrameMicroseconds > aTimeRange ? 1000000.0 / (aFrameMicroseconds - aTimeRange) : 0;
+	
+	// Every byte of the output is written once with the samples (the sound when it's copied), and QTUFlattenMovieFile
+	// reads it and writes it again. Without the probe the time is the frames only.
+	if(MeasureFileMicroseconds(theMovieFile, &aWriteMicroseconds, &aReadMicroseconds) == noErr)
+		aByteMicroseconds = 2 * aWriteMicroseconds + aReadMicroseconds;
+	gMovieEstimate.seconds += (aSetupMicroseconds + aByteMicroseconds * gMovieEstimate.outputBytes) / 1000000.0;
+	gMovieEstimate.secondsLow += (aSetupMicroseconds + aByteMicroseconds * gMovieEstimate.outputBytesLow) / 1000000.0;
+	gMovieEstimate.secondsHigh += (aSetupMicroseconds + aByteMicroseconds * gMovieEstimate.outputBytesHigh) / 1000000.0;
+	
+	AddToBatchEstimate(&gMovieEstimate);
+	WriteEstimateLine(theMovieFile, theMovieFile->name, &gMovieEstimate);
+	
+	return noErr;
+}
+
+
+// ______________________________________________________________________
+// GetRecompressOutputEstimates returns the estimate of the last dry run and of the batch so far, either could be NULL.
+pascal void GetRecompressOutputEstimates(RecompressOutputEstimate *theMovieEstimate, RecompressOutputEstimate *theBatchEstimate)
+{
+	if(theMovieEstimate) *theMovieEstimate = gMovieEstimate;
+	if(theBatchEstimate) *theBatchEstimate = gBatchEstimate;
+}
+
+
+// ______________________________________________________________________
+// FinishRecompressEstimates writes the batch into the estimate file and closes it, the next dry run starts a new batch.
+pascal void FinishRecompressEstimates(void)
+{
+	if(gBatchEstimate.movies > 0)
+		WriteEstimateLine(NULL, "\pbatch", &gBatchEstimate);
+	
+	if(gEstimateFileRefNum) FSClose(gEstimateFileRefNum);
+	gEstimateFileRefNum = 0;
+	
+	BlockZero(&gBatchEstimate, sizeof(gBatchEstimate));
+}
+
+
+// ______________________________________________________________________
+// NewDestinationMovie creates the movie file for the compressed frames, with a video track of the size of the frames
+// and its media ready for adding samples.
+static OSErr NewDestinationMovie(Movie theSourceMovie, FSSpec *theFile, const Rect *theFrameRect, TimeScale theTimeScale, short *theMovieRefNum,
+									Movie *theMovie, Track *theTrack, Media *theMedia, QTUSampleWriter *theWriter)
+{
+	OSErr			anErr = noErr;
+	MatrixRecord	aMatrix;
+	
+	// Create a movie file.
+	anErr = CreateMovieFile(theFile, 'TVOD', 0, createMovieFileDeleteCurFile, theMovieRefNum, theMovie); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	
+	// Create a new video movie track with the dimensions of the frames we compress (the entire source movie if
+	// we don't scale or crop).
+	*theTrack = NewMovieTrack(*theMovie, (long)(theFrameRect->right - theFrameRect->left) << 16, (long)(theFrameRect->bottom - theFrameRect->top) << 16, 0);
+	
+	// Create a media for the new track with the same time scale as the source movie. If the time scales are the same,
+	// we don't need to adjust the time scales with scale conversions.
+	*theMedia = NewTrackMedia(*theTrack, VIDEO_TYPE, theTimeScale, 0, 0);
+	anErr = GetMoviesError();DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	
+	// Copy the user data and settings from the source to the destination movie, if there is one.
+	if(theSourceMovie)
+		CopyMovieSettings(theSourceMovie, *theMovie);
+	
+	// Set the movie matrix to identity and clear the movie clip region so that conversion process transforms and composites
+	// *all* video tracks into one untransformed video track.
+	SetIdentityMatrix(&aMatrix);
+	SetMovieMatrix(*theMovie, &aMatrix);
+	SetMovieClipRgn(*theMovie, NULL);
+	
+	// Prepare for adding frames to the movie.
+	anErr = BeginMediaEdits(*theMedia); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	
+	// Collect the compressed frames into chunks, so they are written with one write and one sample table update
+	// per chunk instead of per frame.
+	if(gOptions.batchSampleWrites)
+	{
+		anErr = QTUNewSampleWriter(*theMedia, theTimeScale * gOptions.chunkMilliseconds / 1000,
+											gOptions.chunkBytes, theWriter); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+		
+		// The frame loop goes on compressing while the chunks are written, it only waits for the disk when it got 
+		// writesInFlight chunks ahead.
+		anErr = QTUSampleWriterSetWriteBehind(*theWriter, gOptions.writesInFlight); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+	}
+	
+	return noErr;
+}
+
+
+// ______________________________________________________________________
+// FRAGMENTED OUTPUT
+// With fragmentSeconds set the output is cut into numbered movie files of about that duration, each one flattened and
+// complete as soon as the next one starts. Every fragment starts with a key frame and has the sound of its time span, 
+// so it plays on its own, and the sample tables in memory never get longer than one fragment.
+
+// ______________________________________________________________________
+// GetFragmentFile returns the file for a fragment, the name of the movie with the number of the fragment and a '*'.
+// The numbers have leading zeroes, as many digits as theFragmentCount (at least three) so the files sort in order.
+static OSErr GetFragmentFile(const FSSpec *theMovieFile, long theFragmentNum, long theFragmentCount, FSSpec *theFile)
+{
+	OSErr	anErr;
+	Str255	aFileName;
+	Str255	aNumber;
+	Str255	aDigits;
+	short	aNameLength = theMovieFile->name[0];
+	short	aWidth = 3;
+	long	aLimit = 1000;
+	
+	while(aLimit <= theFragmentCount && aWidth < 9)
+	{
+		aLimit *= 10;
+		aWidth++;
+	}
+	if(theFragmentNum < 1 || theFragmentNum >= aLimit)
+		return paramErr;								// would give two fragments the same name
+	
+	NumToString(theFragmentNum, aDigits);
+	aNumber[0] = 1 + aWidth;
+	aNumber[1] = ' ';
+	BlockMoveData("000000000", aNumber + 2, aWidth - aDigits[0]);
+	BlockMoveData(aDigits + 1, aNumber + 2 + aWidth - aDigits[0], aDigits[0]);
+	
+	if(aNameLength + aNumber[0] + 1 > 31)
+		aNameLength = 31 - aNumber[0] - 1;
+	BlockMoveData(theMovieFile->name + 1, aFileName + 1, aNameLength);
+	BlockMoveData(aNumber + 1, aFileName + 1 + aNameLength, aNumber[0]);
+	aFileName[0] = aNameLength + aNumber[0];
+	aFileName[++aFileName[0]] = '*';
+	
+	anErr = FSMakeFSSpec(theMovieFile->vRefNum, theMovieFile->parID, aFileName, theFile);
+	if(anErr == fnfErr)
+		anErr = noErr;
+	
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// FinishFragment writes the last chunk of a fragment, adds the sound of its time span and flattens it into its file. 
+// The fragment movie and its writer are disposed in any case.
+static OSErr FinishFragment(Movie theSourceMovie, TimeValue theStartTime, TimeValue theDuration, short theMovieRefNum, Movie theMovie,
+								Track theTrack, Media theMedia, QTUSampleWriter theWriter, FSSpec *theFile)
+{
+	OSErr	anErr = noErr;
+	short	resID = 128;
+	
+	anErr = FinishSampleWriter(theWriter);
+	
+	if(anErr == noErr)
+	{
+		anErr = QTUCopySoundTrackSegments(theSourceMovie, theMovie, theStartTime, theDuration); DebugAssert(anErr == noErr);
+	}
+	
+	if(anErr == noErr)
+	{
+		anErr = EndMediaEdits(theMedia); DebugAssert(anErr == noErr);
+	}
+	
+	if(anErr == noErr)
+	{
+		InsertMediaIntoTrack(theTrack, 0, 0, GetMediaDuration(theMedia), fixed1);
+		anErr = AddMovieResource(theMovie, theMovieRefNum, &resID, "\pMovie 1"); DebugAssert(anErr == noErr);
+	}
+	
+	CloseMovieFile(theMovieRefNum);
+	
+	if(anErr == noErr)
+		anErr = QTUFlattenAndDisposeMovie(&theMovie, theFile);
+	
+	if(theMovie) DisposeMovie(theMovie);
+	
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// RENDITIONS
+// With profiles set, every movie is compressed into one output file per profile in a single pass over the source.
+// Each rendered frame is copied into a ring shared by all renditions, and while the main thread renders the next
+// frame the worker pool scales and compresses the current one for every rendition. A rendition is a compression 
+// sequence of its own, so it only gets the next frame once its last one has been appended.
+#define kRenditionRingSize		2
+
+typedef struct Rendition {
+	ComponentInstance		compressor;
+	FSSpec					file;
+	short					movieRefNum;
+	Movie					movie;
+	Track					track;
+	Media					media;
+	QTUSampleWriter			writer;
+	QTUResampler			resampler;			// NULL if the rendition has the size of the source rect
+	GWorldPtr				scaledGWorld;
+	Rect					bounds;				// size of the rendition, at 0,0
+	ImageDescriptionHandle	imageDescription;	// belongs to the compression sequence
+	Boolean					sequenceStarted;
+	Boolean					onMainThread;		// the codec failed on a worker, compress on the main thread from now on
+	
+	// The frame the rendition is working on.
+	GWorldPtr				frameGWorld;
+	const Rect				*frameRect;
+	TimeValue				duration;
+	Handle					compressedData;		// belongs to the compression sequence
+	long					compressedDataSize;
+	short					syncFlag;
+	Boolean					framePending;		// compressed, but not appended yet
+} Rendition;
+
+
+// ______________________________________________________________________
+// CompressRenditionFrame is the work function for one rendition of a frame, it runs on a worker or the main thread.
+// It calls the Standard Compression component, so it only goes to a worker of a QTUNewMoviesWorkerPool.
+static OSStatus CompressRenditionFrame(void *theWorkItem)
+{
+	Rendition	*aRendition = (Rendition *)theWorkItem;
+	GWorldPtr	aGWorld = aRendition->frameGWorld;
+	const Rect	*aRect = aRendition->frameRect;
+	OSErr		anErr;
+	
+	if(aRendition->resampler)
+	{
+		anErr = QTUResamplePixMap(aRendition->resampler, GetGWorldPixMap(aGWorld), aRect, GetGWorldPixMap(aRendition->scaledGWorld),
+										&aRendition->bounds);
+		if(anErr != noErr) return anErr;
+		
+		aGWorld = aRendition->scaledGWorld;
+		aRect = &aRendition->bounds;
+	}
+	
+	return SCCompressSequenceFrame(aRendition->compressor, GetGWorldPixMap(aGWorld), aRect, &aRendition->compressedData, 
+										&aRendition->compressedDataSize, &aRendition->syncFlag);
+}
+
+
+// ______________________________________________________________________
+// OpenRendition creates the output file of a profile, with its video track, and starts its compression sequence. The
+// file is named like the output of a single rendition, with the suffix of the profile before the '*'.
+static OSErr OpenRendition(Rendition *theRendition, const RecompressProfile *theProfile, const FSSpec *theMovieFile, Movie theSourceMovie,
+								GWorldPtr theSrcGWorld, const Rect *theSourceRect, long theBandCount)
+{
+	OSErr				anErr = noErr;
+	SCSpatialSettings	aSpatialSettings = gSpatialSettings;
+	SCDataRateSettings	aDataRateSettings = aDataRateSetting;
+	GWorldPtr			aGWorld = theSrcGWorld;
+	const Rect			*aRect = theSourceRect;
+	Str255				aFileName;
+	short				aNameLength;
+	long				aFlags;
+	
+	theRendition->compressor = OpenDefaultComponent(StandardCompressionType, StandardCompressionSubType); DebugAssert(theRendition->compressor != NULL);
+	if(theRendition->compressor == NULL) return couldntGetRequiredComponent;
+	
+	SCGetInfo(theRendition->compressor, scPreferenceFlagsType, &aFlags);
+	aFlags &= ~scShowBestDepth;
+	aFlags |= scAllowZeroFrameRate;
+	SCSetInfo(theRendition->compressor, scPreferenceFlagsType, &aFlags);
+	
+	// The settings from the dialog, with the quality and the data rate of the profile.
+	if(theProfile->spatialQuality)
+		aSpatialSettings.spatialQuality = theProfile->spatialQuality;
+	if(theProfile->dataRate)
+		aDataRateSettings.dataRate = theProfile->dataRate;
+	
+	anErr = SCSetInfo(theRendition->compressor, scTemporalSettingsType, &gTemporalSettings); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	anErr = SCSetInfo(theRendition->compressor, scSpatialSettingsType, &aSpatialSettings); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	anErr = SCSetInfo(theRendition->compressor, scDataRateSettingsType, &aDataRateSettings); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	
+	// Keep the name within 31 characters, the suffix and the '*' win over the end of the movie name.
+	aNameLength = theMovieFile->name[0];
+	if(aNameLength + theProfile->suffix[0] + 1 > 31)
+		aNameLength = 31 - theProfile->suffix[0] - 1;
+	BlockMoveData(theMovieFile->name + 1, aFileName + 1, aNameLength);
+	BlockMoveData(theProfile->suffix + 1, aFileName + 1 + aNameLength, theProfile->suffix[0]);
+	aFileName[0] = aNameLength + theProfile->suffix[0];
+	aFileName[++aFileName[0]] = '*';
+	
+	anErr = FSMakeFSSpec(theMovieFile->vRefNum, theMovieFile->parID, aFileName, &theRendition->file);
+	if(anErr != noErr && anErr != fnfErr) return anErr;
+	
+	// Renditions of another size than the source rect scale the shared frame into a GWorld of their own.
+	if(GetOutputRect(theSourceRect, theProfile->width, theProfile->height, &theRendition->bounds))
+	{
+		anErr = QTUNewResampler(theSourceRect->right - theSourceRect->left, theSourceRect->bottom - theSourceRect->top,
+									theRendition->bounds.right, theRendition->bounds.bottom, gOptions.scaleFilter, theBandCount,
+									&theRendition->resampler); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+		
+		anErr = AcquireFrameGWorld(&theRendition->bounds, 32, NULL, &theRendition->scaledGWorld); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+		
+		aGWorld = theRendition->scaledGWorld;
+		aRect = &theRendition->bounds;
+	}
+	
+	anErr = NewDestinationMovie(theSourceMovie, &theRendition->file, &theRendition->bounds, GetMovieTimeScale(theSourceMovie),
+									&theRendition->movieRefNum, &theRendition->movie, &theRendition->track, &theRendition->media,
+									&theRendition->writer);
+	if(anErr != noErr) return anErr;
+	
+	anErr = SCCompressSequenceBegin(theRendition->compressor, GetGWorldPixMap(aGWorld), aRect, &theRendition->imageDescription);
+	DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	theRendition->sequenceStarted = true;
+	
+	return noErr;
+}
+
+
+// ______________________________________________________________________
+// FinishRendition ends the compression sequence of a rendition, adds the sound tracks and flattens its movie file.
+static OSErr FinishRendition(Rendition *theRendition, Movie theSourceMovie)
+{
+	OSErr	anErr = noErr;
+	short	resID = 128;
+	
+	// The last chunk of frames uses the image description, write it before the description goes away.
+	if(theRendition->writer)
+	{
+		anErr = QTUSampleWriterFlush(theRendition->writer); DebugAssert(anErr == noErr);
+	}
+	SCCompressSequenceEnd(theRendition->compressor);
+	theRendition->sequenceStarted = false;
+	if(anErr != noErr) return anErr;
+	
+	anErr = FinishSampleWriter(theRendition->writer);  theRendition->writer = NULL;
+	if(anErr != noErr) return anErr;
+	
+	anErr = QTUCopySoundTracks(theSourceMovie, theRendition->movie); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	
+	anErr = EndMediaEdits(theRendition->media); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	
+	InsertMediaIntoTrack(theRendition->track, 0, 0, GetMediaDuration(theRendition->media), fixed1);
+	
+	anErr = AddMovieResource(theRendition->movie, theRendition->movieRefNum, &resID, "\pMovie 1"); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	
+	CloseMovieFile(theRendition->movieRefNum);
+	theRendition->movieRefNum = 0;
+	
+	return QTUFlattenAndDisposeMovie(&theRendition->movie, &theRendition->file);
+}
+
+
+// ______________________________________________________________________
+// CloseRendition disposes whatever a rendition still has, after FinishRendition or after an error.
+static void CloseRendition(Rendition *theRendition)
+{
+	if(theRendition->sequenceStarted) SCCompressSequenceEnd(theRendition->compressor);
+	if(theRendition->writer) QTUDisposeSampleWriter(theRendition->writer);
+	if(theRendition->movieRefNum) CloseMovieFile(theRendition->movieRefNum);
+	if(theRendition->movie) DisposeMovie(theRendition->movie);
+	if(theRendition->resampler) QTUDisposeResampler(theRendition->resampler);
+	ReleaseFrameGWorld(theRendition->scaledGWorld);
+	if(theRendition->compressor) CloseComponent(theRendition->compressor);
+}
+
+
+// ______________________________________________________________________
+// AppendRenditionFrames waits until every rendition is done with the frame in flight, and appends the compressed
+// frames to their media. A rendition a worker could not compress is compressed again on the main thread.
+static OSErr AppendRenditionFrames(Rendition *theRenditions, short theCount, QTUWorkerPool thePool, long *theOutstandingCount)
+{
+	OSErr	anErr = noErr;
+	short	index;
+	
+	while(*theOutstandingCount > 0)
+	{
+		Rendition	*aRendition;
+		OSStatus	aResult;
+		
+		anErr = QTUWorkerPoolWaitForItem(thePool, (void **)&aRendition, &aResult); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+		
+		(*theOutstandingCount)--;
+		if(aResult != noErr)
+		{
+			aRendition->onMainThread = true;
+			aResult = CompressRenditionFrame(aRendition); DebugAssert(aResult == noErr);
+			if(aResult != noErr)
+			{
+				aRendition->framePending = false;
+				anErr = aResult;
+			}
+		}
+	}
+	if(anErr != noErr) return anErr;
+	
+	for(index = 0; index < theCount; index++)
+	{
+		Rendition *aRendition = &theRenditions[index];
+		
+		if(!aRendition->framePending)
+			continue;
+		aRendition->framePending = false;
+		
+		anErr = AppendCompressedFrame(aRendition->writer, aRendition->media, aRendition->compressedData, *aRendition->compressedData,
+											aRendition->compressedDataSize, aRendition->duration, 
+											(SampleDescriptionHandle)aRendition->imageDescription, aRendition->syncFlag);
+		if(anErr != noErr) return anErr;
+	}
+	
+	return noErr;
+}
+
+
+// ______________________________________________________________________
+// RecompressRenditions is the frame loop used when profiles are set. The source movie is rendered only once, every
+// frame goes into the next slot of the shared ring and is then handed to all the renditions.
+static OSErr RecompressRenditions(const FSSpec *theMovieFile, Movie theSourceMovie, GWorldPtr theSrcGWorld, const Rect *theSourceRect,
+										long theFrameCount)
+{
+	OSErr			anErr = noErr;
+	Rendition		*aRenditions = NULL;
+	GWorldPtr		aRing[kRenditionRingSize] = { NULL, NULL };
+	QTUWorkerPool	aPool = NULL;
+	long			aWorkerCount = gOptions.workerCount > 0 ? gOptions.workerCount : QTUCountProcessors();
+	long			anOutstandingCount = 0;
+	long			aFrameNum;
+	TimeValue		currentMovieTime = 0;
+	short			index;
+	
+	aRenditions = (Rendition *)NewPtrClear(gProfileCount * sizeof(Rendition)); DebugAssert(aRenditions != NULL);
+	if(aRenditions == NULL) return memFullErr;
+	
+	// With workers the renditions run side by side, each scaling in one band. Without, every scaler has the processors.
+	// Where the Movie Toolbox isn't thread safe there's no pool, and the renditions are compressed on the main thread.
+	if(aWorkerCount > 1)
+	{
+		anErr = QTUNewMoviesWorkerPool(gOptions.workerCount, &aPool);
+		if(anErr != noErr) aPool = NULL;
+	}
+	
+	for(index = 0; index < gProfileCount; index++)
+	{
+		anErr = OpenRendition(&aRenditions[index], &gProfiles[index], theMovieFile, theSourceMovie, theSrcGWorld, theSourceRect,
+									aPool ? 1 : aWorkerCount);
+		if(anErr != noErr) goto Closure;
+	}
+	
+	for(index = 0; index < kRenditionRingSize; index++)
+	{
+		anErr = AcquireFrameGWorld(theSourceRect, 32, NULL, &aRing[index]); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+	}
+	
+	SetMovieGWorld(theSourceMovie, theSrcGWorld, GetGWorldDevice(theSrcGWorld));
+	
+	for(aFrameNum = 0; aFrameNum < theFrameCount; aFrameNum++)
+	{
+		EventRecord		anEvent;
+		GWorldPtr		aSlot = aRing[aFrameNum % kRenditionRingSize];
+		TimeValue		duration;
+		
+		// Abort if the end user clicked the mouse or pressed a key.
+		if(EventAvail(keyDownMask | mDownMask, &anEvent))
+		{
+			anErr = userCanceledErr;
+			goto Closure;
+		}
+		
+		// The workers are still on the previous frame, in the other slot of the ring.
+		GetNextSourceFrame(theSourceMovie, aFrameNum, theFrameCount, &currentMovieTime, &duration);
+		CopyBits((BitMap *)*GetGWorldPixMap(theSrcGWorld), (BitMap *)*GetGWorldPixMap(aSlot), theSourceRect, theSourceRect, srcCopy, NULL);
+		
+		anErr = AppendRenditionFrames(aRenditions, gProfileCount, aPool, &anOutstandingCount);
+		if(anErr != noErr) goto Closure;
+		
+		for(index = 0; index < gProfileCount; index++)
+		{
+			Rendition			*aRendition = &aRenditions[index];
+			SCDataRateSettings	aDataRateSettings;
+			
+			// Data rate control wants the duration of every frame in milliseconds.
+			if(!SCGetInfo(aRendition->compressor, scDataRateSettingsType, &aDataRateSettings))
+			{
+				aDataRateSettings.frameDuration = duration * 1000 / GetMovieTimeScale(theSourceMovie);
+				SCSetInfo(aRendition->compressor, scDataRateSettingsType, &aDataRateSettings);
+			}
+			
+			aRendition->frameGWorld = aSlot;
+			aRendition->frameRect = theSourceRect;
+			aRendition->duration = duration;
+			aRendition->framePending = true;
+			
+			if(aPool && !aRendition->onMainThread)
+			{
+				anErr = QTUWorkerPoolSubmit(aPool, CompressRenditionFrame, aRendition); DebugAssert(anErr == noErr);
+				if(anErr != noErr) goto Closure;
+				anOutstandingCount++;
+			}
+			else
+			{
+				anErr = CompressRenditionFrame(aRendition); DebugAssert(anErr == noErr);
+				if(anErr != noErr) { aRendition->framePending = false; goto Closure; }
+			}
+		}
+	}
+	
+	// Append the last frame and close the files.
+	anErr = AppendRenditionFrames(aRenditions, gProfileCount, aPool, &anOutstandingCount);
+	if(anErr != noErr) goto Closure;
+	
+	for(index = 0; index < gProfileCount; index++)
+	{
+		anErr = FinishRendition(&aRenditions[index], theSourceMovie);
+		if(anErr != noErr) goto Closure;
+	}
+	gStatistics.renditionsWritten = gProfileCount;
+
+Closure:
+	// Wait for the renditions still being compressed before we pull the ring away from the workers.
+	while(anOutstandingCount > 0)
+	{
+		void		*unused;
+		OSStatus	aResult;
+		
+		if(QTUWorkerPoolWaitForItem(aPool, &unused, &aResult) != noErr)
+			break;
+		anOutstandingCount--;
+	}
+	if(aPool) QTUDisposeWorkerPool(aPool);
+	
+	for(index = 0; index < gProfileCount; index++)
+		CloseRendition(&aRenditions[index]);
+	DisposePtr((Ptr)aRenditions);
+	
+	for(index = 0; index < kRenditionRingSize; index++)
+		ReleaseFrameGWorld(aRing[index]);
+	
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// SMART RENDER
+// A movie that is already compressed with the codec we compress to, and that was only trimmed or edited a little, 
+// does not need to have every frame compressed again. Smart render walks the edits of the video track, and copies
+// every GOP (a key frame and the frames depending on it) that an edit uses completely as it is. Only the frames of
+// GOPs cut by an edit are rendered and compressed again, starting with a forced key frame.
+
+// ______________________________________________________________________
+// GetLongestGOP returns the most samples of the media from one key frame up to the next one, 1 if every sample is a
+// key frame.
+static long GetLongestGOP(Media theMedia)
+{
+	long		aSampleCount = GetMediaSampleCount(theMedia);
+	long		aKeyFrameNum = 1;
+	long		aLongest = 1;
+	TimeValue	aMediaTime = 0;
+	short		aFlags = nextTimeSyncSample | nextTimeEdgeOK;
+	
+	for(;;)
+	{
+		TimeValue	aSyncTime = -1;
+		long		aSampleNum = aSampleCount + 1;		// the end of the last GOP
+		
+		GetMediaNextInterestingTime(theMedia, aFlags, aMediaTime, fixed1, &aSyncTime, NULL);
+		if(aSyncTime >= 0)
+			MediaTimeToSampleNum(theMedia, aSyncTime, &aSampleNum, NULL, NULL);
+		
+		if(aSampleNum - aKeyFrameNum > aLongest)
+			aLongest = aSampleNum - aKeyFrameNum;
+		if(aSyncTime < 0 || aSampleNum > aSampleCount)
+			return aLongest;
+		
+		aKeyFrameNum = aSampleNum;
+		aMediaTime = aSyncTime;
+		aFlags = nextTimeSyncSample;
+	}
+}
+
+
+// ______________________________________________________________________
+// GetSmartRenderTrack returns the video track of the movie if we could smart render it, NULL if not. This is the case
+// when there's only one video track, drawn untransformed at its natural size, compressed with the codec type, depth
+// and qualities picked in the standard compression dialog, with no GOP longer than the key frame rate, and the edits
+// play the media forward at the normal rate. The qualities count by what the codec wrote into the image description,
+// the temporal quality only if the source has frames that are not key frames. Data rate limits and frame rate changes
+// need all frames to be compressed again.
+static Track GetSmartRenderTrack(Movie theMovie, const Rect *theMovieRect)
+{
+	Track					aTrack;
+	Media					aMedia;
+	ImageDescriptionHandle	anImageDescription = NULL;
+	MatrixRecord			aMatrix;
+	TimeValue				aTrackTime = 0;
+	TimeValue				aTrackDuration;
+	long					aLongestGOP;
+	Boolean					isCompatible = false;
+	
+	if(!gOptions.smartRender || gOptions.fragmentSeconds > 0 || gTemporalSettings.frameRate != 0 || aDataRateSetting.dataRate != 0)
+		return NULL;
+	
+	aTrack = GetMovieIndTrackType(theMovie, 1, VideoMediaType, movieTrackMediaType);
+	if(aTrack == NULL || GetMovieIndTrackType(theMovie, 2, VideoMediaType, movieTrackMediaType) != NULL)
+		return NULL;
+	
+	GetMovieMatrix(theMovie, &aMatrix);
+	if(GetMatrixType(&aMatrix) != identityMatrixType) return NULL;
+	GetTrackMatrix(aTrack, &aMatrix);
+	if(GetMatrixType(&aMatrix) != identityMatrixType) return NULL;
+	
+	aMedia = GetTrackMedia(aTrack);
+	if(aMedia == NULL || GetMediaSampleDescriptionCount(aMedia) != 1)
+		return NULL;
+	
+	aLongestGOP = GetLongestGOP(aMedia);
+	if(gTemporalSettings.keyFrameRate > 0 && aLongestGOP > gTemporalSettings.keyFrameRate)
+		return NULL;
+	
+	anImageDescription = (ImageDescriptionHandle)NewHandle(0); DebugAssert(anImageDescription != NULL);
+	if(anImageDescription == NULL) return NULL;
+	
+	GetMediaSampleDescription(aMedia, 1, (SampleDescriptionHandle)anImageDescription);
+	if(GetMoviesError() == noErr)
+	{
+		isCompatible = (**anImageDescription).cType == gSpatialSettings.codecType &&
+						(**anImageDescription).width == theMovieRect->right - theMovieRect->left &&
+						(**anImageDescription).height == theMovieRect->bottom - theMovieRect->top &&
+						(gSpatialSettings.depth == 0 || (**anImageDescription).depth == gSpatialSettings.depth) &&
+						(**anImageDescription).spatialQuality == gSpatialSettings.spatialQuality &&
+						(aLongestGOP == 1 || (**anImageDescription).temporalQuality == gTemporalSettings.temporalQuality);
+	}
+	DisposeHandle((Handle)anImageDescription);
+	
+	// Every edit has to play media at the normal rate, empty edits are not handled.
+	aTrackDuration = GetTrackDuration(aTrack);
+	while(isCompatible && aTrackTime < aTrackDuration)
+	{
+		TimeValue anEditDuration;
+		
+		GetTrackNextInterestingTime(aTrack, nextTimeTrackEdit | nextTimeEdgeOK, aTrackTime, fixed1, NULL, &anEditDuration);
+		if(anEditDuration <= 0 || TrackTimeToMediaTime(aTrackTime, aTrack) == -1 || GetTrackEditRate(aTrack, aTrackTime) != fixed1)
+			isCompatible = false;
+		
+		aTrackTime += anEditDuration;
+	}
+	
+	return isCompatible ? aTrack : NULL;
+}
+
+
+// ______________________________________________________________________
+// CopyMediaRange appends the compressed samples of the source media from theStartTime up to theEndTime to the 
+// destination media as they are, theStartTime has to be a sync sample.
+static OSErr CopyMediaRange(Media theSourceMedia, TimeValue theStartTime, TimeValue theEndTime, Media theDestinationMedia,
+								QTUSampleWriter theWriter, Handle theSampleData, SampleDescriptionHandle theDescription, long *theDescriptionIndex)
+{
+	OSErr		anErr = noErr;
+	TimeValue	aMediaTime = theStartTime;
+	
+	while(aMediaTime < theEndTime)
+	{
+		long		aSampleSize;
+		long		aDescriptionIndex;
+		TimeValue	aSampleTime;
+		TimeValue	aSampleDuration;
+		short		aSampleFlags;
+		
+		anErr = GetMediaSample(theSourceMedia, theSampleData, 0, &aSampleSize, aMediaTime, &aSampleTime, &aSampleDuration,
+									NULL, &aDescriptionIndex, 1, NULL, &aSampleFlags); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+		DebugAssert(aSampleTime == aMediaTime);
+		
+		// The sample writer tells sample descriptions apart by handle, so write what it has before the description
+		// handle gets new contents.
+		if(aDescriptionIndex != *theDescriptionIndex)
+		{
+			if(theWriter)
+			{
+				anErr = QTUSampleWriterFlush(theWriter); DebugAssert(anErr == noErr);
+				if(anErr != noErr) return anErr;
+			}
+			
+			GetMediaSampleDescription(theSourceMedia, aDescriptionIndex, theDescription);
+			anErr = GetMoviesError(); DebugAssert(anErr == noErr);
+			if(anErr != noErr) return anErr;
+			
+			*theDescriptionIndex = aDescriptionIndex;
+		}
+		
+		HLock(theSampleData);
+		anErr = AppendCompressedFrame(theWriter, theDestinationMedia, theSampleData, *theSampleData, aSampleSize, aSampleDuration,
+											theDescription, aSampleFlags);
+		HUnlock(theSampleData);
+		if(anErr != noErr) return anErr;
+		
+		// AppendCompressedFrame counted the sample as a compressed frame.
+		gStatistics.framesCompressed--;
+		gStatistics.framesCopied++;
+		
+		aMediaTime += aSampleDuration;
+	}
+	
+	return noErr;
+}
+
+
+// ______________________________________________________________________
+// RecompressMediaRange renders the frames of the source media from theStartTime up to theEndTime and compresses them
+// with the standard compression sequence, the first frame is forced to be a key frame. theEditMediaTime is the media
+// time the edit (that starts at theEditTrackTime in the track) plays first.
+static OSErr RecompressMediaRange(ComponentInstance theCompressor, Movie theSourceMovie, GWorldPtr theSrcGWorld, const Rect *theMovieRect,
+									Media theSourceMedia, TimeValue theEditTrackTime, TimeValue theEditMediaTime,
+									TimeValue theStartTime, TimeValue theEndTime, Media theDestinationMedia, QTUSampleWriter theWriter,
+									ImageDescriptionHandle theImageDescription)
+{
+	OSErr		anErr = noErr;
+	TimeValue	aMediaTime = theStartTime;
+	double		aTimeScaleRatio = (double)GetMovieTimeScale(theSourceMovie) / (double)GetMediaTimeScale(theSourceMedia);
+	long		aForceKeyFrame = true;
+	
+	while(aMediaTime < theEndTime)
+	{
+		long		aSampleNum;
+		TimeValue	aSampleTime;
+		TimeValue	aSampleDuration;
+		TimeValue	aFrameEnd;
+		Handle		compressedData;
+		long		dataSize;
+		short		syncFlag;
+		
+		// The first frame of the range could start in the middle of a sample, the last one could end in the middle of one.
+		MediaTimeToSampleNum(theSourceMedia, aMediaTime, &aSampleNum, &aSampleTime, &aSampleDuration);
+		aFrameEnd = aSampleTime + aSampleDuration;
+		if(aFrameEnd > theEndTime || aSampleDuration <= 0)
+			aFrameEnd = theEndTime;
+		
+		RenderSourceFrame(theSourceMovie, theEditTrackTime + (TimeValue)((aMediaTime - theEditMediaTime) * aTimeScaleRatio));
+		
+		if(aForceKeyFrame)
+		{
+			SCSetInfo(theCompressor, scForceKeyValueType, &aForceKeyFrame);
+			aForceKeyFrame = false;
+		}
+		
+		anErr = SCCompressSequenceFrame(theCompressor, GetGWorldPixMap(theSrcGWorld), theMovieRect, &compressedData, &dataSize, &syncFlag);
+		DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+		
+		anErr = AppendCompressedFrame(theWriter, theDestinationMedia, compressedData, *compressedData, dataSize, aFrameEnd - aMediaTime,
+											(SampleDescriptionHandle)theImageDescription, syncFlag);
+		if(anErr != noErr) return anErr;
+		
+		aMediaTime = aFrameEnd;
+	}
+	
+	return noErr;
+}
+
+
+// ______________________________________________________________________
+// SmartRenderVideoTrack is the frame loop used for smart render. The destination media has the time scale of the source
+// media, so the copied samples keep their durations. For every edit of the track, the GOPs that are used completely
+// are copied and the rest is compressed again.
+static OSErr SmartRenderVideoTrack(ComponentInstance theCompressor, Movie theSourceMovie, GWorldPtr theSrcGWorld, const Rect *theMovieRect,
+									Track theSourceTrack, Media theDestinationMedia, QTUSampleWriter theWriter,
+									ImageDescriptionHandle theImageDescription, Boolean *theAbortFlag)
+{
+	OSErr					anErr = noErr;
+	Media					aSourceMedia = GetTrackMedia(theSourceTrack);
+	TimeValue				aMediaDuration = GetMediaDuration(aSourceMedia);
+	double					aTimeScaleRatio = (double)GetMediaTimeScale(aSourceMedia) / (double)GetMovieTimeScale(theSourceMovie);
+	TimeValue				aTrackTime = 0;
+	TimeValue				aTrackDuration = GetTrackDuration(theSourceTrack);
+	Handle					aSampleData = NULL;
+	SampleDescriptionHandle	aSampleDescription = NULL;
+	long					aDescriptionIndex = 0;
+	
+	*theAbortFlag = false;
+	
+	aSampleData = NewHandle(0); DebugAssert(aSampleData != NULL);
+	aSampleDescription = (SampleDescriptionHandle)NewHandle(0); DebugAssert(aSampleDescription != NULL);
+	if(aSampleData == NULL || aSampleDescription == NULL) { anErr = memFullErr; goto Closure; }
+	
+	while(aTrackTime < aTrackDuration)
+	{
+		TimeValue	anEditDuration;
+		TimeValue	anEditMediaStart;
+		TimeValue	anEditMediaEnd;
+		TimeValue	aMediaTime;
+		
+		GetTrackNextInterestingTime(theSourceTrack, nextTimeTrackEdit | nextTimeEdgeOK, aTrackTime, fixed1, NULL, &anEditDuration);
+		anEditMediaStart = TrackTimeToMediaTime(aTrackTime, theSourceTrack);
+		anEditMediaEnd = anEditMediaStart + (TimeValue)(anEditDuration * aTimeScaleRatio);
+		
+		aMediaTime = anEditMediaStart;
+		while(aMediaTime < anEditMediaEnd)
+		{
+			EventRecord		anEvent;
+			TimeValue		aGOPStart;
+			TimeValue		aGOPEnd;
+			TimeValue		aRangeEnd;
+			
+			// Abort if the end user clicked the mouse or pressed a key.
+			if(EventAvail(keyDownMask | mDownMask, &anEvent))
+			{
+				*theAbortFlag = true;
+				goto Closure;
+			}
+			
+			// The GOP aMediaTime is in starts with the sync sample at or before it, and ends with the next one.
+			GetMediaNextInterestingTime(aSourceMedia, nextTimeSyncSample | nextTimeEdgeOK, aMediaTime, -fixed1, &aGOPStart, NULL);
+			GetMediaNextInterestingTime(aSourceMedia, nextTimeSyncSample, aMediaTime, fixed1, &aGOPEnd, NULL);
+			if(aGOPEnd < 0)
+				aGOPEnd = aMediaDuration;
+			
+			aRangeEnd = (aGOPEnd < anEditMediaEnd) ? aGOPEnd : anEditMediaEnd;
+			
+			if(aGOPStart == aMediaTime && aGOPEnd <= anEditMediaEnd)
+			{
+				anErr = CopyMediaRange(aSourceMedia, aMediaTime, aRangeEnd, theDestinationMedia, theWriter,
+											aSampleData, aSampleDescription, &aDescriptionIndex);
+			}
+			else
+			{
+				anErr = RecompressMediaRange(theCompressor, theSourceMovie, theSrcGWorld, theMovieRect, aSourceMedia, aTrackTime,
+												anEditMediaStart, aMediaTime, aRangeEnd, theDestinationMedia, theWriter, theImageDescription);
+			}
+			if(anErr != noErr) goto Closure;
+			
+			aMediaTime = aRangeEnd;
+		}
+		
+		aTrackTime += anEditDuration;
+	}
+	
+Closure:
+	// Write the copied samples while their sample description is still around.
+	if(theWriter)
+		QTUSampleWriterFlush(theWriter);
+	
+	if(aSampleData) DisposeHandle(aSampleData);
+	if(aSampleDescription) DisposeHandle((Handle)aSampleDescription);
+	
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// RecompressMovieFile is a long and windy function, a lot of it is from the ConvertToMovie Jr. 
+// sample (SDK CDs). Many parts have been extracted into the DTSQTLibrary file. Anyway, 
+// this function could be taken out and implemented in other tools and parts as it's very much 
+// self-contained (if you add the DTSQTUtilities files to your project as well).
+
+pascal OSErr RecompressMovieFile(FSSpec* theMovieFile)
+{
+	OSErr 			anErr = noErr;
+	Boolean			abort;
+	
+	ComponentInstance 	ci = NULL;
+	
+	long				ciFlags;
+	long				nFrames;
+	long				aFrameNum;
+	TimeValue			currentMovieTime;
+
+	short				aMovieRefNum;
+	FSSpec 			newFileFSSpec;
+
+	Movie				aSourceMovie = NULL;
+	QTUTrackCatalog		*aCatalog;
+	Rect				 aMovieRect;
+	GWorldPtr			srcGWorld = NULL;
+	ImageDescription		**anImageDescription;
+	ImageSequence		anImageSequence = 0;
+	Boolean				useParallelIntraFrames;
+	Movie				aDestinationMovie = NULL;
+	Track				aDestinationTrack = NULL;
+	Media				aDestinationMedia = NULL;
+	QTUSampleWriter		aSampleWriter = NULL;
+	UInt32				aCacheKey[2];
+	Boolean				useOutputCache = false;
+	Track				aSmartRenderTrack = NULL;
+	TimeScale			aDestinationTimeScale;
+	Rect				aSourceRect;
+	Rect				aCompressRect;
+	Rect				aCompressSourceRect;
+	GWorldPtr			aCompressGWorld = NULL;
+	GWorldPtr			aScaledGWorld = NULL;
+	QTUResampler		aResampler = NULL;
+	TimeValue			aFragmentDuration = 0;
+	TimeValue			aFragmentStart = 0;
+	long				aFragmentCount = 1;
+	long				aFragmentTotal = 0;
+	Boolean				useSceneCuts = false;
+	SceneCutDetector	aSceneCuts;
+	Boolean				useSearchedQuality = false;
+	CodecQ				aDialogQuality = 0;
+	RecompressMemoryEstimate	aMemoryEstimate;
+	RecompressOptions	aCallerOptions = gOptions;		// FitRecompressJob may take some away for this movie
+	
+// if we use a window, the following variables are used
+	Point				where;
+	WindowRef			progressWindow = NULL;
+	
+	
+	BlockZero(&gStatistics, sizeof(gStatistics));
+	gStatistics.renderDepth = 32;
+	StartMemoryTracking();
+	
+	// Open the standard compression component
+	ci = OpenDefaultComponent(StandardCompressionType, StandardCompressionSubType);
+         DebugAssert(ci != NULL);
+	if (ci == NULL) 
+            return couldntGetRequiredComponent; 
+	
+	// Adjust the user settings, we don't want the best depth (we pick the render depth ourselves), and make it possible
+	// to leave the data rate field zero (this indicates to use the existing data rate in the movie)
+	SCGetInfo(ci, scPreferenceFlagsType, &ciFlags);
+	ciFlags &=~scShowBestDepth;
+	ciFlags |= scAllowZeroFrameRate;
+	SCSetInfo(ci, scPreferenceFlagsType, &ciFlags);
+	
+	// Open the movie file, make sure it contains a movie.
+	anErr = OpenMovieFile(theMovieFile, &aMovieRefNum, 0);
+	if(anErr != noErr) goto CleanupMemory;
+	
+	anErr = NewMovieFromFile(&aSourceMovie, aMovieRefNum, NULL, NULL, newMovieActive, NULL);
+	
+	CloseMovieFile(aMovieRefNum);
+	if(anErr != noErr) goto CleanupMemory;
+	
+	// Catalog the tracks once, the questions about them below are answered from it.
+	anErr = QTUGetTrackCatalog(aSourceMovie, &aCatalog); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto CleanupMemory;
+	
+	// If the movie does not contain any video tracks, bail out (we don't re-compress sound or other tracks at this point 
+	// of time.
+	if(! QTUMediaTypeInTrack(aSourceMovie, VideoMediaType))
+	{
+		DebugAssert("No video tracks in movie");
+		anErr = invalidMovie;
+		goto CleanupMemory;
+	}
+	
+	// Count the amount of video frames in the movie
+	nFrames = QTUCountMediaSamples(aSourceMovie, VideoMediaType); DebugAssert(nFrames != -1);
+	
+	// Given the movie's bounding rect, create a 32-bit GWorld we will use for rendering movie frames and for possible test images.
+	{
+		CGrafPtr		aSavedPort = NULL;
+		GDHandle		aGDHandle = NULL ;
+		PicHandle 		aPicHandle = NULL; 
+		
+		GetMovieBox(aSourceMovie, &aMovieRect);
+		
+		anErr = AcquireFrameGWorld(&aMovieRect, 32, NULL, &srcGWorld);   DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto CleanupMemory;
+		
+		aPicHandle = GetMoviePosterPict(aSourceMovie); 	// don't need to test if the PicHandle was created or not.
+		
+		if(aPicHandle)
+		{
+			GetGWorld(&aSavedPort, &aGDHandle);
+			SetGWorld(srcGWorld, NULL);
+			EraseRect(&aMovieRect);
+			
+			DrawPicture(aPicHandle, &aMovieRect);
+			KillPicture(aPicHandle);
+			SetGWorld(aSavedPort, aGDHandle);
+			
+			// Use the image now in the GWorld as the initial image inside the dialog box for compression.
+            
+#if TARGET_OS_WIN32
+			anErr = SCSetTestImagePixMap(ci, srcGWorld->portPixMap, NULL, 0);  DebugAssert(anErr == noErr);
+#else
+			anErr = SCSetTestImagePixMap(ci, GetPortPixMap(srcGWorld), NULL, 0);  DebugAssert(anErr == noErr);
+#endif
+			if(anErr != noErr) goto CleanupMemory;
+		}
+	}	
+	// Set default settings for the compression dialog, and also get the temporal settings we need for further
+	// calculations.
+
+	if(gFirstTime)
+	{
+#if TARGET_OS_WIN32
+		anErr = SCDefaultPixMapSettings(ci, srcGWorld->portPixMap, true);   DebugAssert(anErr == noErr);
+#else
+		anErr = SCDefaultPixMapSettings(ci, GetPortPixMap(srcGWorld), true);   DebugAssert(anErr == noErr);
+#endif
+		if(anErr != noErr) goto CleanupMemory;
+
+		anErr = SCGetInfo(ci, scTemporalSettingsType, &gTemporalSettings);   DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto CleanupMemory;
+		
+		gTemporalSettings.frameRate = 0;
+		
+		anErr = SCSetInfo(ci, scTemporalSettingsType, &gTemporalSettings);   DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto CleanupMemory;
+		
+	}	
+	
+
+	
+	// Clear out the default frame rate at the first pass selected by the standard compression. 0 means that we
+	// need to use the data rate of the movie.
+	if(gFirstTime)
+	{
+		// ask the first time from the end user about the default settings we will use with any other movies passed
+		// along to this batch of movies (dragged to the app).
+		anErr = SCRequestSequenceSettings(ci); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto CleanupMemory; // eventually scUserCancelled as the error
+	
+		// Get a copy of the temporal settings we got from the user interaction, we need the values later for
+		// other calculations (new frame amount and so on).
+	
+		anErr = SCGetInfo(ci, scTemporalSettingsType, &gTemporalSettings);  DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto CleanupMemory;
+		
+		anErr = SCGetInfo(ci, scSpatialSettingsType, &gSpatialSettings); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto CleanupMemory;
+	}
+
+	if(!gFirstTime)	// We need to set the temporal and the spatial settings the following times.
+	{
+		anErr = SCSetInfo(ci, scTemporalSettingsType, &gTemporalSettings);   DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto CleanupMemory;
+		
+		anErr = SCSetInfo(ci, scSpatialSettingsType, &gSpatialSettings); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto CleanupMemory;  
+	}
+	
+	// Calculate the max sound rate, so we know the overall data rate for the video (total = video + sound).
+	{
+		long soundDataRate;
+	
+                if(gFirstTime)
+                {	
+                    anErr = SCGetInfo(ci, scDataRateSettingsType, &aDataRateSetting);  DebugAssert(anErr == noErr);
+                    if(anErr != noErr) goto CleanupMemory;
+                }
+		
+		if(aDataRateSetting.dataRate)
+		{
+			anErr = QTUCountMaxSoundRate(aSourceMovie, &soundDataRate);  DebugAssert(anErr == noErr);
+			if(anErr != noErr) goto CleanupMemory;
+		
+			aDataRateSetting.dataRate  -= soundDataRate;
+		}
+		
+		anErr = SCSetInfo(ci, scDataRateSettingsType, &aDataRateSetting);  DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto CleanupMemory;
+	}
+	
+	// Now that the settings are known, admit the movie that asked for them. It runs with the options that fit, the
+	// caller gets its own options back when we are done.
+	if(gAdmitAfterSettings)
+	{
+		gAdmitAfterSettings = false;
+		anErr = FitRecompressJob(theMovieFile, &aMemoryEstimate);
+		gStatistics.predictedMemory = gAdmittedEstimate * gMemoryCorrection;
+		gAdmittedEstimate = 0;
+		if(anErr != noErr) goto CleanupMemory;
+	}
+	
+	// Calculate the new amount of frames based on the possible new re-defined frame rate.
+	if(gTemporalSettings.frameRate)
+		nFrames = QTUGetMovieFrameCount(aSourceMovie, gTemporalSettings.frameRate);
+	
+	// The new file for the re-compressed movie has the name of the source movie with a '*' in front.
+	{
+		Str255 newFileName;
+		
+		// First fix the name FSSpec and name for this new movie.
+		BlockMove(theMovieFile->name, newFileName, sizeof(theMovieFile->name));	 
+		newFileName[++newFileName[0]] = '*';			// add this character to the beginning of the new file name
+	
+		// Then create a new FSSpec.
+		anErr = FSMakeFSSpec(theMovieFile->vRefNum, theMovieFile->parID, newFileName, &newFileFSSpec);
+	}
+	
+	// If we compressed the very same movie with the very same settings before, the output cache has the result and
+	// we are done. If anything goes wrong with the cache, we simply compress the movie.
+	if(gOptions.useOutputCache && gProfileCount == 0 && gOptions.fragmentSeconds == 0 && !gOptions.dryRun)
+	{
+		useOutputCache = (MakeOutputCacheKey(ci, aSourceMovie, aCacheKey) == noErr);
+		if(useOutputCache && UseCachedOutput(aCacheKey, &newFileFSSpec))
+		{
+			gStatistics.outputFromCache = true;
+			anErr = noErr;
+			goto CleanupMemory;
+		}
+	}
+	
+	// Leave out the black borders of the picture, or what the options want cropped.
+	GetSourceRect(aSourceMovie, srcGWorld, &aMovieRect, &aSourceRect);
+	gStatistics.activeRect = aSourceRect;
+	
+	// The 32-bit GWorld was good for the test image of the dialog, now that we know the codec we can pick the depth the
+	// frames are rendered in. The scaler only takes 32-bit frames.
+	{
+		CTabHandle	aColorTable = NULL;
+		short		aRenderDepth = 32;
+		
+		if(gProfileCount == 0 && !GetOutputRect(&aSourceRect, gOptions.outputWidth, gOptions.outputHeight, &aCompressRect))
+			aRenderDepth = ChooseRenderDepth(aSourceMovie, &aColorTable);
+		
+		if(aRenderDepth != 32)
+		{
+			SCSetTestImagePixMap(ci, NULL, NULL, 0);
+			ReleaseFrameGWorld(srcGWorld);  srcGWorld = NULL;
+			
+			anErr = AcquireFrameGWorld(&aMovieRect, aRenderDepth, aColorTable, &srcGWorld);   DebugAssert(anErr == noErr);
+			if(aColorTable) DisposeCTable(aColorTable);
+			if(anErr != noErr) goto CleanupMemory;
+		}
+		
+		gStatistics.renderDepth = aRenderDepth;
+		gStatistics.renderFrameBytes = GetPixRowBytes(GetGWorldPixMap(srcGWorld)) * (aMovieRect.bottom - aMovieRect.top);
+	}
+	
+	// With profiles the movie is written as several renditions, from a single pass over the source. A dry run only
+	// estimates the output of the settings.
+	if(gProfileCount > 0 && !gOptions.dryRun)
+	{
+		StartPrefetching(aSourceMovie);
+		anErr = RecompressRenditions(theMovieFile, aSourceMovie, srcGWorld, &aSourceRect, nFrames);
+		goto CleanupMemory;
+	}
+	
+	// If the destination track has another size than the source rect, every rendered frame is scaled into a GWorld of
+	// the destination size, and that's what we compress. Otherwise we compress the source rect of the render GWorld.
+	aCompressGWorld = srcGWorld;
+	aCompressSourceRect = aSourceRect;
+	if(GetOutputRect(&aSourceRect, gOptions.outputWidth, gOptions.outputHeight, &aCompressRect))
+	{
+		anErr = QTUNewResampler(aSourceRect.right - aSourceRect.left, aSourceRect.bottom - aSourceRect.top,
+									aCompressRect.right - aCompressRect.left, aCompressRect.bottom - aCompressRect.top,
+									gOptions.scaleFilter, gOptions.workerCount > 0 ? gOptions.workerCount : QTUCountProcessors(),
+									&aResampler); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto CleanupMemory;
+		
+		anErr = AcquireFrameGWorld(&aCompressRect, 32, NULL, &aScaledGWorld);   DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto CleanupMemory;
+		
+		aCompressGWorld = aScaledGWorld;
+		aCompressSourceRect = aCompressRect;
+	}
+	
+	// If the movie only needs the frames around its edits compressed again, the video media gets the time scale of the
+	// source media so that the copied samples keep their durations. Scaled or cropped frames are never copied.
+	if(aResampler == NULL && EqualRect(&aSourceRect, &aMovieRect))
+		aSmartRenderTrack = GetSmartRenderTrack(aSourceMovie, &aMovieRect);
+	if(aSmartRenderTrack)
+		aDestinationTimeScale = GetMediaTimeScale(GetTrackMedia(aSmartRenderTrack));
+	else
+		aDestinationTimeScale = GetMovieTimeScale(aSourceMovie);
+	
+	// With a target quality, search for the quality that meets it on a few frames before the sequence starts. A data
+	// rate would override the quality, so there's no search then. If the search fails the settings are used as they are.
+	if(gOptions.targetPSNR > 0 && aDataRateSetting.dataRate == 0 && aSmartRenderTrack == NULL)
+	{
+		aDialogQuality = gSpatialSettings.spatialQuality;
+		useSearchedQuality = true;
+		
+		if(SearchSpatialQuality(aSourceMovie, srcGWorld, &aSourceRect, aResampler, aCompressGWorld, &aCompressSourceRect, nFrames,
+									&gSpatialSettings.spatialQuality) == noErr)
+		{
+			anErr = SCSetInfo(ci, scSpatialSettingsType, &gSpatialSettings); DebugAssert(anErr == noErr);
+			if(anErr != noErr) goto CleanupMemory;
+		}
+	}
+	
+	// A dry run compresses a sample of the frames to estimate the output, and leaves it at that.
+	if(gOptions.dryRun)
+	{
+		anErr = DryRunMovie(ci, theMovieFile, aSourceMovie, srcGWorld, &aSourceRect, aResampler, aCompressGWorld, &aCompressSourceRect, nFrames);
+		goto CleanupMemory;
+	}
+	
+	// If we want to show a windows when processing the movie, do this here...
+	if(gShowWindow)
+	{
+		Rect aRect = aCompressRect;
+		where.h = where.v = -2;
+		
+		anErr = SCPositionRect(ci, &aRect, &where);
+		if(anErr != noErr) goto CleanupMemory;
+		
+		progressWindow = NewCWindow(0,&aRect, theMovieFile->name, true, 0, (WindowPtr)-1, false, 0);
+	}
+	
+	// A fragmented output is written into numbered files, the first one starts here.
+	if(gOptions.fragmentSeconds > 0)
+	{
+		aFragmentDuration = gOptions.fragmentSeconds * GetMovieTimeScale(aSourceMovie);
+		aFragmentTotal = GetMovieDuration(aSourceMovie) / aFragmentDuration + 1;		// all but the last are that long at least
+		anErr = GetFragmentFile(theMovieFile, 1, aFragmentTotal, &newFileFSSpec);
+		if(anErr != noErr) goto CleanupGeneral;
+	}
+	
+	// Create a new file for the re-compressed movie, with the video track we add the frames to.
+	anErr = NewDestinationMovie(aSourceMovie, &newFileFSSpec, &aCompressRect, aDestinationTimeScale, &aMovieRefNum, &aDestinationMovie,
+										&aDestinationTrack, &aDestinationMedia, &aSampleWriter);
+	if(anErr != noErr) goto CleanupGeneral;
+	
+	// Start a compression sequence using the parameters chosen earlier (not these are true for all the other movies passed
+	// along with the AE. Pass nil for the source rect to use the entire image. We will get an imagedescription as well. Note
+	// that the image description handle is disposed by SCCompressSequenceEnd. If every frame is a key frame we don't need 
+	// a sequence, the frames are compressed one by one in parallel instead.
+	useParallelIntraFrames = (aSmartRenderTrack == NULL) && (aFragmentDuration == 0) && UseParallelIntraCompression();
+	if(!useParallelIntraFrames)
+	{
+		// If we place the key frames at scene cuts, the codec must not add its own at the fixed key frame rate.
+		useSceneCuts = gOptions.sceneCutKeyFrames && (aSmartRenderTrack == NULL);
+		if(useSceneCuts)
+		{
+			SCTemporalSettings aTemporalSettings = gTemporalSettings;
+			
+			StartSceneCutDetection(&aSceneCuts);
+			aTemporalSettings.keyFrameRate = 0;
+			SCSetInfo(ci, scTemporalSettingsType, &aTemporalSettings);
+		}
+		
+#if TARGET_OS_WIN32
+		anErr = SCCompressSequenceBegin(ci, aCompressGWorld->portPixMap, &aCompressSourceRect, &anImageDescription); 
+#else
+		anErr = SCCompressSequenceBegin(ci, GetPortPixMap(aCompressGWorld), &aCompressSourceRect, &anImageDescription); 
+#endif
+		DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto CleanupGeneral;
+	}
+		
+	// Clear out the GWorld and set the movie to draw into this one.
+	SetGWorld(srcGWorld, NULL);
+#if TARGET_OS_WIN32
+	EraseRect(&srcGWorld->portRect);
+#else
+         {
+         Rect portRect;
+            GetPortBounds(srcGWorld, &portRect);
+            EraseRect(&portRect);
+         }
+#endif
+	SetMovieGWorld(aSourceMovie, srcGWorld, GetGWorldDevice(srcGWorld));
+	
+	currentMovieTime = 0;			// set current time value to beginning of movie
+	StartPrefetching(aSourceMovie);
+	
+	// Smart render copies most of the samples, there's nothing to score in them.
+	if(aSmartRenderTrack == NULL)
+	{
+		if(useParallelIntraFrames)
+			StartQualityCheck(&newFileFSSpec, aCompressGWorld, &aCompressRect);
+		else
+			StartQualityCheck(&newFileFSSpec, aCompressGWorld, &aCompressSourceRect);
+	}
+		
+	if(useParallelIntraFrames)
+	{
+		anErr = CompressIntraFramesInParallel(aSourceMovie, srcGWorld, &aSourceRect, aResampler, &aCompressRect, nFrames, aDestinationMedia, 
+														aSampleWriter, gShowWindow ? progressWindow : NULL, &abort); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto CleanupGeneral;
+		
+		goto CopySoundTracks;
+	}
+	
+	if(aSmartRenderTrack)
+	{
+		anErr = SmartRenderVideoTrack(ci, aSourceMovie, srcGWorld, &aMovieRect, aSmartRenderTrack, aDestinationMedia, aSampleWriter,
+											anImageDescription, &abort); DebugAssert(anErr == noErr);
+		SCCompressSequenceEnd(ci);
+		if(anErr != noErr) goto CleanupGeneral;
+		
+		goto CopySoundTracks;
+	}
+	
+	// Loop through all the interesting times counted earlier
+	for(aFrameNum = 0; aFrameNum < nFrames; aFrameNum++)
+	{
+		short		syncFlag;
+		TimeValue	duration;
+		long		dataSize;
+		Handle	compressedData;
+		UnsignedWide	aCompressTimer;
+		double		aCompressMicroseconds;
+		
+		// Abort if the end user clicked the mouse or pressed a key.
+		{
+			EventRecord anEvent;
+			
+			abort = false;
+			if(EventAvail(keyDownMask | mDownMask, &anEvent))
+			{
+				abort = true;
+				break;
+			}
+		}
+		
+		// Get the next frame from the movie.
+		GetNextSourceFrame(aSourceMovie, aFrameNum, nFrames, &currentMovieTime, &duration);
+		
+		// Scale the frame to the size of the destination track.
+		if(aResampler)
+		{
+			anErr = ScaleSourceFrame(aResampler, srcGWorld, &aSourceRect, aCompressGWorld, &aCompressRect);
+			if(anErr != noErr) goto CleanupGeneral;
+		}
+		
+		// Once the current fragment is long enough, it's written out and the next one starts with a key frame.
+		if(aFragmentDuration > 0 && currentMovieTime - aFragmentStart >= aFragmentDuration)
+		{
+			long aForceKeyFrame = true;
+			
+			anErr = FinishFragment(aSourceMovie, aFragmentStart, currentMovieTime - aFragmentStart, aMovieRefNum, aDestinationMovie,
+										aDestinationTrack, aDestinationMedia, aSampleWriter, &newFileFSSpec);
+			aDestinationMovie = NULL;  aSampleWriter = NULL;
+			if(anErr != noErr) goto CleanupGeneral;
+			
+			anErr = GetFragmentFile(theMovieFile, ++aFragmentCount, aFragmentTotal, &newFileFSSpec);
+			if(anErr != noErr) goto CleanupGeneral;
+			
+			anErr = NewDestinationMovie(aSourceMovie, &newFileFSSpec, &aCompressRect, aDestinationTimeScale, &aMovieRefNum, &aDestinationMovie,
+												&aDestinationTrack, &aDestinationMedia, &aSampleWriter);
+			if(anErr != noErr) goto CleanupGeneral;
+			
+			SCSetInfo(ci, scForceKeyValueType, &aForceKeyFrame);
+			aFragmentStart = currentMovieTime;
+		}
+		else if(useSceneCuts && WantKeyFrame(&aSceneCuts, GetGWorldPixMap(aCompressGWorld), &aCompressSourceRect))
+		{
+			long aForceKeyFrame = true;
+			
+			SCSetInfo(ci, scForceKeyValueType, &aForceKeyFrame);
+			gStatistics.forcedKeyFrames++;
+		}
+
+		{
+			// If data rate constraining is being done, tell Standard Compression the duration of the current frame in
+			// milliseconds. We only need to do this if the frames have variable durations.
+			SCDataRateSettings datarate;
+			if(!SCGetInfo(ci, scDataRateSettingsType, &datarate))
+			{
+				datarate.frameDuration = duration * 1000 / GetMovieTimeScale(aSourceMovie);
+				SCSetInfo(ci, scDataRateSettingsType, &datarate);
+			}
+		}
+		
+		// Compress the frame, compressedData will hold a handle to the newly compressed image data. dataSize is
+		// the size of the compressed data, which will usually be different than the size of the compressData handle.
+		// syncFlag is a value that is a key frame. Note that we don't have to dispose the compressedData handle.
+		// It will be disposed for us when we call SCCompressSequenceEnd.
+		QTUStartTimer(&aCompressTimer);
+#if TARGET_OS_WIN32
+		anErr = SCCompressSequenceFrame(ci,aCompressGWorld->portPixMap, &aCompressSourceRect, &compressedData, &dataSize, &syncFlag);
+#else
+		anErr = SCCompressSequenceFrame(ci,GetPortPixMap(aCompressGWorld), &aCompressSourceRect, &compressedData, &dataSize, &syncFlag);
+#endif
+		aCompressMicroseconds = QTUElapsedMicroseconds(&aCompressTimer);
+		if(anErr != noErr) goto CleanupGeneral;
+		
+		if(useSceneCuts)
+			CountKeyFrame(&aSceneCuts, syncFlag);
+		
+		// Append the compressed image data to the media.
+		anErr = AppendCompressedFrame(aSampleWriter, aDestinationMedia, compressedData, *compressedData, dataSize, duration, 
+											(SampleDescriptionHandle)anImageDescription, syncFlag);
+		if(anErr != noErr) goto CleanupGeneral;
+		
+		// Score the frame against what was compressed.
+		if(gQualityMeter)
+		{
+			char hState = HGetState(compressedData);
+			
+			HLock(compressedData);
+			CheckFrameQuality(anImageDescription, *compressedData, dataSize, !(syncFlag & mediaSampleNotSync),
+								aCompressMicroseconds, aCompressGWorld, &aCompressSourceRect);
+			HSetState(compressedData, hState);
+		}
+		
+		// Decompress the compressed frame into the progress window.
+		if(gShowWindow)
+		{
+			char hState;
+
+#if TARGET_OS_WIN32			
+			SetGWorld((CGrafPtr)progressWindow, NULL); 	// set port to progress window
+#else
+			SetGWorld(GetWindowPort(progressWindow),NULL);
+#endif			
+			// If this is the first frame, start up a decompression sequence.
+			if(aFrameNum == 0)
+			{
+				anErr = DecompressSequenceBegin(&anImageSequence, anImageDescription, NULL, NULL, &aCompressRect,
+										NULL, ditherCopy, NULL, 0, codecNormalQuality, anyCodec);  					DebugAssert(anErr == noErr);
+				if(anErr != noErr) goto CleanupGeneral;
+			}
+			
+			// Save the locked state of the compressed data and then lock it. We want it locked but standard compression may or 
+			// may not.
+			hState = HGetState(compressedData);
+			HLock(compressedData);
+			
+			// Decompress the frame to the progress window. Note that we StripAddress the compressedData pointer 
+			// because it must be 32-bit clean.
+			anErr = DecompressSequenceFrame(anImageSequence, *compressedData, 0, NULL, NULL); 						DebugAssert(anErr == noErr);
+			if(anErr != noErr) goto CleanupGeneral;
+			
+			// Restore the locked state of the data handle.
+			HSetState(compressedData, hState);
+		} // end gShowWindow
+	} // end big for loop!
+
+	// The last chunk of frames uses the image description, write it before the description goes away.
+	if(aSampleWriter)
+	{
+		anErr = QTUSampleWriterFlush(aSampleWriter); DebugAssert(anErr == noErr);
+	}
+	
+	// Close the compression sequence. This will dispose of the image description and compressed data handles allocated by
+	// SCCompressSequenceBegin.
+	SCCompressSequenceEnd(ci);
+	if(anErr != noErr) goto CleanupGeneral;
+	
+	// Close the decompression sequence. Note that this is an Image Compression Manager call, not Standard Compression.
+	if(anImageSequence) CDSequenceEnd(anImageSequence);
+	anImageSequence = 0;
+	
+CopySoundTracks:
+	// Our buffers for compressed frames should not have grown after the first frame.
+	if(gStatistics.framesCompressed > 0)
+		gStatistics.frameLoopAllocations = CountBufferAllocations() - gFirstFrameAllocations;
+	
+	// Write the last chunk of video before the sound data goes into the file.
+	anErr = FinishSampleWriter(aSampleWriter);  aSampleWriter = NULL;
+	if(anErr != noErr) goto CleanupGeneral;
+	
+	// Copy all sound tracks from the source to the destination movie. Note that we are currently not copying any other
+	// tracks here (text tracks, alternate tracks and so on). We need to provide more options here later. The last
+	// fragment of a fragmented output gets the rest of the sound.
+	anErr = QTUCopySoundTrackSegments(aSourceMovie, aDestinationMovie, aFragmentStart, -1);  DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto CleanupGeneral;
+	gStatistics.fragmentsWritten = aFragmentCount;
+		
+	// We have now finished compressing video data. Next, make this data part of our movie.
+	if(aDestinationTrack)	// we have a valid destination track
+	{
+		short resID = 128;
+		
+		anErr = EndMediaEdits(aDestinationMedia); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto CleanupGeneral;
+		
+		// Insert the newly created media into the newly created track at the beginning of the track and lasting
+		// for the entire duration of the media. The media rate is 1.0 for normal playback rate.
+		InsertMediaIntoTrack(aDestinationTrack, 0, 0, GetMediaDuration(aDestinationMedia), fixed1);
+		
+		// Add the movie resource into the destination movie file.
+		anErr = AddMovieResource(aDestinationMovie, aMovieRefNum, &resID, "\pMovie 1"); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto CleanupGeneral;
+		
+		// Flatten the movie file just created for performance purposes. Make it crossplatform at the same time.
+		CloseMovieFile(aMovieRefNum);	// note: we need to close this file as we will delete this and swap it with a temp file 
+															// in the function below.
+		anErr = QTUFlattenAndDisposeMovie(&aDestinationMovie, &newFileFSSpec);
+		
+		// Keep the result, next time we get this movie with these settings we don't need to compress it again.
+		if(anErr == noErr && useOutputCache)
+			AddOutputCacheEntry(aCacheKey, &newFileFSSpec);
+	}
+		
+
+// CleanupGeneral is our main entry point if we want to get rid of the window and clean up memory.	
+CleanupGeneral:			
+	// POSTFIX
+	
+	// Get Rid of the progress window
+	if(gShowWindow && progressWindow)
+	{
+		DisposeWindow(progressWindow);
+		progressWindow = NULL;
+	}
+
+        // CleanUpMemory is the entry point if we don't have the window displayed, but we still want to clean up memory.
+        CleanupMemory:	
+	FinishMemoryTracking();
+	gOptions = aCallerOptions;
+	FinishQualityCheck();
+	if(useSearchedQuality)
+		gSpatialSettings.spatialQuality = aDialogQuality;		// the next movie searches again from the settings
+	
+	// Get Rid of any buffers, handles, and other resources allocated earlier
+	if(anImageSequence) CDSequenceEnd(anImageSequence);
+	if(aSampleWriter) QTUDisposeSampleWriter(aSampleWriter);
+	if(aDestinationMovie) DisposeMovie(aDestinationMovie);
+	StopPrefetching();
+	if(aSourceMovie) QTUForgetTrackCatalog(aSourceMovie);
+	if(aSourceMovie) DisposeMovie(aSourceMovie);	// the movie draws into srcGWorld, so it goes first
+	ReleaseFrameGWorld(srcGWorld);				// keep the GWorld for the next movie of the batch
+	ReleaseFrameGWorld(aScaledGWorld);
+	if(aResampler) QTUDisposeResampler(aResampler);
+	
+	// Clear the test image because the pixmap it depended upon goes back to the cache.
+	SCSetTestImagePixMap(ci, NULL, NULL, 0);
+	
+	CloseComponent(ci);										// Close the component after use.
+
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// MEMORY ESTIMATES
+// While a movie is recompressed it takes much more memory than its movie resource. The render and scaled GWorlds, the
+// frames the workers hold, the frames the codec keeps, the sample tables and the write, prefetch and RAM window buffers
+// all count. EstimateRecompressMemory adds these up from the movie and the options. AdmitRecompressJob decides if a
+// movie can be done within memoryLimitMegabytes, and RecompressMovieFile measures what it really took to correct the
+// estimates of the next movies.
+#define kCodecStateFrames		3			// a temporal codec keeps the previous and the reference frame besides the current
+
+// ______________________________________________________________________
+// FrameBytes returns the size of a frame of theRect at theDepth, the way NewGWorld lays it out.
+static double FrameBytes(const Rect *theRect, short theDepth)
+{
+	long aWidth = theRect->right - theRect->left;
+	long aHeight = theRect->bottom - theRect->top;
+	
+	return (double)(((aWidth * theDepth + 31) / 32) * 4) * aHeight;
+}
+
+
+// ______________________________________________________________________
+// EstimateRecompressMemory predicts the memory RecompressMovieFile will take for theMovieFile with the current options
+// and settings, on top of what the application uses before it starts.
+pascal OSErr EstimateRecompressMemory(FSSpec *theMovieFile, RecompressMemoryEstimate *theEstimate)
+{
+	OSErr		anErr = noErr;
+	Movie		aMovie = NULL;
+	short		aMovieRefNum = 0;
+	QTUTrackCatalog	*aCatalog;
+	QTUTrackInfo	*aTrackInfo;
+	CTabHandle	aColorTable = NULL;
+	Rect		aMovieRect;
+	Rect		anOutputRect;
+	short		aRenderDepth = 32;
+	long		aMovieSize = 0;
+	long		aSampleCount = 0;
+	long		aWorkerCount = gOptions.workerCount > 0 ? gOptions.workerCount : QTUCountProcessors();
+	long		anOutputCount = gProfileCount > 0 ? gProfileCount : 1;
+	double		anOutputFrameBytes;
+	short		index;
+	
+	theEstimate->frameBuffers = 0;
+	theEstimate->codecState = 0;
+	theEstimate->sampleTables = 0;
+	theEstimate->ioQueues = 0;
+	theEstimate->total = 0;
+	
+	anErr = OpenMovieFile(theMovieFile, &aMovieRefNum, fsRdPerm); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	
+	anErr = NewMovieFromFile(&aMovie, aMovieRefNum, NULL, NULL, 0, NULL); DebugAssert(anErr == noErr);
+	CloseMovieFile(aMovieRefNum);
+	if(anErr != noErr) return anErr;
+	
+	GetMovieBox(aMovie, &aMovieRect);
+	OffsetRect(&aMovieRect, -aMovieRect.left, -aMovieRect.top);
+	
+	if(gOptions.nativeRenderDepth)
+	{
+		aRenderDepth = ChooseRenderDepth(aMovie, &aColorTable);
+		if(aColorTable) DisposeCTable(aColorTable);
+	}
+	theEstimate->frameBuffers = FrameBytes(&aMovieRect, aRenderDepth);
+	
+	if(gProfileCount > 0)
+	{
+		// The source frames wait in a ring, and every rendition scales into a GWorld of its own for a codec of its own.
+		theEstimate->frameBuffers += kRenditionRingSize * FrameBytes(&aMovieRect, 32);
+		
+		for(index = 0; index < gProfileCount; index++)
+		{
+			GetOutputRect(&aMovieRect, gProfiles[index].width, gProfiles[index].height, &anOutputRect);
+			anOutputFrameBytes = FrameBytes(&anOutputRect, 32);
+			
+			theEstimate->frameBuffers += 2 * anOutputFrameBytes;					// the GWorld and its compressed frame
+			theEstimate->codecState += kCodecStateFrames * anOutputFrameBytes;
+		}
+	}
+	else
+	{
+		if(GetOutputRect(&aMovieRect, gOptions.outputWidth, gOptions.outputHeight, &anOutputRect))
+			theEstimate->frameBuffers += FrameBytes(&anOutputRect, 32);
+		anOutputFrameBytes = FrameBytes(&anOutputRect, 32);
+		
+		// Two frames per worker, each with a payload buffer as big as the frame at worst, and a codec per worker.
+		if(UseParallelIntraCompression())
+		{
+			theEstimate->frameBuffers += 2 * aWorkerCount * 2 * anOutputFrameBytes;
+			theEstimate->codecState += aWorkerCount * anOutputFrameBytes;
+		}
+		else
+			theEstimate->codecState += kCodecStateFrames * anOutputFrameBytes;
+	}
+	
+	// The sample tables of the source are in its movie, ours grow with every frame.
+	QTUCalculateMovieMemorySize(aMovie, &aMovieSize);
+	if(QTUGetTrackCatalog(aMovie, &aCatalog) == noErr && (aTrackInfo = QTUFindTrackInfo(aCatalog, VideoMediaType, 1)) != NULL)
+		aSampleCount = aTrackInfo->sampleCount;
+	theEstimate->sampleTables = (double)aMovieSize + (double)aSampleCount * kSampleTableEntryBytes * anOutputCount;
+	
+	if(gOptions.batchSampleWrites)
+		theEstimate->ioQueues += (double)(gOptions.writesInFlight > 1 ? gOptions.writesInFlight : 1) * gOptions.chunkBytes * anOutputCount;
+	if(gOptions.prefetchMilliseconds > 0)
+		theEstimate->ioQueues += gOptions.prefetchKilobytes * 1024.0;
+	if(gOptions.ramWindowMilliseconds > 0)
+		theEstimate->ioQueues += gOptions.ramWindowKilobytes * 1024.0;
+	
+	QTUForgetTrackCatalog(aMovie);
+	DisposeMovie(aMovie);
+	
+	gAdmittedEstimate = theEstimate->frameBuffers + theEstimate->codecState + theEstimate->sampleTables + theEstimate->ioQueues;
+	theEstimate->total = gAdmittedEstimate * gMemoryCorrection;
+	
+	return noErr;
+}
+
+
+// ______________________________________________________________________
+// AdmitRecompressJob decides if RecompressMovieFile can do theMovieFile within memoryLimitMegabytes, and returns the 
+// options to do it with in theJobOptions, see FitRecompressJob. kRecompressNotAdmittedErr means it doesn't fit, skip
+// the movie. Without a limit, or in a dry run, nothing is estimated. The movie that asks for the settings can't be
+// estimated before, the settings decide how many codecs and frames there are. RecompressMovieFile admits it itself
+// once they are known, and returns kRecompressNotAdmittedErr if it doesn't fit.
+pascal OSErr AdmitRecompressJob(FSSpec *theMovieFile, RecompressOptions *theJobOptions, RecompressMemoryEstimate *theEstimate)
+{
+	OSErr				anErr = noErr;
+	RecompressOptions	aBatchOptions = gOptions;
+	
+	*theJobOptions = gOptions;
+	BlockZero(theEstimate, sizeof(RecompressMemoryEstimate));
+	gAdmitAfterSettings = false;
+	gAdmittedEstimate = 0;
+	
+	if(gOptions.memoryLimitMegabytes <= 0 || gOptions.dryRun)
+		return noErr;
+	
+	if(gFirstTime)
+	{
+		gAdmitAfterSettings = true;
+		return noErr;
+	}
+	
+	anErr = FitRecompressJob(theMovieFile, theEstimate);
+	*theJobOptions = gOptions;
+	gOptions = aBatchOptions;
+	
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// CAPTURE
+// CaptureMovieFile compresses live video into a movie file while it is captured. The main thread takes the frames
+// from the sequence grabber (or draws a synthetic picture, so the path can be measured without a camera) into a fixed
+// set of frame slots and passes them to an encoder task through a lock free ring. The encoder compresses them and
+// passes them back through a second ring, and the main thread appends them to the media. Capture never waits for the
+// encoder: with no free slot the new frame is dropped, and with kDropLateFrames the encoder skips a frame that waited
+// longer than maxLatencyMilliseconds as long as a newer one is queued behind it.
+// The droplet itself does not capture, CaptureMovieFile is there for applications built on these sources.
+#define kCaptureTimeScale		1000
+#define kMinCaptureFrameSlots	2
+
+typedef struct CaptureFrame {
+	GWorldPtr		gWorld;
+	UnsignedWide	captureTimer;		// started when the frame was captured
+	TimeValue		captureTime;		// in kCaptureTimeScale units from the start of the capture
+	Ptr				compressedData;		// from gPayloadPool
+	long			compressedDataSize;
+	short			syncFlag;
+	Boolean			dropped;			// the encoder skipped it, it was late
+	OSErr			result;
+} CaptureFrame;
+
+typedef struct CaptureSession {
+	const CaptureOptions	*options;
+	ComponentInstance		compressor;
+	Rect					bounds;
+	long					frameBytes;			// room for compressed data in every slot
+	CaptureFrame			frames[kMaxCaptureFrameSlots];
+	CaptureFrame			*freeFrames[kMaxCaptureFrameSlots];	// main thread only
+	long					freeCount;
+	UnsignedWide			startTimer;
+	double					latencyMicroseconds;	// sum over the compressed frames
+
+	// The encoder task, NULL when the main thread compresses.
+	QTUWorkerPool			encoder;
+	QTURing					capturedRing;		// main thread to encoder
+	QTURing					compressedRing;		// encoder to main thread
+	MPSemaphoreID			encoderSignal;		// signaled for every captured frame and to stop the encoder
+	volatile Boolean		stopEncoder;
+
+	// The destination. A frame is appended when the next one is there, we need its capture time for the duration.
+	Media					media;
+	QTUSampleWriter			writer;
+	ImageDescriptionHandle	imageDescription;	// belongs to the compression sequence
+	Boolean					sequenceStarted;
+	CaptureFrame			*pendingFrame;
+
+	// Sequence grabber frames are decompressed into grabGWorld and copied into a free slot.
+	SGChannel				videoChannel;
+	ImageSequence			decompressor;
+	GWorldPtr				grabGWorld;
+} CaptureSession;
+
+static	CaptureStatistics	gCaptureStatistics;
+
+
+// ______________________________________________________________________
+// GetCaptureStatistics returns what happened to the frames of the last CaptureMovieFile. The time spent writing them
+// is in the sample write numbers of the RecompressStatistics.
+pascal void GetCaptureStatistics(CaptureStatistics *theStatistics)
+{
+	*theStatistics = gCaptureStatistics;
+}
+
+
+// ______________________________________________________________________
+// CompressCaptureFrame compresses a captured frame into its slot, on the encoder task or on the main thread. A frame
+// that waited too long is skipped instead, if the policy says so and a newer frame is waiting behind it.
+static OSErr CompressCaptureFrame(CaptureSession *theSession, CaptureFrame *theFrame)
+{
+	Handle	aData = NULL;
+	long	aDataSize = 0;
+
+	theFrame->dropped = false;
+
+	if(theSession->options->dropPolicy == kDropLateFrames && QTURingCount(theSession->capturedRing) > 0 &&
+		QTUElapsedMicroseconds(&theFrame->captureTimer) > theSession->options->maxLatencyMilliseconds * 1000.0)
+	{
+		theFrame->dropped = true;
+		theFrame->result = noErr;
+		return noErr;
+	}
+
+	theFrame->result = SCCompressSequenceFrame(theSession->compressor, GetGWorldPixMap(theFrame->gWorld), &theSession->bounds,
+													&aData, &aDataSize, &theFrame->syncFlag);
+	if(theFrame->result == noErr && aDataSize > theSession->frameBytes)
+		theFrame->result = memFullErr;
+
+	if(theFrame->result == noErr)
+	{
+		BlockMoveData(*aData, theFrame->compressedData, aDataSize);
+		theFrame->compressedDataSize = aDataSize;
+	}
+
+	return theFrame->result;
+}
+
+
+// ______________________________________________________________________
+// CaptureEncoder is the work function of the encoder task. It compresses queued frames until the main thread sets
+// stopEncoder, and blocks on encoderSignal when there are none. After a codec error it passes back the failed frame and
+// stops, the main thread takes over from there.
+static OSStatus CaptureEncoder(void *theWorkItem)
+{
+	CaptureSession	*aSession = (CaptureSession *)theWorkItem;
+	CaptureFrame	*aFrame;
+	OSErr			anErr = noErr;
+
+	while(anErr == noErr && !aSession->stopEncoder)
+	{
+		if(!QTURingPop(aSession->capturedRing, (void **)&aFrame))
+		{
+			MPWaitOnSemaphore(aSession->encoderSignal, kDurationForever);
+			continue;
+		}
+
+		anErr = CompressCaptureFrame(aSession, aFrame);
+		QTURingPush(aSession->compressedRing, aFrame);		// never full, both rings have room for all the slots
+	}
+
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// StopCaptureEncoder waits for the encoder task to finish, frames it did not get to stay in capturedRing for the main
+// thread.
+static void StopCaptureEncoder(CaptureSession *theSession)
+{
+	void		*unused;
+	OSStatus	aResult;
+
+	if(theSession->encoder == NULL)
+		return;
+
+	theSession->stopEncoder = true;
+	MPSignalSemaphore(theSession->encoderSignal);
+	QTUWorkerPoolWaitForItem(theSession->encoder, &unused, &aResult);
+	QTUDisposeWorkerPool(theSession->encoder);
+	theSession->encoder = NULL;
+}
+
+
+// ______________________________________________________________________
+// GetCaptureFrame returns a free slot for a new frame, or NULL when all of them are in use and the frame is dropped.
+// PutCaptureFrame queues a filled slot for the encoder.
+static CaptureFrame *GetCaptureFrame(CaptureSession *theSession)
+{
+	CaptureFrame *aFrame;
+
+	gCaptureStatistics.framesCaptured++;
+
+	if(theSession->freeCount == 0)
+	{
+		gCaptureStatistics.framesDroppedFull++;
+		return NULL;
+	}
+
+	aFrame = theSession->freeFrames[--theSession->freeCount];
+	QTUStartTimer(&aFrame->captureTimer);
+	aFrame->captureTime = QTUElapsedMicroseconds(&theSession->startTimer) * kCaptureTimeScale / 1000000.0;
+
+	return aFrame;
+}
+
+static void PutCaptureFrame(CaptureSession *theSession, CaptureFrame *theFrame)
+{
+	long aQueuedFrames;
+
+	QTURingPush(theSession->capturedRing, theFrame);		// never full
+	if(theSession->encoder)
+		MPSignalSemaphore(theSession->encoderSignal);		// fails only when the encoder has enough wake ups already
+
+	aQueuedFrames = QTURingCount(theSession->capturedRing);
+	if(aQueuedFrames > gCaptureStatistics.maxQueuedFrames)
+		gCaptureStatistics.maxQueuedFrames = aQueuedFrames;
+}
+
+
+// ______________________________________________________________________
+// AppendCaptureFrame appends the pending frame, with the time until theFrame was captured as its duration, and keeps
+// theFrame as the next pending one. At the end theFrame is NULL and the last frame gets one frame time.
+static OSErr AppendCaptureFrame(CaptureSession *theSession, CaptureFrame *theFrame)
+{
+	CaptureFrame	*aPendingFrame = theSession->pendingFrame;
+	OSErr			anErr = noErr;
+
+	if(aPendingFrame)
+	{
+		TimeValue aDuration = kCaptureTimeScale / theSession->options->framesPerSecond;
+
+		if(theFrame)
+			aDuration = theFrame->captureTime - aPendingFrame->captureTime;
+		if(aDuration < 1)
+			aDuration = 1;
+
+		anErr = AppendCompressedFrame(theSession->writer, theSession->media, NULL, aPendingFrame->compressedData, aPendingFrame->compressedDataSize,
+											aDuration, (SampleDescriptionHandle)theSession->imageDescription, aPendingFrame->syncFlag);
+		theSession->freeFrames[theSession->freeCount++] = aPendingFrame;
+	}
+
+	theSession->pendingFrame = theFrame;
+
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// TakeCompressedFrame counts a frame the encoder is done with and appends it, or puts it back on the free list when
+// it was dropped.
+static OSErr TakeCompressedFrame(CaptureSession *theSession, CaptureFrame *theFrame)
+{
+	double aLatency;
+
+	if(theFrame->dropped)
+	{
+		gCaptureStatistics.framesDroppedLate++;
+		theSession->freeFrames[theSession->freeCount++] = theFrame;
+		return noErr;
+	}
+
+	aLatency = QTUElapsedMicroseconds(&theFrame->captureTimer);
+	theSession->latencyMicroseconds += aLatency;
+	if(aLatency > gCaptureStatistics.maxLatencyMicroseconds)
+		gCaptureStatistics.maxLatencyMicroseconds = aLatency;
+	gCaptureStatistics.framesCompressed++;
+
+	return AppendCaptureFrame(theSession, theFrame);
+}
+
+
+// ______________________________________________________________________
+// PumpCaptureFrames is the main thread side of the encoding. It appends the frames the encoder has finished, and
+// without an encoder it compresses the queued frames itself.
+static OSErr PumpCaptureFrames(CaptureSession *theSession)
+{
+	CaptureFrame	*aFrame;
+	OSErr			anErr = noErr;
+
+	while(anErr == noErr && QTURingPop(theSession->compressedRing, (void **)&aFrame))
+	{
+		if(aFrame->result != noErr)
+		{
+			// The codec failed on the encoder task, which stops after this frame. Try it again here and compress on
+			// the main thread from now on.
+			StopCaptureEncoder(theSession);
+			anErr = CompressCaptureFrame(theSession, aFrame); DebugAssert(anErr == noErr);
+		}
+
+		if(anErr == noErr)
+			anErr = TakeCompressedFrame(theSession, aFrame);
+	}
+
+	while(anErr == noErr && theSession->encoder == NULL && QTURingPop(theSession->capturedRing, (void **)&aFrame))
+	{
+		anErr = CompressCaptureFrame(theSession, aFrame); DebugAssert(anErr == noErr);
+		if(anErr == noErr)
+			anErr = TakeCompressedFrame(theSession, aFrame);
+	}
+
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// CaptureDataProc gets the frames of the sequence grabber during SGIdle. We don't let it make a movie, every frame is
+// decompressed into the grab GWorld and copied into a free slot.
+static pascal OSErr CaptureDataProc(SGChannel theChannel, Ptr theData, long theDataSize, long *theOffset, long theChannelRefCon,
+										TimeValue theTime, short theWriteType, long theRefCon)
+{
+	CaptureSession	*aSession = (CaptureSession *)theRefCon;
+	CaptureFrame	*aFrame;
+	OSErr			anErr = noErr;
+
+	if(theChannel != aSession->videoChannel)
+		return noErr;
+
+	// The first frame tells us what the digitizer delivers.
+	if(aSession->decompressor == 0)
+	{
+		ImageDescriptionHandle anImageDescription = (ImageDescriptionHandle)NewHandle(0);
+
+		if(anImageDescription == NULL) return memFullErr;
+
+		anErr = SGGetChannelSampleDescription(theChannel, (Handle)anImageDescription); DebugAssert(anErr == noErr);
+		if(anErr == noErr)
+		{
+			anErr = DecompressSequenceBegin(&aSession->decompressor, anImageDescription, aSession->grabGWorld, NULL, NULL, NULL,
+												srcCopy, NULL, 0, codecNormalQuality, bestSpeedCodec); DebugAssert(anErr == noErr);
+		}
+		DisposeHandle((Handle)anImageDescription);
+		if(anErr != noErr) return anErr;
+	}
+
+	// Decompress even when the frame is dropped, the digitizer codec might depend on the frames before.
+	anErr = DecompressSequenceFrameS(aSession->decompressor, theData, theDataSize, 0, NULL, NULL); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+
+	aFrame = GetCaptureFrame(aSession);
+	if(aFrame)
+	{
+		CopyBits((BitMap *)*GetGWorldPixMap(aSession->grabGWorld), (BitMap *)*GetGWorldPixMap(aFrame->gWorld), &aSession->bounds,
+					&aSession->bounds, srcCopy, NULL);
+		PutCaptureFrame(aSession, aFrame);
+	}
+
+	return noErr;
+}
+
+
+// ______________________________________________________________________
+// DrawSyntheticFrame draws the picture of the synthetic source: colored bars that move four pixels every frame over a
+// gray ramp, enough detail and motion for the codec to do real work.
+static void DrawSyntheticFrame(GWorldPtr theGWorld, const Rect *theBounds, long theFrameNum)
+{
+	PixMapHandle	aPixMap = GetGWorldPixMap(theGWorld);
+	long			aRowBytes = GetPixRowBytes(aPixMap);
+	long			x, y;
+
+	for(y = 0; y < theBounds->bottom; y++)
+	{
+		UInt32	*aPixel = (UInt32 *)(GetPixBaseAddr(aPixMap) + y * aRowBytes);
+		UInt32	aGray = (y * 255) / theBounds->bottom;
+
+		for(x = 0; x < theBounds->right; x++)
+		{
+			UInt32 aBar = ((x + theFrameNum * 4) >> 5) & 7;
+
+			*aPixel++ = 0xFF000000 | ((aBar & 1) ? 0x00FF0000 : aGray << 16) | ((aBar & 2) ? 0x0000FF00 : aGray << 8) |
+							((aBar & 4) ? 0x000000FF : aGray);
+		}
+	}
+}
+
+
+// ______________________________________________________________________
+// PrepareCaptureCompressor opens the standard compression component with the settings used for the movies, the frame
+// rate is the one of the capture. The first time the user picks the settings.
+static OSErr PrepareCaptureCompressor(CaptureSession *theSession)
+{
+	OSErr				anErr = noErr;
+	SCTemporalSettings	aTemporalSettings;
+	long				aFlags;
+
+	theSession->compressor = OpenDefaultComponent(StandardCompressionType, StandardCompressionSubType); DebugAssert(theSession->compressor != NULL);
+	if(theSession->compressor == NULL) return couldntGetRequiredComponent;
+
+	SCGetInfo(theSession->compressor, scPreferenceFlagsType, &aFlags);
+	aFlags &= ~scShowBestDepth;
+	aFlags |= scAllowZeroFrameRate;
+	SCSetInfo(theSession->compressor, scPreferenceFlagsType, &aFlags);
+
+	if(gFirstTime)
+	{
+		anErr = SCDefaultPixMapSettings(theSession->compressor, GetGWorldPixMap(theSession->frames[0].gWorld), true); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+
+		anErr = SCRequestSequenceSettings(theSession->compressor); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;		// eventually scUserCancelled
+
+		SCGetInfo(theSession->compressor, scTemporalSettingsType, &gTemporalSettings);
+		SCGetInfo(theSession->compressor, scSpatialSettingsType, &gSpatialSettings);
+		SCGetInfo(theSession->compressor, scDataRateSettingsType, &aDataRateSetting);
+	}
+
+	aTemporalSettings = gTemporalSettings;
+	aTemporalSettings.frameRate = theSession->options->framesPerSecond << 16;
+
+	anErr = SCSetInfo(theSession->compressor, scTemporalSettingsType, &aTemporalSettings); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	anErr = SCSetInfo(theSession->compressor, scSpatialSettingsType, &gSpatialSettings); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	anErr = SCSetInfo(theSession->compressor, scDataRateSettingsType, &aDataRateSetting); DebugAssert(anErr == noErr);
+
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// CaptureMovieFile captures theOptions->seconds of video into theMovieFile, compressing while it captures.
+// theWindow is where the sequence grabber works, it's not used with the synthetic source.
+
+pascal OSErr CaptureMovieFile(FSSpec *theMovieFile, WindowPtr theWindow, const CaptureOptions *theOptions)
+{
+	OSErr				anErr = noErr;
+	CaptureSession		*aSession;
+	SeqGrabComponent	aGrabber = NULL;
+	SGChannel			aSoundChannel = NULL;
+	SGDataUPP			aDataProc = NULL;
+	short				aMovieRefNum = 0;
+	Movie				aMovie = NULL;
+	Track				aTrack = NULL;
+	long				aSlotCount = theOptions->frameSlots;
+	long				aFrameNum = 0;
+	double				aCaptureMicroseconds = theOptions->seconds * 1000000.0;
+	long				index;
+
+	gCaptureStatistics.framesCaptured = 0;
+	gCaptureStatistics.framesCompressed = 0;
+	gCaptureStatistics.framesDroppedFull = 0;
+	gCaptureStatistics.framesDroppedLate = 0;
+	gCaptureStatistics.meanLatencyMicroseconds = 0;
+	gCaptureStatistics.maxLatencyMicroseconds = 0;
+	gCaptureStatistics.maxQueuedFrames = 0;
+	gCaptureStatistics.onEncoderTask = false;
+
+	gStatistics.framesCompressed = 0;
+	gStatistics.sampleWrites = 0;
+	gStatistics.sampleWriteMicroseconds = 0;
+	gStatistics.sampleWriteWaits = 0;
+
+	DebugAssert(theOptions->framesPerSecond > 0); if(theOptions->framesPerSecond <= 0) return paramErr;
+	DebugAssert(theOptions->width > 0 && theOptions->height > 0); if(theOptions->width <= 0 || theOptions->height <= 0) return paramErr;
+
+	if(aSlotCount < kMinCaptureFrameSlots) aSlotCount = kMinCaptureFrameSlots;
+	if(aSlotCount > kMaxCaptureFrameSlots) aSlotCount = kMaxCaptureFrameSlots;
+
+	aSession = (CaptureSession *)NewPtrClear(sizeof(CaptureSession)); DebugAssert(aSession != NULL);
+	if(aSession == NULL) return memFullErr;
+
+	aSession->options = theOptions;
+	SetRect(&aSession->bounds, 0, 0, theOptions->width, theOptions->height);
+
+	// All the memory the capture needs is allocated here, the frames only move between the free list and the rings.
+	for(index = 0; index < aSlotCount; index++)
+	{
+		anErr = AcquireFrameGWorld(&aSession->bounds, 32, NULL, &aSession->frames[index].gWorld); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+	}
+
+	// A compressed frame is not going to be bigger than the frame itself.
+	aSession->frameBytes = GetPixRowBytes(GetGWorldPixMap(aSession->frames[0].gWorld)) * theOptions->height;
+	anErr = PreparePayloadPool(aSession->frameBytes, aSlotCount); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+
+	for(index = 0; index < aSlotCount; index++)
+	{
+		aSession->frames[index].compressedData = QTUBufferPoolGet(gPayloadPool); DebugAssert(aSession->frames[index].compressedData != NULL);
+		if(aSession->frames[index].compressedData == NULL) { anErr = memFullErr; goto Closure; }
+
+		aSession->freeFrames[aSession->freeCount++] = &aSession->frames[index];
+	}
+
+	anErr = QTUNewRing(aSlotCount, &aSession->capturedRing); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+	anErr = QTUNewRing(aSlotCount, &aSession->compressedRing); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+
+	// The settings dialog shows the synthetic picture.
+	DrawSyntheticFrame(aSession->frames[0].gWorld, &aSession->bounds, 0);
+
+	anErr = PrepareCaptureCompressor(aSession);
+	if(anErr != noErr) goto Closure;
+
+	// Set up the sequence grabber to call us with every frame instead of making a movie.
+	if(theOptions->source == kCaptureSequenceGrabber)
+	{
+		aGrabber = QTUCreateSequenceGrabber(theWindow); DebugAssert(aGrabber != NULL);
+		if(aGrabber == NULL) { anErr = couldntGetRequiredComponent; goto Closure; }
+
+		anErr = QTUCreateSGGrabChannels(aGrabber, &aSession->bounds, seqGrabRecord, &aSession->videoChannel, &aSoundChannel); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+
+		// Only video is compressed here.
+		SGDisposeChannel(aGrabber, aSoundChannel);
+
+		if(!QTUDoesVDIGReceiveVideo(SGGetVideoDigitizerComponent(aSession->videoChannel)))
+		{
+			anErr = noDeviceForChannel;
+			goto Closure;
+		}
+
+		anErr = SGSetDataRef(aGrabber, NULL, 0, seqGrabDontMakeMovie); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+
+		aDataProc = NewSGDataUPP(CaptureDataProc);
+		anErr = SGSetDataProc(aGrabber, aDataProc, (long)aSession); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+
+		anErr = AcquireFrameGWorld(&aSession->bounds, 32, NULL, &aSession->grabGWorld); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+	}
+
+	anErr = NewDestinationMovie(NULL, theMovieFile, &aSession->bounds, kCaptureTimeScale, &aMovieRefNum, &aMovie, &aTrack,
+									&aSession->media, &aSession->writer);
+	if(anErr != noErr) goto Closure;
+
+	anErr = SCCompressSequenceBegin(aSession->compressor, GetGWorldPixMap(aSession->frames[0].gWorld), &aSession->bounds,
+										&aSession->imageDescription); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+	aSession->sequenceStarted = true;
+
+	// One encoder task, the compression sequence takes the frames in order. Without MP, or where the Movie Toolbox
+	// isn't thread safe, the main thread compresses between captures.
+	if(QTUCanUseMoviesOnThreads() &&
+		MPCreateSemaphore(aSlotCount + 1, 0, &aSession->encoderSignal) == noErr &&
+		QTUNewMoviesWorkerPool(1, &aSession->encoder) == noErr)
+	{
+		if(QTUWorkerPoolSubmit(aSession->encoder, CaptureEncoder, aSession) != noErr)
+		{
+			QTUDisposeWorkerPool(aSession->encoder);
+			aSession->encoder = NULL;
+		}
+	}
+	else
+		aSession->encoder = NULL;
+	gCaptureStatistics.onEncoderTask = (aSession->encoder != NULL);
+
+	// The capture loop.
+	QTUStartTimer(&aSession->startTimer);
+	if(aGrabber)
+	{
+		anErr = SGStartRecord(aGrabber); DebugAssert(anErr == noErr);
+	}
+
+	while(anErr == noErr && QTUElapsedMicroseconds(&aSession->startTimer) < aCaptureMicroseconds)
+	{
+		if(aGrabber)
+		{
+			anErr = SGIdle(aGrabber);
+		}
+		else
+		{
+			double aTime = QTUElapsedMicroseconds(&aSession->startTimer);
+
+			// Like a camera, the synthetic source skips the frames whose time has passed.
+			if(aTime >= aFrameNum * 1000000.0 / theOptions->framesPerSecond)
+			{
+				CaptureFrame *aFrame = GetCaptureFrame(aSession);
+
+				if(aFrame)
+				{
+					DrawSyntheticFrame(aFrame->gWorld, &aSession->bounds, aFrameNum);
+					PutCaptureFrame(aSession, aFrame);
+				}
+				aFrameNum = (long)(aTime * theOptions->framesPerSecond / 1000000.0) + 1;
+			}
+		}
+
+		if(anErr == noErr)
+			anErr = PumpCaptureFrames(aSession);
+	}
+
+	if(aGrabber) SGStop(aGrabber);
+
+	// Compress what is still queued on the main thread and append the last frame.
+	StopCaptureEncoder(aSession);
+	if(anErr == noErr)
+		anErr = PumpCaptureFrames(aSession);
+	if(anErr == noErr)
+		anErr = AppendCaptureFrame(aSession, NULL);
+	if(anErr != noErr) goto Closure;
+
+	// The last chunk of frames uses the image description, write it before the description goes away.
+	if(aSession->writer)
+	{
+		anErr = QTUSampleWriterFlush(aSession->writer); DebugAssert(anErr == noErr);
+	}
+	SCCompressSequenceEnd(aSession->compressor);
+	aSession->sequenceStarted = false;
+	if(anErr != noErr) goto Closure;
+
+	anErr = FinishSampleWriter(aSession->writer);  aSession->writer = NULL;
+	if(anErr != noErr) goto Closure;
+
+	anErr = EndMediaEdits(aSession->media); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+
+	InsertMediaIntoTrack(aTrack, 0, 0, GetMediaDuration(aSession->media), fixed1);
+
+	{
+		short resID = 128;
+
+		anErr = AddMovieResource(aMovie, aMovieRefNum, &resID, "\pMovie 1"); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+	}
+
+	CloseMovieFile(aMovieRefNum);
+	aMovieRefNum = 0;
+
+	anErr = QTUFlattenAndDisposeMovie(&aMovie, theMovieFile);
+
+Closure:
+	if(gCaptureStatistics.framesCompressed > 0)
+		gCaptureStatistics.meanLatencyMicroseconds = aSession->latencyMicroseconds / gCaptureStatistics.framesCompressed;
+
+	StopCaptureEncoder(aSession);
+	if(aSession->encoderSignal) MPDeleteSemaphore(aSession->encoderSignal);
+	if(aGrabber) CloseComponent(aGrabber);
+	if(aDataProc) DisposeSGDataUPP(aDataProc);
+	if(aSession->decompressor) CDSequenceEnd(aSession->decompressor);
+	ReleaseFrameGWorld(aSession->grabGWorld);
+
+	if(aSession->sequenceStarted) SCCompressSequenceEnd(aSession->compressor);
+	if(aSession->writer) QTUDisposeSampleWriter(aSession->writer);
+	if(aMovieRefNum) CloseMovieFile(aMovieRefNum);
+	if(aMovie) DisposeMovie(aMovie);
+	if(aSession->compressor) CloseComponent(aSession->compressor);
+
+	if(aSession->capturedRing) QTUDisposeRing(aSession->capturedRing);
+	if(aSession->compressedRing) QTUDisposeRing(aSession->compressedRing);
+
+	for(index = 0; index < aSlotCount; index++)
+	{
+		ReleaseFrameGWorld(aSession->frames[index].gWorld);
+		if(aSession->frames[index].compressedData) QTUBufferPoolRelease(gPayloadPool, aSession->frames[index].compressedData);
+	}
+
+	DisposePtr((Ptr)aSession);
+
+	return anErr;
+}
+
+
+
+// ______________________________________________________________________
+// THUMBNAILS
+// ExtractThumbnails writes a contact sheet of a movie, a grid of small frames at even distances, and its poster
+// frame, both as PNG files next to the movie. The sheet uses the sync sample nearest to every grid position, those
+// decode on their own, so the frames are decoded on the worker pool side by side and scaled straight into their cell
+// of the sheet. The main thread only reads the sample data. A 2 hour movie costs columns * rows decoded frames, not
+// two hours of decoding.
+#define kDefaultThumbnailColumns	10
+#define kDefaultThumbnailRows		10
+#define kDefaultThumbnailWidth		96
+
+typedef struct ThumbnailSlot {
+	Boolean					busy;								// a worker has it
+	OSStatus				result;
+	ImageDescriptionHandle	description;
+	long					descriptionIndex;					// of the description the decompression sequence was started with
+	ImageSequence			decompressor;
+	Handle					sampleData;
+	long					sampleDataSize;
+	GWorldPtr				frameGWorld;						// the decoded frame, as big as the image description
+	Rect					frameRect;
+	QTUResampler			resampler;
+	PixMapHandle			sheet;
+	Rect					cellRect;
+} ThumbnailSlot;
+
+static	ThumbnailStatistics	gThumbnailStatistics;
+
+
+// ______________________________________________________________________
+// GetThumbnailStatistics returns what the last ExtractThumbnails did.
+pascal void GetThumbnailStatistics(ThumbnailStatistics *theStatistics)
+{
+	*theStatistics = gThumbnailStatistics;
+}
+
+
+// ______________________________________________________________________
+// GetSuffixedFile returns the file next to theMovieFile with the movie name and theSuffix, the suffix wins over the
+// end of a long name.
+static OSErr GetSuffixedFile(const FSSpec *theMovieFile, ConstStr255Param theSuffix, FSSpec *theFile)
+{
+	OSErr	anErr;
+	Str255	aFileName;
+	short	aNameLength = theMovieFile->name[0];
+
+	if(aNameLength + theSuffix[0] > 31)
+		aNameLength = 31 - theSuffix[0];
+	BlockMoveData(theMovieFile->name + 1, aFileName + 1, aNameLength);
+	BlockMoveData(theSuffix + 1, aFileName + 1 + aNameLength, theSuffix[0]);
+	aFileName[0] = aNameLength + theSuffix[0];
+
+	anErr = FSMakeFSSpec(theMovieFile->vRefNum, theMovieFile->parID, aFileName, theFile);
+	if(anErr == fnfErr)
+		anErr = noErr;
+
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// WritePNGFile writes a GWorld into a PNG file with the graphics exporter.
+static OSErr WritePNGFile(GWorldPtr theGWorld, const FSSpec *theFile)
+{
+	OSErr					anErr = noErr;
+	GraphicsExportComponent	anExporter = NULL;
+
+	anErr = OpenADefaultComponent(GraphicsExporterComponentType, kQTFileTypePNG, &anExporter); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+
+	anErr = GraphicsExportSetInputGWorld(anExporter, theGWorld); DebugAssert(anErr == noErr);
+	if(anErr == noErr)
+	{
+		anErr = GraphicsExportSetOutputFile(anExporter, theFile); DebugAssert(anErr == noErr);
+	}
+	if(anErr == noErr)
+	{
+		anErr = GraphicsExportDoExport(anExporter, NULL); DebugAssert(anErr == noErr);
+	}
+
+	CloseComponent(anExporter);
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// GetNearestSyncTime returns the time of the sync sample closest to theTime, before or after it.
+static TimeValue GetNearestSyncTime(Movie theMovie, TimeValue theTime)
+{
+	OSType		aMediaType = VideoMediaType;
+	TimeValue	aBefore = -1;
+	TimeValue	anAfter = -1;
+
+	GetMovieNextInterestingTime(theMovie, nextTimeSyncSample | nextTimeEdgeOK, 1, &aMediaType, theTime, -fixed1, &aBefore, NULL);
+	GetMovieNextInterestingTime(theMovie, nextTimeSyncSample | nextTimeEdgeOK, 1, &aMediaType, theTime, fixed1, &anAfter, NULL);
+
+	if(aBefore < 0)
+		return (anAfter < 0) ? theTime : anAfter;
+	if(anAfter < 0 || theTime - aBefore <= anAfter - theTime)
+		return aBefore;
+
+	return anAfter;
+}
+
+
+// ______________________________________________________________________
+// DecodeThumbnail is the work function for one cell of the sheet, it runs on a worker or the main thread.
+static OSStatus DecodeThumbnail(void *theWorkItem)
+{
+	ThumbnailSlot	*aSlot = (ThumbnailSlot *)theWorkItem;
+	OSErr			anErr;
+
+	anErr = DecompressSequenceFrameS(aSlot->decompressor, *aSlot->sampleData, aSlot->sampleDataSize, 0, NULL, NULL);
+	if(anErr != noErr) return anErr;
+
+	return QTUResamplePixMap(aSlot->resampler, GetGWorldPixMap(aSlot->frameGWorld), &aSlot->frameRect, aSlot->sheet, &aSlot->cellRect);
+}
+
+
+// ______________________________________________________________________
+// ReadThumbnailSample reads a sync sample into a slot. The decompression sequence, the frame GWorld and the scaler
+// of the slot are set up again when the sample has another sample description than the last one.
+static OSErr ReadThumbnailSample(Track theTrack, Media theMedia, TimeValue theMovieTime, ThumbnailSlot *theSlot, const Rect *theCellRect)
+{
+	OSErr		anErr = noErr;
+	long		aDescriptionIndex = 0;
+	TimeValue	aMediaTime = TrackTimeToMediaTime(theMovieTime, theTrack);
+
+	if(aMediaTime < 0) return invalidTime;
+
+	HUnlock(theSlot->sampleData);
+	anErr = GetMediaSample(theMedia, theSlot->sampleData, 0, &theSlot->sampleDataSize, aMediaTime, NULL, NULL,
+								(SampleDescriptionHandle)theSlot->description, &aDescriptionIndex, 1, NULL, NULL); DebugAssert(anErr == noErr);
+	HLock(theSlot->sampleData);
+	if(anErr != noErr) return anErr;
+
+	if(theSlot->decompressor == 0 || aDescriptionIndex != theSlot->descriptionIndex)
+	{
+		Rect aFrameRect;
+
+		if(theSlot->decompressor) CDSequenceEnd(theSlot->decompressor);
+		theSlot->decompressor = 0;
+
+		SetRect(&aFrameRect, 0, 0, (**theSlot->description).width, (**theSlot->description).height);
+		if(!EqualRect(&aFrameRect, &theSlot->frameRect) || theSlot->frameGWorld == NULL)
+		{
+			ReleaseFrameGWorld(theSlot->frameGWorld);
+			theSlot->frameGWorld = NULL;
+			if(theSlot->resampler) QTUDisposeResampler(theSlot->resampler);
+			theSlot->resampler = NULL;
+			theSlot->frameRect = aFrameRect;
+
+			anErr = AcquireFrameGWorld(&aFrameRect, 32, NULL, &theSlot->frameGWorld); DebugAssert(anErr == noErr);
+			if(anErr != noErr) return anErr;
+
+			// Every worker scales its own cells, one band each.
+			anErr = QTUNewResampler(aFrameRect.right, aFrameRect.bottom, theCellRect->right - theCellRect->left,
+										theCellRect->bottom - theCellRect->top, gOptions.scaleFilter, 1, &theSlot->resampler); DebugAssert(anErr == noErr);
+			if(anErr != noErr) return anErr;
+		}
+
+		anErr = DecompressSequenceBegin(&theSlot->decompressor, theSlot->description, theSlot->frameGWorld, NULL, NULL, NULL,
+											srcCopy, NULL, 0, codecNormalQuality, bestSpeedCodec); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+		theSlot->descriptionIndex = aDescriptionIndex;
+	}
+
+	theSlot->cellRect = *theCellRect;
+	return noErr;
+}
+
+
+// ______________________________________________________________________
+// FinishThumbnail collects a slot from the worker pool, a cell that failed on a worker is decoded again here.
+static OSErr FinishThumbnail(QTUWorkerPool thePool, ThumbnailSlot **theSlot)
+{
+	OSErr		anErr;
+	OSStatus	aResult;
+
+	anErr = QTUWorkerPoolWaitForItem(thePool, (void **)theSlot, &aResult); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+
+	(*theSlot)->busy = false;
+	if(aResult != noErr)
+	{
+		gThumbnailStatistics.retriedOnMainThread++;
+		anErr = DecodeThumbnail(*theSlot); DebugAssert(anErr == noErr);
+	}
+
+	return anErr;
+}
+
+
+// ______________________________________________________________________
+// ExtractThumbnails writes "<movie> sheet" and "<movie> poster", PNG files next to the movie. theOptions could be
+// NULL, that's a 10 by 10 sheet of frames 96 pixels wide.
+
+pascal OSErr ExtractThumbnails(FSSpec *theMovieFile, const ThumbnailOptions *theOptions)
+{
+	OSErr			anErr = noErr;
+	Movie			aMovie = NULL;
+	short			aMovieRefNum = 0;
+	Track			aTrack;
+	Media			aMedia;
+	Rect			aMovieRect;
+	Rect			aSheetRect;
+	GWorldPtr		aSheetGWorld = NULL;
+	QTUWorkerPool	aPool = NULL;
+	ThumbnailSlot	*aSlots = NULL;
+	long			aSlotCount = 1;
+	long			anOutstandingCount = 0;
+	long			aColumns = kDefaultThumbnailColumns;
+	long			aRows = kDefaultThumbnailRows;
+	long			aCellWidth = kDefaultThumbnailWidth;
+	long			aCellHeight;
+	long			aCellCount;
+	TimeValue		aDuration;
+	UnsignedWide	aTimer;
+	FSSpec			aFile;
+	long			index;
+
+	gThumbnailStatistics.thumbnails = 0;
+	gThumbnailStatistics.retriedOnMainThread = 0;
+	gThumbnailStatistics.workers = 0;
+	gThumbnailStatistics.microseconds = 0;
+	QTUStartTimer(&aTimer);
+
+	if(theOptions)
+	{
+		if(theOptions->columns > 0) aColumns = theOptions->columns;
+		if(theOptions->rows > 0) aRows = theOptions->rows;
+		if(theOptions->cellWidth > 0) aCellWidth = theOptions->cellWidth;
+	}
+	aCellCount = aColumns * aRows;
+
+	anErr = OpenMovieFile(theMovieFile, &aMovieRefNum, fsRdPerm); ReturnIfError(anErr);
+	anErr = NewMovieFromFile(&aMovie, aMovieRefNum, NULL, NULL, 0, NULL);
+	CloseMovieFile(aMovieRefNum);
+	ReturnIfError(anErr);
+
+	aTrack = GetMovieIndTrackType(aMovie, 1, VideoMediaType, movieTrackMediaType);
+	if(aTrack == NULL) { anErr = invalidTrack; goto Closure; }
+	aMedia = GetTrackMedia(aTrack);
+	aDuration = GetMovieDuration(aMovie);
+
+	// The cells keep the aspect ratio of the movie, the sheet is packed without gaps.
+	GetMovieBox(aMovie, &aMovieRect);
+	OffsetRect(&aMovieRect, -aMovieRect.left, -aMovieRect.top);
+	if(EmptyRect(&aMovieRect)) { anErr = invalidMovie; goto Closure; }
+	aCellHeight = (aCellWidth * aMovieRect.bottom + aMovieRect.right / 2) / aMovieRect.right;
+	if(theOptions && theOptions->cellHeight > 0) aCellHeight = theOptions->cellHeight;
+	if(aCellHeight < 1) aCellHeight = 1;
+
+	SetRect(&aSheetRect, 0, 0, aColumns * aCellWidth, aRows * aCellHeight);
+	anErr = NewGWorld(&aSheetGWorld, 32, &aSheetRect, NULL, NULL, 0); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+	LockPixels(GetGWorldPixMap(aSheetGWorld));
+
+	// Cells without a frame (a movie with fewer sync samples than cells still fills them all) stay black.
+	{
+		CGrafPtr	aSavedPort;
+		GDHandle	aSavedDevice;
+
+		GetGWorld(&aSavedPort, &aSavedDevice);
+		SetGWorld(aSheetGWorld, NULL);
+		PaintRect(&aSheetRect);
+		SetGWorld(aSavedPort, aSavedDevice);
+	}
+
+	// One slot per worker, the main thread reads the next sample while the workers decode. The workers call the
+	// decompressor, where the Movie Toolbox isn't thread safe there's no pool and the main thread decodes every cell.
+	if(QTUCountProcessors() > 1 || gOptions.workerCount > 1)
+	{
+		if(QTUNewMoviesWorkerPool(gOptions.workerCount, &aPool) == noErr)
+			aSlotCount = gOptions.workerCount > 0 ? gOptions.workerCount : QTUCountProcessors();
+		else
+			aPool = NULL;
+	}
+	gThumbnailStatistics.workers = aPool ? aSlotCount : 0;
+
+	aSlots = (ThumbnailSlot *)NewPtrClear(aSlotCount * sizeof(ThumbnailSlot)); DebugAssert(aSlots != NULL);
+	if(aSlots == NULL) { anErr = memFullErr; goto Closure; }
+
+	for(index = 0; index < aSlotCount; index++)
+	{
+		aSlots[index].description = (ImageDescriptionHandle)NewHandle(0);
+		aSlots[index].sampleData = NewHandle(0);
+		aSlots[index].sheet = GetGWorldPixMap(aSheetGWorld);
+		if(aSlots[index].description == NULL || aSlots[index].sampleData == NULL) { anErr = memFullErr; goto Closure; }
+	}
+
+	for(index = 0; index < aCellCount; index++)
+	{
+		ThumbnailSlot	*aSlot = NULL;
+		TimeValue		aTime = (TimeValue)(((double)index + 0.5) * aDuration / aCellCount);
+		Rect			aCellRect;
+		long			aSlotNum;
+
+		for(aSlotNum = 0; aSlotNum < aSlotCount && aSlot == NULL; aSlotNum++)
+		{
+			if(!aSlots[aSlotNum].busy)
+				aSlot = &aSlots[aSlotNum];
+		}
+
+		if(aSlot == NULL)
+		{
+			anErr = FinishThumbnail(aPool, &aSlot);
+			anOutstandingCount--;
+			if(anErr != noErr) goto Closure;
+		}
+
+		SetRect(&aCellRect, (index % aColumns) * aCellWidth, (index / aColumns) * aCellHeight, 0, 0);
+		aCellRect.right = aCellRect.left + aCellWidth;
+		aCellRect.bottom = aCellRect.top + aCellHeight;
+
+		anErr = ReadThumbnailSample(aTrack, aMedia, GetNearestSyncTime(aMovie, aTime), aSlot, &aCellRect);
+		if(anErr == invalidTime)
+		{
+			anErr = noErr;				// an empty edit, the cell stays black
+			continue;
+		}
+		if(anErr != noErr) goto Closure;
+
+		if(aPool)
+		{
+			anErr = QTUWorkerPoolSubmit(aPool, DecodeThumbnail, aSlot); DebugAssert(anErr == noErr);
+			if(anErr != noErr) goto Closure;
+			aSlot->busy = true;
+			anOutstandingCount++;
+		}
+		else
+		{
+			anErr = DecodeThumbnail(aSlot); DebugAssert(anErr == noErr);
+			if(anErr != noErr) goto Closure;
+		}
+		gThumbnailStatistics.thumbnails++;
+	}
+
+	while(anOutstandingCount > 0)
+	{
+		ThumbnailSlot *aSlot;
+
+		anErr = FinishThumbnail(aPool, &aSlot);
+		anOutstandingCount--;
+		if(anErr != noErr) goto Closure;
+	}
+
+	anErr = GetSuffixedFile(theMovieFile, "\p sheet", &aFile);
+	if(anErr == noErr)
+		anErr = WritePNGFile(aSheetGWorld, &aFile);
+	if(anErr != noErr) goto Closure;
+
+	// The poster is the exact frame at the poster time, at full size.
+	{
+		QTUSeekIndex	anIndex;
+		GWorldPtr		aPosterGWorld;
+
+		anErr = QTUNewSeekIndex(aMovie, &anIndex);
+		if(anErr != noErr) goto Closure;
+
+		anErr = QTUSeekIndexGetFrame(anIndex, GetMoviePosterTime(aMovie), &aPosterGWorld);
+		if(anErr == noErr)
+			anErr = GetSuffixedFile(theMovieFile, "\p poster", &aFile);
+		if(anErr == noErr)
+			anErr = WritePNGFile(aPosterGWorld, &aFile);
+
+		QTUDisposeSeekIndex(anIndex);
+	}
+
+Closure:
+	// Wait for the cells still being decoded before we pull the GWorlds away from the workers.
+	while(anOutstandingCount > 0)
+	{
+		void		*unused;
+		OSStatus	aResult;
+
+		if(QTUWorkerPoolWaitForItem(aPool, &unused, &aResult) != noErr)
+			break;
+		anOutstandingCount--;
+	}
+	if(aPool) QTUDisposeWorkerPool(aPool);
+
+	if(aSlots)
+	{
+		for(index = 0; index < aSlotCount; index++)
+		{
+			if(aSlots[index].decompressor) CDSequenceEnd(aSlots[index].decompressor);
+			if(aSlots[index].resampler) QTUDisposeResampler(aSlots[index].resampler);
+			ReleaseFrameGWorld(aSlots[index].frameGWorld);
+			if(aSlots[index].description) DisposeHandle((Handle)aSlots[index].description);
+			if(aSlots[index].sampleData) DisposeHandle(aSlots[index].sampleData);
+		}
+		DisposePtr((Ptr)aSlots);
+	}
+
+	if(aSheetGWorld) DisposeGWorld(aSheetGWorld);
+	if(aMovie) DisposeMovie(aMovie);
+
+	gThumbnailStatistics.microseconds = QTUElapsedMicroseconds(&aTimer);
+	return anErr;
+}
+
+
 // THE END
\ No newline at end of file
@@ -1 +1 @@
-/*	File:		CompressMovie.h	Contains:	Functions for recompression of QuickTime movies.	Written by: 		Copyright:	Copyright  1991-2001 by Apple Computer, Inc., All Rights Reserved.	Disclaimer:	IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc.				("Apple") in consideration of your agreement to the following terms, and your				use, installation, modification or redistribution of this Apple software				constitutes acceptance of these terms.  If you do not agree with these terms,				please do not use, install, modify or redistribute this Apple software.				In consideration of your agreement to abide by the following terms, and subject				to these terms, Apple grants you a personal, non-exclusive license, under Apples				copyrights in this original Apple software (the "Apple Software"), to use,				reproduce, modify and redistribute the Apple Software, with or without				modifications, in source and/or binary forms; provided that if you redistribute				the Apple Software in its entirety and without modifications, you must retain				this notice and the following text and disclaimers in all such redistributions of				the Apple Software.  Neither the name, trademarks, service marks or logos of				Apple Computer, Inc. may be used to endorse or promote products derived from the				Apple Software without specific prior written permission from Apple.  Except as				expressly stated in this notice, no other rights or licenses, express or implied,				are granted by Apple herein, including but not limited to any patent rights that				may be infringed by your derivative works or by other works in which the Apple				Software may be incorporated.				The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO				WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED				WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR				PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN				COMBINATION WITH YOUR PRODUCTS.				IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR				CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE				GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)				ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION				OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT				(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN				ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.	Change History (most recent first):				7/28/1999	Karl Groethe	Updated for Metrowerks Codewarror Pro 2.1				*/#pragma once on// FUNCTION PROTOTYPESpascal void 		SetFirstRecompressState(Boolean state);pascal OSErr 	RecompressMovieFile(FSSpec *theMovieFile);
\ No newline at end of file
+/*	File:		CompressMovie.h	Contains:	Functions for recompression of QuickTime movies.	Written by: 		Copyright:	Copyright  1991-2001 by Apple Computer, Inc., All Rights Reserved.	Disclaimer:	IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc.				("Apple") in consideration of your agreement to the following terms, and your				use, installation, modification or redistribution of this Apple software				constitutes acceptance of these terms.  If you do not agree with these terms,				please do not use, install, modify or redistribute this Apple software.				In consideration of your agreement to abide by the following terms, and subject				to these terms, Apple grants you a personal, non-exclusive license, under Apples				copyrights in this original Apple software (the "Apple Software"), to use,				reproduce, modify and redistribute the Apple Software, with or without				modifications, in source and/or binary forms; provided that if you redistribute				the Apple Software in its entirety and without modifications, you must retain				this notice and the following text and disclaimers in all such redistributions of				the Apple Software.  Neither the name, trademarks, service marks or logos of				Apple Computer, Inc. may be used to endorse or promote products derived from the				Apple Software without specific prior written permission from Apple.  Except as				expressly stated in this notice, no other rights or licenses, express or implied,				are granted by Apple herein, including but not limited to any patent rights that				may be infringed by your derivative works or by other works in which the Apple				Software may be incorporated.				The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO				WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED				WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR				PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN				COMBINATION WITH YOUR PRODUCTS.				IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR				CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE				GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)				ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION				OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT				(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN				ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.	Change History (most recent first):				7/28/1999	Karl Groethe	Updated for Metrowerks Codewarror Pro 2.1				*/#pragma once on// TYPES// RecompressOptions control how RecompressMovieFile does its work, the compression settings themselves come// from the standard compression dialog.typedef struct RecompressOptions {	Boolean		parallelIntraFrames;		// compress frames on all processors when every frame is a key frame	long		workerCount;				// worker tasks for parallel compression, 0 means one per processor	Boolean		batchSampleWrites;			// append compressed frames in chunks instead of one AddMediaSample per frame	long		chunkMilliseconds;			// max duration of one chunk of frames	long		chunkBytes;					// max size of one chunk of frames	Boolean		useOutputCache;				// reuse the earlier output for a movie compressed before with the same settings	long		outputCacheMegabytes;		// the output cache is trimmed to this size	Boolean		smartRender;				// copy the GOPs an edited movie uses as they are, compress only the frames around edits	Boolean		nativeRenderDepth;			// render 8 and 16-bit movies at their own depth when the codec takes it	long		outputWidth;				// width of the compressed frames, 0 keeps the movie width (or its aspect ratio)	long		outputHeight;				// height of the compressed frames, 0 keeps the movie height (or its aspect ratio)	short		scaleFilter;				// kQTUResampleBox, kQTUResampleBilinear or kQTUResampleLanczos	Boolean		detectCrop;					// leave out black borders around the picture	Rect		cropRect;					// crop to this part of the movie box instead, empty to detect or not crop	long		fragmentSeconds;			// cut the output into files of this duration that play on their own, 0 for one file	Boolean		sceneCutKeyFrames;			// place key frames at scene cuts instead of at the fixed key frame rate	long		minKeyFrameInterval;		// frames between key frames at least, even at scene cuts	long		maxKeyFrameInterval;		// frames between key frames at most, 0 uses the key frame rate of the settings	long		writesInFlight;				// chunk writes the frame loop may run ahead of the disk, 0 waits for every write	long		prefetchMilliseconds;		// how far to read the source video ahead of the frame being rendered, 0 doesn't	long		prefetchKilobytes;			// memory for reading ahead, it stops short of prefetchMilliseconds when this is full	long		ramWindowMilliseconds;		// keep this much of the source movie ahead of the frame being rendered in RAM, 0 doesn't	long		ramWindowKilobytes;			// the most source media data kept in RAM	long		memoryLimitMegabytes;		// AdmitRecompressJob admits a movie only if its estimate fits, 0 admits all	Boolean		verifyQuality;				// decode every compressed frame again and score it, the scores go next to the output	double		targetPSNR;					// search for the lowest spatial quality with this mean PSNR in dB, 0 takes the settings	long		searchFrames;				// frames of different scenes the search compresses at most	Boolean		dryRun;						// write no movie, only estimate its size and time from a sample of the frames	double		dryRunPercent;				// of the frames the dry run compresses} RecompressOptions;// RecompressProfile describes one rendition when RecompressMovieFile writes several output files of every movie.#define kMaxRecompressProfiles		8typedef struct RecompressProfile {	long		width;						// 0 keeps the width of the source (or its aspect ratio)	long		height;						// 0 keeps the height of the source (or its aspect ratio)	long		dataRate;					// video bytes per second, 0 takes the data rate from the settings	CodecQ		spatialQuality;				// 0 takes the quality from the settings	Str31		suffix;						// added to the name of the output file} RecompressProfile;// RecompressStatistics describe the last movie RecompressMovieFile worked on.typedef struct RecompressStatistics {	long		framesCompressed;	long		framesCopied;				// samples smart render copied without compressing them again	long		sampleWrites;				// data writes (each with its sample table update) for the video media	double		sampleWriteMicroseconds;	// time spent appending compressed frames to the video media	long		sampleWriteWaits;			// times the frame loop waited for a chunk write, all writesInFlight were busy	long		frameLoopAllocations;		// allocations of our compressed frame buffers after the first frame, the codec's own are not seen	Boolean		outputFromCache;			// the movie came out of the output cache, nothing was compressed	short		renderDepth;				// pixel depth the frames were rendered in	long		renderFrameBytes;			// bytes of one rendered frame, what every frame costs in memory bandwidth	double		renderMicroseconds;			// time spent rendering source frames	double		scaleMicroseconds;			// time spent scaling rendered frames to the output size	Rect		activeRect;					// the part of the movie box that was compressed	long		renditionsWritten;			// output files written from one pass over the movie	long		fragmentsWritten;			// files of a fragmented output	long		sceneCuts;					// scene cuts found in the frames	long		forcedKeyFrames;			// key frames placed at scene cuts or at the max key frame interval	long		prefetchReads;				// large reads of source video ahead of the render position	long		prefetchSeeks;				// times the render position jumped and the read-ahead started over	long		ramWindowHits;				// frames rendered with the source already in RAM	long		ramWindowMisses;	double		predictedMemory;			// what EstimateRecompressMemory predicted for the movie, 0 if it was not called	double		peakMemory;					// the most memory the movie took	long		qualityFrames;				// frames scored with verifyQuality	long		qualityFramesSkipped;		// frames not scored to keep the check within its share of the time	double		meanPSNR;					// in dB, of red, green and blue	double		minPSNR;	double		meanSSIM;					// of the luma, 1 is a perfect copy	double		minSSIM;	double		qualityMicroseconds;		// time spent decoding and scoring	long		searchFrames;				// frames the quality search compressed, 0 if there was no search	CodecQ		searchQuality;				// the spatial quality it found	double		searchPSNR;					// the mean PSNR the curve predicts at that quality	double		searchBytesPerFrame;		// and the size of a frame	double		searchMicroseconds;} RecompressStatistics;// RecompressOutputEstimate is what a dry run predicts for a movie, or for the batch so far. The low and high values// are the 95% confidence interval.typedef struct RecompressOutputEstimate {	long		movies;	long		frameCount;					// frames the output would have	long		framesSampled;				// frames the dry run compressed	double		outputBytes;				// video, sound and sample tables	double		outputBytesLow;	double		outputBytesHigh;	double		framesPerSecond;			// rendered, scaled and compressed	double		framesPerSecondLow;	double		framesPerSecondHigh;		// 0 when the sample sets no upper bound	double		seconds;					// wall time, the frames and writing and flattening the file	double		secondsLow;	double		secondsHigh;} RecompressOutputEstimate;// RecompressMemoryEstimate is what EstimateRecompressMemory predicts a movie takes while it's recompressed.typedef struct RecompressMemoryEstimate {	double		frameBuffers;				// render, scaled and worker GWorlds, compressed frames in flight	double		codecState;					// frames the codecs keep	double		sampleTables;				// of the source movie and of the movies we write	double		ioQueues;					// chunk writes in flight, prefetch buffers and the RAM window	double		total;						// the sum, corrected by what the movies so far really took} RecompressMemoryEstimate;// AdmitRecompressJob and RecompressMovieFile return this for a movie that doesn't fit memoryLimitMegabytes.enum { kRecompressNotAdmittedErr = 1 };// RecompressCacheStatistics add up over all the movies RecompressMovieFile worked on.typedef struct RecompressCacheStatistics {	long		hits;	long		misses;	long		evictions;					// entries removed to keep the cache below outputCacheMegabytes	double		bytesReused;				// size of the movies we did not have to compress again} RecompressCacheStatistics;// CaptureOptions control CaptureMovieFile, the compression settings are the ones used for the movies.enum { kCaptureSequenceGrabber = 0, kCaptureSynthetic = 1 };enum { kDropNewFrames = 0, kDropLateFrames = 1 };#define kMaxCaptureFrameSlots		32typedef struct CaptureOptions {	short		source;						// kCaptureSequenceGrabber, or kCaptureSynthetic for a generated picture	long		width;	long		height;	long		framesPerSecond;	long		seconds;					// how long to capture	long		frameSlots;					// frames captured but not written yet at most, up to kMaxCaptureFrameSlots	short		dropPolicy;					// kDropNewFrames drops only when all slots are full, kDropLateFrames also skips late frames	long		maxLatencyMilliseconds;		// with kDropLateFrames, a frame older than this is skipped if a newer one is waiting} CaptureOptions;// CaptureStatistics describe the last capture of CaptureMovieFile.typedef struct CaptureStatistics {	long		framesCaptured;				// frames the source delivered	long		framesCompressed;	long		framesDroppedFull;			// dropped because no frame slot was free	long		framesDroppedLate;			// skipped by the encoder, they waited longer than maxLatencyMilliseconds	double		meanLatencyMicroseconds;	// from capture until the compressed frame was appended	double		maxLatencyMicroseconds;	long		maxQueuedFrames;			// most frames waiting for the encoder at once	Boolean		onEncoderTask;				// frames were compressed on a task of their own, not between captures} CaptureStatistics;// ThumbnailOptions control the contact sheet ExtractThumbnails writes, zero takes the default.typedef struct ThumbnailOptions {	long		columns;					// 10 by default	long		rows;						// 10 by default	long		cellWidth;					// width of one frame on the sheet, 96 by default	long		cellHeight;					// 0 keeps the aspect ratio of the movie} ThumbnailOptions;// ThumbnailStatistics describe the last ExtractThumbnails.typedef struct ThumbnailStatistics {	long		thumbnails;					// frames on the sheet	long		workers;					// tasks decoding side by side, 0 when the main thread did it all	long		retriedOnMainThread;		// frames a worker could not decode	double		microseconds;				// for the sheet and the poster together} ThumbnailStatistics;// FUNCTION PROTOTYPESpascal void 		SetFirstRecompressState(Boolean state);pascal void 		SetRecompressOptions(const RecompressOptions *theOptions);pascal void 		GetRecompressOptions(RecompressOptions *theOptions);pascal OSErr 	SetRecompressProfiles(const RecompressProfile *theProfiles, short theCount);pascal void 		GetRecompressStatistics(RecompressStatistics *theStatistics);pascal void 		GetRecompressCacheStatistics(RecompressCacheStatistics *theStatistics);pascal void 		FlushRecompressCaches(void);pascal OSErr 	RecompressMovieFile(FSSpec *theMovieFile);pascal OSErr 	EstimateRecompressMemory(FSSpec *theMovieFile, RecompressMemoryEstimate *theEstimate);pascal OSErr 	AdmitRecompressJob(FSSpec *theMovieFile, RecompressOptions *theJobOptions, RecompressMemoryEstimate *theEstimate);pascal void 		GetRecompressOutputEstimates(RecompressOutputEstimate *theMovieEstimate, RecompressOutputEstimate *theBatchEstimate);pascal void 		FinishRecompressEstimates(void);pascal OSErr 	CaptureMovieFile(FSSpec *theMovieFile, WindowPtr theWindow, const CaptureOptions *theOptions);pascal void 		GetCaptureStatistics(CaptureStatistics *theStatistics);pascal OSErr 	ExtractThumbnails(FSSpec *theMovieFile, const ThumbnailOptions *theOptions);pascal void 		GetThumbnailStatistics(ThumbnailStatistics *theStatistics);
\ No newline at end of file
@@ -86,6 +86,8 @@ int main(void)
 	if(anErr != noErr)
 		ExitToShell();
 
+	LoadCapabilityRegistry();
+
 	MainEventLoop();
     
         return 0;
@@ -105,6 +107,34 @@ pascal void InitMacEnvironment(long nMasters)
 }
 
 
+// ______________________________________________________________________
+// The codecs and components are asked what they can do the first time it's needed, not at launch, and only once: later
+// launches read it from the Preferences folder as long as the same components are installed. The file is ours, it gets
+// the signature of the application.
+pascal void LoadCapabilityRegistry(void)
+{
+	OSErr				anErr;
+	short				aVRefNum;
+	long				aDirID;
+	FSSpec				aCacheFile;
+	ProcessSerialNumber	aProcess = { 0, kCurrentProcess };
+	ProcessInfoRec		aProcessInfo;
+	
+	aProcessInfo.processInfoLength = sizeof(ProcessInfoRec);
+	aProcessInfo.processName = NULL;
+	aProcessInfo.processAppSpec = NULL;
+	if(GetProcessInformation(&aProcess, &aProcessInfo) != noErr)
+		aProcessInfo.processSignature = kUnknownType;
+	
+	anErr = FindFolder(kOnSystemDisk, kPreferencesFolderType, kCreateFolder, &aVRefNum, &aDirID);
+	if(anErr == noErr)
+		anErr = FSMakeFSSpec(aVRefNum, aDirID, "\pCompressMovies Capabilities", &aCacheFile);
+	
+	// Without a place to keep it the registry is still worth having for this launch.
+	anErr = QTUInitCapabilityRegistry((anErr == noErr || anErr == fnfErr) ? &aCacheFile : NULL, aProcessInfo.processSignature); DebugAssert(anErr == noErr);
+}
+
+
 // ______________________________________________________________________
 pascal Boolean InitializeAppleEvents(void)
 {
@@ -207,6 +237,10 @@ pascal void MainEventLoop(void)
 	Size		actualSize;
 	long		nDocuments, index;
 	FSSpec	anFSSpec;
+	Boolean	isFirstMovie = true;
+	RecompressOptions			aBatchOptions;
+	RecompressOptions			aJobOptions;
+	RecompressMemoryEstimate	anEstimate;
 	
 	anErr = AEGetParamDesc(theMessage, keyDirectObject, typeAEList, &aDocumentList); DebugAssert(anErr == noErr);
 	if(anErr != noErr) return anErr;
@@ -224,6 +258,8 @@ pascal void MainEventLoop(void)
 		return anErr;
 	}
 	
+	GetRecompressOptions(&aBatchOptions);
+	
 	for(index = 1; index <= nDocuments; index++)
 	{
 		anErr = AEGetNthPtr(&aDocumentList, index, typeFSS, &aKeyword, &aTypeCode,(Ptr)&anFSSpec,
@@ -231,13 +267,22 @@ pascal void MainEventLoop(void)
 		if(anErr != noErr)
 			return anErr;
 		
+		SetFirstRecompressState(isFirstMovie);	// the first movie we run through asks for the settings
+		
+	// Movies predicted to take more memory than the limit are skipped, the batch goes on with the next one. The
+	// others might run with less parallelism than the batch options, so they fit.
+		if(AdmitRecompressJob(&anFSSpec, &aJobOptions, &anEstimate) == kRecompressNotAdmittedErr)
+			continue;
+		
 	// Call a function and pass the obtained FSSpec.
-		if(index == 1)
-			SetFirstRecompressState(true);		// first time we run through the movies (or movie)
-		else
-			SetFirstRecompressState(false);		// if this is the second, or N:th time, set this to false
-			
-		anErr = RecompressMovieFile(&anFSSpec); DebugAssert(anErr == noErr);
+		isFirstMovie = false;
+		
+		SetRecompressOptions(&aJobOptions);
+		anErr = RecompressMovieFile(&anFSSpec);
+		SetRecompressOptions(&aBatchOptions);
+		if(anErr == kRecompressNotAdmittedErr)
+			continue;							// the first movie is admitted once the settings are known
+		DebugAssert(anErr == noErr);
 		if(anErr != noErr)
 		{
 			gDone = true;
@@ -245,6 +290,12 @@ pascal void MainEventLoop(void)
 		}
 	}
 	
+	// A dry run adds the whole batch to its estimates.
+	FinishRecompressEstimates();
+	
+	// The GWorlds and buffers kept between the movies of this batch are not needed anymore.
+	FlushRecompressCaches();
+	
 	if(gOneShot)
 		gDone = true;
 	
@@ -1 +1 @@
-/*	File:		CompressMoviesMain.h	Contains:	Simple AE framework for QuickTime related tools.	Written by: 		Copyright:	Copyright  1991-2001 by Apple Computer, Inc., All Rights Reserved.	Disclaimer:	IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc.				("Apple") in consideration of your agreement to the following terms, and your				use, installation, modification or redistribution of this Apple software				constitutes acceptance of these terms.  If you do not agree with these terms,				please do not use, install, modify or redistribute this Apple software.				In consideration of your agreement to abide by the following terms, and subject				to these terms, Apple grants you a personal, non-exclusive license, under Apples				copyrights in this original Apple software (the "Apple Software"), to use,				reproduce, modify and redistribute the Apple Software, with or without				modifications, in source and/or binary forms; provided that if you redistribute				the Apple Software in its entirety and without modifications, you must retain				this notice and the following text and disclaimers in all such redistributions of				the Apple Software.  Neither the name, trademarks, service marks or logos of				Apple Computer, Inc. may be used to endorse or promote products derived from the				Apple Software without specific prior written permission from Apple.  Except as				expressly stated in this notice, no other rights or licenses, express or implied,				are granted by Apple herein, including but not limited to any patent rights that				may be infringed by your derivative works or by other works in which the Apple				Software may be incorporated.				The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO				WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED				WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR				PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN				COMBINATION WITH YOUR PRODUCTS.				IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR				CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE				GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)				ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION				OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT				(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN				ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                	Change History (most recent first):                                    11/7/2001	srk			Carbonized				7/28/1999	Karl Groethe	Updated for Metrowerks Codewarror Pro 2.1				*/#pragma once#include <Types.h>#include <AppleEvents.h>// FUNCTION PROTOTYPESpascal void 			InitMacEnvironment(long nMasters);pascal Boolean 		InitializeAppleEvents(void);pascal void 			MainEventLoop(void);#ifdef __APPLE_CC__	pascal OSErr 		AEOpenHandler(const AppleEvent *theMessage, AppleEvent *theReply, long refCon);	pascal OSErr 		AEOpenDocHandler(const AppleEvent *theMessage, AppleEvent *theReply, long refCon);	pascal OSErr 		AEPrintHandler(const AppleEvent *theMessage, AppleEvent *theReply, long refCon);	pascal OSErr 		AEQuitHandler(const AppleEvent *theMessage, AppleEvent *theReply, long refCon);#else	pascal OSErr 		AEOpenHandler(const AppleEvent *theMessage, AppleEvent *theReply, UInt32 refCon);	pascal OSErr 		AEOpenDocHandler(const AppleEvent *theMessage, AppleEvent *theReply, UInt32 refCon);	pascal OSErr 		AEPrintHandler(const AppleEvent *theMessage, AppleEvent *theReply, UInt32 refCon);	pascal OSErr 		AEQuitHandler(const AppleEvent *theMessage, AppleEvent *theReply, UInt32 refCon);#endifpascal OSErr 		CheckForRequiredAEParams(const AppleEvent *theEvent);
\ No newline at end of file
+/*	File:		CompressMoviesMain.h	Contains:	Simple AE framework for QuickTime related tools.	Written by: 		Copyright:	Copyright  1991-2001 by Apple Computer, Inc., All Rights Reserved.	Disclaimer:	IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc.				("Apple") in consideration of your agreement to the following terms, and your				use, installation, modification or redistribution of this Apple software				constitutes acceptance of these terms.  If you do not agree with these terms,				please do not use, install, modify or redistribute this Apple software.				In consideration of your agreement to abide by the following terms, and subject				to these terms, Apple grants you a personal, non-exclusive license, under Apples				copyrights in this original Apple software (the "Apple Software"), to use,				reproduce, modify and redistribute the Apple Software, with or without				modifications, in source and/or binary forms; provided that if you redistribute				the Apple Software in its entirety and without modifications, you must retain				this notice and the following text and disclaimers in all such redistributions of				the Apple Software.  Neither the name, trademarks, service marks or logos of				Apple Computer, Inc. may be used to endorse or promote products derived from the				Apple Software without specific prior written permission from Apple.  Except as				expressly stated in this notice, no other rights or licenses, express or implied,				are granted by Apple herein, including but not limited to any patent rights that				may be infringed by your derivative works or by other works in which the Apple				Software may be incorporated.				The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO				WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED				WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR				PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN				COMBINATION WITH YOUR PRODUCTS.				IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR				CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE				GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)				ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION				OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT				(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN				ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                	Change History (most recent first):                                    11/7/2001	srk			Carbonized				7/28/1999	Karl Groethe	Updated for Metrowerks Codewarror Pro 2.1				*/#pragma once#include <Types.h>#include <AppleEvents.h>// FUNCTION PROTOTYPESpascal void 			InitMacEnvironment(long nMasters);pascal Boolean 		InitializeAppleEvents(void);pascal void 			LoadCapabilityRegistry(void);pascal void 			MainEventLoop(void);#ifdef __APPLE_CC__	pascal OSErr 		AEOpenHandler(const AppleEvent *theMessage, AppleEvent *theReply, long refCon);	pascal OSErr 		AEOpenDocHandler(const AppleEvent *theMessage, AppleEvent *theReply, long refCon);	pascal OSErr 		AEPrintHandler(const AppleEvent *theMessage, AppleEvent *theReply, long refCon);	pascal OSErr 		AEQuitHandler(const AppleEvent *theMessage, AppleEvent *theReply, long refCon);#else	pascal OSErr 		AEOpenHandler(const AppleEvent *theMessage, AppleEvent *theReply, UInt32 refCon);	pascal OSErr 		AEOpenDocHandler(const AppleEvent *theMessage, AppleEvent *theReply, UInt32 refCon);	pascal OSErr 		AEPrintHandler(const AppleEvent *theMessage, AppleEvent *theReply, UInt32 refCon);	pascal OSErr 		AEQuitHandler(const AppleEvent *theMessage, AppleEvent *theReply, UInt32 refCon);#endifpascal OSErr 		CheckForRequiredAEParams(const AppleEvent *theEvent);
\ No newline at end of file
@@ -53,6 +53,27 @@
 // INCLUDES
 #include "DTSQTUtilities.h"
 
+#include <math.h>
+
+#if TARGET_RT_MAC_MACHO
+#include <unistd.h>
+#include <libkern/OSAtomic.h>
+#include <mach/mach.h>
+#endif
+
+#if defined(__VEC__) && !defined(__APPLE_ALTIVEC__)
+#include <altivec.h>
+#endif
+
+// Memory barrier for the lock free ring, CFM builds for one processor don't need one.
+#if TARGET_RT_MAC_MACHO
+#define QTUMemoryBarrier()		OSMemoryBarrier()
+#elif defined(__MWERKS__) && TARGET_CPU_PPC
+#define QTUMemoryBarrier()		__sync()
+#else
+#define QTUMemoryBarrier()
+#endif
+
 
 // MOVIE TOOLBOX FUNCTIONS
 
@@ -387,12 +408,36 @@ DESCRIPTION
 */
 
 pascal OSErr QTUFlattenMovieFile(Movie theMovie, FSSpec *theFile)
+{
+	return QTUFlattenAndDisposeMovie(&theMovie, theFile);
+}
+
+
+/*______________________________________________________________________
+	QTUFlattenAndDisposeMovie - Flatten a movie into a specified file, and tell if it's gone.
+
+pascal OSErr QTUFlattenAndDisposeMovie(Movie *theMovie, FSSpec *theFile)
+
+theMovie				the movie to be flattened, set to NULL once it's disposed
+theFile					defines the target file
+
+DESCRIPTION
+	QTUFlattenAndDisposeMovie is QTUFlattenMovieFile for callers that own the movie. The movie is
+	disposed as soon as it's flattened, even if swapping the files fails after that, and *theMovie
+	is cleared then. If the flatten fails the movie is left as it is, for the caller to dispose.
+
+EXAMPLE
+	anErr = QTUFlattenAndDisposeMovie(&aMovie, &aFile);
+	if(aMovie) DisposeMovie(aMovie);
+*/
+
+pascal OSErr QTUFlattenAndDisposeMovie(Movie *theMovie, FSSpec *theFile)
 {
 	OSErr 		anErr = noErr;
 	FSSpec 		tempFile;
 	Str255 	tempFileName;
 	
-	DebugAssert(theMovie != NULL); if(theMovie == NULL) return invalidMovie;
+	DebugAssert(theMovie != NULL && *theMovie != NULL); if(theMovie == NULL || *theMovie == NULL) return invalidMovie;
 	
 	// Create the needed temp file.
 	NumToString(TickCount(), tempFileName);
@@ -400,7 +445,7 @@ pascal OSErr QTUFlattenMovieFile(Movie theMovie, FSSpec *theFile)
 	if(anErr != fnfErr) return anErr;
 	
 	// Flatten the movie.
-	FlattenMovie(theMovie, flattenAddMovieToDataFork, &tempFile, 'TVOD', smSystemScript, 
+	FlattenMovie(*theMovie, flattenAddMovieToDataFork, &tempFile, 'TVOD', smSystemScript, 
 							createMovieFileDeleteCurFile, 0, NULL);
 	anErr = GetMoviesError();
 	if(anErr != noErr)
@@ -409,7 +454,8 @@ pascal OSErr QTUFlattenMovieFile(Movie theMovie, FSSpec *theFile)
 		return anErr;
 	}
 	
-	DisposeMovie(theMovie);
+	DisposeMovie(*theMovie);
+	*theMovie = NULL;
 	anErr = FSpDelete(theFile);  ReturnIfError(anErr);
 	anErr = FSpRename(&tempFile, theFile->name); ReturnIfError(anErr);
 	
@@ -419,6 +465,253 @@ pascal OSErr QTUFlattenMovieFile(Movie theMovie, FSSpec *theFile)
 
 // TRACKS AND MEDIA
 
+#define kQTUTrackCatalogCacheSize	4
+
+static QTUTrackCatalog *gQTUTrackCatalogs[kQTUTrackCatalogCacheSize];
+
+
+/*______________________________________________________________________
+	QTUDescribeTrack - Fill in the catalog entry of a track.
+
+static OSErr QTUDescribeTrack(Track theTrack, QTUTrackInfo *theInfo)
+
+DESCRIPTION
+	QTUDescribeTrack asks the Movie Toolbox everything the catalog keeps about a track. The summary
+	of the sample description is taken from the first one, video tracks tell the compression type,
+	the depth, sound tracks the format, the rate and the channels.
+*/
+
+static OSErr QTUDescribeTrack(Track theTrack, QTUTrackInfo *theInfo)
+{
+	OSErr					anErr = noErr;
+	Media					aMedia;
+	SampleDescriptionHandle	aDesc = NULL;
+
+	aMedia = GetTrackMedia(theTrack);
+	anErr = GetMoviesError(); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+
+	theInfo->track = theTrack;
+	theInfo->trackID = GetTrackID(theTrack);
+	theInfo->enabled = GetTrackEnabled(theTrack);
+	theInfo->duration = GetTrackDuration(theTrack);
+	theInfo->timeScale = GetMediaTimeScale(aMedia);
+	theInfo->mediaDuration = GetMediaDuration(aMedia);
+	theInfo->dataSize = GetMediaDataSize(aMedia, 0, theInfo->mediaDuration);
+	theInfo->sampleCount = GetMediaSampleCount(aMedia);
+	theInfo->sampleDescriptionCount = GetMediaSampleDescriptionCount(aMedia);
+	GetTrackDimensions(theTrack, &theInfo->width, &theInfo->height);
+	GetMediaHandlerDescription(aMedia, &theInfo->mediaType, NULL, NULL);
+
+	if(theInfo->sampleDescriptionCount == 0)
+		return noErr;
+
+	aDesc = (SampleDescriptionHandle)NewHandle(sizeof(Handle)); DebugAssert(aDesc != NULL);
+	if(aDesc == NULL) return memFullErr;
+
+	GetMediaSampleDescription(aMedia, 1, aDesc);
+	anErr = GetMoviesError(); DebugAssert(anErr == noErr);
+	if(anErr == noErr)
+	{
+		theInfo->dataFormat = (*aDesc)->dataFormat;
+
+		if(theInfo->mediaType == VideoMediaType)
+			theInfo->depth = (*(ImageDescriptionHandle)aDesc)->depth;
+		else if(theInfo->mediaType == SoundMediaType)
+		{
+			theInfo->sampleRate = (*(SoundDescriptionHandle)aDesc)->sampleRate;
+			theInfo->channels = (*(SoundDescriptionHandle)aDesc)->numChannels;
+			theInfo->sampleSize = (*(SoundDescriptionHandle)aDesc)->sampleSize;
+		}
+	}
+
+	DisposeHandle((Handle)aDesc);
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUIsTrackCatalogCurrent - Check a cached catalog against its movie.
+
+static Boolean QTUIsTrackCatalogCurrent(QTUTrackCatalog *theCatalog, long theTrackCount)
+
+DESCRIPTION
+	A catalog is current if the movie has the same modification time and the same tracks, at
+	the same index with the same ID. A movie disposed without QTUForgetTrackCatalog and another
+	one opened at the same address most likely has other Track pointers, its catalog is not used.
+*/
+
+static Boolean QTUIsTrackCatalogCurrent(QTUTrackCatalog *theCatalog, long theTrackCount)
+{
+	long index;
+
+	if(theCatalog->trackCount != theTrackCount || theCatalog->modificationTime != GetMovieModificationTime(theCatalog->movie))
+		return false;
+
+	for(index = 0; index < theTrackCount; index++)
+	{
+		Track aTrack = GetMovieIndTrack(theCatalog->movie, index + 1);
+
+		if(aTrack != theCatalog->tracks[index].track || aTrack == NULL || GetTrackID(aTrack) != theCatalog->tracks[index].trackID)
+			return false;
+	}
+
+	return true;
+}
+
+
+/*______________________________________________________________________
+	QTUGetTrackCatalog - Get what's in every track of a movie.
+
+pascal OSErr QTUGetTrackCatalog(Movie theMovie, QTUTrackCatalog **theCatalog)
+
+theMovie					the movie
+theCatalog					will point to the catalog of the movie
+
+DESCRIPTION
+	QTUGetTrackCatalog walks the tracks of the movie once, and keeps the media type, time scale,
+	dimensions, duration, data size and a summary of the sample description of each of them. The 
+	catalogs of the last few movies are kept, so asking again costs a few calls to the Movie
+	Toolbox per track instead of describing every track again. That's what the track functions
+	here use instead of going through all the tracks every time.
+
+	The catalog belongs to the cache, don't dispose it. It's built again if tracks are added,
+	removed or replaced, or the modification time of the movie changed. The track functions build
+	catalogs as a side effect, so a catalog can outlive its movie; it's checked track by track
+	before it's used, but call QTUForgetTrackCatalog before disposing a movie to free it.
+
+EXAMPLE
+	anErr = QTUGetTrackCatalog(aSourceMovie, &aCatalog);
+	aTrackInfo = QTUFindTrackInfo(aCatalog, VideoMediaType, 1);
+*/
+
+pascal OSErr QTUGetTrackCatalog(Movie theMovie, QTUTrackCatalog **theCatalog)
+{
+	OSErr				anErr = noErr;
+	QTUTrackCatalog		*aCatalog;
+	long				aTrackCount;
+	long				index;
+
+	*theCatalog = NULL;
+	DebugAssert(theMovie != NULL); if(theMovie == NULL) return invalidMovie;
+
+	aTrackCount = GetMovieTrackCount(theMovie);
+
+	for(index = 0; index < kQTUTrackCatalogCacheSize; index++)
+	{
+		aCatalog = gQTUTrackCatalogs[index];
+		if(aCatalog == NULL || aCatalog->movie != theMovie)
+			continue;
+
+		if(QTUIsTrackCatalogCurrent(aCatalog, aTrackCount))
+		{
+			// Keep the most recent catalog first.
+			for(; index > 0; index--)
+				gQTUTrackCatalogs[index] = gQTUTrackCatalogs[index - 1];
+			gQTUTrackCatalogs[0] = aCatalog;
+
+			*theCatalog = aCatalog;
+			return noErr;
+		}
+
+		QTUForgetTrackCatalog(theMovie);
+		break;
+	}
+
+	aCatalog = (QTUTrackCatalog *)NewPtrClear(sizeof(QTUTrackCatalog) + aTrackCount * sizeof(QTUTrackInfo)); DebugAssert(aCatalog != NULL);
+	if(aCatalog == NULL) return memFullErr;
+
+	aCatalog->movie = theMovie;
+	aCatalog->modificationTime = GetMovieModificationTime(theMovie);
+	aCatalog->trackCount = aTrackCount;
+
+	for(index = 0; index < aTrackCount; index++)
+	{
+		Track aTrack = GetMovieIndTrack(theMovie, index + 1); DebugAssert(aTrack != NULL);
+
+		anErr = (aTrack != NULL) ? QTUDescribeTrack(aTrack, &aCatalog->tracks[index]) : invalidTrack;
+		if(anErr != noErr)
+		{
+			DisposePtr((Ptr)aCatalog);
+			return anErr;
+		}
+	}
+
+	// The least recently used catalog makes room.
+	if(gQTUTrackCatalogs[kQTUTrackCatalogCacheSize - 1] != NULL)
+		DisposePtr((Ptr)gQTUTrackCatalogs[kQTUTrackCatalogCacheSize - 1]);
+	for(index = kQTUTrackCatalogCacheSize - 1; index > 0; index--)
+		gQTUTrackCatalogs[index] = gQTUTrackCatalogs[index - 1];
+	gQTUTrackCatalogs[0] = aCatalog;
+
+	*theCatalog = aCatalog;
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUFindTrackInfo - Find a track of a media type in a catalog.
+
+pascal QTUTrackInfo *QTUFindTrackInfo(QTUTrackCatalog *theCatalog, OSType theMediaType, long theIndex)
+
+theCatalog					the catalog from QTUGetTrackCatalog
+theMediaType				the media type, or 0 for any track
+theIndex					1 for the first track of the type, 2 for the second and so on
+
+DESCRIPTION
+	QTUFindTrackInfo counts the tracks the way GetMovieIndTrackType does, and returns NULL when
+	there are not that many tracks of the type.
+*/
+
+pascal QTUTrackInfo *QTUFindTrackInfo(QTUTrackCatalog *theCatalog, OSType theMediaType, long theIndex)
+{
+	long index;
+
+	if(theCatalog == NULL) return NULL;
+
+	for(index = 0; index < theCatalog->trackCount; index++)
+	{
+		if(theMediaType != 0 && theCatalog->tracks[index].mediaType != theMediaType)
+			continue;
+		if(--theIndex == 0)
+			return &theCatalog->tracks[index];
+	}
+	return NULL;
+}
+
+
+/*______________________________________________________________________
+	QTUForgetTrackCatalog - Drop the catalog of a movie.
+
+pascal void QTUForgetTrackCatalog(Movie theMovie)
+
+theMovie					the movie, NULL to drop every catalog
+
+DESCRIPTION
+	QTUForgetTrackCatalog disposes the catalog of the movie if there's one in the cache. Call it
+	before DisposeMovie, and after editing a movie the catalog should not be trusted with.
+*/
+
+pascal void QTUForgetTrackCatalog(Movie theMovie)
+{
+	long index, aKept = 0;
+
+	for(index = 0; index < kQTUTrackCatalogCacheSize; index++)
+	{
+		QTUTrackCatalog *aCatalog = gQTUTrackCatalogs[index];
+
+		gQTUTrackCatalogs[index] = NULL;
+		if(aCatalog == NULL)
+			continue;
+
+		if(theMovie == NULL || aCatalog->movie == theMovie)
+			DisposePtr((Ptr)aCatalog);
+		else
+			gQTUTrackCatalogs[aKept++] = aCatalog;
+	}
+}
+
+
 /*______________________________________________________________________
 	QTUMediaTypeInTrack - Check if a particular media type is present in the movie.
 
@@ -429,31 +722,17 @@ theMediaType			media type we want to test about
 
 DESCRIPTION
 	QTUMediaTypeInTrack could be used to scan if a possible media type is present in the movie 
-	(video,sound, other media types).
+	(video,sound, other media types). The track catalog of the movie is used.
 */
 
 pascal Boolean QTUMediaTypeInTrack(Movie theMovie, OSType theMediaType)
 {
-	Track 		aTrack = NULL;
-	long			aTrackCount = 0;
-	long			index;
-	OSType		aMediaType;
-	Boolean		haveMediaType = false;
+	QTUTrackCatalog *aCatalog;
 	
-	aTrackCount = GetMovieTrackCount(theMovie);
-	if(aTrackCount == 0)
-		return false;				// no tracks in movie
+	if(QTUGetTrackCatalog(theMovie, &aCatalog) != noErr)
+		return false;
 	
-	for(index = 1; index <= aTrackCount; index++)
-	{
-		aTrack = GetMovieIndTrack(theMovie, index);
-		GetMediaHandlerDescription( GetTrackMedia(aTrack), &aMediaType, NULL, NULL);
-		
-		haveMediaType = ( aMediaType == theMediaType);
-		if(haveMediaType == true)
-			return true;
-	}
-	return false;			// didn't find the media type track in the movie
+	return QTUFindTrackInfo(aCatalog, theMediaType, 1) != NULL;
 }
 
 
@@ -505,7 +784,8 @@ index	   			index into the media sample we are interested in
 
 DESCRIPTION
 	QTUGetVideoMediaPixelDepth will take a specified video media and an index into the media 
-	samples, and look up the pixel depth for the video sample.
+	samples, and look up the pixel depth for the video sample. The depth of the first sample 
+	description comes from the track catalog of the movie.
 */
 
 pascal short QTUGetVideoMediaPixelDepth(Media theMedia,short index)
@@ -518,6 +798,18 @@ pascal short QTUGetVideoMediaPixelDepth(Media theMedia,short index)
 	DebugAssert(theMedia != NULL);
 	DebugAssert(index > 0);
 	
+	if(index == 1)
+	{
+		Track				aTrack = GetMediaTrack(theMedia);
+		QTUTrackCatalog		*aCatalog;
+		long				aTrackIndex;
+		
+		if(aTrack != NULL && QTUGetTrackCatalog(GetTrackMovie(aTrack), &aCatalog) == noErr)
+			for(aTrackIndex = 0; aTrackIndex < aCatalog->trackCount; aTrackIndex++)
+				if(aCatalog->tracks[aTrackIndex].track == aTrack)
+					return (aCatalog->tracks[aTrackIndex].mediaType == VideoMediaType) ? aCatalog->tracks[aTrackIndex].depth : 0;
+	}
+	
 	// Test if we are indeed dealing with video media.
 	GetMediaHandlerDescription(theMedia, &mediaType, NULL, NULL);
 	if(mediaType != VideoMediaType)
@@ -538,148 +830,506 @@ pascal short QTUGetVideoMediaPixelDepth(Media theMedia,short index)
 }
 
 
+#define kQTUSampleReferenceBatch	256
+
 /*______________________________________________________________________
-	QTUCountMediaSamples - Count the amount of known media samples in a movie.
+	QTUGetMediaSampleStatistics - Count the samples of a media and their sizes from the sample table.
 
-pascal long QTUCountMediaSamples(Movie theMovie, OSType theMediaType)
+pascal OSErr QTUGetMediaSampleStatistics(Media theMedia, QTUMediaSampleStatistics *theStatistics)
 
-theMovie					the movie with the track(tracks).	
-theMediaType			the type of media we are interested in (video, sound and so on)
+theMedia					the media
+theStatistics				will contain the sample count, the duration and the sample sizes
 
 DESCRIPTION
-	QTUCountMediaSamples will take a specified movie and a media type, and calculate the amount 
-	of samples of this particular type. It could be used to find the total amount of video frames in a 
-	movie, or sound samples and so on.
+	QTUGetMediaSampleStatistics reads the sample table of the media with GetMediaSampleReferences. 
+	Samples of the same size and duration that follow each other come back as one reference, so the
+	time this takes goes with the number of entries in the table and not with the number of samples.
+	A sound track of a few hours with millions of samples has only a few thousand chunks. The sample 
+	count and the duration are the ones of the media, edits in the track don't change them.
+*/
+
+pascal OSErr QTUGetMediaSampleStatistics(Media theMedia, QTUMediaSampleStatistics *theStatistics)
+{
+	OSErr					anErr = noErr;
+	SampleReferenceRecord	aSamples[kQTUSampleReferenceBatch];
+	TimeValue				aMediaTime = 0;
+	TimeValue				aMediaDuration;
+	long					index;
+
+	DebugAssert(theMedia != NULL); if(theMedia == NULL) return invalidMedia;
+	DebugAssert(theStatistics != NULL); if(theStatistics == NULL) return paramErr;
+
+	aMediaDuration = GetMediaDuration(theMedia);
+
+	theStatistics->sampleCount = 0;
+	theStatistics->syncSampleCount = GetMediaSyncSampleCount(theMedia);
+	theStatistics->duration = aMediaDuration;
+	theStatistics->timeScale = GetMediaTimeScale(theMedia);
+	theStatistics->totalDataSize = 0;
+	theStatistics->minDataSize = 0;
+	theStatistics->maxDataSize = 0;
+	theStatistics->meanDataSize = 0;
+	theStatistics->tableEntries = 0;
+
+	while(aMediaTime < aMediaDuration)
+	{
+		TimeValue	aSampleTime;
+		long		aDescriptionIndex;
+		long		aCount = 0;
 
-	Note that if the movie is long, it will take a long time to go through all the samples, especially 
-	in the case of sound samples.
+		anErr = GetMediaSampleReferences(theMedia, aMediaTime, &aSampleTime, NULL, &aDescriptionIndex, kQTUSampleReferenceBatch,
+												&aCount, aSamples); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+		if(aCount == 0) break;
 
-EXAMPLE:
-	nFrames = QTUCountMediaSamples(aSourceMovie, VideoMediaType); 
+		for(index = 0; index < aCount; index++)
+		{
+			SampleReferenceRecord *aSample = &aSamples[index];
 
-ISSUES
-	This function could be modified to count other types of samples by changing the flags definitions 
-	(nextTimeSyncSample for key frames and so on).
-*/
+			if(theStatistics->sampleCount == 0 || aSample->dataSize < theStatistics->minDataSize)
+				theStatistics->minDataSize = aSample->dataSize;
+			if(aSample->dataSize > theStatistics->maxDataSize)
+				theStatistics->maxDataSize = aSample->dataSize;
 
-pascal long QTUCountMediaSamples(Movie theMovie, OSType theMediaType)
-{
-	long 				numFrames = 0;
-	short 			flags = nextTimeMediaSample + nextTimeEdgeOK;
-	TimeValue		aDuration = 0;
-	TimeValue 	theTime = 0;
-	
-	GetMovieNextInterestingTime(theMovie, flags, 1, &theMediaType, theTime, 0, &theTime, &aDuration);
-	if(theTime == -1) return numFrames;
+			theStatistics->sampleCount += aSample->numberOfSamples;
+			theStatistics->totalDataSize += (double)aSample->dataSize * aSample->numberOfSamples;
+			aSampleTime += aSample->durationPerSample * aSample->numberOfSamples;
+		}
 
-	flags = nextTimeMediaSample; // Don't include the  nudge after the first interesting time.
-	
-	while(theTime != -1)  // When the returned time equals -1, then there were no more interesting times.
-	{
-		numFrames++;
-		GetMovieNextInterestingTime(theMovie, flags, 1, &theMediaType, theTime, 0, &theTime, &aDuration);
+		theStatistics->tableEntries += aCount;
+
+		// A sample starting before aMediaTime would be read twice otherwise.
+		if(aSampleTime <= aMediaTime) break;
+		aMediaTime = aSampleTime;
 	}
-	
-	return numFrames;
+
+	if(theStatistics->sampleCount > 0)
+		theStatistics->meanDataSize = theStatistics->totalDataSize / theStatistics->sampleCount;
+
+	return noErr;
 }
 
 
 /*______________________________________________________________________
-	QTUGetDurationOfFirstMovieSample - Return the time value of the first sample of a certain 
-	media type.
+	QTUHashMediaContent - Add the sample table and some of the samples of a media to a hash.
 
-pascal TimeValue  QTUGetDurationOfFirstMovieSample(Movie theMovie, OSType theMediaType)
-
-theMovie						the movie with the media track
-theMediaType				specified media type (VideoMediaType, SoundMediaType and so on)
+static OSErr QTUHashMediaContent(Media theMedia, long theSampledCount, Handle theSampleData, UInt32 theHash[2])
 
 DESCRIPTION
-	QTUGetDurationOfFirstMovieSample returns the duration of the first sample of a certain media 
-	in the movie. If there is no such sample, the duration is 0.
+	QTUHashMediaContent hashes the sample descriptions, the size, duration and flags of every sample
+	(but not where the sample is, that's a matter of the file layout) and the data of theSampledCount
+	samples spread over the media.
+*/
 
-	This function could be used in known cases where all the samples are assumed to be of the same 
-	duration. For instance in such cases the frame count could be calculated as:
+static OSErr QTUHashMediaContent(Media theMedia, long theSampledCount, Handle theSampleData, UInt32 theHash[2])
+{
+	OSErr					anErr = noErr;
+	SampleReferenceRecord	aSamples[kQTUSampleReferenceBatch];
+	SampleDescriptionHandle	aDescription = NULL;
+	TimeValue				aMediaTime = 0;
+	TimeValue				aMediaDuration = GetMediaDuration(theMedia);
+	TimeScale				aTimeScale = GetMediaTimeScale(theMedia);
+	OSType					aMediaType;
+	long					aDescriptionCount = GetMediaSampleDescriptionCount(theMedia);
+	long					index;
+
+	GetMediaHandlerDescription(theMedia, &aMediaType, NULL, NULL);
+	QTUHashData(theHash, &aMediaType, sizeof(aMediaType));
+	QTUHashData(theHash, &aTimeScale, sizeof(aTimeScale));
+	QTUHashData(theHash, &aMediaDuration, sizeof(aMediaDuration));
+
+	aDescription = (SampleDescriptionHandle)NewHandle(0); DebugAssert(aDescription != NULL);
+	if(aDescription == NULL) return memFullErr;
+
+	for(index = 1; index <= aDescriptionCount; index++)
+	{
+		GetMediaSampleDescription(theMedia, index, aDescription);
+		anErr = GetMoviesError(); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
 
-	framecount =
-			 GetMovieDuration(theMovie)/QTUGetDurationofFirstMovieSample(theMovie, VideoMediaType);
+		HLock((Handle)aDescription);
+		QTUHashData(theHash, *aDescription, GetHandleSize((Handle)aDescription));
+		HUnlock((Handle)aDescription);
+	}
 
-*/
+	while(aMediaTime < aMediaDuration)
+	{
+		TimeValue	aSampleTime;
+		long		aDescriptionIndex;
+		long		aCount = 0;
 
-pascal TimeValue  QTUGetDurationOfFirstMovieSample(Movie theMovie, OSType theMediaType)
-{
-	OSErr 			anErr = noErr;
-	TimeValue		interestingDuration = 0;
-	short			timeFlags = nextTimeMediaSample+nextTimeEdgeOK;
+		anErr = GetMediaSampleReferences(theMedia, aMediaTime, &aSampleTime, NULL, &aDescriptionIndex, kQTUSampleReferenceBatch,
+												&aCount, aSamples); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+		if(aCount == 0) break;
 
-	GetMovieNextInterestingTime(theMovie, timeFlags, (TimeValue)1, &theMediaType, 0, 
-													fixed1, NULL, &interestingDuration);
-	anErr = GetMoviesError(); DebugAssert(anErr == noErr);
+		QTUHashData(theHash, &aDescriptionIndex, sizeof(aDescriptionIndex));
+		for(index = 0; index < aCount; index++)
+		{
+			SampleReferenceRecord *aSample = &aSamples[index];
 
-	return interestingDuration;
+			QTUHashData(theHash, &aSample->dataSize, sizeof(aSample->dataSize));
+			QTUHashData(theHash, &aSample->durationPerSample, sizeof(aSample->durationPerSample));
+			QTUHashData(theHash, &aSample->numberOfSamples, sizeof(aSample->numberOfSamples));
+			QTUHashData(theHash, &aSample->sampleFlags, sizeof(aSample->sampleFlags));
+			aSampleTime += aSample->durationPerSample * aSample->numberOfSamples;
+		}
+
+		// A sample starting before aMediaTime would be read twice otherwise.
+		if(aSampleTime <= aMediaTime) break;
+		aMediaTime = aSampleTime;
+	}
+
+	for(index = 0; index < theSampledCount && aMediaDuration > 0; index++)
+	{
+		TimeValue	aTime = (TimeValue)((index + 0.5) * aMediaDuration / theSampledCount);
+		TimeValue	aSampleTime;
+		long		aDataSize;
+
+		anErr = GetMediaSample(theMedia, theSampleData, 0, &aDataSize, aTime, &aSampleTime, NULL, NULL, NULL, 0, NULL, NULL);
+		DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+
+		QTUHashData(theHash, &aSampleTime, sizeof(aSampleTime));
+		HLock(theSampleData);
+		QTUHashData(theHash, *theSampleData, aDataSize);
+		HUnlock(theSampleData);
+	}
+
+Closure:
+	DisposeHandle((Handle)aDescription);
+	return anErr;
 }
 
 
 /*______________________________________________________________________
-	QTUCountMaxSoundRate - Calculate the max sound data rate of a possible sound track
-   in the movie.
+	QTUHashMovieContent - Hash what a movie plays, without reading all of its media.
 
-pascal OSErr QTUCountMaxSoundRate(Movie theMovie,long *theMaxSoundRate)
+pascal OSErr QTUHashMovieContent(Movie theMovie, long theSampledCount, UInt32 theHash[2])
 
-theMovie						the movie with the sound track(tracks).	
-theMaxSoundRate			the final returned value
+theMovie					the movie
+theSampledCount				how many samples of each media are read and hashed
+theHash						will contain the hash of the movie
 
 DESCRIPTION
-	QTUCountMaxSoundRate (taken from the ConvertToMovieJr file) is a simple function that tries
-	to figure out the maximum sound track rate. This is done by looking at all of the sound tracks
-	in the source movie, and using the one with the highest sample rate (11khz, 22khz and so on),
+	QTUHashMovieContent is a fingerprint of a movie: its geometry, the edits of every track, the
+	sample tables and theSampledCount samples of every media. That's much less than QTUHashFile
+	reads, and it doesn't depend on the file. A copy of the movie, or the same movie saved in
+	another layout, has the same hash. Two movies that differ only in samples that were not read
+	have the same hash too, use QTUHashFile where that matters.
 
-	This number could then be used for calculating the maximum data rate by extracting the sound rate and 
-	this way we get a loose estimation how much is left for the video data rate.
-	
-	This is just an approximation, and a better function should take into account non-overlapping
-	sound tracks, stereo sound data rates, compressed sound tracks and so on.
+EXAMPLE
+	anErr = QTUHashMovieContent(theMovie, 8, aHash);
 */
 
-pascal OSErr QTUCountMaxSoundRate(Movie theMovie,long *theMaxSoundRate)
+pascal OSErr QTUHashMovieContent(Movie theMovie, long theSampledCount, UInt32 theHash[2])
 {
-	OSErr	anErr = noErr;
-	short 	index, trackCount;
-	
+	OSErr			anErr = noErr;
+	Handle			aSampleData = NULL;
+	MatrixRecord	aMatrix;
+	Rect			aBox;
+	TimeScale		aTimeScale;
+	TimeValue		aDuration;
+	long			aTrackCount;
+	long			index;
+
 	DebugAssert(theMovie != NULL); if(theMovie == NULL) return invalidMovie;
-	*theMaxSoundRate = 0; // just for security we place this value in here
-	
-	trackCount = GetMovieTrackCount(theMovie);
-	
-	for(index = 1; index <= trackCount; index++)
+
+	aSampleData = NewHandle(0); DebugAssert(aSampleData != NULL);
+	if(aSampleData == NULL) return memFullErr;
+
+	QTUStartHash(theHash);
+
+	aTimeScale = GetMovieTimeScale(theMovie);
+	aDuration = GetMovieDuration(theMovie);
+	GetMovieBox(theMovie, &aBox);
+	GetMovieMatrix(theMovie, &aMatrix);
+	QTUHashData(theHash, &aTimeScale, sizeof(aTimeScale));
+	QTUHashData(theHash, &aDuration, sizeof(aDuration));
+	QTUHashData(theHash, &aBox, sizeof(aBox));
+	QTUHashData(theHash, &aMatrix, sizeof(aMatrix));
+
+	aTrackCount = GetMovieTrackCount(theMovie);
+	for(index = 1; index <= aTrackCount; index++)
 	{
-		OSType 	aTrackType;
-		Track		aTrack = NULL;
-		Media		aMedia = NULL;
-		
-		aTrack = GetMovieIndTrack(theMovie, index);  DebugAssert(aTrack != NULL);
-		aMedia = GetTrackMedia(aTrack); DebugAssert(aMedia != NULL);
-		anErr = GetMoviesError();  DebugAssert(anErr == noErr);
-		if(anErr != noErr) return anErr;
-		
-		GetMediaHandlerDescription(aMedia, &aTrackType, 0, 0);
-		if(aTrackType == SoundMediaType)
+		Track		aTrack = GetMovieIndTrack(theMovie, index);
+		Boolean		isEnabled;
+		Fixed		aWidth, aHeight;
+		TimeValue	aTrackTime = 0;
+
+		if(aTrack == NULL) continue;
+
+		isEnabled = GetTrackEnabled(aTrack);
+		GetTrackDimensions(aTrack, &aWidth, &aHeight);
+		GetTrackMatrix(aTrack, &aMatrix);
+		QTUHashData(theHash, &isEnabled, sizeof(isEnabled));
+		QTUHashData(theHash, &aWidth, sizeof(aWidth));
+		QTUHashData(theHash, &aHeight, sizeof(aHeight));
+		QTUHashData(theHash, &aMatrix, sizeof(aMatrix));
+
+		// The edits, what part of the media plays when and how fast.
+		for(;;)
 		{
-			long aRate;
-			SampleDescriptionHandle aDesc = NULL;
-			
-			aDesc = (SampleDescriptionHandle)NewHandle(sizeof(SampleDescription)); DebugAssert(aDesc != NULL);
-			GetMediaSampleDescription(aMedia, 1, aDesc);
-			anErr = GetMoviesError(); DebugAssert(anErr == noErr);
-			if(anErr != noErr)
-			{
-				DisposeHandle((Handle)aDesc);
-				continue;
-			}
-			
-			aRate = (*(SoundDescriptionHandle)aDesc)->sampleRate >> 16;
-			if(aRate > *theMaxSoundRate)
-				*theMaxSoundRate = aRate;
+			TimeValue	anEditTime, anEditDuration, aMediaTime;
+			Fixed		aRate;
+
+			GetTrackNextInterestingTime(aTrack, nextTimeTrackEdit | nextTimeEdgeOK, aTrackTime, fixed1, &anEditTime, &anEditDuration);
+			if(anEditTime < 0 || anEditDuration <= 0) break;
+
+			aMediaTime = TrackTimeToMediaTime(anEditTime, aTrack);
+			aRate = GetTrackEditRate(aTrack, anEditTime);
+			QTUHashData(theHash, &anEditTime, sizeof(anEditTime));
+			QTUHashData(theHash, &anEditDuration, sizeof(anEditDuration));
+			QTUHashData(theHash, &aMediaTime, sizeof(aMediaTime));
+			QTUHashData(theHash, &aRate, sizeof(aRate));
+
+			aTrackTime = anEditTime + anEditDuration;
 		}
+
+		anErr = QTUHashMediaContent(GetTrackMedia(aTrack), theSampledCount, aSampleData, theHash);
+		if(anErr != noErr) break;
+	}
+
+	DisposeHandle(aSampleData);
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUTrackPlaysMediaOnce - Test if a track plays all of its media once, at the normal rate.
+
+static Boolean QTUTrackPlaysMediaOnce(Track theTrack)
+
+DESCRIPTION
+	QTUTrackPlaysMediaOnce is true for a track with one edit (after the empty edit of a track offset)
+	that starts at media time 0, plays at rate 1, and lasts as long as the media. Every sample of such
+	a track is played exactly once, the sample table tells how many there are.
+*/
+
+static Boolean QTUTrackPlaysMediaOnce(Track theTrack)
+{
+	Media		aMedia = GetTrackMedia(theTrack);
+	TimeScale	aMovieTimeScale = GetMovieTimeScale(GetTrackMovie(theTrack));
+	TimeScale	aMediaTimeScale = GetMediaTimeScale(aMedia);
+	TimeValue	anEditTime, anEditDuration, aNextEditTime;
+	double		aMediaDuration;
+
+	GetTrackNextInterestingTime(theTrack, nextTimeTrackEdit | nextTimeEdgeOK, GetTrackOffset(theTrack), fixed1, 
+									&anEditTime, &anEditDuration);
+	if(anEditTime < 0 || anEditDuration <= 0)
+		return false;
+	if(TrackTimeToMediaTime(anEditTime, theTrack) != 0 || GetTrackEditRate(theTrack, anEditTime) != fixed1)
+		return false;
+
+	GetTrackNextInterestingTime(theTrack, nextTimeTrackEdit, anEditTime, fixed1, &aNextEditTime, NULL);
+	if(aNextEditTime >= 0 && aNextEditTime < GetTrackOffset(theTrack) + GetTrackDuration(theTrack))
+		return false;
+
+	// Converting between the time scales rounds, a movie time unit is close enough.
+	aMediaDuration = (double)anEditDuration * aMediaTimeScale / aMovieTimeScale;
+	return fabs(aMediaDuration - GetMediaDuration(aMedia)) <= (double)aMediaTimeScale / aMovieTimeScale + 1;
+}
+
+
+/*______________________________________________________________________
+	QTUCountMediaSamplesByTime - Count the samples by stepping through the interesting times.
+
+static long QTUCountMediaSamplesByTime(Movie theMovie, OSType theMediaType)
+
+DESCRIPTION
+	QTUCountMediaSamplesByTime is the way QTUCountMediaSamples always counted, one call to
+	GetMovieNextInterestingTime per sample. It's what we do for edited tracks, where a sample could
+	play more than once or not at all.
+*/
+
+static long QTUCountMediaSamplesByTime(Movie theMovie, OSType theMediaType)
+{
+	long 				numFrames = 0;
+	short 			flags = nextTimeMediaSample + nextTimeEdgeOK;
+	TimeValue		aDuration = 0;
+	TimeValue 	theTime = 0;
+	
+	GetMovieNextInterestingTime(theMovie, flags, 1, &theMediaType, theTime, 0, &theTime, &aDuration);
+	if(theTime == -1) return numFrames;
+
+	flags = nextTimeMediaSample; // Don't include the  nudge after the first interesting time.
+	
+	while(theTime != -1)  // When the returned time equals -1, then there were no more interesting times.
+	{
+		numFrames++;
+		GetMovieNextInterestingTime(theMovie, flags, 1, &theMediaType, theTime, 0, &theTime, &aDuration);
+	}
+	
+	return numFrames;
+}
+
+
+/*______________________________________________________________________
+	QTUCountMediaSamples - Count the amount of known media samples in a movie.
+
+pascal long QTUCountMediaSamples(Movie theMovie, OSType theMediaType)
+
+theMovie					the movie with the track(tracks).	
+theMediaType			the type of media we are interested in (video, sound and so on)
+
+DESCRIPTION
+	QTUCountMediaSamples will take a specified movie and a media type, and calculate the amount 
+	of samples of this particular type. It could be used to find the total amount of video frames in a 
+	movie, or sound samples and so on.
+
+	If the movie has one enabled track of the type, and the track plays its media once from start to
+	end (no edits), the count comes right from the sample table and takes no time. Otherwise we step 
+	through the movie, and if the movie is long that takes a long time, especially for sound samples.
+	QTUGetMediaSampleStatistics counts the samples of any media from its sample table.
+
+EXAMPLE:
+	nFrames = QTUCountMediaSamples(aSourceMovie, VideoMediaType); 
+
+ISSUES
+	This function could be modified to count other types of samples by changing the flags definitions 
+	(nextTimeSyncSample for key frames and so on).
+*/
+
+pascal long QTUCountMediaSamples(Movie theMovie, OSType theMediaType)
+{
+	QTUTrackCatalog	*aCatalog;
+	QTUTrackInfo	*aTrackInfo;
+
+	DebugAssert(theMovie != NULL); if(theMovie == NULL) return 0;
+
+	if(QTUGetTrackCatalog(theMovie, &aCatalog) == noErr)
+	{
+		aTrackInfo = QTUFindTrackInfo(aCatalog, theMediaType, 1);
+		if( aTrackInfo != NULL && aTrackInfo->enabled &&
+			QTUFindTrackInfo(aCatalog, theMediaType, 2) == NULL &&
+			QTUTrackPlaysMediaOnce(aTrackInfo->track) )
+			return aTrackInfo->sampleCount;
+	}
+
+	return QTUCountMediaSamplesByTime(theMovie, theMediaType);
+}
+
+
+/*______________________________________________________________________
+	QTUTimeMediaSampleCounting - Compare counting samples by time and by sample table.
+
+pascal OSErr QTUTimeMediaSampleCounting(Movie theMovie, OSType theMediaType, double *theByTimeMicroseconds, 
+											double *theByTableMicroseconds, Boolean *theSameCount)
+
+theMovie					the movie
+theMediaType				the media type to count
+theByTimeMicroseconds		will contain the time stepping through the interesting times took
+theByTableMicroseconds		will contain the time QTUGetMediaSampleStatistics took for the first track
+theSameCount				will be true if both came to the same sample count
+
+DESCRIPTION
+	QTUTimeMediaSampleCounting is the benchmark of the sample table count, run it on a long sound 
+	track to see the difference. The counts are only expected to be the same if the movie has one 
+	track of the type and no edits.
+*/
+
+pascal OSErr QTUTimeMediaSampleCounting(Movie theMovie, OSType theMediaType, double *theByTimeMicroseconds, 
+											double *theByTableMicroseconds, Boolean *theSameCount)
+{
+	OSErr						anErr = noErr;
+	QTUMediaSampleStatistics	aStatistics;
+	UnsignedWide				aTimer;
+	Track						aTrack;
+	long						aCount;
+
+	DebugAssert(theMovie != NULL); if(theMovie == NULL) return invalidMovie;
+
+	aTrack = GetMovieIndTrackType(theMovie, 1, theMediaType, movieTrackMediaType);
+	if(aTrack == NULL) return invalidTrack;
+
+	QTUStartTimer(&aTimer);
+	aCount = QTUCountMediaSamplesByTime(theMovie, theMediaType);
+	*theByTimeMicroseconds = QTUElapsedMicroseconds(&aTimer);
+
+	QTUStartTimer(&aTimer);
+	anErr = QTUGetMediaSampleStatistics(GetTrackMedia(aTrack), &aStatistics);
+	*theByTableMicroseconds = QTUElapsedMicroseconds(&aTimer);
+
+	*theSameCount = (anErr == noErr && aStatistics.sampleCount == aCount);
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUGetDurationOfFirstMovieSample - Return the time value of the first sample of a certain 
+	media type.
+
+pascal TimeValue  QTUGetDurationOfFirstMovieSample(Movie theMovie, OSType theMediaType)
+
+theMovie						the movie with the media track
+theMediaType				specified media type (VideoMediaType, SoundMediaType and so on)
+
+DESCRIPTION
+	QTUGetDurationOfFirstMovieSample returns the duration of the first sample of a certain media 
+	in the movie. If there is no such sample, the duration is 0.
+
+	This function could be used in known cases where all the samples are assumed to be of the same 
+	duration. For instance in such cases the frame count could be calculated as:
+
+	framecount =
+			 GetMovieDuration(theMovie)/QTUGetDurationofFirstMovieSample(theMovie, VideoMediaType);
+
+*/
+
+pascal TimeValue  QTUGetDurationOfFirstMovieSample(Movie theMovie, OSType theMediaType)
+{
+	OSErr 			anErr = noErr;
+	TimeValue		interestingDuration = 0;
+	short			timeFlags = nextTimeMediaSample+nextTimeEdgeOK;
+
+	GetMovieNextInterestingTime(theMovie, timeFlags, (TimeValue)1, &theMediaType, 0, 
+													fixed1, NULL, &interestingDuration);
+	anErr = GetMoviesError(); DebugAssert(anErr == noErr);
+
+	return interestingDuration;
+}
+
+
+/*______________________________________________________________________
+	QTUCountMaxSoundRate - Calculate the max sound data rate of a possible sound track
+   in the movie.
+
+pascal OSErr QTUCountMaxSoundRate(Movie theMovie,long *theMaxSoundRate)
+
+theMovie						the movie with the sound track(tracks).	
+theMaxSoundRate			the final returned value
+
+DESCRIPTION
+	QTUCountMaxSoundRate (taken from the ConvertToMovieJr file) is a simple function that tries
+	to figure out the maximum sound track rate. This is done by looking at all of the sound tracks
+	in the source movie, and using the one with the highest sample rate (11khz, 22khz and so on),
+
+	This number could then be used for calculating the maximum data rate by extracting the sound rate and 
+	this way we get a loose estimation how much is left for the video data rate.
+	
+	This is just an approximation, and a better function should take into account non-overlapping
+	sound tracks, stereo sound data rates, compressed sound tracks and so on.
+*/
+
+pascal OSErr QTUCountMaxSoundRate(Movie theMovie,long *theMaxSoundRate)
+{
+	OSErr				anErr = noErr;
+	QTUTrackCatalog		*aCatalog;
+	QTUTrackInfo		*aTrackInfo;
+	long				index;
+	
+	DebugAssert(theMovie != NULL); if(theMovie == NULL) return invalidMovie;
+	*theMaxSoundRate = 0; // just for security we place this value in here
+	
+	anErr = QTUGetTrackCatalog(theMovie, &aCatalog); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	
+	for(index = 1; (aTrackInfo = QTUFindTrackInfo(aCatalog, SoundMediaType, index)) != NULL; index++)
+	{
+		long aRate = aTrackInfo->sampleRate >> 16;
+		
+		if(aRate > *theMaxSoundRate)
+			*theMaxSoundRate = aRate;
 	}
 	return anErr;
 }
@@ -735,53 +1385,74 @@ DESCRIPTION
 */
 
 pascal OSErr QTUCopySoundTracks(Movie theSrcMovie, Movie theDestMovie)
+{
+	return QTUCopySoundTrackSegments(theSrcMovie, theDestMovie, 0, -1);
+}
+
+
+/*______________________________________________________________________
+	QTUCopySoundTrackSegments - Copy a segment of any sound track from the source movie to the destination movie.
+
+pascal OSErr QTUCopySoundTrackSegments(Movie theSrcMovie, Movie theDestMovie, TimeValue theStartTime, TimeValue theDuration)
+
+theSrcMovie		 			movie from which to copy the sound tracks			
+theDestMovie	 			movie to which we will copy the sound tracks.	
+theStartTime				start of the segment in the time scale of the source movie
+theDuration					duration of the segment, -1 for the rest of the track
+
+DESCRIPTION
+	QTUCopySoundTrackSegments works like QTUCopySoundTracks, but only the part of the sound tracks 
+	from theStartTime on is copied, to the beginning of the new tracks. This is what a movie cut 
+	into pieces needs for each of them.
+*/
+
+pascal OSErr QTUCopySoundTrackSegments(Movie theSrcMovie, Movie theDestMovie, TimeValue theStartTime, TimeValue theDuration)
 {
 	OSErr 	anErr = noErr;
-	long		trackCount, index;
+	QTUTrackCatalog	*aCatalog;
+	QTUTrackInfo	*aTrackInfo;
+	long		index;
 	
 	DebugAssert(theSrcMovie != NULL); if(theSrcMovie == NULL) return invalidMovie;
 	DebugAssert(theDestMovie != NULL); if(theDestMovie == NULL) return invalidMovie;
 
-	trackCount = GetMovieTrackCount(theSrcMovie);
+	anErr = QTUGetTrackCatalog(theSrcMovie, &aCatalog); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
 	
-	// Loop through each track, look for sound tracks.
-	for(index = 1; index <= trackCount; index++)
+	// Loop through the sound tracks of the catalog.
+	for(index = 1; (aTrackInfo = QTUFindTrackInfo(aCatalog, SoundMediaType, index)) != NULL; index++)
 	{
-		OSType aTrackType;
-		Track	aSrcTrack, aDestTrack;
-		Media	aSrcMedia, aDestMedia;
+		Track	aSrcTrack = aTrackInfo->track, aDestTrack;
+		Media	aDestMedia;
+		TimeValue aDuration;
 		
-		aSrcTrack = GetMovieIndTrack(theSrcMovie, index);			// get next track and media
-		aSrcMedia = GetTrackMedia(aSrcTrack);
+		// The segment might end after the track, or the track before the segment.
+		aDuration = aTrackInfo->duration - theStartTime;
+		if(theDuration >= 0 && theDuration < aDuration)
+			aDuration = theDuration;
+		if(aDuration <= 0)
+			continue;
+		
+		// Create the track for the sound media.
+		aDestTrack = NewMovieTrack(theDestMovie, 0, 0, GetTrackVolume(aSrcTrack));
 		anErr = GetMoviesError(); DebugAssert(anErr == noErr);
 		if(anErr != noErr) return anErr;
 		
-		// try to find sound tracks/media
-		GetMediaHandlerDescription(aSrcMedia, &aTrackType, 0, 0);
-		if(aTrackType == SoundMediaType)
-		{
-			// Create the track for the sound media.
-			aDestTrack = NewMovieTrack(theDestMovie, 0, 0, GetTrackVolume(aSrcTrack));
-			anErr = GetMoviesError(); DebugAssert(anErr == noErr);
-			if(anErr != noErr) return anErr;
-			
-			// Create a media for the sound track and prepare this media for editing.
-			aDestMedia = NewTrackMedia(aDestTrack, SoundMediaType, GetMediaTimeScale(aSrcMedia), 0, 0);
-			anErr = GetMoviesError(); DebugAssert(anErr == noErr);
-			if(anErr != noErr) return anErr;
-			
-			anErr = BeginMediaEdits(aDestMedia); DebugAssert(anErr == noErr);
-			if(anErr != noErr) return anErr;
-			
-			// Insert the new track into the destination movie starting at time zero and
-			// lasting for the entire duration of the movie.
-			InsertTrackSegment(aSrcTrack, aDestTrack, 0 , GetTrackDuration(aSrcTrack), 0);
-			anErr = GetMoviesError(); DebugAssert(anErr == noErr);
-			if(anErr != noErr) return anErr;
-			
-			// We've done editing the media
-			EndMediaEdits(aDestMedia);
-		}
+		// Create a media for the sound track and prepare this media for editing.
+		aDestMedia = NewTrackMedia(aDestTrack, SoundMediaType, aTrackInfo->timeScale, 0, 0);
+		anErr = GetMoviesError(); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+		
+		anErr = BeginMediaEdits(aDestMedia); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+		
+		// Insert the segment into the new track starting at time zero.
+		InsertTrackSegment(aSrcTrack, aDestTrack, theStartTime, aDuration, 0);
+		anErr = GetMoviesError(); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+		
+		// We've done editing the media
+		EndMediaEdits(aDestMedia);
 	}
 	return anErr;
 }
@@ -789,446 +1460,959 @@ pascal OSErr QTUCopySoundTracks(Movie theSrcMovie, Movie theDestMovie)
 
 
 /*______________________________________________________________________
-	QTUPrintMoviePICT - Print the existing movie frame pict.
+	QTUNewSampleWriter - Create a writer that appends samples to a media in chunks.
 
-pascal Boolean QTUPrintMoviePICTr(Movie theMovie, short x, short y,  long PICTUsed)
+pascal OSErr QTUNewSampleWriter(Media theMedia, TimeValue theChunkDuration, long theChunkSize, QTUSampleWriter *theWriter)
 
-theMovie					movie that has the poster		
-x,y		    				starting point coordinates where to place the poster on paper
+theMedia					the media we are adding samples to, it has to be inside BeginMediaEdits
+theChunkDuration			collect at most this much media time in one chunk
+theChunkSize				collect at most this many bytes in one chunk
+theWriter					will contain the new sample writer
 
 DESCRIPTION
-	QTUPrintMoviePICT is a simple function showing how to print movie posters. 
+	AddMediaSample writes the sample data and updates the sample table every time it's called, which
+	for video means once per frame. QTUNewSampleWriter creates a writer that collects the samples in a
+	buffer instead, and when the chunk is full (duration or size), the whole chunk is written with one
+	data handler write at the end of the media's data file, and all the samples are added to the sample
+	table with one AddMediaSampleReferences call. The result is fewer and larger writes, and a compact
+	sample-to-chunk table.
 
-ISSUES
-	Note that in a real application we should put the PrStlDialog code into the Print Setup menu
-	function. The reason it's inside this function is that we use this code for quick testing of 
-	printing.
+	All the samples in one chunk share one sample description, a sample with another description
+	handle flushes the chunk collected so far.
+
+	By default every chunk write is finished before QTUSampleWriterAddSample returns, call
+	QTUSampleWriterSetWriteBehind to let the writes run behind the caller.
+
+EXAMPLE
+	anErr = BeginMediaEdits(aMedia);
+	anErr = QTUNewSampleWriter(aMedia, GetMediaTimeScale(aMedia) / 2, 1024L * 1024L, &aWriter);
+	anErr = QTUSampleWriterAddSample(aWriter, *aData, aDataSize, aDuration, aDescription, aSyncFlag);
+	anErr = QTUDisposeSampleWriter(aWriter);
+	anErr = EndMediaEdits(aMedia);
 */
-#if TARGET_OS_WIN32
-pascal OSErr QTUPrintMoviePICT(Movie theMovie, short x, short y, long PICTUsed)
+
+#define kQTUMaxChunkSamples		1024
+#define kQTUMaxWritesInFlight	8
+
+typedef struct QTUChunkWrite {
+	Ptr							data;							// the chunk buffer, untouchable while inFlight
+	volatile Boolean			inFlight;
+	volatile OSErr				result;
+} QTUChunkWrite;
+
+struct QTUSampleWriterRecord {
+	Media						media;
+	DataHandler					dataHandler;
+	TimeValue					chunkDuration;
+	long						chunkSize;
+	Ptr							chunkData;						// the buffer of the current write
+	long						writeCount;						// chunk buffers, 0 when every write is synchronous
+	long						currentWrite;
+	long						writeOffset;					// where the next chunk goes when writes are in flight
+	QTUChunkWrite				writes[kQTUMaxWritesInFlight];
+	DataHCompletionUPP			writeCompletion;
+	long						chunkDataSize;
+	TimeValue					chunkDataDuration;
+	SampleDescriptionHandle		chunkDescription;
+	long						sampleCount;
+	SampleReferenceRecord		samples[kQTUMaxChunkSamples];
+	QTUSampleWriterStatistics	statistics;
+};
+
+pascal OSErr QTUNewSampleWriter(Media theMedia, TimeValue theChunkDuration, long theChunkSize, QTUSampleWriter *theWriter)
 {
-	OSErr		anErr = noErr;
-	PicHandle 	aPictHandle = NULL;
-	THPrint		aTHPrint = NULL;
-	GrafPtr	 	aSavedPort;
-	TPPrPort	aPrintPort;
-	Boolean 	aResult;
-	Boolean		isPrinting = false;
-	Rect			aPictRect;
-	
-	DebugAssert(theMovie != NULL); if(theMovie == NULL) return invalidMovie;
-	
-	GetPort(&aSavedPort);
+	QTUSampleWriter		aWriter = NULL;
 
-// Get the PICT to be printed, either the poster pict or the current frame pict.
-	switch(PICTUsed)
-	{
-		case kPrintFrame:
-			aPictHandle = GetMoviePict(theMovie, GetMovieTime(theMovie, 0L));
-			break;
-			
+	DebugAssert(theMedia != NULL); if(theMedia == NULL) return invalidMedia;
+	DebugAssert(theWriter != NULL); if(theWriter == NULL) return paramErr;
+	*theWriter = NULL;
 
-		case kPrintPoster:
-			aPictHandle = GetMoviePosterPict(theMovie); 
-			break;
+	aWriter = (QTUSampleWriter)NewPtrClear(sizeof(struct QTUSampleWriterRecord)); DebugAssert(aWriter != NULL);
+	if(aWriter == NULL) return memFullErr;
 
-		default:
-			DebugAssert("Should not happen, incorrect constant used"); goto Closure;
-	}
+	aWriter->media = theMedia;
+	aWriter->chunkDuration = theChunkDuration;
+	aWriter->chunkSize = theChunkSize;
 
-	if(aPictHandle == NULL) goto Closure;
+	// This is the data handler BeginMediaEdits opened for writing.
+	aWriter->dataHandler = GetMediaDataHandler(theMedia, 1); DebugAssert(aWriter->dataHandler != NULL);
+	aWriter->chunkData = NewPtr(theChunkSize); DebugAssert(aWriter->chunkData != NULL);
+	aWriter->writes[0].data = aWriter->chunkData;
+	if(aWriter->dataHandler == NULL || aWriter->chunkData == NULL)
+	{
+		OSErr anErr = (aWriter->dataHandler == NULL) ? cantFindHandler : memFullErr;
 
+		QTUDisposeSampleWriter(aWriter);
+		return anErr;
+	}
 
-// Get the Print record.
-	aTHPrint = (THPrint) NewHandleClear(sizeof(TPrint)); DebugAssert(aTHPrint != NULL);
-	if(aTHPrint == NULL) goto Closure;
+	*theWriter = aWriter;
+	return noErr;
+}
 
-	PrOpen(); isPrinting = true;
-	anErr = PrError(); DebugAssert(anErr == noErr);
-		if(anErr != noErr) goto Closure;
 
-	PrintDefault(aTHPrint);
+/*______________________________________________________________________
+	QTUSampleWriterWriteData - Append data at the end of the media's data file.
 
-// Move this to Print Setupif you want to make this look really cool.	
-	aResult = PrStlDialog(aTHPrint); DebugAssert(aResult == true);
-	if(!aResult) goto Closure;
-	
-	aResult = PrJobDialog(aTHPrint); DebugAssert(aResult == true);
-	if(!aResult) goto Closure;
-	
-	aPrintPort = PrOpenDoc(aTHPrint, NULL, NULL); DebugAssert(aPrintPort != NULL);
-	PrOpenPage(aPrintPort, NULL);
-	anErr = PrError(); DebugAssert(anErr == noErr);
-	if(anErr != noErr) goto Closure;
-	
-// Print at x,y position
-	aPictRect =  (*aPictHandle)->picFrame;
-	OffsetRect(&aPictRect, x - aPictRect.left,  y  - aPictRect.top);
-	
-	DrawPicture(aPictHandle, &aPictRect);
+static OSErr QTUSampleWriterWriteData(QTUSampleWriter theWriter, Ptr theData, long theDataSize, QTUChunkWrite *theWrite, 
+										long *theOffset)
+
+DESCRIPTION
+	QTUSampleWriterWriteData does the one contiguous write for a chunk, and returns the file offset the
+	data was written to, this is what the sample references need. With theWrite the write is only 
+	started, theData has to stay as it is until the completion routine clears theWrite->inFlight.
+*/
+
+static OSErr QTUSampleWriterWriteData(QTUSampleWriter theWriter, Ptr theData, long theDataSize, QTUChunkWrite *theWrite, 
+										long *theOffset)
+{
+	OSErr	anErr = noErr;
+
+	// With writes in flight the file is not as long as it is going to be, so we keep track of its end ourselves.
+	if(theWriter->writeCount > 0)
+		*theOffset = theWriter->writeOffset;
+	else
+	{
+		anErr = DataHGetFileSize(theWriter->dataHandler, theOffset); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+	}
+
+	if(theWrite != NULL)
+	{
+		theWrite->result = noErr;
+		theWrite->inFlight = true;
+		anErr = DataHWrite(theWriter->dataHandler, theData, *theOffset, theDataSize, theWriter->writeCompletion, 
+								(long)theWrite); DebugAssert(anErr == noErr);
+		if(anErr != noErr)
+			theWrite->inFlight = false;
+	}
+	else
+	{
+		anErr = DataHWrite(theWriter->dataHandler, theData, *theOffset, theDataSize, NULL, 0); DebugAssert(anErr == noErr);
+	}
+
+	if(anErr == noErr)
+		theWriter->writeOffset = *theOffset + theDataSize;
 
-// If you want to do additional drawing, do it here.
-	
-	PrClosePage(aPrintPort);
-	PrCloseDoc(aPrintPort);
-	anErr = PrError(); DebugAssert(anErr == noErr);
-	if(anErr != noErr) goto Closure;
-	
-	if(( *aTHPrint)->prJob.bJDocLoop == bSpoolLoop)
-		PrPicFile(aTHPrint, NULL, NULL, NULL, NULL);
-	
-// Our closure handling.
-Closure:
-	SetPort(aSavedPort);
-	
-	if(isPrinting) PrClose();
-	if(aPictHandle) KillPicture(aPictHandle);
-	if(aTHPrint) DisposeHandle((Handle)aTHPrint);
 	return anErr;
 }
-#endif
+
 
 /*______________________________________________________________________
-	QTUCalculateMovieMemorySize - Calculate how much memory a movie takes in the app heap.
+	QTUSampleWriterWriteDone - Completion routine of the chunk writes.
 
-pascal OSErr QTUCalculateMovieMemorySize(Movie theMovie, long *theSize)
+static pascal void QTUSampleWriterWriteDone(Ptr theRequest, long theRefCon, OSErr theErr)
 
-theMovie						movie we want to know the size of in the current application heap
-theSize							pointer to a long that will contain the movie size in bytes
+DESCRIPTION
+	QTUSampleWriterWriteDone could be called at deferred task time, all it does is mark the chunk 
+	buffer free.
+*/
+
+static pascal void QTUSampleWriterWriteDone(Ptr theRequest, long theRefCon, OSErr theErr)
+{
+#pragma unused(theRequest)
+	QTUChunkWrite *aWrite = (QTUChunkWrite*)theRefCon;
+
+	aWrite->result = theErr;
+	aWrite->inFlight = false;
+}
+
+
+/*______________________________________________________________________
+	QTUSampleWriterWaitForWrite - Wait until a chunk write is done.
+
+static OSErr QTUSampleWriterWaitForWrite(QTUSampleWriter theWriter, QTUChunkWrite *theWrite)
 
 DESCRIPTION
-	QTUCalculateMovieMemorySize will return the amount of bytes it is allocating as a handle
-	in the current application heap, if there's not enough space for a temp handle, or if anything
-	else fails, the function will return 0L in theSize (and the OSErr).
+	QTUSampleWriterWaitForWrite gives the data handler time until the write completed, and returns
+	the result of the write.
+*/
 
-ISSUES
-	Note that possible movie controllers associated with the movie and other constructs will eat up
-	memory. What you could do is to do a MacsBug HT before the movie or movies are opened, 
-	check the amount of free space, and HT after the movies are opened, figure out the movie sizes 
-	using the function below, and calculate the delta from these values.
+static OSErr QTUSampleWriterWaitForWrite(QTUSampleWriter theWriter, QTUChunkWrite *theWrite)
+{
+	if(theWrite->inFlight)
+	{
+		UnsignedWide aTimer;
+
+		QTUStartTimer(&aTimer);
+		while(theWrite->inFlight)
+			DataHTask(theWriter->dataHandler);
+
+		theWriter->statistics.writeWaits++;
+		theWriter->statistics.writeWaitMicroseconds += QTUElapsedMicroseconds(&aTimer);
+	}
+
+	return theWrite->result;
+}
+
+
+/*______________________________________________________________________
+	QTUSampleWriterFlush - Write the samples collected so far.
+
+pascal OSErr QTUSampleWriterFlush(QTUSampleWriter theWriter)
+
+theWriter					the sample writer
+
+DESCRIPTION
+	QTUSampleWriterFlush writes the current chunk (if there's anything in it) and adds the samples to
+	the media's sample table. The writer flushes itself when a chunk is full, call this function when
+	you need all the samples added so far to be part of the media, QTUDisposeSampleWriter does it too.
+	With write-behind the samples are in the sample table when we return, but the data might still be
+	on its way to the disk, QTUSampleWriterSync waits for it. An error might be the one of an earlier
+	chunk write.
 */
 
-pascal OSErr QTUCalculateMovieMemorySize(Movie theMovie, long *theSize)
+pascal OSErr QTUSampleWriterFlush(QTUSampleWriter theWriter)
 {
-	OSErr 	anErr = noErr;
-	Handle	tempHandle = NULL;
+	OSErr	anErr = noErr;
+	long	aChunkOffset;
+	long	index;
 
-	DebugAssert(theMovie != NULL); if(theMovie == NULL) return invalidMovie;
+	DebugAssert(theWriter != NULL); if(theWriter == NULL) return paramErr;
 
-	*theSize = 0L;
+	if(theWriter->sampleCount == 0)
+		return noErr;
 
-	tempHandle = NewHandle(sizeof(Movie)); DebugAssert(tempHandle != NULL);
-	anErr = MemError(); DebugAssert(anErr == noErr);
-	if(anErr != noErr || tempHandle == NULL) goto Closure;
+	anErr = QTUSampleWriterWriteData(theWriter, theWriter->chunkData, theWriter->chunkDataSize, 
+											(theWriter->writeCount > 0) ? &theWriter->writes[theWriter->currentWrite] : NULL,
+											&aChunkOffset);
+	if(anErr != noErr) return anErr;
 
-	anErr =  PutMovieIntoHandle(theMovie, tempHandle); DebugAssert(anErr == noErr);
+	// The sample offsets were collected relative to the chunk start.
+	for(index = 0; index < theWriter->sampleCount; index++)
+		theWriter->samples[index].dataOffset += aChunkOffset;
 
-	if(anErr == noErr)	
-			*theSize = GetHandleSize(tempHandle);
+	anErr = AddMediaSampleReferences(theWriter->media, theWriter->chunkDescription, theWriter->sampleCount, 
+												theWriter->samples, NULL); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
 
-Closure:
-	if(tempHandle != NULL) DisposeHandle(tempHandle);
+	theWriter->statistics.samplesWritten += theWriter->sampleCount;
+	theWriter->statistics.chunksWritten++;
+	theWriter->statistics.bytesWritten += theWriter->chunkDataSize;
+
+	theWriter->sampleCount = 0;
+	theWriter->chunkDataSize = 0;
+	theWriter->chunkDataDuration = 0;
+
+	// The next chunk goes into the next buffer, this is the only place we wait for the disk, and only when
+	// all the buffers are still being written.
+	if(theWriter->writeCount > 0)
+	{
+		theWriter->currentWrite = (theWriter->currentWrite + 1) % theWriter->writeCount;
+		theWriter->chunkData = theWriter->writes[theWriter->currentWrite].data;
+
+		anErr = QTUSampleWriterWaitForWrite(theWriter, &theWriter->writes[theWriter->currentWrite]); DebugAssert(anErr == noErr);
+	}
 
 	return anErr;
 }
 
 
 /*______________________________________________________________________
-	QTULoadWholeMovieToRAM - Load the entire active segment (movie) into RAM
+	QTUSampleWriterAddSample - Add a sample to the current chunk.
 
-pascal OSErr	QTULoadWholeMovieToRAM(Movie theMovie)
+pascal OSErr QTUSampleWriterAddSample(QTUSampleWriter theWriter, Ptr theData, long theDataSize, TimeValue theDuration,
+										SampleDescriptionHandle theDescription, short theSampleFlags)
 
-theMovie						movie we want to know the size of in the current application heap.
+theWriter					the sample writer
+theData						the sample data, it's copied so it could be reused as soon as we return
+theDataSize					size of the sample data
+theDuration					duration of the sample in the media time scale
+theDescription				sample description, this handle should stay around until the writer is flushed
+theSampleFlags				same flags as with AddMediaSample (mediaSampleNotSync and so on)
 
 DESCRIPTION
-	QTULoadWholeMovieToRAM is an example of how to load movie information into RAM. In
-	this case we will load the entire movie, or in other words all the active segments.
-
-ISSUES
-	The most likely error returned from this function is due to lack of memory.  You could 
-	also fine tune this function by loading partial data based on time or track specifications.
-
-	Loading whole movies is OK if the movies are small, have few tracks with little info (text
-	tracks, music tracks and so on), there's a certain performance need  why it makes sense 
-	to keep the movie in RAM (looping, other issues), and in general if you know why it's needed.
+	QTUSampleWriterAddSample copies the sample into the current chunk, and writes the chunk out first
+	if the sample would not fit, if the chunk already holds the chunk duration, or if the sample uses
+	another sample description. A sample bigger than the whole chunk buffer is written on its own.
 */
 
-pascal OSErr	QTULoadWholeMovieToRAM(Movie theMovie)
+pascal OSErr QTUSampleWriterAddSample(QTUSampleWriter theWriter, Ptr theData, long theDataSize, TimeValue theDuration,
+											SampleDescriptionHandle theDescription, short theSampleFlags)
 {
-	OSErr anErr = noErr;
+	OSErr					anErr = noErr;
+	SampleReferenceRecord	*aSample;
 
-	DebugAssert(theMovie != NULL); if(theMovie == NULL) return invalidMovie;
+	DebugAssert(theWriter != NULL); if(theWriter == NULL) return paramErr;
+	DebugAssert(theData != NULL); if(theData == NULL) return paramErr;
 
-	GoToBeginningOfMovie(theMovie);
-	anErr = GetMoviesError(); DebugAssert(anErr == noErr);
-	if (anErr != noErr) return anErr;
+	if( (theWriter->sampleCount == kQTUMaxChunkSamples) ||
+		(theWriter->sampleCount > 0 && theDescription != theWriter->chunkDescription) ||
+		(theWriter->chunkDataSize + theDataSize > theWriter->chunkSize) ||
+		(theWriter->chunkDataDuration >= theWriter->chunkDuration) )
+	{
+		anErr = QTUSampleWriterFlush(theWriter);
+		if(anErr != noErr) return anErr;
+	}
 
-	anErr = LoadMovieIntoRam(theMovie, GetMovieTime(theMovie, NULL), GetMovieDuration(theMovie), 0);
+	theWriter->chunkDescription = theDescription;
 
-	return anErr;
+	// Too big for the chunk buffer, write it directly as a chunk of its own.
+	if(theDataSize > theWriter->chunkSize)
+	{
+		SampleReferenceRecord aLargeSample;
+
+		// theData is the caller's, so this write can't be left behind.
+		anErr = QTUSampleWriterWriteData(theWriter, theData, theDataSize, NULL, &aLargeSample.dataOffset);
+		if(anErr != noErr) return anErr;
+
+		aLargeSample.dataSize = theDataSize;
+		aLargeSample.durationPerSample = theDuration;
+		aLargeSample.numberOfSamples = 1;
+		aLargeSample.sampleFlags = theSampleFlags;
+
+		anErr = AddMediaSampleReferences(theWriter->media, theDescription, 1, &aLargeSample, NULL); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+
+		theWriter->statistics.samplesWritten++;
+		theWriter->statistics.chunksWritten++;
+		theWriter->statistics.bytesWritten += theDataSize;
+		return noErr;
+	}
+
+	BlockMoveData(theData, theWriter->chunkData + theWriter->chunkDataSize, theDataSize);
+
+	aSample = &theWriter->samples[theWriter->sampleCount++];
+	aSample->dataOffset = theWriter->chunkDataSize;
+	aSample->dataSize = theDataSize;
+	aSample->durationPerSample = theDuration;
+	aSample->numberOfSamples = 1;
+	aSample->sampleFlags = theSampleFlags;
+
+	theWriter->chunkDataSize += theDataSize;
+	theWriter->chunkDataDuration += theDuration;
+
+	return noErr;
 }
 
 
 /*______________________________________________________________________
-	QTUPlayMovieSound - Play the movie sound track using the Sound Manager.
+	QTUSampleWriterSync - Wait for the chunk writes and flush them to the disk.
 
-pascal OSErr QTUPlayMovieSound(Movie theMovie)
+pascal OSErr QTUSampleWriterSync(QTUSampleWriter theWriter)
 
-theMovie						movie wherefrom we extract the sound resource
+theWriter					the sample writer
 
 DESCRIPTION
-	QTUPlayMovieSound is an example of how to extract the 'snd ' sound resource from the 
-	first sound track in a movie, and play this track back using the Sound Manager. This
-	sound resource could also be retrieved, or otherwised used in other instances. Note that
-	this function is more of an example of how to retrieve sound from a movie; you might
-	want to control the start point, duration, and sound track extracted.
-
+	QTUSampleWriterSync waits until every chunk write that was started is done and asks the data handler
+	to flush what it wrote. Call it at the points where the file has to be complete, before the movie
+	resource is added or anything else is written to the same data file. Samples in the current chunk
+	are not written, call QTUSampleWriterFlush first for those.
 */
 
-pascal OSErr QTUPlayMovieSound(Movie theMovie)
+pascal OSErr QTUSampleWriterSync(QTUSampleWriter theWriter)
 {
 	OSErr	anErr = noErr;
-	Handle 	tempHandle  = NewHandle(1);
-	
-	DebugAssert(theMovie != NULL); if(theMovie == NULL) return invalidMovie;
+	OSErr	aWriteErr;
+	long	index;
 
-	// Extract first sound track.
-	anErr = PutMovieIntoTypedHandle(theMovie, (Track)0, 'snd ', tempHandle, 0, GetMovieDuration(theMovie),
-														0, (ComponentInstance)0); DebugAssert(anErr == noErr);
-	if(anErr != noErr) goto Closure;
-	anErr = MemError(); DebugAssert(anErr == noErr);
-	if(anErr != noErr) goto Closure;
+	DebugAssert(theWriter != NULL); if(theWriter == NULL) return paramErr;
 
-	// Play sound resource async.
-	anErr = SndPlay(0L, (SndListHandle)tempHandle, true);	 DebugAssert(anErr == noErr);
+	for(index = 0; index < theWriter->writeCount; index++)
+	{
+		aWriteErr = QTUSampleWriterWaitForWrite(theWriter, &theWriter->writes[index]); DebugAssert(aWriteErr == noErr);
+		if(anErr == noErr) 
+			anErr = aWriteErr;
+	}
 
-Closure:
-	if(tempHandle) DisposeHandle(tempHandle);
+	// Data handlers that don't buffer writes don't implement the flush.
+	if(theWriter->statistics.chunksWritten > 0)
+	{
+		ComponentResult aFlushResult = DataHFlushData(theWriter->dataHandler);
+
+		if(anErr == noErr && aFlushResult != badComponentSelector) 
+			anErr = (OSErr)aFlushResult;
+	}
 
 	return anErr;
 }
 
 
 /*______________________________________________________________________
-	QTUDrawVideoFrameAtTime - Display a movie video frame at specified movie time.
+	QTUSampleWriterSetWriteBehind - Let the chunk writes run behind the caller.
 
-pascal OSErr QTUDrawVideoFrameAtTime(Movie theMovie, TimeValue atTime)
+pascal OSErr QTUSampleWriterSetWriteBehind(QTUSampleWriter theWriter, long theWritesInFlight)
 
-theMovie						movie we are using
-atTime							time value in the movie for the video frame we want to display
+theWriter					the sample writer
+theWritesInFlight			chunk writes that may be in flight at once, up to 8, 0 to wait for every write
 
 DESCRIPTION
-	QTUDrawVideoFrameAtTime will display a specific video sample (or frame) at a specified time.
-	In other words if we want to draw a frame at time point 600, the nearest video frame
-	corresponding to this time value will be shown. 
+	A full chunk is normally written before QTUSampleWriterAddSample returns, so the caller (compressing
+	the next frame) waits for the disk every time. With write-behind the writer has theWritesInFlight
+	chunk buffers, a full chunk is written asynchronously by the data handler and the next chunk is
+	collected in the next buffer. The caller only waits when all the buffers are still being written,
+	this is counted in the writeWaits of the statistics. The memory used is theWritesInFlight times the
+	chunk size.
 
-	We assume that the movie is properly set, and is using a correct portRect or GWorld.
+	The writer keeps track of the end of the data file itself, so nothing else should write to the same
+	data file before QTUSampleWriterSync (or QTUDisposeSampleWriter) was called. Samples bigger than a
+	chunk are still written synchronously, the data is the caller's.
 
+EXAMPLE
+	anErr = QTUNewSampleWriter(aMedia, GetMediaTimeScale(aMedia) / 2, 1024L * 1024L, &aWriter);
+	anErr = QTUSampleWriterSetWriteBehind(aWriter, 4);
+	anErr = QTUSampleWriterAddSample(aWriter, *aData, aDataSize, aDuration, aDescription, aSyncFlag);
+	anErr = QTUSampleWriterFlush(aWriter);
+	anErr = QTUSampleWriterSync(aWriter);
 */
 
-pascal OSErr QTUDrawVideoFrameAtTime(Movie theMovie, TimeValue atTime)
+pascal OSErr QTUSampleWriterSetWriteBehind(QTUSampleWriter theWriter, long theWritesInFlight)
 {
-	TimeValue totalTime;
-	
-	OSErr anErr = noErr;
-	DebugAssert(theMovie != NULL); if(theMovie == NULL) return paramErr;
-	
-	totalTime = GetMovieDuration(theMovie);
-	if(atTime > totalTime) return paramErr;
-	
-	if(atTime == 0L) {
-		GoToBeginningOfMovie(theMovie); anErr = GetMoviesError(); DebugAssert(anErr == noErr);
-		if(anErr) goto Closure;
+	OSErr	anErr = noErr;
+	long	index;
+
+	DebugAssert(theWriter != NULL); if(theWriter == NULL) return paramErr;
+	if(theWritesInFlight > kQTUMaxWritesInFlight) theWritesInFlight = kQTUMaxWritesInFlight;
+	if(theWritesInFlight < 0) theWritesInFlight = 0;
+
+	if(theWritesInFlight == theWriter->writeCount)
+		return noErr;
+
+	// Start over with everything on the disk, the chunk collected so far is written the old way.
+	anErr = QTUSampleWriterFlush(theWriter); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	anErr = QTUSampleWriterSync(theWriter); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+
+	// The first buffer is the one the writer was created with.
+	for(index = 1; index < theWriter->writeCount; index++)
+	{
+		DisposePtr(theWriter->writes[index].data);
+		theWriter->writes[index].data = NULL;
 	}
-	else {
-		SetMovieTimeValue(theMovie, atTime); anErr = GetMoviesError(); DebugAssert(anErr == noErr);
-		if(anErr) goto Closure;
+	theWriter->chunkData = theWriter->writes[0].data;
+	theWriter->currentWrite = 0;
+	theWriter->writeCount = 0;
+
+	if(theWritesInFlight == 0)
+		return noErr;
+
+	if(theWriter->writeCompletion == NULL)
+	{
+		theWriter->writeCompletion = NewDataHCompletionUPP(QTUSampleWriterWriteDone); DebugAssert(theWriter->writeCompletion != NULL);
+		if(theWriter->writeCompletion == NULL) return memFullErr;
 	}
-	
-	anErr = UpdateMovie(theMovie);  DebugAssert(anErr == noErr);
-	if(anErr) goto Closure;
-	
-	MoviesTask(theMovie, 0L); anErr = GetMoviesError(); DebugAssert(anErr == noErr);
 
-Closure:	
-	return anErr;
-}
+	anErr = DataHGetFileSize(theWriter->dataHandler, &theWriter->writeOffset); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+
+	for(index = 1; index < theWritesInFlight; index++)
+	{
+		theWriter->writes[index].data = NewPtr(theWriter->chunkSize); DebugAssert(theWriter->writes[index].data != NULL);
+		if(theWriter->writes[index].data == NULL)
+		{
+			// Keep the buffers we got, fewer writes in flight is still better than none.
+			if(index == 1) return memFullErr;
+			break;
+		}
+	}
+	theWriter->writeCount = index;
 
+	return noErr;
+}
 
 
 /*______________________________________________________________________
-	QTUScrollToNextVideoSample -  Scroll offscreen from one video sample to the next.
+	QTUSampleWriterGetStatistics - Return how much the sample writer has written.
 
-pascal OSErr QTUScrollToNextVideoSample(Movie theMovie, TimeValue fromTimePoint, TimeValue toTimePoint)
+pascal void QTUSampleWriterGetStatistics(QTUSampleWriter theWriter, QTUSampleWriterStatistics *theStatistics)
 
-fromTimePoint						starting time value of the first video sample (frame)
-toTimePoint							end time value for the second video sample (frame)
+theWriter					the sample writer
+theStatistics				will contain the sample, chunk and byte counts
 
 DESCRIPTION
-	QTUScrollToNextVideoSample will scroll from one video sample to the other one using offscreen
-	GWorlds where the effect is created. 
+	QTUSampleWriterGetStatistics returns the counters for what was written so far, samples still in
+	the current chunk are not included.
+*/
 
-	We assume that the movie is properly set, and that the movie will use a proper portRect or GWorld.
+pascal void QTUSampleWriterGetStatistics(QTUSampleWriter theWriter, QTUSampleWriterStatistics *theStatistics)
+{
+	DebugAssert(theWriter != NULL);
+	if(theWriter != NULL) 
+		*theStatistics = theWriter->statistics;
+}
 
-CREDITS
-	Presto Studios for the core idea and some of the code below.
 
-*/
-#if TARGET_OS_WIN32
-pascal OSErr QTUScrollToNextVideoSample(Movie theMovie, TimeValue fromTimePoint, TimeValue toTimePoint) 
+/*______________________________________________________________________
+	QTUDisposeSampleWriter - Flush and dispose a sample writer.
+
+pascal OSErr QTUDisposeSampleWriter(QTUSampleWriter theWriter)
+
+theWriter					the sample writer
+
+DESCRIPTION
+	QTUDisposeSampleWriter writes what is left in the current chunk, waits for the writes in flight and
+	disposes the writer. Call it before EndMediaEdits. The error returned is the one from the last flush
+	or write, the writer is gone anyway.
+*/
+
+pascal OSErr QTUDisposeSampleWriter(QTUSampleWriter theWriter)
 {
-	OSErr 				anErr = noErr;
-	GWorldPtr			frameGWorld1 = NULL;
-	GWorldPtr			frameGWorld2 = NULL;
-	PixMapHandle	pixMap1 = NULL;
-	PixMapHandle	pixMap2	= NULL;
-	CGrafPtr			aSavedPort, moviePort;
-	GDHandle			aSavedGDevice, movieGDevice;
-	CTabHandle		colorTable;
-	short				screenDepth = 0;
-	short				screenSize = 0;
-	Rect					movieRect, sourceRect, destinationRect;
-	RgnHandle			scrollRegion = NULL;
-	RgnHandle			clipRegion = NULL;
-	short				nSteps;
-		
-	DebugAssert(theMovie != NULL); if(theMovie == NULL) goto Closure;
+	OSErr	anErr = noErr;
+	long	index;
+
+	if(theWriter == NULL) return noErr;
+
+	if(theWriter->chunkData != NULL)
+	{
+		OSErr aSyncErr;
+
+		anErr = QTUSampleWriterFlush(theWriter);
+
+		// No buffer can go away while it's being written.
+		aSyncErr = QTUSampleWriterSync(theWriter);
+		if(anErr == noErr)
+			anErr = aSyncErr;
+	}
+
+	for(index = 0; index < kQTUMaxWritesInFlight; index++)
+		if(theWriter->writes[index].data != NULL)
+			DisposePtr(theWriter->writes[index].data);
+	if(theWriter->writeCompletion != NULL)
+		DisposeDataHCompletionUPP(theWriter->writeCompletion);
+
+	DisposePtr((Ptr)theWriter);
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUPrintMoviePICT - Print the existing movie frame pict.
+
+pascal Boolean QTUPrintMoviePICTr(Movie theMovie, short x, short y,  long PICTUsed)
+
+theMovie					movie that has the poster		
+x,y		    				starting point coordinates where to place the poster on paper
+
+DESCRIPTION
+	QTUPrintMoviePICT is a simple function showing how to print movie posters. 
+
+ISSUES
+	Note that in a real application we should put the PrStlDialog code into the Print Setup menu
+	function. The reason it's inside this function is that we use this code for quick testing of 
+	printing.
+*/
+#if TARGET_OS_WIN32
+pascal OSErr QTUPrintMoviePICT(Movie theMovie, short x, short y, long PICTUsed)
+{
+	OSErr		anErr = noErr;
+	PicHandle 	aPictHandle = NULL;
+	THPrint		aTHPrint = NULL;
+	GrafPtr	 	aSavedPort;
+	TPPrPort	aPrintPort;
+	Boolean 	aResult;
+	Boolean		isPrinting = false;
+	Rect			aPictRect;
 	
-	// Store away current portrect and Gdevice, get pixel sizes and color table for GWorld creation purposes.
-	GetGWorld(&aSavedPort, &aSavedGDevice);
+	DebugAssert(theMovie != NULL); if(theMovie == NULL) return invalidMovie;
 	
-	GetMovieGWorld(theMovie, &moviePort, &movieGDevice);
-	screenDepth = (**(**aSavedGDevice).gdPMap).pixelSize;
-	colorTable = (**(**aSavedGDevice).gdPMap).pmTable;
+	GetPort(&aSavedPort);
+
+// Get the PICT to be printed, either the poster pict or the current frame pict.
+	switch(PICTUsed)
+	{
+		case kPrintFrame:
+			aPictHandle = GetMoviePict(theMovie, GetMovieTime(theMovie, 0L));
+			break;
+			
+
+		case kPrintPoster:
+			aPictHandle = GetMoviePosterPict(theMovie); 
+			break;
+
+		default:
+			DebugAssert("Should not happen, incorrect constant used"); goto Closure;
+	}
+
+	if(aPictHandle == NULL) goto Closure;
+
+
+// Get the Print record.
+	aTHPrint = (THPrint) NewHandleClear(sizeof(TPrint)); DebugAssert(aTHPrint != NULL);
+	if(aTHPrint == NULL) goto Closure;
+
+	PrOpen(); isPrinting = true;
+	anErr = PrError(); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+
+	PrintDefault(aTHPrint);
+
+// Move this to Print Setupif you want to make this look really cool.	
+	aResult = PrStlDialog(aTHPrint); DebugAssert(aResult == true);
+	if(!aResult) goto Closure;
 	
-	// Adjust the movie box.
-	 GetMovieBox(theMovie, &movieRect);  // If you want to offset by 10,10: OffsetRect(&movieRect, 10 -movieRect.left, 10 - movieRect.top);
-	 SetMovieBox(theMovie, &movieRect);
+	aResult = PrJobDialog(aTHPrint); DebugAssert(aResult == true);
+	if(!aResult) goto Closure;
 	
-	// Create two GWorlds for dual screen writing and possible scrolling transition effects. Lock down pixmaps.
-	anErr = NewGWorld(&frameGWorld1, screenDepth, &movieRect, colorTable, NULL, 0); DebugAssert(anErr == noErr);
-	if(anErr != noErr) goto Closure;
-	anErr = NewGWorld(&frameGWorld2, screenDepth, &movieRect, colorTable, NULL, 0); DebugAssert(anErr == noErr);
+	aPrintPort = PrOpenDoc(aTHPrint, NULL, NULL); DebugAssert(aPrintPort != NULL);
+	PrOpenPage(aPrintPort, NULL);
+	anErr = PrError(); DebugAssert(anErr == noErr);
 	if(anErr != noErr) goto Closure;
 	
-	pixMap1 = GetGWorldPixMap(frameGWorld1);  if(!LockPixels(pixMap1)) goto Closure;
-	pixMap2 = GetGWorldPixMap(frameGWorld2);  if(!LockPixels(pixMap2)) goto Closure;
-	
-	// Draw first video sample (frame) to GWorld number 1.
-	SetMovieGWorld(theMovie, frameGWorld1, GetGWorldDevice(frameGWorld1));
-	SetMovieTimeValue(theMovie, fromTimePoint);
-	UpdateMovie(theMovie); MoviesTask(theMovie, 0);
+// Print at x,y position
+	aPictRect =  (*aPictHandle)->picFrame;
+	OffsetRect(&aPictRect, x - aPictRect.left,  y  - aPictRect.top);
 	
-	// Draw second video sample (frame) to GWorld number 2.
-	SetMovieGWorld(theMovie, frameGWorld2, GetGWorldDevice(frameGWorld2));
-	SetMovieTimeValue(theMovie, toTimePoint); 
-	UpdateMovie(theMovie); MoviesTask(theMovie, 0);
+	DrawPicture(aPictHandle, &aPictRect);
+
+// If you want to do additional drawing, do it here.
 	
-	// Create scroll region and store away the current clip region.
-	scrollRegion = NewRgn(); DebugAssert(scrollRegion != NULL);
-	if(scrollRegion == NULL) goto Closure;
+	PrClosePage(aPrintPort);
+	PrCloseDoc(aPrintPort);
+	anErr = PrError(); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
 	
-	clipRegion = NewRgn(); DebugAssert(clipRegion != NULL);
-	if(clipRegion == NULL) goto Closure;
-	GetClip(clipRegion); ClipRect(&movieRect);
+	if(( *aTHPrint)->prJob.bJDocLoop == bSpoolLoop)
+		PrPicFile(aTHPrint, NULL, NULL, NULL, NULL);
 	
-	// Create the scroll effect.
-	screenSize = movieRect.right - movieRect.left;
+// Our closure handling.
+Closure:
+	SetPort(aSavedPort);
 	
-	for(nSteps = 10; nSteps <= screenSize; nSteps += 10)  {
-		SetGWorld( frameGWorld1, NULL);
-		
-		ScrollRect(&movieRect, -10, 0, scrollRegion);
-		SetRect(&sourceRect, movieRect.left, movieRect.top, 
-				movieRect.left + nSteps, movieRect.bottom);
-		SetRect(&destinationRect, movieRect.right - nSteps,
-				movieRect.top, movieRect.right, movieRect.bottom);
-		
-		CopyBits( (BitMap *) *pixMap2, (BitMap *) *pixMap1, &sourceRect, &destinationRect,
-					srcCopy, NULL );				// blit from frameGWorld2 to frameGWorld1
-		DebugAssert(QDError() == noErr);
-		
-		SetGWorld(aSavedPort, aSavedGDevice);
-		CopyBits( (BitMap *) *pixMap1, (BitMap *) &aSavedPort->portPixMap, &movieRect,
-					&movieRect, srcCopy, NULL );   	// blit from frameGWorld1 to screen pixmap
-		DebugAssert(QDError() == noErr);
-	}
+	if(isPrinting) PrClose();
+	if(aPictHandle) KillPicture(aPictHandle);
+	if(aTHPrint) DisposeHandle((Handle)aTHPrint);
+	return anErr;
+}
+#endif
 
-	// Unlock pixels, restore the original clip region.	
-	UnlockPixels(pixMap1); UnlockPixels(pixMap2);
-	SetClip(clipRegion);
-	
-	// Closure. Clean up if we have handles.
-Closure:	
-	if(frameGWorld1 != NULL) 		DisposeGWorld(frameGWorld1);
-	if(frameGWorld2 != NULL) 		DisposeGWorld(frameGWorld2);
-	if(scrollRegion != NULL) 			DisposeRgn(scrollRegion);
-	if(clipRegion != NULL) 				DisposeRgn(clipRegion);
+/*______________________________________________________________________
+	QTUCalculateMovieMemorySize - Calculate how much memory a movie takes in the app heap.
 
-	SetMovieGWorld(theMovie, moviePort, movieGDevice);
-	SetGWorld(aSavedPort, aSavedGDevice);	
+pascal OSErr QTUCalculateMovieMemorySize(Movie theMovie, long *theSize)
+
+theMovie						movie we want to know the size of in the current application heap
+theSize							pointer to a long that will contain the movie size in bytes
+
+DESCRIPTION
+	QTUCalculateMovieMemorySize will return the amount of bytes it is allocating as a handle
+	in the current application heap, if there's not enough space for a temp handle, or if anything
+	else fails, the function will return 0L in theSize (and the OSErr).
+
+ISSUES
+	Note that possible movie controllers associated with the movie and other constructs will eat up
+	memory. What you could do is to do a MacsBug HT before the movie or movies are opened, 
+	check the amount of free space, and HT after the movies are opened, figure out the movie sizes 
+	using the function below, and calculate the delta from these values.
+*/
+
+pascal OSErr QTUCalculateMovieMemorySize(Movie theMovie, long *theSize)
+{
+	OSErr 	anErr = noErr;
+	Handle	tempHandle = NULL;
+
+	DebugAssert(theMovie != NULL); if(theMovie == NULL) return invalidMovie;
+
+	*theSize = 0L;
+
+	tempHandle = NewHandle(sizeof(Movie)); DebugAssert(tempHandle != NULL);
+	anErr = MemError(); DebugAssert(anErr == noErr);
+	if(anErr != noErr || tempHandle == NULL) goto Closure;
+
+	anErr =  PutMovieIntoHandle(theMovie, tempHandle); DebugAssert(anErr == noErr);
+
+	if(anErr == noErr)	
+			*theSize = GetHandleSize(tempHandle);
+
+Closure:
+	if(tempHandle != NULL) DisposeHandle(tempHandle);
 
 	return anErr;
 }
-#endif
+
 
 /*______________________________________________________________________
-	QTUGetStartPointOfFirstVideoSample -  Get time value of first sample in the movie.
+	QTULoadWholeMovieToRAM - Load the entire active segment (movie) into RAM
 
-TimeValue QTUGetStartPointOfFirstVideoSample(Movie theMovie) 
+pascal OSErr	QTULoadWholeMovieToRAM(Movie theMovie)
 
-theMovie					movie we are interested in
-startPoint					will contain the value of the start point, if the function fails it will contain
-								-1.
+theMovie						movie we want to know the size of in the current application heap.
 
 DESCRIPTION
-	QTUGetStartPointOfFirstVideoSample will return the time value of the first video sample found in the
-	movie in the startPoint parameter. If the function fails, startPoint will contain -1 and the OSErr is 
-	also returned.
+	QTULoadWholeMovieToRAM is an example of how to load movie information into RAM. In
+	this case we will load the entire movie, or in other words all the active segments.
+
+ISSUES
+	The most likely error returned from this function is due to lack of memory.  You could 
+	also fine tune this function by loading partial data based on time or track specifications.
+
+	Loading whole movies is OK if the movies are small, have few tracks with little info (text
+	tracks, music tracks and so on), there's a certain performance need  why it makes sense 
+	to keep the movie in RAM (looping, other issues), and in general if you know why it's needed.
+	For long movies use QTUNewWindowLoader, it keeps only a window ahead of the playhead loaded.
 */
 
-pascal OSErr QTUGetStartPointOfFirstVideoSample(Movie theMovie, TimeValue *startPoint) 
+pascal OSErr	QTULoadWholeMovieToRAM(Movie theMovie)
 {
-	OSErr	anErr = noErr;
-	OSType	media = VideoMediaType;
-	
-	*startPoint = -1;
+	OSErr anErr = noErr;
 
-	GetMovieNextInterestingTime(theMovie, nextTimeMediaSample+nextTimeEdgeOK, (TimeValue)1, &media, 0, 
-													fixed1, startPoint, NULL);
+	DebugAssert(theMovie != NULL); if(theMovie == NULL) return invalidMovie;
+
+	GoToBeginningOfMovie(theMovie);
 	anErr = GetMoviesError(); DebugAssert(anErr == noErr);
+	if (anErr != noErr) return anErr;
+
+	anErr = LoadMovieIntoRam(theMovie, GetMovieTime(theMovie, NULL), GetMovieDuration(theMovie), 0);
 
 	return anErr;
 }
 
 
-// IMAGE COMPRESSION MANAGER
-
 /*______________________________________________________________________
-	QTUHasCodecLossLessQuality - Test if a specific codec has a lossless mode in a specific bit depth.
+	QTUPlayMovieSound - Play the movie sound track using the Sound Manager.
 
-Boolean QTUHasCodecLossLessQuality(CodecType theCodec, short thePixelDepth)
+pascal OSErr QTUPlayMovieSound(Movie theMovie)
 
-theCodec						specifies the Codec Type ('jpeg, 'rle ' and so on).
-thePixelDepth				specifies the bit depth (8, 24, 30 and so on). See NIM:QuickTime, page 
-									3-70 for more details.
+theMovie						movie wherefrom we extract the sound resource
 
 DESCRIPTION
-	QTUHasCodecLossLessQuality will test if a specific codec has a lossless spatial compression 
-	quality at a certain bit depth. Note that we are not testing the temporal compression qualities.
-
-EXAMPLE OF USE:
-	if(QTUHasCodecLossLessQuality('jpeg', 32))  
-		printf("JPEG has lossless spatial compression\n");
-	else
-		printf("JPEG has NOT lossless spatial compression\n");
+	QTUPlayMovieSound is an example of how to extract the 'snd ' sound resource from the 
+	first sound track in a movie, and play this track back using the Sound Manager. This
+	sound resource could also be retrieved, or otherwised used in other instances. Note that
+	this function is more of an example of how to retrieve sound from a movie; you might
+	want to control the start point, duration, and sound track extracted.
 
 */
 
-Boolean QTUHasCodecLossLessQuality(CodecType theCodec, short thePixelDepth)
+pascal OSErr QTUPlayMovieSound(Movie theMovie)
 {
-	OSErr 	anErr = noErr;
-	CodecQ	aSpatialQuality = codecLosslessQuality;
+	OSErr	anErr = noErr;
+	Handle 	tempHandle  = NewHandle(1);
+	
+	DebugAssert(theMovie != NULL); if(theMovie == NULL) return invalidMovie;
+
+	// Extract first sound track.
+	anErr = PutMovieIntoTypedHandle(theMovie, (Track)0, 'snd ', tempHandle, 0, GetMovieDuration(theMovie),
+														0, (ComponentInstance)0); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+	anErr = MemError(); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+
+	// Play sound resource async.
+	anErr = SndPlay(0L, (SndListHandle)tempHandle, true);	 DebugAssert(anErr == noErr);
+
+Closure:
+	if(tempHandle) DisposeHandle(tempHandle);
+
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUDrawVideoFrameAtTime - Display a movie video frame at specified movie time.
+
+pascal OSErr QTUDrawVideoFrameAtTime(Movie theMovie, TimeValue atTime)
+
+theMovie						movie we are using
+atTime							time value in the movie for the video frame we want to display
+
+DESCRIPTION
+	QTUDrawVideoFrameAtTime will display a specific video sample (or frame) at a specified time.
+	In other words if we want to draw a frame at time point 600, the nearest video frame
+	corresponding to this time value will be shown. 
+
+	We assume that the movie is properly set, and is using a correct portRect or GWorld.
+
+	Every call decodes from the key frame before atTime, which is slow with long distances between
+	key frames. To fetch many frames out of order, use a seek index (QTUGetSeekIndex and
+	QTUSeekIndexGetFrame) instead.
+
+*/
+
+pascal OSErr QTUDrawVideoFrameAtTime(Movie theMovie, TimeValue atTime)
+{
+	TimeValue totalTime;
+	
+	OSErr anErr = noErr;
+	DebugAssert(theMovie != NULL); if(theMovie == NULL) return paramErr;
+	
+	totalTime = GetMovieDuration(theMovie);
+	if(atTime > totalTime) return paramErr;
+	
+	if(atTime == 0L) {
+		GoToBeginningOfMovie(theMovie); anErr = GetMoviesError(); DebugAssert(anErr == noErr);
+		if(anErr) goto Closure;
+	}
+	else {
+		SetMovieTimeValue(theMovie, atTime); anErr = GetMoviesError(); DebugAssert(anErr == noErr);
+		if(anErr) goto Closure;
+	}
+	
+	anErr = UpdateMovie(theMovie);  DebugAssert(anErr == noErr);
+	if(anErr) goto Closure;
+	
+	MoviesTask(theMovie, 0L); anErr = GetMoviesError(); DebugAssert(anErr == noErr);
+
+Closure:	
+	return anErr;
+}
+
+
+
+/*______________________________________________________________________
+	QTUScrollToNextVideoSample -  Scroll offscreen from one video sample to the next.
+
+pascal OSErr QTUScrollToNextVideoSample(Movie theMovie, TimeValue fromTimePoint, TimeValue toTimePoint)
+
+fromTimePoint						starting time value of the first video sample (frame)
+toTimePoint							end time value for the second video sample (frame)
+
+DESCRIPTION
+	QTUScrollToNextVideoSample will scroll from one video sample to the other one using offscreen
+	GWorlds where the effect is created. 
+
+	The frames of the scroll are built from the pixels of the two GWorlds by a compositor (see
+	QTUNewCompositor), and every step copies only the part that changed to the port, instead of a
+	ScrollRect and two CopyBits of the whole frame. QTUTimeScrollTransition compares both ways.
+
+	We assume that the movie is properly set, and that the movie will use a proper portRect or GWorld.
+
+CREDITS
+	Presto Studios for the core idea and some of the code below.
+
+*/
+pascal OSErr QTUScrollToNextVideoSample(Movie theMovie, TimeValue fromTimePoint, TimeValue toTimePoint) 
+{
+	OSErr 				anErr = noErr;
+	GWorldPtr			frameGWorld1 = NULL;
+	GWorldPtr			frameGWorld2 = NULL;
+	PixMapHandle	pixMap1 = NULL;
+	PixMapHandle	pixMap2	= NULL;
+	CGrafPtr			aSavedPort, moviePort;
+	GDHandle			aSavedGDevice, movieGDevice;
+	QTUCompositor		aCompositor = NULL;
+	short				screenSize = 0;
+	Rect					movieRect;
+	short				nSteps;
+		
+	DebugAssert(theMovie != NULL); if(theMovie == NULL) return paramErr;
+	
+	// Store away current port and GDevice.
+	GetGWorld(&aSavedPort, &aSavedGDevice);
+	GetMovieGWorld(theMovie, &moviePort, &movieGDevice);
+	
+	GetMovieBox(theMovie, &movieRect);
+	
+	// Create two 32-bit GWorlds for the two frames, the compositor works on their pixels. Lock down pixmaps.
+	anErr = NewGWorld(&frameGWorld1, 32, &movieRect, NULL, NULL, 0); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+	anErr = NewGWorld(&frameGWorld2, 32, &movieRect, NULL, NULL, 0); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+	
+	pixMap1 = GetGWorldPixMap(frameGWorld1);  if(!LockPixels(pixMap1)) goto Closure;
+	pixMap2 = GetGWorldPixMap(frameGWorld2);  if(!LockPixels(pixMap2)) goto Closure;
+	
+	// Draw first video sample (frame) to GWorld number 1.
+	SetMovieGWorld(theMovie, frameGWorld1, GetGWorldDevice(frameGWorld1));
+	SetMovieTimeValue(theMovie, fromTimePoint);
+	UpdateMovie(theMovie); MoviesTask(theMovie, 0);
+	
+	// Draw second video sample (frame) to GWorld number 2.
+	SetMovieGWorld(theMovie, frameGWorld2, GetGWorldDevice(frameGWorld2));
+	SetMovieTimeValue(theMovie, toTimePoint); 
+	UpdateMovie(theMovie); MoviesTask(theMovie, 0);
+	
+	anErr = QTUNewCompositor(pixMap1, pixMap2, &movieRect, kQTUTransitionScroll, &aCompositor);
+	if(anErr != noErr) goto Closure;
+	
+	// Create the scroll effect, every step copies only what changed to the port.
+	screenSize = movieRect.right - movieRect.left;
+	SetGWorld(aSavedPort, aSavedGDevice);
+	
+	for(nSteps = 10; nSteps <= screenSize; nSteps += 10)  {
+		PixMapHandle	aFrame;
+		Rect			aDirtyRect, destinationRect;
+		
+		anErr = QTUCompositorRenderStep(aCompositor, nSteps, &aFrame, &aDirtyRect);
+		if(anErr != noErr) goto Closure;
+		
+		destinationRect = aDirtyRect;
+		OffsetRect(&destinationRect, movieRect.left, movieRect.top);
+		CopyBits( (BitMap *) *aFrame, GetPortBitMapForCopyBits(aSavedPort), &aDirtyRect,
+					&destinationRect, srcCopy, NULL );   	// blit from the compositor to the screen pixmap
+		DebugAssert(QDError() == noErr);
+	}
+	
+	// Closure. Clean up if we have handles.
+Closure:	
+	if(aCompositor != NULL)			QTUDisposeCompositor(aCompositor);
+	if(frameGWorld1 != NULL) 		DisposeGWorld(frameGWorld1);
+	if(frameGWorld2 != NULL) 		DisposeGWorld(frameGWorld2);
+
+	SetMovieGWorld(theMovie, moviePort, movieGDevice);
+	SetGWorld(aSavedPort, aSavedGDevice);	
+
+	return anErr;
+}
+
+/*______________________________________________________________________
+	QTUGetStartPointOfFirstVideoSample -  Get time value of first sample in the movie.
+
+TimeValue QTUGetStartPointOfFirstVideoSample(Movie theMovie) 
+
+theMovie					movie we are interested in
+startPoint					will contain the value of the start point, if the function fails it will contain
+								-1.
+
+DESCRIPTION
+	QTUGetStartPointOfFirstVideoSample will return the time value of the first video sample found in the
+	movie in the startPoint parameter. If the function fails, startPoint will contain -1 and the OSErr is 
+	also returned.
+*/
+
+pascal OSErr QTUGetStartPointOfFirstVideoSample(Movie theMovie, TimeValue *startPoint) 
+{
+	OSErr	anErr = noErr;
+	OSType	media = VideoMediaType;
+	
+	*startPoint = -1;
+
+	GetMovieNextInterestingTime(theMovie, nextTimeMediaSample+nextTimeEdgeOK, (TimeValue)1, &media, 0, 
+													fixed1, startPoint, NULL);
+	anErr = GetMoviesError(); DebugAssert(anErr == noErr);
+
+	return anErr;
+}
+
+
+// IMAGE COMPRESSION MANAGER
+
+static short QTULosslessDepthBit(short thePixelDepth);
+
+/*______________________________________________________________________
+	QTUHasCodecLossLessQuality - Test if a specific codec has a lossless mode in a specific bit depth.
+
+Boolean QTUHasCodecLossLessQuality(CodecType theCodec, short thePixelDepth)
+
+theCodec						specifies the Codec Type ('jpeg, 'rle ' and so on).
+thePixelDepth				specifies the bit depth (8, 24, 30 and so on). See NIM:QuickTime, page 
+									3-70 for more details.
+
+DESCRIPTION
+	QTUHasCodecLossLessQuality will test if a specific codec has a lossless spatial compression 
+	quality at a certain bit depth. Note that we are not testing the temporal compression qualities.
+	If the capability registry knows the codec and the depth, the Image Compression Manager is not 
+	asked again.
+
+EXAMPLE OF USE:
+	if(QTUHasCodecLossLessQuality('jpeg', 32))  
+		printf("JPEG has lossless spatial compression\n");
+	else
+		printf("JPEG has NOT lossless spatial compression\n");
+
+*/
+
+Boolean QTUHasCodecLossLessQuality(CodecType theCodec, short thePixelDepth)
+{
+	OSErr 	anErr = noErr;
+	CodecQ	aSpatialQuality = codecLosslessQuality;
+	QTUCodecCapability *aCapability;
+	short	aDepthBit;
+
+	aCapability = QTUFindCodecCapability(theCodec);
+	aDepthBit = QTULosslessDepthBit(thePixelDepth);
+	if(aCapability != NULL && aDepthBit >= 0)
+		return (aCapability->losslessDepths & (1 << aDepthBit)) != 0;
 
 	anErr = GetCompressionTime(NULL, NULL, thePixelDepth, theCodec, anyCodec, &aSpatialQuality,
 						NULL, NULL); DebugAssert(anErr == noErr);
@@ -1241,582 +2425,5228 @@ Boolean QTUHasCodecLossLessQuality(CodecType theCodec, short thePixelDepth)
 
 
 
-// MOVIE CONTROLLER FUNCTIONS
+// MOVIE CONTROLLER FUNCTIONS
+
+
+/*______________________________________________________________________
+	QTUPlayMovieWithMC - Play a specific movie when using movie controllers.
+
+pascal OSErr QTUPlayMovieWithMC( MovieController mc)
+
+mc						specified movie controller to be used
+
+DESCRIPTION
+	Playmovie will start a movie using a moviecontroller and a specified movie. Note that it also  
+	does a preroll of the movie for performance reasons. 
+
+*/
+
+pascal OSErr QTUPlayMovieWithMC(MovieController mc)
+{
+// Play normal speed forward, taking into account the possibility 
+// of a movie with a nonstandard PreferredRate.
+	OSErr	anErr = noErr;
+	Fixed 	aRate;
+	Movie	aMovie;
+
+	aMovie = MCGetMovie(mc);
+
+	aRate= GetMoviePreferredRate(aMovie);
+	anErr = QTUPrerollMovie(aMovie);  // Important: Preroll the movie here.
+	DebugAssert(anErr == noErr);
+
+	if(anErr == noErr)
+	{
+		MCDoAction(mc, mcActionPlay, (void *)aRate);  // note last value
+	}
+	
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUDoIgnoreMCDrags - Disable Drag and Drop facilities of the movie controller environment.
+
+pascal OSErr  QTUDoIgnoreMCDrags(MovieController  mc)
+
+mc						is the specified moviecontroller to be used
+
+DESCRIPTION
+	QTUDoIgnoreMCDrags will ensure that the Drag and Drop functionality is not handled within 
+	the movie specified by the movie controller.
+
+ISSUES
+	Note that this is a workaround in QT 2.0 (test for QT 2.0 or higher if you want to use
+	the drag-and-drop support in QT), and this function might not be needed in later QT versions.
+*/
+
+pascal OSErr QTUDoIgnoreMCDrags(MovieController  mc)
+{
+   OSErr   		anErr = noErr;
+   GWorldPtr  aTempGWorld;
+   Rect 			aTempRect = {0, 0, 20, 20};
+   CGrafPtr 	aPort;
+
+   // First create a 1-bit small 20x20 offscreen.
+   anErr = NewGWorld( &aTempGWorld, 1, &aTempRect, NULL, NULL, 0L );
+   DebugAssert(anErr == noErr);
+
+   if (anErr != noErr)
+   {
+   		aPort = MCGetControllerPort(mc);									// get the current port
+   		MCSetControllerPort(mc, (CGrafPtr)aTempGWorld );		// set mc port to new offscreen
+   		MCDoAction(mc, mcActionSetDragEnabled, (void *)false); // don't want dragging
+  		MCSetControllerPort(mc, aPort);										// restore mc port
+   		DisposeGWorld(aTempGWorld);											// dispose offscreen
+   }
+   return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUPointInMC - Test if a point is placed in the movie controller rect area or not.
+
+pascal Boolean QTUPointInMC(MovieController mc, WindowRef theWindow, Point where)
+
+mc							is the specified moviecontroller to be used
+theWindow				window used for testing for the hit point
+where						hit point
+
+DESCRIPTION
+	QTUPointInMC is a simple test to check where the mouse was clicked inside the window
+	with a movie controller, returns true of the mouse click was inside the movie controller
+	rect. See Peter Hoddie's article in develop# 18 for more details (code is from him as well).
+*/
+
+pascal Boolean QTUPointInMC(MovieController mc, WindowRef theWindow, Point where)
+{
+	RgnHandle		aRegion;
+	Boolean			result = false;
+	
+	aRegion = MCGetWindowRgn(mc, theWindow);
+   	DebugAssert(aRegion != NULL);
+	
+	if(aRegion != NULL)
+	{
+		result = PtInRgn(where, aRegion);
+		DisposeRgn(aRegion);
+	}
+	
+	return result;
+}
+
+
+/*______________________________________________________________________
+	QTUSelectAllMovie - Select the whole movie time duration with the controller.
+
+pascal OSErr QTUSelectAllMovie(MovieController mc)
+
+mc						is the specified moviecontroller to be used
+
+DESCRIPTION
+	QTUSelectAllMovie is an example how to select the whole movie duration using the movie
+	controller, this function could be used for Select All menu entries and similar cases.
+*/
+
+pascal OSErr QTUSelectAllMovie(MovieController mc)
+{
+	OSErr 			anErr = noErr;
+	TimeRecord  aTimeRecord;
+	Movie 			aMovie = NULL;
+	
+	DebugAssert(mc != NULL);
+	if(mc == NULL) return paramErr;
+	
+	aMovie = MCGetMovie(mc); DebugAssert(aMovie != NULL);
+	if(aMovie == NULL) return paramErr;
+	
+	aTimeRecord.value.hi = 0;
+	aTimeRecord.value.lo = 0;
+	aTimeRecord.base = 0;
+	
+	aTimeRecord.scale = GetMovieTimeScale(aMovie);
+	anErr = GetMoviesError(); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	
+	anErr = MCDoAction(mc, mcActionSetSelectionBegin, &aTimeRecord);
+	DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	
+	aTimeRecord.value.lo = GetMovieDuration(aMovie);
+	anErr = GetMoviesError(); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+	
+	anErr = MCDoAction(mc, mcActionSetSelectionDuration, &aTimeRecord);
+	DebugAssert(anErr == noErr);
+	
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	 QTUResizeMCActionFilter - Example of a movie controller filter that will resize the window 
+	where the movie is placed when the controllers themself change. 
+
+pascal Boolean QTUResizeMCActionFilter(MovieController mc, short action, void *params, long refCon)
+
+mc							specified moviecontroller to be used.
+action						the action for the mc action filter
+params						parameters passed with the action
+refCon  					additional long word that could be used for all kinds of purposes
+
+DESCRIPTION
+	QTUResizeMCActionFilter is an example of how to create a nice movie controller filter that 
+	will handle resizing of the window with the movie, and this will happen every time the controllers
+	themselves change. It's also an example of how to write other kinds of movie controller filters.
+*/
+
+pascal Boolean QTUResizeMCActionFilter(MovieController mc, short action, void* params , long refCon)
+{
+	#pragma unused (params)
+	Rect aMovieBounds;
+	
+	switch(action)
+	{
+		case mcActionControllerSizeChanged:
+			MCGetControllerBoundsRect(mc, &aMovieBounds);
+			SizeWindow((WindowPtr) refCon, aMovieBounds.right - aMovieBounds.left,
+								aMovieBounds.bottom - aMovieBounds.top, true);
+			break;
+	}
+		return false;
+}
+
+
+/*______________________________________________________________________
+	QTUResizeMCWindow - Resize a window to either normal size, double size or  half of the movie rect size.
+
+pascal Boolean QTUResizeMCWindow(MovieController mc, WindowPtr theWindow, long theMovieSize, Rect originalSize)
+
+mc								specified moviecontroller to be used
+theWindow					window that will be resized
+theMovieSize				constant that defines what default size we are interested in,  kNormalSize, kHalfSize, kDoubleSize
+originalSize					the original size of the movie, we need to keep track of this one in order to handle the 
+ 									ambient new sizes (half, double, normal).
+
+DESCRIPTION
+	QTUResizeMCWindow is an example of a function how to resize the movie window with the controllers.
+	The most common cases is half size, normal size or double size. But nothing hinders to add more sizes
+	into this function. Note that if the movie window is doubled, we will get pixel-doubling by the QuickTime
+	engine.
+*/
+
+pascal OSErr QTUResizeMCWindow(MovieController mc, WindowPtr theWindow, long theMovieSize, Rect originalSize)
+{
+	OSErr 		anErr = noErr;
+	Rect 			aMovieBounds;
+	GrafPtr 	aSavedPort;
+	
+	DebugAssert(mc != NULL); if(mc == NULL) return paramErr;
+	DebugAssert(theWindow != NULL); if(theWindow == NULL) return paramErr;
+	
+	GetPort(&aSavedPort);
+	SetPort((GrafPtr)theWindow);
+	
+	aMovieBounds.top = 0; aMovieBounds.left = 0;
+
+	switch(theMovieSize)
+	{
+		case kNormalMovieSize:
+				MCSetControllerBoundsRect(mc, &originalSize);
+				SizeWindow(theWindow, originalSize.right, originalSize.bottom, true);
+			break;
+		
+		case kHalfMovieSize:
+				aMovieBounds.right = (originalSize.right - originalSize.left) / 2;
+				aMovieBounds.bottom = (originalSize.bottom - originalSize.top) / 2;
+				MCSetControllerBoundsRect(mc, &aMovieBounds);
+				SizeWindow(theWindow, aMovieBounds.right, aMovieBounds.bottom, true);
+			break;
+		
+		case kDoubleMovieSize:
+				aMovieBounds.right = (originalSize.right - originalSize.left) * 2;
+				aMovieBounds.bottom = (originalSize.bottom - originalSize.top) * 2;
+				MCSetControllerBoundsRect(mc, &aMovieBounds);
+				SizeWindow(theWindow, aMovieBounds.right, aMovieBounds.bottom, true);
+			break;
+		
+		default:
+			SetPort(aSavedPort);
+			anErr = paramErr;
+	}
+	
+	SetPort(aSavedPort);
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUResizeMCWindow -Change the movie rate using the movie controller. 
+
+pascal OSErr QTUMCSetMovieRate(MovieController mc, long theRate)
+
+mc							specified moviecontroller to be used
+theRate						new rate value, we are using specific constants, see the eQTUMovieRates enum
+								in the DTSQTUtilities.h file concerning the values.
+
+DESCRIPTION
+	QTUMCSetMovieRate will use an existing movie controller and change the rate. This is a very 
+	simple function, but we do have a list of constants that shows the various values that could be used 
+	(eQTUMovieRates, DTSQTUtilities.h), and also it shows that if the rate changes from 0 to something 
+	else, then we need to preroll the movie. The Apple MM Tuner will make sure the movie is prerolled,
+	but we can't assume that every Mac has this extension installed, that's why it's still very important
+	to preroll.
+	
+ISSUES
+	Note that movies have stored preferred rates, so if you want to compensate for this factor you need
+	to read in this value as well before setting a double or half speed value.
+*/
+
+pascal OSErr QTUMCSetMovieRate(MovieController mc, long theRate)
+{
+	OSErr 	anErr = noErr;
+	Fixed 	aRate;
+	
+	DebugAssert(mc != NULL);  
+	if(mc == NULL)
+	{
+		anErr = paramErr; goto Closure;
+	}
+	
+	// Test if the playrate changes from 0 to a non-zero value, if so then preroll the movie.
+	MCDoAction(mc, mcActionGetPlayRate, &aRate);
+	if( (aRate == 0) && (theRate != 0) )
+	{
+		anErr = QTUPrerollMovie(MCGetMovie(mc));			// we are using the DTSQTUtilities function
+		DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+	}
+		
+	anErr = MCDoAction(mc, mcActionPlay, (Ptr) theRate); DebugAssert(anErr == noErr);
+
+Closure:	
+	return anErr;
+}
+
+// SEQUENCE GRABBER FUNCTIONS
+/*______________________________________________________________________
+	QTUCreateSequenceGrabber - Create an instance of a sequence grabber for specified window.
+
+pascal SeqGrabComponent QTUCreateSequenceGrabber(WindowPtr theWindow)
+
+theWindow					window where the sequence grabber will operate
+
+DESCRIPTION
+	QTUCreateSequenceGrabber will try to open the default sequence grabber component and 
+	make sure this component will work in the GWorld of a specified window. 
+
+	If we don't find a suitable sequence grabber, or if we encounter problems, we will return NULL.
+*/
+
+
+pascal SeqGrabComponent QTUCreateSequenceGrabber(WindowPtr theWindow)
+{
+	OSErr anErr = noErr;
+	SeqGrabComponent s = NULL;
+
+	DebugAssert(theWindow != NULL); if(theWindow == NULL) goto Closure;
+
+	s = OpenDefaultComponent(SeqGrabComponentType, 0);
+
+	if(s) // we got a valid one
+	{
+		anErr = SGInitialize(s); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+
+		anErr = SGSetGWorld(s, (CGrafPtr)theWindow, NULL); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+	}
+
+	return s;
+Closure:
+	return NULL;
+}
+
+/*______________________________________________________________________
+	QTUCreateSGGrabChannels - Create SG channels, video and audio.
+
+pascal OSErr QTUCreateSGGrabChannels(SeqGrabComponent s, const Rect *theBounds, long theUsage,
+																SGChannel *theVideoChannel, SGChannel *theSoundChannel)
+
+s							current active sequence grabber component instance
+theBounds				the size of the video channel sequence grabber area
+theUsage				any additional flags for the video SG
+theVideoChannel	pointer to the video channel we will receive
+theSoundChannel	pointer to the audio channel we will receive
+
+
+DESCRIPTION
+	QTUCreateSGGrabChannels will create video and audio SG channels (SGChannels) using the specified
+	default SG component.
+
+ISSUES
+	We will terminate whenever we can't properly create  a channel (sound, audio), if you still want to
+	retrieve a valid channel (let's say the sound one is OK while the we can't open an audio one), you
+	could slightly rewrite this code.
+*/
+
+pascal OSErr QTUCreateSGGrabChannels(SeqGrabComponent s, const Rect *theBounds, long theUsage,
+																SGChannel *theVideoChannel, SGChannel *theSoundChannel)
+{
+	OSErr 	anErr = noErr;
+	long		sgUsage = seqGrabPreview;	// default at least this flag	
+
+	DebugAssert(s != NULL); if(s == NULL) return badSGChannel;
+
+	sgUsage |= theUsage;						// add any other usage flag info now
+
+	// Create Video Channel.
+	anErr = SGNewChannel(s, VideoMediaType, theVideoChannel); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto FailureHandling;
+	
+	anErr = SGSetChannelBounds(*theVideoChannel, theBounds); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto FailureHandling;
+
+	anErr = SGSetChannelUsage(*theVideoChannel, sgUsage); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto FailureHandling;
+
+	// Create Sound Channel.
+	anErr = SGNewChannel(s, SoundMediaType, theSoundChannel); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto FailureHandling;
+
+	anErr = SGSetChannelUsage(*theSoundChannel, sgUsage); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto FailureHandling;
+
+
+	return anErr;
+
+FailureHandling:
+	SGDisposeChannel(s, *theVideoChannel); *theVideoChannel = NULL;
+	SGDisposeChannel(s, *theSoundChannel); *theSoundChannel = NULL;
+
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUDoesVDIGReceiveVideo - Test if vdig receives a live incoming video signal.
+
+pascal Boolean QTUDoesVDIGReceiveVideo(SeqGrabComponent s)
+
+s					our sequence grabber component instance
+
+DESCRIPTION
+	QTUDoesVDIGReceiveVideo test if the currently active vdig is receiving an incoming, live 
+	video signal. We assume that all well behaved vdigs set the digiInSignalLock flag.
+
+*/
+pascal Boolean QTUDoesVDIGReceiveVideo(SeqGrabComponent s)
+{
+	OSErr		anErr = noErr;
+	long		inputFlags, outFlags;
+
+	DebugAssert(s != NULL); if(s == NULL) goto Closure;
+
+	anErr = VDGetCurrentFlags(s, &inputFlags, &outFlags); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+
+	if(inputFlags & digiInSignalLock)
+		return true;
+
+Closure:
+	return false;
+}
+
+
+/*______________________________________________________________________
+	QTUChangeSGWindowSize - Change window size of the video sequence grabber window.
+
+pascal OSErr QTUChangeSGWindowSize(SeqGrabComponent s, SGChannel videoChannel, 
+							WindowPtr theWindow, long width, long height)
+
+s			our sequence grabber component instance
+videoChannel	the specified (currently used) video channel
+theWindow		window used for the digitizing sequence
+width			new width of the digitizer rect
+height			new height of the digitizer rect
+
+DESCRIPTION
+	QTUChangeSGWindowSize shows how to change the window size for the current digitizing sequence
+	taking place in the window. This is more of an example function as there might be other issues
+	to be taken into account (such as preference settings and similar issues) while changing the
+	bounds of the digitizing rect.
+
+*/
+
+pascal OSErr QTUChangeSGWindowSize(SeqGrabComponent s, SGChannel videoChannel, WindowPtr theWindow, long width, long height)
+{
+	OSErr		anErr = noErr;
+    Rect		portRect;
+         
+	DebugAssert(theWindow != NULL); if(theWindow == NULL) return paramErr;
+	DebugAssert(s != NULL); if(s == NULL) return badSGChannel;
+	DebugAssert(videoChannel != NULL); if(videoChannel == NULL) return badSGChannel;
+
+	anErr = SGPause(s, true); DebugAssert(anErr == noErr); if(anErr != noErr) goto Closure;
+
+	SizeWindow(theWindow, width, height, false);
+#if TARGET_OS_WIN32
+	anErr = SGSetChannelBounds(videoChannel, &theWindow->portRect); DebugAssert(anErr == noErr);
+#else
+	GetWindowBounds(theWindow, kWindowContentRgn, &portRect);
+	anErr = SGSetChannelBounds(videoChannel, &portRect); DebugAssert(anErr == noErr);
+#endif
+	if(anErr != noErr) goto Closure;
+
+	anErr = SGPause(s, false); DebugAssert(anErr == noErr); 
+
+Closure:
+	return anErr;
+}
+
+
+
+// COMPONENT FUNCTIONS
+
+#define kQTUCapabilityFileType		'QCap'
+#define kQTUCapabilityVersion		1
+
+// The depths the lossless bits of a codec are for, in order.
+static const short kQTULosslessDepths[] = { 1, 2, 4, 8, 16, 24, 32, 34, 36, 40 };
+
+// What the cache file starts with, the codecs and then the components follow in native byte order.
+typedef struct QTUCapabilityHeader {
+	OSType						fileType;
+	long						version;
+	long						qtVersion;
+	long						componentSeed;				// GetComponentListModSeed
+	long						componentCount;
+	long						codecCount;
+} QTUCapabilityHeader;
+
+static struct {
+	Boolean						enabled;					// by QTUInitCapabilityRegistry, the registry is built on the first question
+	Boolean						hasCacheFile;
+	FSSpec						cacheFile;
+	OSType						creator;					// of the cache file
+	QTUCapabilityHeader			header;
+	QTUCodecCapability			*codecs;
+	QTUComponentCapability		*components;
+	QTUCapabilityStatistics		statistics;
+} gQTURegistry;
+
+
+/*______________________________________________________________________
+	QTULosslessDepthBit - Return the bit of a depth in the lossless depths of a codec.
+
+static short QTULosslessDepthBit(short thePixelDepth)
+
+DESCRIPTION
+	QTULosslessDepthBit returns -1 for a depth the registry doesn't keep.
+*/
+
+static short QTULosslessDepthBit(short thePixelDepth)
+{
+	short index;
+
+	for(index = 0; index < sizeof(kQTULosslessDepths) / sizeof(kQTULosslessDepths[0]); index++)
+		if(kQTULosslessDepths[index] == thePixelDepth)
+			return index;
+	return -1;
+}
+
+
+/*______________________________________________________________________
+	QTUGetComponentFingerprint - Fill in what the cached capabilities have to match.
+
+static void QTUGetComponentFingerprint(QTUCapabilityHeader *theHeader)
+
+DESCRIPTION
+	The seed changes when a component is registered or unregistered, the QuickTime version when 
+	QuickTime is updated. The count is there in case the seed comes back the same after a restart
+	with other components installed.
+*/
+
+static void QTUGetComponentFingerprint(QTUCapabilityHeader *theHeader)
+{
+	ComponentDescription anyComponent = { 0, 0, 0, 0, 0 };
+
+	theHeader->fileType = kQTUCapabilityFileType;
+	theHeader->version = kQTUCapabilityVersion;
+	theHeader->qtVersion = QTUGetQTVersion();
+	theHeader->componentSeed = GetComponentListModSeed();
+	theHeader->componentCount = CountComponents(&anyComponent);
+	theHeader->codecCount = 0;
+}
+
+
+/*______________________________________________________________________
+	QTUBuildCapabilities - Ask the Component Manager and the Image Compression Manager.
+
+static OSErr QTUBuildCapabilities(void)
+
+DESCRIPTION
+	QTUBuildCapabilities lists every component, and for every type of compressor gets the codec
+	information and tries each depth for a lossless quality. Asking GetCompressionTime for every depth
+	of every codec is what makes this slow enough to keep in a file.
+*/
+
+static OSErr QTUBuildCapabilities(void)
+{
+	ComponentDescription	anyComponent = { 0, 0, 0, 0, 0 };
+	ComponentDescription	aDescription;
+	Component				aComponent = NULL;
+	long					aCount = 0;
+	long					index;
+
+	gQTURegistry.components = (QTUComponentCapability *)NewPtrClear((gQTURegistry.header.componentCount + 1) * sizeof(QTUComponentCapability));
+	gQTURegistry.codecs = (QTUCodecCapability *)NewPtrClear((gQTURegistry.header.componentCount + 1) * sizeof(QTUCodecCapability));
+	DebugAssert(gQTURegistry.components != NULL && gQTURegistry.codecs != NULL);
+	if(gQTURegistry.components == NULL || gQTURegistry.codecs == NULL) return memFullErr;
+
+	while(aCount < gQTURegistry.header.componentCount && (aComponent = FindNextComponent(aComponent, &anyComponent)) != NULL)
+	{
+		QTUComponentCapability *aCapability = &gQTURegistry.components[aCount];
+
+		if(GetComponentInfo(aComponent, &aDescription, NULL, NULL, NULL) != noErr)
+			continue;
+
+		aCapability->componentType = aDescription.componentType;
+		aCapability->componentSubType = aDescription.componentSubType;
+		aCapability->componentManufacturer = aDescription.componentManufacturer;
+		aCapability->componentFlags = aDescription.componentFlags;
+		aCount++;
+
+		if(aDescription.componentType != compressorComponentType)
+			continue;
+
+		// One entry per codec type, the first compressor of the type is the one anyCodec gets.
+		for(index = 0; index < gQTURegistry.header.codecCount; index++)
+			if(gQTURegistry.codecs[index].cType == aDescription.componentSubType)
+				break;
+
+		if(index == gQTURegistry.header.codecCount)
+		{
+			QTUCodecCapability	*aCodec = &gQTURegistry.codecs[index];
+			CodecInfo			aCodecInfo;
+			short				aDepthBit;
+
+			if(GetCodecInfo(&aCodecInfo, aDescription.componentSubType, anyCodec) != noErr)
+				continue;
+
+			aCodec->cType = aDescription.componentSubType;
+			aCodec->formatFlags = aCodecInfo.formatFlags;
+			aCodec->compressFlags = aCodecInfo.compressFlags;
+			aCodec->doesTemporal = (aCodecInfo.compressFlags & codecInfoDoesTemporal) != 0;
+
+			for(aDepthBit = 0; aDepthBit < sizeof(kQTULosslessDepths) / sizeof(kQTULosslessDepths[0]); aDepthBit++)
+			{
+				CodecQ aSpatialQuality = codecLosslessQuality;
+
+				if(GetCompressionTime(NULL, NULL, kQTULosslessDepths[aDepthBit], aCodec->cType, anyCodec, &aSpatialQuality, NULL, NULL) == noErr &&
+					aSpatialQuality == codecLosslessQuality)
+					aCodec->losslessDepths |= 1 << aDepthBit;
+			}
+			gQTURegistry.header.codecCount++;
+		}
+	}
+
+	gQTURegistry.header.componentCount = aCount;
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUReadCapabilities - Read the capabilities kept in a file.
+
+static OSErr QTUReadCapabilities(const FSSpec *theFile)
+
+DESCRIPTION
+	QTUReadCapabilities returns paramErr if the file was written with other components or another
+	version of QuickTime, gQTURegistry.header already contains the fingerprint to match.
+*/
+
+static OSErr QTUReadCapabilities(const FSSpec *theFile)
+{
+	OSErr				anErr = noErr;
+	QTUCapabilityHeader	aHeader;
+	short				aRefNum = 0;
+	long				aCount;
+
+	anErr = FSpOpenDF(theFile, fsRdPerm, &aRefNum);
+	if(anErr != noErr) return anErr;
+
+	aCount = sizeof(aHeader);
+	anErr = FSRead(aRefNum, &aCount, &aHeader);
+	if(anErr != noErr) goto Closure;
+
+	if(aHeader.fileType != gQTURegistry.header.fileType || aHeader.version != gQTURegistry.header.version ||
+		aHeader.qtVersion != gQTURegistry.header.qtVersion || aHeader.componentSeed != gQTURegistry.header.componentSeed ||
+		aHeader.componentCount != gQTURegistry.header.componentCount || aHeader.codecCount > aHeader.componentCount)
+	{
+		anErr = paramErr;
+		goto Closure;
+	}
+
+	gQTURegistry.codecs = (QTUCodecCapability *)NewPtr((aHeader.codecCount + 1) * sizeof(QTUCodecCapability));
+	gQTURegistry.components = (QTUComponentCapability *)NewPtr((aHeader.componentCount + 1) * sizeof(QTUComponentCapability));
+	if(gQTURegistry.codecs == NULL || gQTURegistry.components == NULL) { anErr = memFullErr; goto Closure; }
+
+	aCount = aHeader.codecCount * sizeof(QTUCodecCapability);
+	anErr = FSRead(aRefNum, &aCount, gQTURegistry.codecs);
+	if(anErr == noErr)
+	{
+		aCount = aHeader.componentCount * sizeof(QTUComponentCapability);
+		anErr = FSRead(aRefNum, &aCount, gQTURegistry.components);
+	}
+	if(anErr == eofErr) anErr = paramErr;			// cut short
+
+	if(anErr == noErr)
+		gQTURegistry.header = aHeader;
+
+Closure:
+	FSClose(aRefNum);
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUWriteCapabilities - Keep the capabilities in a file.
+
+static OSErr QTUWriteCapabilities(const FSSpec *theFile)
+
+DESCRIPTION
+	QTUWriteCapabilities replaces the file, and deletes it again if it couldn't be written completely.
+*/
+
+static OSErr QTUWriteCapabilities(const FSSpec *theFile)
+{
+	OSErr	anErr = noErr;
+	short	aRefNum = 0;
+	long	aCount;
+
+	FSpDelete(theFile);
+	anErr = FSpCreate(theFile, gQTURegistry.creator, kQTUCapabilityFileType, smSystemScript); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+
+	anErr = FSpOpenDF(theFile, fsWrPerm, &aRefNum); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+
+	aCount = sizeof(QTUCapabilityHeader);
+	anErr = FSWrite(aRefNum, &aCount, &gQTURegistry.header); DebugAssert(anErr == noErr);
+
+	if(anErr == noErr)
+	{
+		aCount = gQTURegistry.header.codecCount * sizeof(QTUCodecCapability);
+		anErr = FSWrite(aRefNum, &aCount, gQTURegistry.codecs); DebugAssert(anErr == noErr);
+	}
+	if(anErr == noErr)
+	{
+		aCount = gQTURegistry.header.componentCount * sizeof(QTUComponentCapability);
+		anErr = FSWrite(aRefNum, &aCount, gQTURegistry.components); DebugAssert(anErr == noErr);
+	}
+
+	FSClose(aRefNum);
+
+	if(anErr != noErr)
+		FSpDelete(theFile);
+
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUFreeCapabilities - Dispose what the registry knows.
+
+static void QTUFreeCapabilities(void)
+*/
+
+static void QTUFreeCapabilities(void)
+{
+	if(gQTURegistry.codecs) DisposePtr((Ptr)gQTURegistry.codecs);
+	if(gQTURegistry.components) DisposePtr((Ptr)gQTURegistry.components);
+
+	gQTURegistry.codecs = NULL;
+	gQTURegistry.components = NULL;
+	gQTURegistry.header.codecCount = 0;
+	gQTURegistry.header.componentCount = 0;
+	gQTURegistry.statistics.fromCache = false;
+	gQTURegistry.statistics.codecCount = 0;
+	gQTURegistry.statistics.componentCount = 0;
+}
+
+
+/*______________________________________________________________________
+	QTULoadCapabilities - Read the registry from the cache file, or build it.
+
+static OSErr QTULoadCapabilities(void)
+
+DESCRIPTION
+	QTULoadCapabilities reads the cache file if its fingerprint is the one of the installed
+	components, and builds the registry and writes the file again if not.
+*/
+
+static OSErr QTULoadCapabilities(void)
+{
+	OSErr			anErr = noErr;
+	UnsignedWide	aTimer;
+
+	QTUStartTimer(&aTimer);
+	QTUFreeCapabilities();
+	QTUGetComponentFingerprint(&gQTURegistry.header);
+
+	if(gQTURegistry.hasCacheFile && QTUReadCapabilities(&gQTURegistry.cacheFile) == noErr)
+		gQTURegistry.statistics.fromCache = true;
+	else
+	{
+		QTUFreeCapabilities();
+		QTUGetComponentFingerprint(&gQTURegistry.header);
+
+		anErr = QTUBuildCapabilities();
+		if(anErr != noErr)
+		{
+			QTUFreeCapabilities();
+			return anErr;
+		}
+
+		// Not being able to keep it only costs the next launch some time.
+		if(gQTURegistry.hasCacheFile)
+			QTUWriteCapabilities(&gQTURegistry.cacheFile);
+	}
+
+	gQTURegistry.statistics.codecCount = gQTURegistry.header.codecCount;
+	gQTURegistry.statistics.componentCount = gQTURegistry.header.componentCount;
+	gQTURegistry.statistics.microseconds = QTUElapsedMicroseconds(&aTimer);
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUCapabilityRegistryReady - Make sure the registry is there and up to date.
+
+static Boolean QTUCapabilityRegistryReady(void)
+
+DESCRIPTION
+	QTUCapabilityRegistryReady builds the registry on the first question after
+	QTUInitCapabilityRegistry, and again when the component list seed changed since, so a component
+	registered while running is not missed. It returns false if there's no registry to answer from,
+	the toolbox has to be asked.
+*/
+
+static Boolean QTUCapabilityRegistryReady(void)
+{
+	if(!gQTURegistry.enabled)
+		return false;
+
+	if(gQTURegistry.components != NULL && gQTURegistry.header.componentSeed == GetComponentListModSeed())
+		return true;
+
+	// Don't try again on every question if it can't be built.
+	if(QTULoadCapabilities() != noErr)
+	{
+		gQTURegistry.enabled = false;
+		return false;
+	}
+
+	return true;
+}
+
+
+/*______________________________________________________________________
+	QTUInitCapabilityRegistry - Answer the questions about codecs and components from a registry.
+
+pascal OSErr QTUInitCapabilityRegistry(const FSSpec *theCacheFile, OSType theCreator)
+
+theCacheFile				the file the registry is kept in between launches, or NULL
+theCreator					the creator of the file, the one of the application
+
+DESCRIPTION
+	After QTUInitCapabilityRegistry, QTUHasComponentType, QTUDoGetComponent, QTUFindCodecCapability
+	and QTUHasCodecLossLessQuality answer from a registry of the installed components, and the
+	depths, lossless qualities and temporal compression of every codec. Nothing is asked here, the
+	registry is built on the first question. Asking every codec about every depth is slow, it's
+	worth it for an application that asks many questions, not for one or two.
+
+	The registry is kept in theCacheFile with a fingerprint of the installed components (the
+	component list seed, their count and the QuickTime version). The next launch reads the file 
+	if the fingerprint is the same, and builds and writes the registry again if not. The seed is
+	checked on every question, the registry is built again when components are registered or
+	unregistered while running. Call it after EnterMovies.
+
+EXAMPLE
+	anErr = QTUInitCapabilityRegistry(&aCacheFile, 'CMov');
+	if(QTUHasCodecLossLessQuality('rle ', 32)) ...
+*/
+
+pascal OSErr QTUInitCapabilityRegistry(const FSSpec *theCacheFile, OSType theCreator)
+{
+	QTUFreeCapabilities();
+
+	gQTURegistry.hasCacheFile = (theCacheFile != NULL);
+	if(theCacheFile != NULL)
+		gQTURegistry.cacheFile = *theCacheFile;
+	gQTURegistry.creator = theCreator;
+	gQTURegistry.statistics.microseconds = 0;
+	gQTURegistry.enabled = true;
+
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUFindCodecCapability - Look up a codec in the capability registry.
+
+pascal QTUCodecCapability *QTUFindCodecCapability(CodecType theCodec)
+
+theCodec					the codec type
+
+DESCRIPTION
+	QTUFindCodecCapability returns NULL if there's no registry, or no compressor of the type.
+*/
+
+pascal QTUCodecCapability *QTUFindCodecCapability(CodecType theCodec)
+{
+	long index;
+
+	if(!QTUCapabilityRegistryReady())
+		return NULL;
+
+	for(index = 0; index < gQTURegistry.header.codecCount; index++)
+		if(gQTURegistry.codecs[index].cType == theCodec)
+			return &gQTURegistry.codecs[index];
+	return NULL;
+}
+
+
+/*______________________________________________________________________
+	QTUGetCapabilityStatistics - Return how the capability registry was made.
+
+pascal void QTUGetCapabilityStatistics(QTUCapabilityStatistics *theStatistics)
+*/
+
+pascal void QTUGetCapabilityStatistics(QTUCapabilityStatistics *theStatistics)
+{
+	*theStatistics = gQTURegistry.statistics;
+}
+
+
+/*______________________________________________________________________
+	QTUDisposeCapabilityRegistry - Forget the capabilities.
+
+pascal void QTUDisposeCapabilityRegistry(void)
+
+DESCRIPTION
+	After QTUDisposeCapabilityRegistry the component functions ask the toolbox every time again.
+*/
+
+pascal void QTUDisposeCapabilityRegistry(void)
+{
+	QTUFreeCapabilities();
+	gQTURegistry.enabled = false;
+}
+
+
+/*______________________________________________________________________
+	QTUSetComponentSearch - Fill in the description QTUDoGetComponent and QTUHasComponentType search for.
+
+static void QTUSetComponentSearch(OSType theComponentType, OSType theSpecificComponent, ComponentDescription *theDescription)
+*/
+
+static void QTUSetComponentSearch(OSType theComponentType, OSType theSpecificComponent, ComponentDescription *theDescription)
+{
+	theDescription->componentType = theComponentType;
+	theDescription->componentSubType = theSpecificComponent;
+	theDescription->componentManufacturer = 0;
+	theDescription->componentFlags = 0;
+	theDescription->componentFlagsMask = 0;
+	
+	// The following code is inserted for special handling of some known cases.
+	if(theComponentType == MovieImportType)
+	{
+		theDescription->componentFlags = canMovieImportFiles;
+		theDescription->componentFlagsMask = canMovieImportFiles;
+	}
+	else if(theComponentType == MovieExportType)
+	{
+		theDescription->componentFlags = canMovieExportFiles;
+		theDescription->componentFlagsMask = canMovieExportFiles;
+	}
+}
+
+
+/*______________________________________________________________________
+	QTURegistryHasComponent - Search the capability registry the way FindNextComponent does.
+
+static Boolean QTURegistryHasComponent(const ComponentDescription *theDescription)
+
+DESCRIPTION
+	Zero for the type, sub-type or manufacturer matches any, the flags only count under the mask.
+*/
+
+static Boolean QTURegistryHasComponent(const ComponentDescription *theDescription)
+{
+	long index;
+
+	for(index = 0; index < gQTURegistry.header.componentCount; index++)
+	{
+		QTUComponentCapability *aCapability = &gQTURegistry.components[index];
+
+		if( (theDescription->componentType == 0 || theDescription->componentType == aCapability->componentType) &&
+			(theDescription->componentSubType == 0 || theDescription->componentSubType == aCapability->componentSubType) &&
+			(theDescription->componentManufacturer == 0 || theDescription->componentManufacturer == aCapability->componentManufacturer) &&
+			((aCapability->componentFlags ^ theDescription->componentFlags) & theDescription->componentFlagsMask) == 0 )
+			return true;
+	}
+	return false;
+}
+
+/*______________________________________________________________________
+	QTUDoGetComponent - Get a specific component based on component type and component sub-type.
+
+pascal Component QTUDoGetComponent(OSType theComponentType, OSType theSpecificComponent)
+
+theComponentType					the component type we are interested in
+theSpecificComponent				the specific component sub-type we are interested int
+
+DESCRIPTION
+	QTUDoGetComponent will get a specific component based on the component type and sub-type.  We have 
+	special code for particular components (for instance movieImporttype and movieExporttype), so
+	if we specify such types, the function will narrow down the search further for the right components.
+	
+	The specificComponent is just the special component we want to search for, if the component type is 
+	NULL, then the Specific component is the one and only we are interested in. Note that we don't care 
+	about the manufacturer information in this function. 
+	
+	If we don't find a suitable component we will return NULL. With a capability registry we know
+	that without asking the Component Manager, as long as the component list did not change.
+*/
+
+pascal Component QTUDoGetComponent(OSType theComponentType, OSType theSpecificComponent)
+{
+	ComponentDescription 	aCD;
+	Component 					aComponent = NULL;
+	
+	QTUSetComponentSearch(theComponentType, theSpecificComponent, &aCD);
+	
+	if(QTUCapabilityRegistryReady() && !QTURegistryHasComponent(&aCD))
+		return NULL;
+
+	// OK, get the component.
+	aComponent = FindNextComponent((Component)0, &aCD);
+	
+	return aComponent;
+}
+
+
+/*______________________________________________________________________
+	QTUHasComponentType -Query for a specific component based on component type and 
+	component sub-type.
+
+pascal Boolean QTUHasComponentType(OSType theComponentType, OSType theSpecificComponent)
+
+theComponentType					the component type we are interested in
+theSpecificComponent				the specific component sub-type we are interested int
+
+DESCRIPTION
+	QTUDoGetComponent will query for a specific component based on the component type and sub-type.  
+	We have special code for particular components (for instance movieImporttype and movieExporttype),
+    so if we query for such types, the function will narrow down the search further for the right 
+	components.
+	
+	The specificComponent is just the special component we want to search for, if the component 
+	type is NULL, then the Specific component is the one and only we are interested in. Note that we 
+	don't care about the manufacturer information in this function. 
+	
+	If we don't find a suitable component we will return false, otherwise we will return true. The
+	capability registry is searched if there is one.
+*/
+
+pascal Boolean QTUHasComponentType(OSType theComponentType, OSType theSpecificComponent)
+{
+	ComponentDescription aCD;
+	
+	QTUSetComponentSearch(theComponentType, theSpecificComponent, &aCD);
+	
+	if(QTUCapabilityRegistryReady())
+		return QTURegistryHasComponent(&aCD);
+
+	if(FindNextComponent((Component)0, &aCD) != NULL)
+		return true;
+	else
+		return false;
+}
+
+
+// BUFFER POOL FUNCTIONS
+
+// The pool memory comes in slabs, the first one is allocated when the pool is created and new ones only when all
+// the buffers are in use. Free buffers are kept in a list linked through the buffers themselves.
+typedef struct QTUBufferSlab {
+	struct QTUBufferSlab	*nextSlab;
+} QTUBufferSlab;
+
+struct QTUBufferPoolRecord {
+	long					bufferSize;
+	long					alignment;
+	long					slabBufferCount;
+	QTUBufferSlab			*slabs;
+	Ptr						freeList;
+	QTUBufferPoolStatistics	statistics;
+};
+
+
+/*______________________________________________________________________
+	QTUBufferPoolAddSlab - Add another slab of buffers to a buffer pool.
+
+static OSErr QTUBufferPoolAddSlab(QTUBufferPool thePool)
+
+DESCRIPTION
+	QTUBufferPoolAddSlab allocates room for slabBufferCount buffers (plus the slab header and the
+	alignment slop) in one Memory Manager call, and puts all the new buffers on the free list.
+*/
+
+static OSErr QTUBufferPoolAddSlab(QTUBufferPool thePool)
+{
+	QTUBufferSlab	*aSlab;
+	unsigned long	aFirstBuffer;
+	long			index;
+
+	aSlab = (QTUBufferSlab *)NewPtr(sizeof(QTUBufferSlab) + thePool->alignment + thePool->slabBufferCount * thePool->bufferSize);
+	DebugAssert(aSlab != NULL);
+	if(aSlab == NULL) return memFullErr;
+
+	thePool->statistics.heapAllocations++;
+	thePool->statistics.buffersHeld += thePool->slabBufferCount;
+
+	aSlab->nextSlab = thePool->slabs;
+	thePool->slabs = aSlab;
+
+	aFirstBuffer = ((unsigned long)(aSlab + 1) + thePool->alignment - 1) & ~(unsigned long)(thePool->alignment - 1);
+
+	for(index = 0; index < thePool->slabBufferCount; index++)
+	{
+		Ptr aBuffer = (Ptr)(aFirstBuffer + index * thePool->bufferSize);
+
+		*(Ptr *)aBuffer = thePool->freeList;
+		thePool->freeList = aBuffer;
+	}
+
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUNewBufferPool - Create a pool of same sized memory buffers.
+
+pascal OSErr QTUNewBufferPool(long theBufferSize, long theBufferCount, long theAlignment, QTUBufferPool *thePool)
+
+theBufferSize				size of every buffer in the pool
+theBufferCount				the amount of buffers allocated up front (and when the pool needs to grow)
+theAlignment				buffer address alignment, a power of two (16 for AltiVec, 4096 for uncached I/O)
+thePool						will contain the new pool
+
+DESCRIPTION
+	Allocating frame and compressed data buffers with NewHandle or NewPtr for every frame costs time
+	and fragments the heap. QTUNewBufferPool allocates all the buffers of a pool in one go, and after
+	that QTUBufferPoolGet and QTUBufferPoolRelease only move buffers on and off a free list. The pool
+	only goes back to the Memory Manager when more than theBufferCount buffers are in use at the same
+	time, this is counted in the heapAllocations statistics, so it's easy to check that a loop is not
+	allocating memory once it's running.
+
+	The pool is not protected against concurrent use, get and release the buffers from one task only.
+*/
+
+pascal OSErr QTUNewBufferPool(long theBufferSize, long theBufferCount, long theAlignment, QTUBufferPool *thePool)
+{
+	OSErr			anErr = noErr;
+	QTUBufferPool	aPool;
+
+	DebugAssert(thePool != NULL); if(thePool == NULL) return paramErr;
+	*thePool = NULL;
+
+	if(theBufferCount < 1) theBufferCount = 1;
+	if(theAlignment < (long)sizeof(Ptr)) theAlignment = sizeof(Ptr);
+	DebugAssert((theAlignment & (theAlignment - 1)) == 0);
+
+	aPool = (QTUBufferPool)NewPtrClear(sizeof(struct QTUBufferPoolRecord)); DebugAssert(aPool != NULL);
+	if(aPool == NULL) return memFullErr;
+
+	// Round the buffer size up so every buffer in a slab stays aligned.
+	aPool->bufferSize = (theBufferSize + theAlignment - 1) & ~(theAlignment - 1);
+	aPool->alignment = theAlignment;
+	aPool->slabBufferCount = theBufferCount;
+	aPool->statistics.bufferSize = theBufferSize;
+
+	anErr = QTUBufferPoolAddSlab(aPool);
+	if(anErr != noErr)
+	{
+		DisposePtr((Ptr)aPool);
+		return anErr;
+	}
+
+	*thePool = aPool;
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUBufferPoolGet - Get a buffer from a buffer pool.
+
+pascal Ptr QTUBufferPoolGet(QTUBufferPool thePool)
+
+thePool						the pool
+
+DESCRIPTION
+	QTUBufferPoolGet returns a free buffer, or NULL if the pool is empty and we could not allocate
+	more memory.
+*/
+
+pascal Ptr QTUBufferPoolGet(QTUBufferPool thePool)
+{
+	Ptr aBuffer;
+
+	DebugAssert(thePool != NULL); if(thePool == NULL) return NULL;
+
+	if(thePool->freeList == NULL)
+	{
+		if(QTUBufferPoolAddSlab(thePool) != noErr)
+			return NULL;
+	}
+
+	aBuffer = thePool->freeList;
+	thePool->freeList = *(Ptr *)aBuffer;
+
+	thePool->statistics.buffersInUse++;
+	if(thePool->statistics.buffersInUse > thePool->statistics.peakBuffersInUse)
+		thePool->statistics.peakBuffersInUse = thePool->statistics.buffersInUse;
+
+	return aBuffer;
+}
+
+
+/*______________________________________________________________________
+	QTUBufferPoolRelease - Give a buffer back to its buffer pool.
+
+pascal void QTUBufferPoolRelease(QTUBufferPool thePool, Ptr theBuffer)
+
+thePool						the pool the buffer came from
+theBuffer					the buffer, NULL is OK
+
+DESCRIPTION
+	QTUBufferPoolRelease puts the buffer back on the free list, the memory stays with the pool.
+*/
+
+pascal void QTUBufferPoolRelease(QTUBufferPool thePool, Ptr theBuffer)
+{
+	DebugAssert(thePool != NULL); 
+	if(thePool == NULL || theBuffer == NULL) return;
+
+	*(Ptr *)theBuffer = thePool->freeList;
+	thePool->freeList = theBuffer;
+
+	thePool->statistics.buffersInUse--;
+}
+
+
+/*______________________________________________________________________
+	QTUBufferPoolGetBufferSize - Return the size of the buffers in a buffer pool.
+
+pascal long QTUBufferPoolGetBufferSize(QTUBufferPool thePool)
+
+thePool						the pool
+
+DESCRIPTION
+	QTUBufferPoolGetBufferSize returns the size asked for when the pool was created, so a pool
+	kept around could be tested if it's still big enough.
+*/
+
+pascal long QTUBufferPoolGetBufferSize(QTUBufferPool thePool)
+{
+	if(thePool == NULL) return 0;
+
+	return thePool->statistics.bufferSize;
+}
+
+
+/*______________________________________________________________________
+	QTUBufferPoolGetStatistics - Return the usage counters of a buffer pool.
+
+pascal void QTUBufferPoolGetStatistics(QTUBufferPool thePool, QTUBufferPoolStatistics *theStatistics)
+
+thePool						the pool
+theStatistics				will contain the counters
+
+DESCRIPTION
+	QTUBufferPoolGetStatistics returns how many buffers are in use, the peak, and how many times the
+	pool needed to allocate memory (the first slab included).
+*/
+
+pascal void QTUBufferPoolGetStatistics(QTUBufferPool thePool, QTUBufferPoolStatistics *theStatistics)
+{
+	DebugAssert(thePool != NULL);
+	if(thePool != NULL)
+		*theStatistics = thePool->statistics;
+}
+
+
+/*______________________________________________________________________
+	QTUDisposeBufferPool - Dispose a buffer pool and all of its memory.
+
+pascal void QTUDisposeBufferPool(QTUBufferPool thePool)
+
+thePool						the pool
+
+DESCRIPTION
+	QTUDisposeBufferPool disposes all the slabs, so any buffer still in use is gone as well.
+*/
+
+pascal void QTUDisposeBufferPool(QTUBufferPool thePool)
+{
+	if(thePool == NULL) return;
+
+	DebugAssert(thePool->statistics.buffersInUse == 0);
+
+	while(thePool->slabs != NULL)
+	{
+		QTUBufferSlab *aSlab = thePool->slabs;
+
+		thePool->slabs = aSlab->nextSlab;
+		DisposePtr((Ptr)aSlab);
+	}
+
+	DisposePtr((Ptr)thePool);
+}
+
+
+// RESAMPLING FUNCTIONS
+
+// The resampler is separable, every frame is first scaled horizontally into an intermediate buffer of 16-bit values 
+// (the 8-bit components with 7 bits of fraction) and then vertically into the destination. Filter weights are 14-bit
+// fixed point numbers adding up to 16384.
+#define kQTUMaxResampleTaps		64
+#define kQTUMaxResampleBands	32
+#define kQTUWeightBits			14
+#define kQTUFractionBits		7
+
+typedef struct QTUFilterTaps {
+	long				*first;						// first source pixel (or row) for every destination pixel (or row)
+	long				*count;						// number of source pixels (or rows) used
+	SInt16				*weights;					// maxTaps weights for every destination pixel (or row)
+	long				maxTaps;
+} QTUFilterTaps;
+
+typedef struct QTUResampleBand {
+	struct QTUResamplerRecord	*resampler;
+	Boolean						vertical;			// the pass this band is doing
+	long						firstRow;
+	long						rowCount;
+	long						*accumulator;		// one row of sums for the vertical pass
+	Ptr							rowMemory;
+} QTUResampleBand;
+
+struct QTUResamplerRecord {
+	short				sourceWidth;
+	short				sourceHeight;
+	short				destinationWidth;
+	short				destinationHeight;
+	QTUFilterTaps		horizontal;
+	QTUFilterTaps		vertical;
+	Ptr					intermediateMemory;
+	SInt16				*intermediate;				// sourceHeight rows of intermediateStride values, 16 byte aligned
+	long				intermediateStride;
+	QTUWorkerPool		pool;
+	long				bandCount;
+	QTUResampleBand		bands[kQTUMaxResampleBands];
+
+	// The frame we are working on.
+	UInt8				*sourceBase;
+	long				sourceRowBytes;
+	UInt8				*destinationBase;
+	long				destinationRowBytes;
+};
+
+
+/*______________________________________________________________________
+	QTUResampleFilter - Return the weight of a filter at a distance from the center.
+
+static double QTUResampleFilter(short theFilter, double theDistance)
+
+DESCRIPTION
+	The box filter averages the source pixels covered by a destination pixel, bilinear is the
+	tent filter and Lanczos is the windowed sinc with three lobes.
+*/
+
+static double QTUResampleFilter(short theFilter, double theDistance)
+{
+	double x = fabs(theDistance);
+
+	switch(theFilter)
+	{
+		case kQTUResampleBox:
+			return (x <= 0.5) ? 1.0 : 0.0;
+
+		case kQTUResampleBilinear:
+			return (x < 1.0) ? 1.0 - x : 0.0;
+
+		case kQTUResampleLanczos:
+		default:
+			if(x < 1.0e-8) return 1.0;
+			if(x >= 3.0) return 0.0;
+			return 3.0 * sin(3.14159265358979 * x) * sin(3.14159265358979 * x / 3.0) / (3.14159265358979 * 3.14159265358979 * x * x);
+	}
+}
+
+
+/*______________________________________________________________________
+	QTUMakeFilterTaps - Calculate the filter weights for one direction.
+
+static OSErr QTUMakeFilterTaps(short theFilter, long theSourceSize, long theDestinationSize, QTUFilterTaps *theTaps)
+
+DESCRIPTION
+	For every destination pixel QTUMakeFilterTaps finds the source pixels under the filter, and
+	turns the filter weights into fixed point numbers adding up to exactly 1 << kQTUWeightBits.
+	When scaling down, the filter is stretched over all the source pixels the destination pixel
+	covers. Taps outside the image are left out, the remaining ones are normalized again.
+
+	A filter that would need more than kQTUMaxResampleTaps taps is replaced by a narrower one,
+	Lanczos by bilinear and bilinear by box. If even the box does not fit, it's stretched only as
+	far as kQTUMaxResampleTaps reach, some source pixels between the taps are then left out.
+*/
+
+static OSErr QTUMakeFilterTaps(short theFilter, long theSourceSize, long theDestinationSize, QTUFilterTaps *theTaps)
+{
+	double	aRatio = (double)theSourceSize / (double)theDestinationSize;
+	double	aScale = (aRatio > 1.0) ? aRatio : 1.0;
+	double	aRadius;
+	double	aSupport;
+	long	index;
+
+	for(;;)
+	{
+		aRadius = (theFilter == kQTUResampleBox) ? 0.5 : (theFilter == kQTUResampleBilinear) ? 1.0 : 3.0;
+		aSupport = aRadius * aScale;
+		theTaps->maxTaps = (long)ceil(2.0 * aSupport) + 2;
+		if(theTaps->maxTaps <= kQTUMaxResampleTaps)
+			break;
+
+		// Too much scaling down for this filter in one pass.
+		if(theFilter == kQTUResampleBox)
+		{
+			aScale = (kQTUMaxResampleTaps - 3) / (2.0 * aRadius);
+			aSupport = aRadius * aScale;
+			theTaps->maxTaps = (long)ceil(2.0 * aSupport) + 2;
+			break;
+		}
+		theFilter = (theFilter == kQTUResampleBilinear) ? kQTUResampleBox : kQTUResampleBilinear;
+	}
+
+	theTaps->first = (long *)NewPtr(theDestinationSize * sizeof(long));
+	theTaps->count = (long *)NewPtr(theDestinationSize * sizeof(long));
+	theTaps->weights = (SInt16 *)NewPtrClear(theDestinationSize * theTaps->maxTaps * sizeof(SInt16));
+	if(theTaps->first == NULL || theTaps->count == NULL || theTaps->weights == NULL)
+		return memFullErr;
+
+	for(index = 0; index < theDestinationSize; index++)
+	{
+		double	aCenter = (index + 0.5) * aRatio;
+		long	aLeft = (long)floor(aCenter - aSupport);
+		long	aRight = (long)ceil(aCenter + aSupport);
+		double	aWeights[kQTUMaxResampleTaps];
+		double	aTotal = 0.0;
+		long	aCount = 0;
+		long	aFixedTotal = 0;
+		long	aLargest = 0;
+		SInt16	*aFixedWeights = theTaps->weights + index * theTaps->maxTaps;
+		long	tap;
+
+		if(aLeft < 0) aLeft = 0;
+		if(aRight > theSourceSize - 1) aRight = theSourceSize - 1;
+
+		for(tap = aLeft; tap <= aRight && aCount < theTaps->maxTaps; tap++)
+		{
+			aWeights[aCount] = QTUResampleFilter(theFilter, (tap + 0.5 - aCenter) / aScale);
+			aTotal += aWeights[aCount];
+			aCount++;
+		}
+
+		// Leave out the zero weights at both ends.
+		while(aCount > 1 && aWeights[0] == 0.0)
+		{
+			BlockMoveData(&aWeights[1], &aWeights[0], (aCount - 1) * sizeof(double));
+			aLeft++; aCount--;
+		}
+		while(aCount > 1 && aWeights[aCount - 1] == 0.0)
+			aCount--;
+
+		if(aTotal == 0.0)
+		{
+			aWeights[0] = aTotal = 1.0;
+			aCount = 1;
+		}
+
+		for(tap = 0; tap < aCount; tap++)
+		{
+			aFixedWeights[tap] = (SInt16)floor(aWeights[tap] / aTotal * (1L << kQTUWeightBits) + 0.5);
+			aFixedTotal += aFixedWeights[tap];
+			if(aFixedWeights[tap] > aFixedWeights[aLargest])
+				aLargest = tap;
+		}
+
+		// Rounding could be off by a little, the largest weight takes the difference.
+		aFixedWeights[aLargest] += (SInt16)((1L << kQTUWeightBits) - aFixedTotal);
+
+		theTaps->first[index] = aLeft;
+		theTaps->count[index] = aCount;
+	}
+
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUResampleRowsHorizontally - The horizontal pass of the resampler.
+
+static void QTUResampleRowsHorizontally(QTUResampler theResampler, long theFirstRow, long theRowCount)
+
+DESCRIPTION
+	Scales source rows into intermediate rows, the four components of a pixel are done together.
+*/
+
+static void QTUResampleRowsHorizontally(QTUResampler theResampler, long theFirstRow, long theRowCount)
+{
+	const QTUFilterTaps	*aTaps = &theResampler->horizontal;
+	long				aRow;
+	long				x;
+
+	for(aRow = theFirstRow; aRow < theFirstRow + theRowCount; aRow++)
+	{
+		const UInt8		*aSource = theResampler->sourceBase + aRow * theResampler->sourceRowBytes;
+		SInt16			*anIntermediate = theResampler->intermediate + aRow * theResampler->intermediateStride;
+
+		for(x = 0; x < theResampler->destinationWidth; x++)
+		{
+			const UInt8		*aPixel = aSource + aTaps->first[x] * 4;
+			const SInt16	*aWeight = aTaps->weights + x * aTaps->maxTaps;
+			long			aCount = aTaps->count[x];
+			long			aSum0 = 0, aSum1 = 0, aSum2 = 0, aSum3 = 0;
+			long			aComponent;
+
+			while(aCount-- > 0)
+			{
+				aSum0 += aPixel[0] * *aWeight;
+				aSum1 += aPixel[1] * *aWeight;
+				aSum2 += aPixel[2] * *aWeight;
+				aSum3 += aPixel[3] * *aWeight;
+				aPixel += 4; aWeight++;
+			}
+
+#define QTUStoreIntermediate(theSum)																\
+			aComponent = ((theSum) + (1L << (kQTUWeightBits - kQTUFractionBits - 1))) >> (kQTUWeightBits - kQTUFractionBits);	\
+			*anIntermediate++ = (SInt16)((aComponent > 32767) ? 32767 : (aComponent < -32768) ? -32768 : aComponent);
+
+			QTUStoreIntermediate(aSum0);
+			QTUStoreIntermediate(aSum1);
+			QTUStoreIntermediate(aSum2);
+			QTUStoreIntermediate(aSum3);
+
+#undef QTUStoreIntermediate
+		}
+	}
+}
+
+
+/*______________________________________________________________________
+	QTUResampleRowsVertically - The vertical pass of the resampler.
+
+static void QTUResampleRowsVertically(QTUResampleBand *theBand)
+
+DESCRIPTION
+	Every destination row is the weighted sum of a few intermediate rows. All the components of the
+	row are independent of each other, so this is a straight multiply and add over long rows,
+	which we do eight components at a time with AltiVec when we have it.
+*/
+
+static void QTUResampleRowsVertically(QTUResampleBand *theBand)
+{
+	QTUResampler		aResampler = theBand->resampler;
+	const QTUFilterTaps	*aTaps = &aResampler->vertical;
+	long				aRowSize = aResampler->destinationWidth * 4;
+	long				aShift = kQTUWeightBits + kQTUFractionBits;
+	long				aRow;
+
+	for(aRow = theBand->firstRow; aRow < theBand->firstRow + theBand->rowCount; aRow++)
+	{
+		const SInt16	*aWeight = aTaps->weights + aRow * aTaps->maxTaps;
+		const SInt16	*aFirstRow = aResampler->intermediate + aTaps->first[aRow] * aResampler->intermediateStride;
+		long			aCount = aTaps->count[aRow];
+		UInt8			*aDestination = aResampler->destinationBase + aRow * aResampler->destinationRowBytes;
+		long			tap, index;
+
+#if defined(__VEC__)
+		// The row is built in the 16 byte aligned accumulator memory, and then copied to the destination.
+		UInt8							*anAlignedRow = (UInt8 *)theBand->accumulator;
+		vector signed short				aWeights[kQTUMaxResampleTaps];
+		union { SInt32 s[4]; vector signed int v; }		aRound;
+		union { UInt32 s[4]; vector unsigned int v; }	aShiftCount;
+
+		for(tap = 0; tap < aCount; tap++)
+		{
+			union { SInt16 s[8]; vector signed short v; } aSplat;
+
+			for(index = 0; index < 8; index++) aSplat.s[index] = aWeight[tap];
+			aWeights[tap] = aSplat.v;
+		}
+		for(index = 0; index < 4; index++)
+		{
+			aRound.s[index] = 1L << (aShift - 1);
+			aShiftCount.s[index] = aShift;
+		}
+
+		for(index = 0; index < aResampler->intermediateStride; index += 16)
+		{
+			vector signed int	aSums[4];
+			vector signed short	aPacked[2];
+			long				half;
+
+			for(half = 0; half < 2; half++)
+			{
+				vector signed int aEven = vec_splat_s32(0);
+				vector signed int aOdd = vec_splat_s32(0);
+
+				for(tap = 0; tap < aCount; tap++)
+				{
+					vector signed short aValues = vec_ld(0, aFirstRow + tap * aResampler->intermediateStride + index + half * 8);
+
+					aEven = vec_add(aEven, vec_mule(aValues, aWeights[tap]));
+					aOdd = vec_add(aOdd, vec_mulo(aValues, aWeights[tap]));
+				}
+
+				aEven = vec_sra(vec_add(aEven, aRound.v), aShiftCount.v);
+				aOdd = vec_sra(vec_add(aOdd, aRound.v), aShiftCount.v);
+
+				// Put the even and odd components back in order.
+				aSums[0] = vec_mergeh(aEven, aOdd);
+				aSums[1] = vec_mergel(aEven, aOdd);
+				aPacked[half] = vec_packs(aSums[0], aSums[1]);
+			}
+
+			vec_st(vec_packsu(aPacked[0], aPacked[1]), index, anAlignedRow);
+		}
+
+		BlockMoveData(anAlignedRow, aDestination, aRowSize);
+#else
+		long	*aSum = theBand->accumulator;
+
+		for(index = 0; index < aRowSize; index++)
+			aSum[index] = 1L << (aShift - 1);
+
+		for(tap = 0; tap < aCount; tap++)
+		{
+			const SInt16	*aValues = aFirstRow + tap * aResampler->intermediateStride;
+			long			aTapWeight = aWeight[tap];
+
+			for(index = 0; index < aRowSize; index++)
+				aSum[index] += aValues[index] * aTapWeight;
+		}
+
+		for(index = 0; index < aRowSize; index++)
+		{
+			long aComponent = aSum[index] >> aShift;
+
+			aDestination[index] = (UInt8)((aComponent > 255) ? 255 : (aComponent < 0) ? 0 : aComponent);
+		}
+#endif
+	}
+}
+
+
+/*______________________________________________________________________
+	QTUResampleBandProc - Work function for the resampler bands.
+
+static OSStatus QTUResampleBandProc(void *theWorkItem)
+*/
+
+static OSStatus QTUResampleBandProc(void *theWorkItem)
+{
+	QTUResampleBand *aBand = (QTUResampleBand *)theWorkItem;
+
+	if(aBand->vertical)
+		QTUResampleRowsVertically(aBand);
+	else
+		QTUResampleRowsHorizontally(aBand->resampler, aBand->firstRow, aBand->rowCount);
+
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUResampleAllBands - Run one pass of the resampler over all bands.
+
+static OSErr QTUResampleAllBands(QTUResampler theResampler, Boolean isVertical)
+
+DESCRIPTION
+	Splits the rows of the pass into one band per worker, and waits until all are done.
+*/
+
+static OSErr QTUResampleAllBands(QTUResampler theResampler, Boolean isVertical)
+{
+	OSErr	anErr = noErr;
+	long	aRowCount = isVertical ? theResampler->destinationHeight : theResampler->sourceHeight;
+	long	aSubmitted = 0;
+	long	index;
+
+	for(index = 0; index < theResampler->bandCount; index++)
+	{
+		QTUResampleBand *aBand = &theResampler->bands[index];
+
+		aBand->vertical = isVertical;
+		aBand->firstRow = aRowCount * index / theResampler->bandCount;
+		aBand->rowCount = aRowCount * (index + 1) / theResampler->bandCount - aBand->firstRow;
+
+		if(theResampler->pool == NULL)
+		{
+			QTUResampleBandProc(aBand);
+			continue;
+		}
+
+		anErr = QTUWorkerPoolSubmit(theResampler->pool, QTUResampleBandProc, aBand); DebugAssert(anErr == noErr);
+		if(anErr != noErr) break;
+		aSubmitted++;
+	}
+
+	while(aSubmitted-- > 0)
+	{
+		void		*aBand;
+		OSStatus	aResult;
+
+		if(QTUWorkerPoolWaitForItem(theResampler->pool, &aBand, &aResult) != noErr)
+			break;
+	}
+
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUNewResampler - Prepare to scale 32-bit frames of one size to another size.
+
+pascal OSErr QTUNewResampler(short theSourceWidth, short theSourceHeight, short theDestinationWidth, short theDestinationHeight,
+								short theFilter, long theBandCount, QTUResampler *theResampler)
+
+theSourceWidth, theSourceHeight				size of the frames to scale
+theDestinationWidth, theDestinationHeight	size of the scaled frames
+theFilter									kQTUResampleBox, kQTUResampleBilinear or kQTUResampleLanczos
+theBandCount								rows are split in this many bands done in parallel, 1 does it all
+											on the calling task
+theResampler								will contain the resampler
+
+DESCRIPTION
+	QTUNewResampler calculates the filter weights and allocates the intermediate buffer once, so
+	scaling every frame of a movie with QTUResamplePixMap does not allocate any memory. Box is the
+	fastest and good for scaling down by whole numbers, Lanczos is the sharpest. When scaling down
+	by more than about 10 times the filter falls back to bilinear, and beyond that to box.
+
+	Bands are done by a worker pool of the resampler's own, so it could be used while other pools
+	are busy with something else.
+*/
+
+pascal OSErr QTUNewResampler(short theSourceWidth, short theSourceHeight, short theDestinationWidth, short theDestinationHeight,
+								short theFilter, long theBandCount, QTUResampler *theResampler)
+{
+	OSErr			anErr = noErr;
+	QTUResampler	aResampler;
+	long			index;
+
+	DebugAssert(theResampler != NULL); if(theResampler == NULL) return paramErr;
+	*theResampler = NULL;
+
+	if(theSourceWidth <= 0 || theSourceHeight <= 0 || theDestinationWidth <= 0 || theDestinationHeight <= 0)
+		return paramErr;
+
+	if(theBandCount < 1) theBandCount = 1;
+	if(theBandCount > kQTUMaxResampleBands) theBandCount = kQTUMaxResampleBands;
+	if(theBandCount > theDestinationHeight) theBandCount = theDestinationHeight;
+
+	aResampler = (QTUResampler)NewPtrClear(sizeof(struct QTUResamplerRecord)); DebugAssert(aResampler != NULL);
+	if(aResampler == NULL) return memFullErr;
+
+	aResampler->sourceWidth = theSourceWidth;
+	aResampler->sourceHeight = theSourceHeight;
+	aResampler->destinationWidth = theDestinationWidth;
+	aResampler->destinationHeight = theDestinationHeight;
+	aResampler->bandCount = theBandCount;
+
+	anErr = QTUMakeFilterTaps(theFilter, theSourceWidth, theDestinationWidth, &aResampler->horizontal);
+	if(anErr != noErr) goto Closure;
+
+	anErr = QTUMakeFilterTaps(theFilter, theSourceHeight, theDestinationHeight, &aResampler->vertical);
+	if(anErr != noErr) goto Closure;
+
+	// Intermediate rows are padded to 16 values so the vertical pass can always do whole vectors.
+	aResampler->intermediateStride = (theDestinationWidth * 4 + 15) & ~15;
+	aResampler->intermediateMemory = NewPtrClear(aResampler->intermediateStride * theSourceHeight * sizeof(SInt16) + 16);
+	if(aResampler->intermediateMemory == NULL) { anErr = memFullErr; goto Closure; }
+	aResampler->intermediate = (SInt16 *)(((unsigned long)aResampler->intermediateMemory + 15) & ~15UL);
+
+	for(index = 0; index < theBandCount; index++)
+	{
+		QTUResampleBand *aBand = &aResampler->bands[index];
+
+		aBand->resampler = aResampler;
+		aBand->rowMemory = NewPtr(aResampler->intermediateStride * sizeof(long) + 16);
+		if(aBand->rowMemory == NULL) { anErr = memFullErr; goto Closure; }
+		aBand->accumulator = (long *)(((unsigned long)aBand->rowMemory + 15) & ~15UL);
+	}
+
+	if(theBandCount > 1)
+	{
+		anErr = QTUNewWorkerPool(theBandCount, &aResampler->pool); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+	}
+
+Closure:
+	if(anErr != noErr)
+	{
+		QTUDisposeResampler(aResampler);
+		return anErr;
+	}
+
+	*theResampler = aResampler;
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUResamplePixMap - Scale a 32-bit frame.
+
+pascal OSErr QTUResamplePixMap(QTUResampler theResampler, PixMapHandle theSource, const Rect *theSourceRect,
+								PixMapHandle theDestination, const Rect *theDestinationRect)
+
+theResampler				resampler made for the sizes of the two rects
+theSource					32-bit pixmap with the frame, locked
+theSourceRect				the part of theSource to scale
+theDestination				32-bit pixmap for the scaled frame, locked
+theDestinationRect			where the scaled frame goes in theDestination
+
+DESCRIPTION
+	QTUResamplePixMap scales the pixels of the source rect into the destination rect, the four
+	components of every pixel are filtered alike so the pixel format does not matter as long as
+	it's 32 bits. The call returns when the whole frame is done.
+*/
+
+pascal OSErr QTUResamplePixMap(QTUResampler theResampler, PixMapHandle theSource, const Rect *theSourceRect,
+								PixMapHandle theDestination, const Rect *theDestinationRect)
+{
+	OSErr	anErr = noErr;
+	Rect	aBounds;
+
+	DebugAssert(theResampler != NULL); if(theResampler == NULL) return paramErr;
+
+	if(GetPixDepth(theSource) != 32 || GetPixDepth(theDestination) != 32 ||
+		theSourceRect->right - theSourceRect->left != theResampler->sourceWidth ||
+		theSourceRect->bottom - theSourceRect->top != theResampler->sourceHeight ||
+		theDestinationRect->right - theDestinationRect->left != theResampler->destinationWidth ||
+		theDestinationRect->bottom - theDestinationRect->top != theResampler->destinationHeight)
+		return paramErr;
+
+	GetPixBounds(theSource, &aBounds);
+	theResampler->sourceRowBytes = GetPixRowBytes(theSource);
+	theResampler->sourceBase = (UInt8 *)GetPixBaseAddr(theSource) + (theSourceRect->top - aBounds.top) * theResampler->sourceRowBytes +
+									(theSourceRect->left - aBounds.left) * 4;
+
+	GetPixBounds(theDestination, &aBounds);
+	theResampler->destinationRowBytes = GetPixRowBytes(theDestination);
+	theResampler->destinationBase = (UInt8 *)GetPixBaseAddr(theDestination) + (theDestinationRect->top - aBounds.top) * theResampler->destinationRowBytes +
+									(theDestinationRect->left - aBounds.left) * 4;
+
+	// The vertical pass needs all of the intermediate rows, so one pass has to be done before the other starts.
+	anErr = QTUResampleAllBands(theResampler, false);
+	if(anErr == noErr)
+		anErr = QTUResampleAllBands(theResampler, true);
+
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUDisposeResampler - Dispose a resampler.
+
+pascal void QTUDisposeResampler(QTUResampler theResampler)
+
+theResampler				the resampler, NULL is OK
+*/
+
+pascal void QTUDisposeResampler(QTUResampler theResampler)
+{
+	long index;
+
+	if(theResampler == NULL) return;
+
+	if(theResampler->pool) QTUDisposeWorkerPool(theResampler->pool);
+
+	for(index = 0; index < kQTUMaxResampleBands; index++)
+		if(theResampler->bands[index].rowMemory) DisposePtr(theResampler->bands[index].rowMemory);
+
+	if(theResampler->intermediateMemory) DisposePtr(theResampler->intermediateMemory);
+	if(theResampler->horizontal.first) DisposePtr((Ptr)theResampler->horizontal.first);
+	if(theResampler->horizontal.count) DisposePtr((Ptr)theResampler->horizontal.count);
+	if(theResampler->horizontal.weights) DisposePtr((Ptr)theResampler->horizontal.weights);
+	if(theResampler->vertical.first) DisposePtr((Ptr)theResampler->vertical.first);
+	if(theResampler->vertical.count) DisposePtr((Ptr)theResampler->vertical.count);
+	if(theResampler->vertical.weights) DisposePtr((Ptr)theResampler->vertical.weights);
+
+	DisposePtr((Ptr)theResampler);
+}
+
+
+// COMPOSITING FUNCTIONS
+
+struct QTUCompositorRecord {
+	short						transition;
+	long						width;
+	long						height;
+	const UInt8					*fromBase;				// top left of theRect in the pixmaps
+	long						fromRowBytes;
+	const UInt8					*toBase;
+	long						toRowBytes;
+
+	// Two output buffers, the caller can still use one frame while we build the next.
+	GWorldPtr					buffers[2];
+	long						bufferOffsets[2];		// the step each buffer shows, -1 for none yet
+	long						current;				// the buffer returned last
+	long						lastOffset;				// the step returned last, -1 for none yet
+};
+
+
+/*______________________________________________________________________
+	QTUCopyPixelRun - Copy a run of 32-bit pixels.
+
+static void QTUCopyPixelRun(UInt32 *theDestination, const UInt32 *theSource, long theCount)
+
+DESCRIPTION
+	With AltiVec the destination is brought to a 16 byte boundary with single pixels first, then
+	four pixels are stored at a time, vec_perm takes care of a source at another alignment (which
+	is the normal case when scrolling). Without AltiVec this is BlockMoveData, a tuned memcpy.
+*/
+
+static void QTUCopyPixelRun(UInt32 *theDestination, const UInt32 *theSource, long theCount)
+{
+#if defined(__VEC__)
+	vector unsigned char	aPermute;
+
+	for(; theCount > 0 && ((unsigned long)theDestination & 15); theCount--)
+		*theDestination++ = *theSource++;
+
+	aPermute = vec_lvsl(0, (const UInt8 *)theSource);
+	for(; theCount >= 4; theCount -= 4)
+	{
+		const UInt8 *aSource = (const UInt8 *)theSource;
+
+		vec_st(vec_perm(vec_ld(0, aSource), vec_ld(15, aSource), aPermute), 0, (UInt8 *)theDestination);
+		theDestination += 4;
+		theSource += 4;
+	}
+
+	for(; theCount > 0; theCount--)
+		*theDestination++ = *theSource++;
+#else
+	BlockMoveData(theSource, theDestination, theCount * 4);
+#endif
+}
+
+
+/*______________________________________________________________________
+	QTUCopyPixelColumns - Copy the same columns of a number of rows.
+
+static void QTUCopyPixelColumns(UInt8 *theDestination, long theDestinationRowBytes, long theDestinationLeft,
+									const UInt8 *theSource, long theSourceRowBytes, long theSourceLeft, long theWidth, long theHeight)
+*/
+
+static void QTUCopyPixelColumns(UInt8 *theDestination, long theDestinationRowBytes, long theDestinationLeft,
+									const UInt8 *theSource, long theSourceRowBytes, long theSourceLeft, long theWidth, long theHeight)
+{
+	long aRow;
+
+	if(theWidth <= 0)
+		return;
+
+	theDestination += theDestinationLeft * 4;
+	theSource += theSourceLeft * 4;
+
+	for(aRow = 0; aRow < theHeight; aRow++)
+	{
+		QTUCopyPixelRun((UInt32 *)theDestination, (const UInt32 *)theSource, theWidth);
+		theDestination += theDestinationRowBytes;
+		theSource += theSourceRowBytes;
+	}
+}
+
+
+/*______________________________________________________________________
+	QTUNewCompositor - Prepare a transition between two frames.
+
+pascal OSErr QTUNewCompositor(PixMapHandle theFrom, PixMapHandle theTo, const Rect *theRect, short theTransition,
+									QTUCompositor *theCompositor)
+
+theFrom						32-bit pixmap with the frame we leave, locked as long as the compositor is used
+theTo						32-bit pixmap with the frame we go to, locked as well
+theRect						the part of both pixmaps the transition is about
+theTransition				kQTUTransitionScroll or kQTUTransitionWipe
+theCompositor				will contain the compositor
+
+DESCRIPTION
+	A compositor builds the frames of a transition straight from the pixels of the two frames,
+	without QuickDraw. kQTUTransitionScroll pushes the first frame out to the left while the second
+	one comes in from the right, like QTUScrollToNextVideoSample always did. kQTUTransitionWipe
+	uncovers the second frame from the right without moving anything.
+
+	The frames are built in two buffers of their own, so a frame QTUCompositorRenderStep returned
+	stays intact while the next one is built. With a wipe only the columns that changed since a
+	buffer was used last are copied again, and every step returns the rectangle that changed since
+	the frame before, that's all the caller has to copy to the screen.
+
+	The frames can go to the screen, or straight into a compression sequence.
+
+EXAMPLE
+	anErr = QTUNewCompositor(aFromPixMap, aToPixMap, &aRect, kQTUTransitionScroll, &aCompositor);
+	for(aStep = 10; aStep <= aWidth; aStep += 10)
+	{
+		anErr = QTUCompositorRenderStep(aCompositor, aStep, &aFrame, &aDirtyRect);
+		anErr = SCCompressSequenceFrame(ci, aFrame, &aFrameRect, &aData, &aDataSize, &aSyncFlag);
+	}
+	QTUDisposeCompositor(aCompositor);
+*/
+
+pascal OSErr QTUNewCompositor(PixMapHandle theFrom, PixMapHandle theTo, const Rect *theRect, short theTransition,
+									QTUCompositor *theCompositor)
+{
+	OSErr			anErr = noErr;
+	QTUCompositor	aCompositor;
+	Rect			aBounds;
+	Rect			aBufferRect;
+	long			index;
+
+	DebugAssert(theCompositor != NULL); if(theCompositor == NULL) return paramErr;
+	*theCompositor = NULL;
+
+	DebugAssert(theFrom != NULL && theTo != NULL); if(theFrom == NULL || theTo == NULL) return paramErr;
+	if(GetPixDepth(theFrom) != 32 || GetPixDepth(theTo) != 32) return paramErr;
+	if(theTransition != kQTUTransitionScroll && theTransition != kQTUTransitionWipe) return paramErr;
+
+	aCompositor = (QTUCompositor)NewPtrClear(sizeof(struct QTUCompositorRecord)); DebugAssert(aCompositor != NULL);
+	if(aCompositor == NULL) return memFullErr;
+
+	aCompositor->transition = theTransition;
+	aCompositor->width = theRect->right - theRect->left;
+	aCompositor->height = theRect->bottom - theRect->top;
+	aCompositor->current = 1;
+	aCompositor->lastOffset = -1;
+
+	GetPixBounds(theFrom, &aBounds);
+	aCompositor->fromRowBytes = GetPixRowBytes(theFrom);
+	aCompositor->fromBase = (const UInt8 *)GetPixBaseAddr(theFrom) + (theRect->top - aBounds.top) * aCompositor->fromRowBytes +
+								(theRect->left - aBounds.left) * 4;
+
+	GetPixBounds(theTo, &aBounds);
+	aCompositor->toRowBytes = GetPixRowBytes(theTo);
+	aCompositor->toBase = (const UInt8 *)GetPixBaseAddr(theTo) + (theRect->top - aBounds.top) * aCompositor->toRowBytes +
+								(theRect->left - aBounds.left) * 4;
+
+	SetRect(&aBufferRect, 0, 0, aCompositor->width, aCompositor->height);
+	for(index = 0; index < 2; index++)
+	{
+		aCompositor->bufferOffsets[index] = -1;
+
+		anErr = NewGWorld(&aCompositor->buffers[index], 32, &aBufferRect, NULL, NULL, 0); DebugAssert(anErr == noErr);
+		if(anErr != noErr)
+		{
+			QTUDisposeCompositor(aCompositor);
+			return anErr;
+		}
+		LockPixels(GetGWorldPixMap(aCompositor->buffers[index]));
+	}
+
+	*theCompositor = aCompositor;
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUCompositorRenderStep - Build one frame of a transition.
+
+pascal OSErr QTUCompositorRenderStep(QTUCompositor theCompositor, long theOffset, PixMapHandle *theFrame, Rect *theDirtyRect)
+
+theCompositor				the compositor
+theOffset					how far the transition is, in pixels from 0 (the first frame) to the width (the second)
+theFrame					will contain the frame, at 0,0, valid until the step after the next one
+theDirtyRect				will contain the part of the frame that differs from the one returned before, could be NULL
+
+DESCRIPTION
+	Steps usually go forward, but any order works, a buffer that can't be updated is built again.
+*/
+
+pascal OSErr QTUCompositorRenderStep(QTUCompositor theCompositor, long theOffset, PixMapHandle *theFrame, Rect *theDirtyRect)
+{
+	long			aBufferNum;
+	PixMapHandle	aPixMap;
+	UInt8			*aBase;
+	long			aRowBytes;
+	long			aWidth;
+	long			aBufferOffset;
+
+	DebugAssert(theCompositor != NULL); if(theCompositor == NULL) return paramErr;
+	DebugAssert(theFrame != NULL); if(theFrame == NULL) return paramErr;
+
+	aWidth = theCompositor->width;
+	if(theOffset < 0) theOffset = 0;
+	if(theOffset > aWidth) theOffset = aWidth;
+
+	aBufferNum = 1 - theCompositor->current;
+	aPixMap = GetGWorldPixMap(theCompositor->buffers[aBufferNum]);
+	aBase = (UInt8 *)GetPixBaseAddr(aPixMap);
+	aRowBytes = GetPixRowBytes(aPixMap);
+	aBufferOffset = theCompositor->bufferOffsets[aBufferNum];
+
+	if(theCompositor->transition == kQTUTransitionScroll)
+	{
+		// Everything moves, the whole frame is built from both sources.
+		QTUCopyPixelColumns(aBase, aRowBytes, 0, theCompositor->fromBase, theCompositor->fromRowBytes, theOffset,
+								aWidth - theOffset, theCompositor->height);
+		QTUCopyPixelColumns(aBase, aRowBytes, aWidth - theOffset, theCompositor->toBase, theCompositor->toRowBytes, 0,
+								theOffset, theCompositor->height);
+	}
+	else if(aBufferOffset < 0 || aBufferOffset > theOffset)
+	{
+		// A wipe in a buffer we can't update, build it all.
+		QTUCopyPixelColumns(aBase, aRowBytes, 0, theCompositor->fromBase, theCompositor->fromRowBytes, 0,
+								aWidth - theOffset, theCompositor->height);
+		QTUCopyPixelColumns(aBase, aRowBytes, aWidth - theOffset, theCompositor->toBase, theCompositor->toRowBytes, aWidth - theOffset,
+								theOffset, theCompositor->height);
+	}
+	else
+	{
+		// A wipe further than the buffer shows, only the columns uncovered since then.
+		QTUCopyPixelColumns(aBase, aRowBytes, aWidth - theOffset, theCompositor->toBase, theCompositor->toRowBytes, aWidth - theOffset,
+								theOffset - aBufferOffset, theCompositor->height);
+	}
+
+	if(theDirtyRect)
+	{
+		long aLastOffset = theCompositor->lastOffset;
+
+		if(aLastOffset == theOffset)
+			SetRect(theDirtyRect, 0, 0, 0, 0);
+		else if(theCompositor->transition == kQTUTransitionWipe && aLastOffset >= 0)
+		{
+			long aLeft = aWidth - ((theOffset > aLastOffset) ? theOffset : aLastOffset);
+			long aRight = aWidth - ((theOffset > aLastOffset) ? aLastOffset : theOffset);
+
+			SetRect(theDirtyRect, aLeft, 0, aRight, theCompositor->height);
+		}
+		else
+			SetRect(theDirtyRect, 0, 0, aWidth, theCompositor->height);
+	}
+
+	theCompositor->bufferOffsets[aBufferNum] = theOffset;
+	theCompositor->current = aBufferNum;
+	theCompositor->lastOffset = theOffset;
+
+	*theFrame = aPixMap;
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUDisposeCompositor - Dispose a compositor and its buffers.
+
+pascal void QTUDisposeCompositor(QTUCompositor theCompositor)
+*/
+
+pascal void QTUDisposeCompositor(QTUCompositor theCompositor)
+{
+	long index;
+
+	if(theCompositor == NULL)
+		return;
+
+	for(index = 0; index < 2; index++)
+	{
+		if(theCompositor->buffers[index]) DisposeGWorld(theCompositor->buffers[index]);
+	}
+
+	DisposePtr((Ptr)theCompositor);
+}
+
+
+/*______________________________________________________________________
+	QTUTimeScrollTransition - Compare the compositor with the step-wise CopyBits scroll.
+
+pascal OSErr QTUTimeScrollTransition(GWorldPtr theFrom, GWorldPtr theTo, short theStep, double *theCopyBitsMicroseconds,
+										double *theCompositorMicroseconds, Boolean *theSameOutput)
+
+theFrom						32-bit GWorld with the first frame
+theTo						32-bit GWorld with the second frame, with the same bounds
+theStep						pixels per step
+theCopyBitsMicroseconds		will contain the time the ScrollRect and CopyBits version took
+theCompositorMicroseconds	will contain the time the compositor took
+theSameOutput				will be true if both ended with the same pixels
+
+DESCRIPTION
+	QTUTimeScrollTransition runs the scroll transition both ways into an offscreen 'screen', the
+	way QTUScrollToNextVideoSample used to do it (ScrollRect, a CopyBits for the new strip and a
+	CopyBits of the whole frame per step) and with a compositor, copying only the dirty rect.
+	The alpha byte is not compared, QuickDraw does not care about it.
+*/
+
+pascal OSErr QTUTimeScrollTransition(GWorldPtr theFrom, GWorldPtr theTo, short theStep, double *theCopyBitsMicroseconds,
+										double *theCompositorMicroseconds, Boolean *theSameOutput)
+{
+	OSErr			anErr = noErr;
+	CGrafPtr		aSavedPort;
+	GDHandle		aSavedGDevice;
+	GWorldPtr		aWorkGWorld = NULL;
+	GWorldPtr		aScreenGWorld = NULL;
+	GWorldPtr		aCompositorScreenGWorld = NULL;
+	QTUCompositor	aCompositor = NULL;
+	RgnHandle		aScrollRegion = NULL;
+	Rect			aRect;
+	Rect			aSourceRect, aDestinationRect;
+	UnsignedWide	aTimer;
+	short			aWidth;
+	short			nSteps;
+	long			x, y;
+
+	DebugAssert(theStep > 0); if(theStep <= 0) return paramErr;
+	*theSameOutput = false;
+
+	GetGWorld(&aSavedPort, &aSavedGDevice);
+	GetPortBounds(theFrom, &aRect);
+	aWidth = aRect.right - aRect.left;
+
+	anErr = NewGWorld(&aWorkGWorld, 32, &aRect, NULL, NULL, 0); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+	anErr = NewGWorld(&aScreenGWorld, 32, &aRect, NULL, NULL, 0); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+	anErr = NewGWorld(&aCompositorScreenGWorld, 32, &aRect, NULL, NULL, 0); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+
+	LockPixels(GetGWorldPixMap(theFrom));
+	LockPixels(GetGWorldPixMap(theTo));
+	LockPixels(GetGWorldPixMap(aWorkGWorld));
+	LockPixels(GetGWorldPixMap(aScreenGWorld));
+	LockPixels(GetGWorldPixMap(aCompositorScreenGWorld));
+
+	aScrollRegion = NewRgn(); DebugAssert(aScrollRegion != NULL);
+	if(aScrollRegion == NULL) { anErr = memFullErr; goto Closure; }
+
+	// The step-wise version.
+	CopyBits((BitMap *)*GetGWorldPixMap(theFrom), (BitMap *)*GetGWorldPixMap(aWorkGWorld), &aRect, &aRect, srcCopy, NULL);
+
+	QTUStartTimer(&aTimer);
+	SetGWorld(aWorkGWorld, NULL);
+	for(nSteps = theStep; nSteps <= aWidth; nSteps += theStep)
+	{
+		ScrollRect(&aRect, -theStep, 0, aScrollRegion);
+		SetRect(&aSourceRect, aRect.left, aRect.top, aRect.left + nSteps, aRect.bottom);
+		SetRect(&aDestinationRect, aRect.right - nSteps, aRect.top, aRect.right, aRect.bottom);
+
+		CopyBits((BitMap *)*GetGWorldPixMap(theTo), (BitMap *)*GetGWorldPixMap(aWorkGWorld), &aSourceRect, &aDestinationRect, srcCopy, NULL);
+		CopyBits((BitMap *)*GetGWorldPixMap(aWorkGWorld), (BitMap *)*GetGWorldPixMap(aScreenGWorld), &aRect, &aRect, srcCopy, NULL);
+	}
+	SetGWorld(aSavedPort, aSavedGDevice);
+	*theCopyBitsMicroseconds = QTUElapsedMicroseconds(&aTimer);
+
+	// The compositor, the first step still copies everything.
+	anErr = QTUNewCompositor(GetGWorldPixMap(theFrom), GetGWorldPixMap(theTo), &aRect, kQTUTransitionScroll, &aCompositor);
+	if(anErr != noErr) goto Closure;
+
+	QTUStartTimer(&aTimer);
+	for(nSteps = theStep; nSteps <= aWidth; nSteps += theStep)
+	{
+		PixMapHandle	aFrame;
+		Rect			aDirtyRect;
+
+		anErr = QTUCompositorRenderStep(aCompositor, nSteps, &aFrame, &aDirtyRect);
+		if(anErr != noErr) goto Closure;
+
+		aDestinationRect = aDirtyRect;
+		OffsetRect(&aDestinationRect, aRect.left, aRect.top);
+		CopyBits((BitMap *)*aFrame, (BitMap *)*GetGWorldPixMap(aCompositorScreenGWorld), &aDirtyRect, &aDestinationRect, srcCopy, NULL);
+	}
+	*theCompositorMicroseconds = QTUElapsedMicroseconds(&aTimer);
+
+	// Both 'screens' should show the same now.
+	*theSameOutput = true;
+	for(y = 0; y < aRect.bottom - aRect.top && *theSameOutput; y++)
+	{
+		const UInt32 *aPixel = (const UInt32 *)(GetPixBaseAddr(GetGWorldPixMap(aScreenGWorld)) + y * GetPixRowBytes(GetGWorldPixMap(aScreenGWorld)));
+		const UInt32 *anOtherPixel = (const UInt32 *)(GetPixBaseAddr(GetGWorldPixMap(aCompositorScreenGWorld)) +
+										y * GetPixRowBytes(GetGWorldPixMap(aCompositorScreenGWorld)));
+
+		for(x = 0; x < aWidth; x++)
+		{
+			if((aPixel[x] ^ anOtherPixel[x]) & 0x00FFFFFF)
+			{
+				*theSameOutput = false;
+				break;
+			}
+		}
+	}
+
+Closure:
+	SetGWorld(aSavedPort, aSavedGDevice);
+
+	if(aCompositor) QTUDisposeCompositor(aCompositor);
+	if(aScrollRegion) DisposeRgn(aScrollRegion);
+	if(aWorkGWorld) DisposeGWorld(aWorkGWorld);
+	if(aScreenGWorld) DisposeGWorld(aScreenGWorld);
+	if(aCompositorScreenGWorld) DisposeGWorld(aCompositorScreenGWorld);
+
+	return anErr;
+}
+
+
+// PICTURE ANALYSIS FUNCTIONS
+
+/*______________________________________________________________________
+	QTUCountBrightPixels - Count the pixels of one row of 32-bit pixels that are not black.
+
+static UInt32 QTUCountBrightPixels(const UInt8 *thePixels, long theWidth, UInt8 theBlackLevel, UInt32 *theColumnCounts)
+
+thePixels					the first pixel of the row
+theWidth					number of pixels
+theBlackLevel				a pixel with any of red, green or blue above this is bright
+theColumnCounts				1 is added to the column of every bright pixel, 16 byte aligned
+
+DESCRIPTION
+	The result is the number of bright pixels in the row, alpha is left out. With AltiVec four
+	pixels are looked at at once, the row doesn't have to be aligned.
+*/
+
+static UInt32 QTUCountBrightPixels(const UInt8 *thePixels, long theWidth, UInt8 theBlackLevel, UInt32 *theColumnCounts)
+{
+	UInt32	aRowCount = 0;
+	long	x = 0;
+
+#if defined(__VEC__)
+	{
+		vector unsigned char	aColorOnes = (vector unsigned char)(0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1);
+		vector unsigned char	aPermute = vec_lvsl(0, thePixels);
+		vector unsigned int		aZero = vec_splat_u32(0);
+		vector unsigned int		anOne = vec_splat_u32(1);
+		vector unsigned int		aRowCounts = aZero;
+		union { UInt8 b[16]; vector unsigned char v; }	aLevel;
+		union { UInt32 s[4]; vector unsigned int v; }	aResult;
+		short					index;
+
+		for(index = 0; index < 16; index++)
+			aLevel.b[index] = theBlackLevel;
+
+		for(; x + 4 <= theWidth; x += 4)
+		{
+			const UInt8				*aPixels = thePixels + x * 4;
+			vector unsigned char	aValues = vec_perm(vec_ld(0, aPixels), vec_ld(15, aPixels), aPermute);
+			vector unsigned char	aBright = vec_and((vector unsigned char)vec_cmpgt(aValues, aLevel.v), aColorOnes);
+			vector unsigned int		aCounts = vec_min(vec_sum4s(aBright, aZero), anOne);		// 1 for every bright pixel
+
+			aRowCounts = vec_add(aRowCounts, aCounts);
+			vec_st(vec_add(vec_ld(0, theColumnCounts + x), aCounts), 0, theColumnCounts + x);
+		}
+
+		aResult.v = aRowCounts;
+		aRowCount = aResult.s[0] + aResult.s[1] + aResult.s[2] + aResult.s[3];
+	}
+#endif
+
+	for(; x < theWidth; x++)
+	{
+		const UInt8	*aPixel = thePixels + x * 4;
+
+		if(aPixel[1] > theBlackLevel || aPixel[2] > theBlackLevel || aPixel[3] > theBlackLevel)
+		{
+			aRowCount++;
+			theColumnCounts[x]++;
+		}
+	}
+
+	return aRowCount;
+}
+
+
+/*______________________________________________________________________
+	QTUFindActiveRect - Find the part of a frame that is not black borders.
+
+pascal OSErr QTUFindActiveRect(PixMapHandle thePixMap, const Rect *theRect, short theBlackLevel, Rect *theActiveRect)
+
+thePixMap					a 32-bit pixmap with the frame
+theRect						the part of the pixmap to look at
+theBlackLevel				pixels with red, green and blue (0..255) all up to this are black
+theActiveRect				returns the rect inside theRect that has picture, empty if all of it is black
+
+DESCRIPTION
+	QTUFindActiveRect counts the pixels above the black level in every row and column once, and
+	then trims the rows and columns from the outside in as long as they are black. Letterboxed
+	and pillarboxed frames return the picture between the bars. A row or column is black when
+	hardly any of its pixels is above the black level, one in kQTUStrayPixelShare is let go as
+	the noise and the odd bright pixel a codec leaves in the bars. Dark picture is not taken for
+	a bar, all it takes is a few pixels above the black level.
+*/
+
+#define kQTUStrayPixelShare		64
+
+pascal OSErr QTUFindActiveRect(PixMapHandle thePixMap, const Rect *theRect, short theBlackLevel, Rect *theActiveRect)
+{
+	OSErr		anErr = noErr;
+	long		aWidth = theRect->right - theRect->left;
+	long		aHeight = theRect->bottom - theRect->top;
+	long		aRowBytes;
+	Rect		aBounds;
+	UInt8		*aBase;
+	Ptr			aCountMemory = NULL;
+	UInt32		*aColumnCounts;
+	UInt32		*aRowCounts;
+	UInt32		aRowLimit, aColumnLimit;
+	long		aLeft, aTop, aRight, aBottom;
+	long		y;
+
+	SetRect(theActiveRect, 0, 0, 0, 0);
+
+	if(GetPixDepth(thePixMap) != 32 || aWidth <= 0 || aHeight <= 0) return paramErr;
+	if(theBlackLevel < 0) theBlackLevel = 0;
+	if(theBlackLevel > 255) theBlackLevel = 255;
+
+	// Column counts are used as vectors, keep them 16 byte aligned with room for whole vectors.
+	aCountMemory = NewPtrClear((((aWidth + 3) & ~3) + aHeight) * sizeof(UInt32) + 15);
+	if(aCountMemory == NULL) return MemError() ? MemError() : memFullErr;
+	aColumnCounts = (UInt32 *)(((unsigned long)aCountMemory + 15) & ~15UL);
+	aRowCounts = aColumnCounts + ((aWidth + 3) & ~3);
+
+	GetPixBounds(thePixMap, &aBounds);
+	aRowBytes = GetPixRowBytes(thePixMap);
+	aBase = (UInt8 *)GetPixBaseAddr(thePixMap) + (theRect->top - aBounds.top) * aRowBytes + (theRect->left - aBounds.left) * 4;
+
+	for(y = 0; y < aHeight; y++)
+		aRowCounts[y] = QTUCountBrightPixels(aBase + y * aRowBytes, aWidth, (UInt8)theBlackLevel, aColumnCounts);
+
+	aRowLimit = aWidth / kQTUStrayPixelShare;
+	aColumnLimit = aHeight / kQTUStrayPixelShare;
+
+	for(aTop = 0; aTop < aHeight && aRowCounts[aTop] <= aRowLimit; aTop++) ;
+	for(aBottom = aHeight; aBottom > aTop && aRowCounts[aBottom - 1] <= aRowLimit; aBottom--) ;
+	for(aLeft = 0; aLeft < aWidth && aColumnCounts[aLeft] <= aColumnLimit; aLeft++) ;
+	for(aRight = aWidth; aRight > aLeft && aColumnCounts[aRight - 1] <= aColumnLimit; aRight--) ;
+
+	if(aTop < aBottom && aLeft < aRight)
+		SetRect(theActiveRect, theRect->left + aLeft, theRect->top + aTop, theRect->left + aRight, theRect->top + aBottom);
+
+	DisposePtr(aCountMemory);
+
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUGetPixelLuma - Return the luma (0..255) of a pixel.
+
+static UInt8 QTUGetPixelLuma(const UInt8 *theRow, long theX, short theDepth, CTabHandle theColorTable)
+
+DESCRIPTION
+	32-bit, 16-bit and indexed pixels are taken, luma is the usual 0.30, 0.59, 0.11 mix of red,
+	green and blue.
+*/
+
+static UInt8 QTUGetPixelLuma(const UInt8 *theRow, long theX, short theDepth, CTabHandle theColorTable)
+{
+	long	aRed, aGreen, aBlue;
+
+	if(theDepth == 32)
+	{
+		const UInt8 *aPixel = theRow + theX * 4;
+
+		aRed = aPixel[1];  aGreen = aPixel[2];  aBlue = aPixel[3];
+	}
+	else if(theDepth == 16)
+	{
+		UInt16 aPixel = (UInt16)((theRow[theX * 2] << 8) | theRow[theX * 2 + 1]);
+
+		aRed = ((aPixel >> 10) & 0x1F) << 3;  aGreen = ((aPixel >> 5) & 0x1F) << 3;  aBlue = (aPixel & 0x1F) << 3;
+	}
+	else
+	{
+		UInt8 anIndex = theRow[theX];
+
+		if(theColorTable == NULL || anIndex > (**theColorTable).ctSize) return anIndex;
+		aRed = (**theColorTable).ctTable[anIndex].rgb.red >> 8;
+		aGreen = (**theColorTable).ctTable[anIndex].rgb.green >> 8;
+		aBlue = (**theColorTable).ctTable[anIndex].rgb.blue >> 8;
+	}
+
+	return (UInt8)((aRed * 77 + aGreen * 150 + aBlue * 29) >> 8);
+}
+
+
+/*______________________________________________________________________
+	QTUGetSceneSignature - Reduce a frame to what is needed to find scene cuts.
+
+pascal OSErr QTUGetSceneSignature(PixMapHandle thePixMap, const Rect *theRect, QTUSceneSignature *theSignature)
+
+thePixMap					the frame, 32-bit, 16-bit or 8-bit
+theRect						the part of the pixmap to look at
+theSignature				returns a small luma picture of the frame and its luma histogram
+
+DESCRIPTION
+	Every pixel of the kQTUSceneThumbnailSize square thumbnail is the mean of a grid of 4 x 4
+	pixels sampled from its part of the frame, so the signature costs the same for any frame
+	size. Compare two signatures with QTUCompareSceneSignatures.
+*/
+
+pascal OSErr QTUGetSceneSignature(PixMapHandle thePixMap, const Rect *theRect, QTUSceneSignature *theSignature)
+{
+	short		aDepth = GetPixDepth(thePixMap);
+	long		aWidth = theRect->right - theRect->left;
+	long		aHeight = theRect->bottom - theRect->top;
+	long		aRowBytes = GetPixRowBytes(thePixMap);
+	CTabHandle	aColorTable = (**thePixMap).pmTable;
+	UInt8		*aBase;
+	Rect		aBounds;
+	long		x, y, index;
+
+	if((aDepth != 32 && aDepth != 16 && aDepth != 8) || aWidth <= 0 || aHeight <= 0) return paramErr;
+
+	GetPixBounds(thePixMap, &aBounds);
+	aBase = (UInt8 *)GetPixBaseAddr(thePixMap) + (theRect->top - aBounds.top) * aRowBytes + (((theRect->left - aBounds.left) * aDepth) >> 3);
+
+	for(index = 0; index < kQTUSceneHistogramBins; index++)
+		theSignature->histogram[index] = 0;
+
+	for(y = 0; y < kQTUSceneThumbnailSize; y++)
+	{
+		for(x = 0; x < kQTUSceneThumbnailSize; x++)
+		{
+			long aSum = 0;
+			long sx, sy;
+
+			for(sy = 0; sy < 4; sy++)
+			{
+				const UInt8 *aRow = aBase + ((y * 4 + sy) * aHeight / (kQTUSceneThumbnailSize * 4)) * aRowBytes;
+
+				for(sx = 0; sx < 4; sx++)
+					aSum += QTUGetPixelLuma(aRow, (x * 4 + sx) * aWidth / (kQTUSceneThumbnailSize * 4), aDepth, aColorTable);
+			}
+
+			theSignature->luma[y * kQTUSceneThumbnailSize + x] = (UInt8)(aSum >> 4);
+			theSignature->histogram[(aSum >> 4) * kQTUSceneHistogramBins / 256]++;
+		}
+	}
+
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUCompareSceneSignatures - Tell how different two frames are.
+
+pascal void QTUCompareSceneSignatures(const QTUSceneSignature *theFirst, const QTUSceneSignature *theSecond, 
+										long *theLumaDifference, long *theHistogramDifference)
+
+theFirst, theSecond			the signatures of the two frames
+theLumaDifference			returns the mean absolute difference of the thumbnails, 0..255
+theHistogramDifference		returns the part of the histograms that differs, 0..1000
+
+DESCRIPTION
+	Motion makes the thumbnails differ, but leaves the histogram about the same, while a cut
+	usually changes both. The sum of absolute differences is done with AltiVec when we have it.
+*/
+
+pascal void QTUCompareSceneSignatures(const QTUSceneSignature *theFirst, const QTUSceneSignature *theSecond, 
+										long *theLumaDifference, long *theHistogramDifference)
+{
+	const long	aPixelCount = kQTUSceneThumbnailSize * kQTUSceneThumbnailSize;
+	UInt32		aSum = 0;
+	long		aHistogramSum = 0;
+	long		index = 0;
+
+#if defined(__VEC__)
+	{
+		vector unsigned char	aFirstPermute = vec_lvsl(0, theFirst->luma);
+		vector unsigned char	aSecondPermute = vec_lvsl(0, theSecond->luma);
+		vector unsigned int		aSums = vec_splat_u32(0);
+		union { UInt32 s[4]; vector unsigned int v; }	aResult;
+
+		for(; index + 16 <= aPixelCount; index += 16)
+		{
+			const UInt8				*aFirst = theFirst->luma + index;
+			const UInt8				*aSecond = theSecond->luma + index;
+			vector unsigned char	a = vec_perm(vec_ld(0, aFirst), vec_ld(15, aFirst), aFirstPermute);
+			vector unsigned char	b = vec_perm(vec_ld(0, aSecond), vec_ld(15, aSecond), aSecondPermute);
+
+			aSums = vec_sum4s(vec_sub(vec_max(a, b), vec_min(a, b)), aSums);
+		}
+
+		aResult.v = aSums;
+		aSum = aResult.s[0] + aResult.s[1] + aResult.s[2] + aResult.s[3];
+	}
+#endif
+
+	for(; index < aPixelCount; index++)
+	{
+		long aDifference = (long)theFirst->luma[index] - (long)theSecond->luma[index];
+
+		aSum += (aDifference < 0) ? -aDifference : aDifference;
+	}
+
+	for(index = 0; index < kQTUSceneHistogramBins; index++)
+	{
+		long aDifference = theFirst->histogram[index] - theSecond->histogram[index];
+
+		aHistogramSum += (aDifference < 0) ? -aDifference : aDifference;
+	}
+
+	*theLumaDifference = aSum / aPixelCount;
+	*theHistogramDifference = aHistogramSum * 500 / aPixelCount;		// every moved pixel is counted twice
+}
+
+
+#define kQTUQualityBlockSize		8
+#define kQTUMaxQualityBands			16
+
+// One band of rows of the frames, measured by one worker.
+typedef struct QTUQualityBand {
+	const UInt8					*reference;
+	long						referenceRowBytes;
+	const UInt8					*frame;
+	long						frameRowBytes;
+	long						width;
+	long						rowCount;
+	UInt8						*referenceLuma;			// kQTUQualityBlockSize rows of luma, 16 byte aligned
+	UInt8						*frameLuma;
+	long						lumaRowBytes;
+	double						sse;					// the results
+	double						ssimSum;
+	long						ssimBlocks;
+} QTUQualityBand;
+
+struct QTUQualityMeterRecord {
+	long						width;
+	long						height;
+	long						bandCount;
+	QTUQualityBand				bands[kQTUMaxQualityBands];
+	Ptr							lumaMemory;
+	QTUWorkerPool				pool;
+	double						psnrSum;
+	double						ssimSum;
+	QTUQualityStatistics		statistics;
+};
+
+
+/*______________________________________________________________________
+	QTUSumSquaredErrorRow - Add up the squared differences of two rows of 32-bit pixels.
+
+static double QTUSumSquaredErrorRow(const UInt8 *theFirst, const UInt8 *theSecond, long theWidth)
+
+DESCRIPTION
+	Red, green and blue count, alpha is left out. With AltiVec four pixels are done at once, one
+	row fits in the 32-bit sum for any width up to 20000 pixels.
+*/
+
+static double QTUSumSquaredErrorRow(const UInt8 *theFirst, const UInt8 *theSecond, long theWidth)
+{
+	UInt32	aSum = 0;
+	long	x = 0;
+
+#if defined(__VEC__)
+	{
+		vector unsigned char	aMask = (vector unsigned char)(0, 255, 255, 255, 0, 255, 255, 255, 0, 255, 255, 255, 0, 255, 255, 255);
+		vector unsigned char	aFirstPermute = vec_lvsl(0, theFirst);
+		vector unsigned char	aSecondPermute = vec_lvsl(0, theSecond);
+		vector unsigned int		aSums = vec_splat_u32(0);
+		union { UInt32 s[4]; vector unsigned int v; }	aResult;
+
+		for(; x + 4 <= theWidth; x += 4)
+		{
+			const UInt8				*aFirst = theFirst + x * 4;
+			const UInt8				*aSecond = theSecond + x * 4;
+			vector unsigned char	a = vec_perm(vec_ld(0, aFirst), vec_ld(15, aFirst), aFirstPermute);
+			vector unsigned char	b = vec_perm(vec_ld(0, aSecond), vec_ld(15, aSecond), aSecondPermute);
+			vector unsigned char	aDifference = vec_and(vec_sub(vec_max(a, b), vec_min(a, b)), aMask);
+
+			aSums = vec_msum(aDifference, aDifference, aSums);
+		}
+
+		aResult.v = aSums;
+		aSum = aResult.s[0] + aResult.s[1] + aResult.s[2] + aResult.s[3];
+	}
+#endif
+
+	for(; x < theWidth; x++)
+	{
+		const UInt8	*a = theFirst + x * 4;
+		const UInt8	*b = theSecond + x * 4;
+		long		aRed = (long)a[1] - b[1], aGreen = (long)a[2] - b[2], aBlue = (long)a[3] - b[3];
+
+		aSum += aRed * aRed + aGreen * aGreen + aBlue * aBlue;
+	}
+
+	return aSum;
+}
+
+
+/*______________________________________________________________________
+	QTULumaRow - Convert a row of 32-bit pixels to luma.
+
+static void QTULumaRow(const UInt8 *thePixels, long theWidth, UInt8 *theLuma)
+
+DESCRIPTION
+	The same mix as QTUGetPixelLuma. theLuma is 16 byte aligned, with AltiVec 16 pixels are
+	converted and stored at once.
+*/
+
+static void QTULumaRow(const UInt8 *thePixels, long theWidth, UInt8 *theLuma)
+{
+	long x = 0;
+
+#if defined(__VEC__)
+	{
+		vector unsigned char	aWeights = (vector unsigned char)(0, 77, 150, 29, 0, 77, 150, 29, 0, 77, 150, 29, 0, 77, 150, 29);
+		vector unsigned char	aPermute = vec_lvsl(0, thePixels);
+		vector unsigned int		aZero = vec_splat_u32(0);
+		vector unsigned int		anEight = vec_splat_u32(8);
+
+		for(; x + 16 <= theWidth; x += 16)
+		{
+			const UInt8				*aPixels = thePixels + x * 4;
+			vector unsigned int		aLumas[4];
+			long					part;
+
+			for(part = 0; part < 4; part++)
+			{
+				vector unsigned char aValues = vec_perm(vec_ld(part * 16, aPixels), vec_ld(part * 16 + 15, aPixels), aPermute);
+
+				aLumas[part] = vec_sr(vec_msum(aValues, aWeights, aZero), anEight);
+			}
+
+			vec_st(vec_pack(vec_pack(aLumas[0], aLumas[1]), vec_pack(aLumas[2], aLumas[3])), 0, theLuma + x);
+		}
+	}
+#endif
+
+	for(; x < theWidth; x++)
+	{
+		const UInt8 *aPixel = thePixels + x * 4;
+
+		theLuma[x] = (UInt8)((aPixel[1] * 77 + aPixel[2] * 150 + aPixel[3] * 29) >> 8);
+	}
+}
+
+
+/*______________________________________________________________________
+	QTUBlockSSIM - Return the structural similarity of two blocks from their sums.
+
+static double QTUBlockSSIM(double theSumA, double theSumB, double theSumAA, double theSumBB, double theSumAB)
+
+DESCRIPTION
+	The usual SSIM with the constants for 8-bit values, on kQTUQualityBlockSize square blocks.
+*/
+
+static double QTUBlockSSIM(double theSumA, double theSumB, double theSumAA, double theSumBB, double theSumAB)
+{
+	const double	n = kQTUQualityBlockSize * kQTUQualityBlockSize;
+	const double	c1 = (0.01 * 255) * (0.01 * 255);
+	const double	c2 = (0.03 * 255) * (0.03 * 255);
+	double			aMeanA = theSumA / n;
+	double			aMeanB = theSumB / n;
+	double			aVarianceA = theSumAA / n - aMeanA * aMeanA;
+	double			aVarianceB = theSumBB / n - aMeanB * aMeanB;
+	double			aCovariance = theSumAB / n - aMeanA * aMeanB;
+
+	return ((2 * aMeanA * aMeanB + c1) * (2 * aCovariance + c2)) /
+			((aMeanA * aMeanA + aMeanB * aMeanB + c1) * (aVarianceA + aVarianceB + c2));
+}
+
+
+/*______________________________________________________________________
+	QTUMeasureBlockRow - Add the SSIM of a row of blocks to a band.
+
+static void QTUMeasureBlockRow(QTUQualityBand *theBand)
+
+DESCRIPTION
+	The luma of kQTUQualityBlockSize rows is in the band. With AltiVec two blocks side by side
+	are summed at once, the sums of the left block end up in the first two elements.
+*/
+
+static void QTUMeasureBlockRow(QTUQualityBand *theBand)
+{
+	long x = 0;
+	long row;
+
+#if defined(__VEC__)
+	for(; x + 2 * kQTUQualityBlockSize <= theBand->width; x += 2 * kQTUQualityBlockSize)
+	{
+		vector unsigned int		aZero = vec_splat_u32(0);
+		vector unsigned int		aSumA = aZero, aSumB = aZero, aSumAA = aZero, aSumBB = aZero, aSumAB = aZero;
+		union { UInt32 s[4]; vector unsigned int v; }	a, b, aa, bb, ab;
+
+		for(row = 0; row < kQTUQualityBlockSize; row++)
+		{
+			vector unsigned char aReference = vec_ld(0, theBand->referenceLuma + row * theBand->lumaRowBytes + x);
+			vector unsigned char aFrame = vec_ld(0, theBand->frameLuma + row * theBand->lumaRowBytes + x);
+
+			aSumA = vec_sum4s(aReference, aSumA);
+			aSumB = vec_sum4s(aFrame, aSumB);
+			aSumAA = vec_msum(aReference, aReference, aSumAA);
+			aSumBB = vec_msum(aFrame, aFrame, aSumBB);
+			aSumAB = vec_msum(aReference, aFrame, aSumAB);
+		}
+
+		a.v = aSumA;  b.v = aSumB;  aa.v = aSumAA;  bb.v = aSumBB;  ab.v = aSumAB;
+		theBand->ssimSum += QTUBlockSSIM(a.s[0] + a.s[1], b.s[0] + b.s[1], aa.s[0] + aa.s[1], bb.s[0] + bb.s[1], ab.s[0] + ab.s[1]);
+		theBand->ssimSum += QTUBlockSSIM(a.s[2] + a.s[3], b.s[2] + b.s[3], aa.s[2] + aa.s[3], bb.s[2] + bb.s[3], ab.s[2] + ab.s[3]);
+		theBand->ssimBlocks += 2;
+	}
+#endif
+
+	for(; x + kQTUQualityBlockSize <= theBand->width; x += kQTUQualityBlockSize)
+	{
+		UInt32	aSumA = 0, aSumB = 0, aSumAA = 0, aSumBB = 0, aSumAB = 0;
+		long	column;
+
+		for(row = 0; row < kQTUQualityBlockSize; row++)
+		{
+			const UInt8 *aReference = theBand->referenceLuma + row * theBand->lumaRowBytes + x;
+			const UInt8 *aFrame = theBand->frameLuma + row * theBand->lumaRowBytes + x;
+
+			for(column = 0; column < kQTUQualityBlockSize; column++)
+			{
+				UInt32 a = aReference[column], b = aFrame[column];
+
+				aSumA += a;  aSumB += b;
+				aSumAA += a * a;  aSumBB += b * b;  aSumAB += a * b;
+			}
+		}
+
+		theBand->ssimSum += QTUBlockSSIM(aSumA, aSumB, aSumAA, aSumBB, aSumAB);
+		theBand->ssimBlocks++;
+	}
+}
+
+
+/*______________________________________________________________________
+	QTUMeasureBand - Measure the error and the SSIM of a band of rows.
+
+static OSStatus QTUMeasureBand(void *theWorkItem)
+
+DESCRIPTION
+	QTUMeasureBand is the work function of the meter's workers, it only touches the pixels and the
+	band, no toolbox calls. A band starts at a block boundary, rows left over at the bottom of the
+	frame count for the error but not for the SSIM.
+*/
+
+static OSStatus QTUMeasureBand(void *theWorkItem)
+{
+	QTUQualityBand	*aBand = (QTUQualityBand *)theWorkItem;
+	long			y;
+
+	aBand->sse = 0;
+	aBand->ssimSum = 0;
+	aBand->ssimBlocks = 0;
+
+	for(y = 0; y < aBand->rowCount; y++)
+	{
+		const UInt8	*aReference = aBand->reference + y * aBand->referenceRowBytes;
+		const UInt8	*aFrame = aBand->frame + y * aBand->frameRowBytes;
+		long		aLumaRow = y % kQTUQualityBlockSize;
+
+		aBand->sse += QTUSumSquaredErrorRow(aReference, aFrame, aBand->width);
+
+		QTULumaRow(aReference, aBand->width, aBand->referenceLuma + aLumaRow * aBand->lumaRowBytes);
+		QTULumaRow(aFrame, aBand->width, aBand->frameLuma + aLumaRow * aBand->lumaRowBytes);
+
+		if(aLumaRow == kQTUQualityBlockSize - 1)
+			QTUMeasureBlockRow(aBand);
+	}
+
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUNewQualityMeter - Create a meter that scores decoded frames against their originals.
+
+pascal OSErr QTUNewQualityMeter(long theWidth, long theHeight, long theWorkerCount, QTUQualityMeter *theMeter)
+
+theWidth, theHeight			the size of the frames that will be compared
+theWorkerCount				tasks measuring bands of the frame beside the caller, 0 for one per 
+							additional processor, 1 or less measures on the caller only
+theMeter					will contain the meter
+
+DESCRIPTION
+	QTUQualityMeterCompare returns the PSNR of red, green and blue, and the mean SSIM of the luma
+	of 8 x 8 blocks, for a frame and the frame it was compressed from. The frame is cut into
+	bands of rows that are measured side by side, with AltiVec kernels when we have them. The
+	blocks don't overlap, which makes the SSIM a bit coarser than the sliding window version, for 
+	a sixteenth of the work.
+
+EXAMPLE
+	anErr = QTUNewQualityMeter(aWidth, aHeight, 0, &aMeter);
+	anErr = QTUQualityMeterCompare(aMeter, GetGWorldPixMap(aSource), &aRect, GetGWorldPixMap(aDecoded), &aRect, &aQuality);
+	QTUDisposeQualityMeter(aMeter);
+*/
+
+pascal OSErr QTUNewQualityMeter(long theWidth, long theHeight, long theWorkerCount, QTUQualityMeter *theMeter)
+{
+	OSErr			anErr = noErr;
+	QTUQualityMeter	aMeter;
+	long			aLumaRowBytes = (theWidth + 15) & ~15;
+	long			aBandBytes = 2 * kQTUQualityBlockSize * aLumaRowBytes;
+	UInt8			*aLuma;
+	long			index;
+
+	*theMeter = NULL;
+	if(theWidth <= 0 || theHeight <= 0) return paramErr;
+
+	if(theWorkerCount == 0)
+		theWorkerCount = QTUCountProcessors() - 1;
+	if(theWorkerCount > kQTUMaxQualityBands - 1)
+		theWorkerCount = kQTUMaxQualityBands - 1;
+
+	aMeter = (QTUQualityMeter)NewPtrClear(sizeof(struct QTUQualityMeterRecord)); DebugAssert(aMeter != NULL);
+	if(aMeter == NULL) return memFullErr;
+
+	aMeter->width = theWidth;
+	aMeter->height = theHeight;
+	aMeter->bandCount = (theWorkerCount > 0) ? theWorkerCount + 1 : 1;
+	aMeter->statistics.minPSNR = kQTUMaxPSNR;
+	aMeter->statistics.minSSIM = 1.0;
+
+	aMeter->lumaMemory = NewPtr(aMeter->bandCount * aBandBytes + 15);
+	if(aMeter->lumaMemory == NULL) { anErr = memFullErr; goto Closure; }
+	aLuma = (UInt8 *)(((unsigned long)aMeter->lumaMemory + 15) & ~15UL);
+
+	for(index = 0; index < aMeter->bandCount; index++)
+	{
+		aMeter->bands[index].width = theWidth;
+		aMeter->bands[index].lumaRowBytes = aLumaRowBytes;
+		aMeter->bands[index].referenceLuma = aLuma + index * aBandBytes;
+		aMeter->bands[index].frameLuma = aLuma + index * aBandBytes + aBandBytes / 2;
+	}
+
+	// Without workers it still works, only slower.
+	if(aMeter->bandCount > 1 && QTUNewWorkerPool(theWorkerCount, &aMeter->pool) != noErr)
+	{
+		aMeter->pool = NULL;
+		aMeter->bandCount = 1;
+	}
+
+	*theMeter = aMeter;
+	return noErr;
+
+Closure:
+	QTUDisposeQualityMeter(aMeter);
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUQualityMeterCompare - Score a frame against the frame it was compressed from.
+
+pascal OSErr QTUQualityMeterCompare(QTUQualityMeter theMeter, PixMapHandle theReference, const Rect *theReferenceRect,
+										PixMapHandle theFrame, const Rect *theFrameRect, QTUFrameQuality *theQuality)
+
+theMeter					the meter
+theReference				the original frame, 32-bit
+theReferenceRect			the part of it that was compressed
+theFrame					the decoded frame, 32-bit
+theFrameRect				the part of it to compare, the same size as theReferenceRect
+theQuality					returns the scores, they are added to the statistics of the meter
+
+DESCRIPTION
+	Identical frames get a PSNR of kQTUMaxPSNR and an SSIM of 1. The pixels of both pixmaps have
+	to be locked.
+*/
+
+pascal OSErr QTUQualityMeterCompare(QTUQualityMeter theMeter, PixMapHandle theReference, const Rect *theReferenceRect,
+										PixMapHandle theFrame, const Rect *theFrameRect, QTUFrameQuality *theQuality)
+{
+	OSErr			anErr = noErr;
+	UnsignedWide	aTimer;
+	const UInt8		*aReference, *aFrame;
+	long			aReferenceRowBytes, aFrameRowBytes;
+	long			aBandRows, aBandsUsed = 0, aBandsSubmitted = 0;
+	double			aSSE = 0, aSSIMSum = 0;
+	long			aSSIMBlocks = 0;
+	Rect			aBounds;
+	long			index;
+
+	DebugAssert(theMeter != NULL); if(theMeter == NULL) return paramErr;
+
+	if(GetPixDepth(theReference) != 32 || GetPixDepth(theFrame) != 32 ||
+		theReferenceRect->right - theReferenceRect->left != theMeter->width || theReferenceRect->bottom - theReferenceRect->top != theMeter->height ||
+		theFrameRect->right - theFrameRect->left != theMeter->width || theFrameRect->bottom - theFrameRect->top != theMeter->height)
+		return paramErr;
+
+	QTUStartTimer(&aTimer);
+
+	aReferenceRowBytes = GetPixRowBytes(theReference);
+	GetPixBounds(theReference, &aBounds);
+	aReference = (UInt8 *)GetPixBaseAddr(theReference) + (theReferenceRect->top - aBounds.top) * aReferenceRowBytes + (theReferenceRect->left - aBounds.left) * 4;
+
+	aFrameRowBytes = GetPixRowBytes(theFrame);
+	GetPixBounds(theFrame, &aBounds);
+	aFrame = (UInt8 *)GetPixBaseAddr(theFrame) + (theFrameRect->top - aBounds.top) * aFrameRowBytes + (theFrameRect->left - aBounds.left) * 4;
+
+	// Bands of whole blocks, the last one gets what is left.
+	aBandRows = (theMeter->height + theMeter->bandCount - 1) / theMeter->bandCount;
+	aBandRows = (aBandRows + kQTUQualityBlockSize - 1) / kQTUQualityBlockSize * kQTUQualityBlockSize;
+
+	for(index = 0; index < theMeter->bandCount && index * aBandRows < theMeter->height; index++)
+	{
+		QTUQualityBand *aBand = &theMeter->bands[index];
+
+		aBand->reference = aReference + index * aBandRows * aReferenceRowBytes;
+		aBand->referenceRowBytes = aReferenceRowBytes;
+		aBand->frame = aFrame + index * aBandRows * aFrameRowBytes;
+		aBand->frameRowBytes = aFrameRowBytes;
+		aBand->rowCount = theMeter->height - index * aBandRows;
+		if(aBand->rowCount > aBandRows)
+			aBand->rowCount = aBandRows;
+		aBandsUsed++;
+	}
+
+	// The workers take every band but the first, that one is ours.
+	for(index = 1; index < aBandsUsed; index++)
+	{
+		if(QTUWorkerPoolSubmit(theMeter->pool, QTUMeasureBand, &theMeter->bands[index]) != noErr)
+			QTUMeasureBand(&theMeter->bands[index]);
+		else
+			aBandsSubmitted++;
+	}
+
+	QTUMeasureBand(&theMeter->bands[0]);
+
+	while(aBandsSubmitted > 0)
+	{
+		void		*aWorkItem;
+		OSStatus	aResult;
+
+		anErr = QTUWorkerPoolWaitForItem(theMeter->pool, &aWorkItem, &aResult); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+		aBandsSubmitted--;
+	}
+
+	for(index = 0; index < aBandsUsed; index++)
+	{
+		aSSE += theMeter->bands[index].sse;
+		aSSIMSum += theMeter->bands[index].ssimSum;
+		aSSIMBlocks += theMeter->bands[index].ssimBlocks;
+	}
+
+	theQuality->mse = aSSE / (3.0 * theMeter->width * theMeter->height);
+	theQuality->psnr = (theQuality->mse > 0) ? 10 * log10(255.0 * 255.0 / theQuality->mse) : kQTUMaxPSNR;
+	if(theQuality->psnr > kQTUMaxPSNR)
+		theQuality->psnr = kQTUMaxPSNR;
+	theQuality->ssim = (aSSIMBlocks > 0) ? aSSIMSum / aSSIMBlocks : 1.0;
+
+	theMeter->psnrSum += theQuality->psnr;
+	theMeter->ssimSum += theQuality->ssim;
+	theMeter->statistics.frames++;
+	if(theQuality->psnr < theMeter->statistics.minPSNR)
+		theMeter->statistics.minPSNR = theQuality->psnr;
+	if(theQuality->ssim < theMeter->statistics.minSSIM)
+		theMeter->statistics.minSSIM = theQuality->ssim;
+	theMeter->statistics.meanPSNR = theMeter->psnrSum / theMeter->statistics.frames;
+	theMeter->statistics.meanSSIM = theMeter->ssimSum / theMeter->statistics.frames;
+	theMeter->statistics.microseconds += QTUElapsedMicroseconds(&aTimer);
+
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUQualityMeterGetStatistics - Return the scores of all the frames compared so far.
+
+pascal void QTUQualityMeterGetStatistics(QTUQualityMeter theMeter, QTUQualityStatistics *theStatistics)
+*/
+
+pascal void QTUQualityMeterGetStatistics(QTUQualityMeter theMeter, QTUQualityStatistics *theStatistics)
+{
+	*theStatistics = theMeter->statistics;
+}
+
+
+/*______________________________________________________________________
+	QTUDisposeQualityMeter - Stop the workers and dispose the meter.
+
+pascal void QTUDisposeQualityMeter(QTUQualityMeter theMeter)
+*/
+
+pascal void QTUDisposeQualityMeter(QTUQualityMeter theMeter)
+{
+	if(theMeter == NULL)
+		return;
+
+	if(theMeter->pool) QTUDisposeWorkerPool(theMeter->pool);
+	if(theMeter->lumaMemory) DisposePtr(theMeter->lumaMemory);
+	DisposePtr((Ptr)theMeter);
+}
+
+
+// SEEK INDEX FUNCTIONS
+
+#define kQTUSeekIndexFileType		'QSIx'
+#define kQTUSeekIndexVersion		2
+#define kQTUSeekIndexNameLength		18						// of the movie name in the sidecar name, the file ID follows
+#define kQTUSeekCacheFrames			4
+
+typedef struct QTUSeekSample {
+	TimeValue					mediaTime;
+	long						dataSize;
+	long						syncSample;				// the sample decoding has to start at
+} QTUSeekSample;
+
+// What the sidecar file starts with, the samples follow in native byte order.
+typedef struct QTUSeekIndexHeader {
+	OSType						fileType;
+	long						version;
+	TimeScale					timeScale;
+	TimeValue					mediaDuration;
+	long						sampleCount;
+	long						syncSampleCount;
+	UInt32						sourceNodeID;			// of the movie file, set by QTUGetSeekIndex
+	UTCDateTime					sourceModDate;
+} QTUSeekIndexHeader;
+
+struct QTUSeekIndexRecord {
+	Track						track;
+	Media						media;
+	QTUSeekIndexHeader			header;
+	QTUSeekSample				*samples;
+
+	// Decoding, decodedSample is what gWorld shows and where the decompression sequence could go on from.
+	Rect						bounds;
+	GWorldPtr					gWorld;
+	ImageDescriptionHandle		description;
+	long						descriptionIndex;
+	ImageSequence				decompressor;
+	Handle						sampleData;
+	long						decodedSample;
+
+	// Frames handed out before, least recently used goes first.
+	GWorldPtr					cacheGWorlds[kQTUSeekCacheFrames];
+	long						cacheSamples[kQTUSeekCacheFrames];
+	long						cacheUses[kQTUSeekCacheFrames];
+	long						cacheClock;
+
+	QTUSeekIndexStatistics		statistics;
+};
+
+
+/*______________________________________________________________________
+	QTUSeekIndexAllocate - Allocate an index and what it needs for decoding.
+
+static OSErr QTUSeekIndexAllocate(Movie theMovie, QTUSeekIndex *theIndex)
+
+DESCRIPTION
+	QTUSeekIndexAllocate sets up an empty index for the first video track of the movie, with the
+	header filled in from the media so it can be compared with a sidecar file.
+*/
+
+static OSErr QTUSeekIndexAllocate(Movie theMovie, QTUSeekIndex *theIndex)
+{
+	OSErr			anErr = noErr;
+	QTUSeekIndex	anIndex;
+	long			index;
+
+	*theIndex = NULL;
+
+	anIndex = (QTUSeekIndex)NewPtrClear(sizeof(struct QTUSeekIndexRecord)); DebugAssert(anIndex != NULL);
+	if(anIndex == NULL) return memFullErr;
+
+	anIndex->decodedSample = -1;
+	for(index = 0; index < kQTUSeekCacheFrames; index++)
+		anIndex->cacheSamples[index] = -1;
+
+	anIndex->track = GetMovieIndTrackType(theMovie, 1, VideoMediaType, movieTrackMediaType);
+	if(anIndex->track == NULL) { anErr = invalidTrack; goto Closure; }
+	anIndex->media = GetTrackMedia(anIndex->track);
+
+	anIndex->header.fileType = kQTUSeekIndexFileType;
+	anIndex->header.version = kQTUSeekIndexVersion;
+	anIndex->header.timeScale = GetMediaTimeScale(anIndex->media);
+	anIndex->header.mediaDuration = GetMediaDuration(anIndex->media);
+	anIndex->header.sampleCount = GetMediaSampleCount(anIndex->media);
+	anIndex->header.syncSampleCount = GetMediaSyncSampleCount(anIndex->media);
+	if(anIndex->header.sampleCount <= 0) { anErr = invalidMedia; goto Closure; }
+
+	anIndex->samples = (QTUSeekSample *)NewPtr(anIndex->header.sampleCount * sizeof(QTUSeekSample));
+	anIndex->description = (ImageDescriptionHandle)NewHandle(0);
+	anIndex->sampleData = NewHandle(0);
+	if(anIndex->samples == NULL || anIndex->description == NULL || anIndex->sampleData == NULL) { anErr = memFullErr; goto Closure; }
+
+	// The frames have the size of the first sample description.
+	GetMediaSampleDescription(anIndex->media, 1, (SampleDescriptionHandle)anIndex->description);
+	anErr = GetMoviesError(); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+
+	SetRect(&anIndex->bounds, 0, 0, (**anIndex->description).width, (**anIndex->description).height);
+	anErr = NewGWorld(&anIndex->gWorld, 32, &anIndex->bounds, NULL, NULL, 0); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+	LockPixels(GetGWorldPixMap(anIndex->gWorld));
+
+	*theIndex = anIndex;
+	return noErr;
+
+Closure:
+	QTUDisposeSeekIndex(anIndex);
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUNewSeekIndex - Index the samples of the first video track of a movie.
+
+pascal OSErr QTUNewSeekIndex(Movie theMovie, QTUSeekIndex *theIndex)
+
+theMovie					the movie
+theIndex					will contain the new index
+
+DESCRIPTION
+	To show the frame at some time, QuickTime has to decode from the key frame before it, and
+	QTUDrawVideoFrameAtTime does that again for every frame, wherever the movie was before. A seek
+	index knows for every sample where it is, how big it is and which sync sample it depends on, so
+	QTUSeekIndexGetFrame can decode just the samples it needs and go on from the last frame when
+	that is shorter, and QTUSeekIndexGetSeekCost can tell in advance what a frame costs.
+
+	The sample table is read with GetMediaSampleReferences, many samples per call. Building an index
+	reads the whole table, QTUWriteSeekIndex keeps it in a file for the next time.
+
+EXAMPLE
+	anErr = QTUNewSeekIndex(aMovie, &anIndex);
+	anErr = QTUSeekIndexGetFrame(anIndex, aTime, &aFrame);
+	QTUDisposeSeekIndex(anIndex);
+*/
+
+pascal OSErr QTUNewSeekIndex(Movie theMovie, QTUSeekIndex *theIndex)
+{
+	OSErr					anErr = noErr;
+	QTUSeekIndex			anIndex = NULL;
+	SampleReferenceRecord	aReferences[kQTUSampleReferenceBatch];
+	TimeValue				aTime = 0;
+	long					aSampleNum = 0;
+	long					aSyncSample = 0;
+
+	DebugAssert(theMovie != NULL); if(theMovie == NULL) return invalidMovie;
+	DebugAssert(theIndex != NULL); if(theIndex == NULL) return paramErr;
+
+	anErr = QTUSeekIndexAllocate(theMovie, &anIndex);
+	if(anErr != noErr) return anErr;
+
+	while(aSampleNum < anIndex->header.sampleCount && aTime < anIndex->header.mediaDuration)
+	{
+		TimeValue	aSampleTime;
+		long		aReferenceCount = 0;
+		long		aReference;
+
+		anErr = GetMediaSampleReferences(anIndex->media, aTime, &aSampleTime, NULL, NULL, kQTUSampleReferenceBatch, &aReferenceCount,
+											aReferences); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+		if(aReferenceCount == 0) break;
+
+		aTime = aSampleTime;
+		for(aReference = 0; aReference < aReferenceCount; aReference++)
+		{
+			long aCount;
+
+			for(aCount = 0; aCount < aReferences[aReference].numberOfSamples && aSampleNum < anIndex->header.sampleCount; aCount++)
+			{
+				if(!(aReferences[aReference].sampleFlags & mediaSampleNotSync))
+					aSyncSample = aSampleNum;
+
+				anIndex->samples[aSampleNum].mediaTime = aTime;
+				anIndex->samples[aSampleNum].dataSize = aReferences[aReference].dataSize;
+				anIndex->samples[aSampleNum].syncSample = aSyncSample;
+
+				aTime += aReferences[aReference].durationPerSample;
+				aSampleNum++;
+			}
+		}
+	}
+
+	// The table and the sample count should agree, if not only index what we have.
+	DebugAssert(aSampleNum == anIndex->header.sampleCount);
+	if(aSampleNum == 0) { anErr = invalidMedia; goto Closure; }
+	anIndex->header.sampleCount = aSampleNum;
+
+	*theIndex = anIndex;
+	return noErr;
+
+Closure:
+	QTUDisposeSeekIndex(anIndex);
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUWriteSeekIndex - Keep a seek index in a file.
+
+pascal OSErr QTUWriteSeekIndex(QTUSeekIndex theIndex, const FSSpec *theFile)
+
+theIndex					the index
+theFile						the sidecar file, it's replaced if it exists
+
+DESCRIPTION
+	QTUWriteSeekIndex writes the index with a header that QTUReadSeekIndex checks against the
+	movie, so an index left over from another version of the movie is not used.
+*/
+
+pascal OSErr QTUWriteSeekIndex(QTUSeekIndex theIndex, const FSSpec *theFile)
+{
+	OSErr	anErr = noErr;
+	short	aRefNum = 0;
+	long	aCount;
+
+	DebugAssert(theIndex != NULL); if(theIndex == NULL) return paramErr;
+
+	FSpDelete(theFile);
+	anErr = FSpCreate(theFile, 'TVOD', kQTUSeekIndexFileType, smSystemScript); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+
+	anErr = FSpOpenDF(theFile, fsWrPerm, &aRefNum); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+
+	aCount = sizeof(QTUSeekIndexHeader);
+	anErr = FSWrite(aRefNum, &aCount, &theIndex->header); DebugAssert(anErr == noErr);
+
+	if(anErr == noErr)
+	{
+		aCount = theIndex->header.sampleCount * sizeof(QTUSeekSample);
+		anErr = FSWrite(aRefNum, &aCount, theIndex->samples); DebugAssert(anErr == noErr);
+	}
+
+	FSClose(aRefNum);
+
+	// Half an index is worse than none.
+	if(anErr != noErr)
+		FSpDelete(theFile);
+
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUReadSeekIndex - Read a seek index kept in a file.
+
+pascal OSErr QTUReadSeekIndex(Movie theMovie, const FSSpec *theFile, QTUSeekIndex *theIndex)
+
+theMovie					the movie the index is for
+theFile						the sidecar file written by QTUWriteSeekIndex
+theIndex					will contain the index
+
+DESCRIPTION
+	QTUReadSeekIndex returns invalidMedia if the file is not an index of this movie: another
+	version, or a media with another time scale, duration or number of (sync) samples. The caller
+	then builds the index again with QTUNewSeekIndex. It can't tell a movie that was edited
+	without changing those, QTUGetSeekIndex also checks the date of the movie file.
+*/
+
+pascal OSErr QTUReadSeekIndex(Movie theMovie, const FSSpec *theFile, QTUSeekIndex *theIndex)
+{
+	OSErr				anErr = noErr;
+	QTUSeekIndex		anIndex = NULL;
+	QTUSeekIndexHeader	aHeader;
+	short				aRefNum = 0;
+	long				aCount;
+
+	DebugAssert(theMovie != NULL); if(theMovie == NULL) return invalidMovie;
+	DebugAssert(theIndex != NULL); if(theIndex == NULL) return paramErr;
+	*theIndex = NULL;
+
+	anErr = FSpOpenDF(theFile, fsRdPerm, &aRefNum);
+	if(anErr != noErr) return anErr;
+
+	anErr = QTUSeekIndexAllocate(theMovie, &anIndex);
+	if(anErr != noErr) goto Closure;
+
+	aCount = sizeof(aHeader);
+	anErr = FSRead(aRefNum, &aCount, &aHeader);
+	if(anErr != noErr) goto Closure;
+
+	if(aHeader.fileType != anIndex->header.fileType || aHeader.version != anIndex->header.version ||
+		aHeader.timeScale != anIndex->header.timeScale || aHeader.mediaDuration != anIndex->header.mediaDuration ||
+		aHeader.sampleCount != anIndex->header.sampleCount || aHeader.syncSampleCount != anIndex->header.syncSampleCount)
+	{
+		anErr = invalidMedia;
+		goto Closure;
+	}
+
+	aCount = aHeader.sampleCount * sizeof(QTUSeekSample);
+	anErr = FSRead(aRefNum, &aCount, anIndex->samples);
+	if(anErr == eofErr) anErr = invalidMedia;			// cut short
+
+Closure:
+	FSClose(aRefNum);
+
+	if(anErr != noErr)
+	{
+		if(anIndex) QTUDisposeSeekIndex(anIndex);
+		return anErr;
+	}
+
+	*theIndex = anIndex;
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUGetSeekIndexSource - Get what tells the movie file apart for its seek index.
+
+static OSErr QTUGetSeekIndexSource(const FSSpec *theMovieFile, UInt32 *theNodeID, UTCDateTime *theModDate)
+
+DESCRIPTION
+	QTUGetSeekIndexSource returns the file ID of the movie file and the date its contents were
+	last changed.
+*/
+
+static OSErr QTUGetSeekIndexSource(const FSSpec *theMovieFile, UInt32 *theNodeID, UTCDateTime *theModDate)
+{
+	OSErr			anErr = noErr;
+	FSRef			aFileRef;
+	FSCatalogInfo	aCatalogInfo;
+
+	anErr = FSpMakeFSRef(theMovieFile, &aFileRef); DebugAssert(anErr == noErr);
+	if(anErr == noErr)
+		anErr = FSGetCatalogInfo(&aFileRef, kFSCatInfoNodeID | kFSCatInfoContentMod, &aCatalogInfo, NULL, NULL, NULL); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+
+	*theNodeID = aCatalogInfo.nodeID;
+	*theModDate = aCatalogInfo.contentModDate;
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUGetSeekIndex - Get the seek index of a movie file, from its sidecar file if possible.
+
+pascal OSErr QTUGetSeekIndex(Movie theMovie, const FSSpec *theMovieFile, QTUSeekIndex *theIndex)
+
+theMovie					the movie
+theMovieFile				the file the movie came from
+theIndex					will contain the index
+
+DESCRIPTION
+	The sidecar file is next to the movie. Its name is the start of the movie name, the file ID of
+	the movie in hex and ".qsi", so movies whose long names start the same get an index each. An
+	index is only used if the movie file has not changed since it was written. If it's missing or
+	does not fit the movie, QTUGetSeekIndex builds the index and writes the file again. Not being
+	able to write it (a locked volume) is not an error, there's just no sidecar next time either.
+*/
+
+pascal OSErr QTUGetSeekIndex(Movie theMovie, const FSSpec *theMovieFile, QTUSeekIndex *theIndex)
+{
+	OSErr		anErr = noErr;
+	FSSpec		anIndexFile;
+	Str255		aFileName;
+	short		aNameLength = theMovieFile->name[0];
+	UInt32		aNodeID;
+	UTCDateTime	aModDate;
+	short		index;
+
+	anErr = QTUGetSeekIndexSource(theMovieFile, &aNodeID, &aModDate);
+	if(anErr != noErr) return anErr;
+
+	if(aNameLength > kQTUSeekIndexNameLength)
+		aNameLength = kQTUSeekIndexNameLength;
+	BlockMoveData(theMovieFile->name + 1, aFileName + 1, aNameLength);
+	aFileName[1 + aNameLength] = ' ';
+	for(index = 0; index < 8; index++)
+		aFileName[2 + aNameLength + index] = "0123456789ABCDEF"[(aNodeID >> (28 - index * 4)) & 0x0F];
+	BlockMoveData(".qsi", aFileName + 10 + aNameLength, 4);
+	aFileName[0] = aNameLength + 13;
+
+	anErr = FSMakeFSSpec(theMovieFile->vRefNum, theMovieFile->parID, aFileName, &anIndexFile);
+	if(anErr == noErr)
+	{
+		anErr = QTUReadSeekIndex(theMovie, &anIndexFile, theIndex);
+		if(anErr == noErr)
+		{
+			if((*theIndex)->header.sourceNodeID == aNodeID && (*theIndex)->header.sourceModDate.highSeconds == aModDate.highSeconds &&
+				(*theIndex)->header.sourceModDate.lowSeconds == aModDate.lowSeconds &&
+				(*theIndex)->header.sourceModDate.fraction == aModDate.fraction)
+				return noErr;
+
+			QTUDisposeSeekIndex(*theIndex);			// the movie was changed since
+			*theIndex = NULL;
+			anErr = invalidMedia;
+		}
+	}
+	if(anErr != fnfErr && anErr != invalidMedia && anErr != eofErr) return anErr;
+
+	anErr = QTUNewSeekIndex(theMovie, theIndex);
+	if(anErr != noErr) return anErr;
+
+	(*theIndex)->header.sourceNodeID = aNodeID;
+	(*theIndex)->header.sourceModDate = aModDate;
+	QTUWriteSeekIndex(*theIndex, &anIndexFile);
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUSeekIndexFindSample - Find the sample shown at a movie time.
+
+static long QTUSeekIndexFindSample(QTUSeekIndex theIndex, TimeValue theMovieTime)
+
+DESCRIPTION
+	QTUSeekIndexFindSample maps the movie time through the edits of the track to media time and
+	does a binary search for the last sample starting at or before it. It returns -1 if the track
+	shows nothing at that time.
+*/
+
+static long QTUSeekIndexFindSample(QTUSeekIndex theIndex, TimeValue theMovieTime)
+{
+	TimeValue	aMediaTime = TrackTimeToMediaTime(theMovieTime, theIndex->track);
+	long		aLow = 0;
+	long		aHigh = theIndex->header.sampleCount - 1;
+
+	if(aMediaTime < 0)
+		return -1;
+
+	while(aLow < aHigh)
+	{
+		long aMiddle = (aLow + aHigh + 1) / 2;
+
+		if(theIndex->samples[aMiddle].mediaTime <= aMediaTime)
+			aLow = aMiddle;
+		else
+			aHigh = aMiddle - 1;
+	}
+
+	return aLow;
+}
+
+
+/*______________________________________________________________________
+	QTUSeekIndexFirstSampleToDecode - Where decoding a sample has to start.
+
+static long QTUSeekIndexFirstSampleToDecode(QTUSeekIndex theIndex, long theSample)
+
+DESCRIPTION
+	Decoding starts at the sync sample, unless the decompression sequence is already between the
+	sync sample and the one we want, then it just goes on. A decoded picture alone is not enough to
+	start from, the codec keeps its own reference frames.
+*/
+
+static long QTUSeekIndexFirstSampleToDecode(QTUSeekIndex theIndex, long theSample)
+{
+	long aSyncSample = theIndex->samples[theSample].syncSample;
+
+	if(theIndex->decodedSample >= aSyncSample && theIndex->decodedSample <= theSample)
+		return theIndex->decodedSample + 1;
+
+	return aSyncSample;
+}
+
+
+/*______________________________________________________________________
+	QTUSeekIndexDecodeSample - Decode one sample into the index's GWorld.
+
+static OSErr QTUSeekIndexDecodeSample(QTUSeekIndex theIndex, long theSample)
+
+DESCRIPTION
+	QTUSeekIndexDecodeSample reads the sample and hands it to the decompression sequence, which
+	is started again when the sample has another sample description.
+*/
+
+static OSErr QTUSeekIndexDecodeSample(QTUSeekIndex theIndex, long theSample)
+{
+	OSErr		anErr = noErr;
+	long		aDataSize = 0;
+	long		aDescriptionIndex = 0;
+	short		aFlags;
+
+	theIndex->decodedSample = -1;
+
+	anErr = GetMediaSample(theIndex->media, theIndex->sampleData, 0, &aDataSize, theIndex->samples[theSample].mediaTime, NULL, NULL,
+								(SampleDescriptionHandle)theIndex->description, &aDescriptionIndex, 1, NULL, &aFlags); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+
+	if(theIndex->decompressor == 0 || aDescriptionIndex != theIndex->descriptionIndex)
+	{
+		if(theIndex->decompressor) CDSequenceEnd(theIndex->decompressor);
+		theIndex->decompressor = 0;
+
+		anErr = DecompressSequenceBegin(&theIndex->decompressor, theIndex->description, theIndex->gWorld, NULL, NULL, NULL,
+											srcCopy, NULL, 0, codecNormalQuality, NULL); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+		theIndex->descriptionIndex = aDescriptionIndex;
+	}
+
+	HLock(theIndex->sampleData);
+	anErr = DecompressSequenceFrameS(theIndex->decompressor, *theIndex->sampleData, aDataSize, 0, NULL, NULL); DebugAssert(anErr == noErr);
+	HUnlock(theIndex->sampleData);
+	if(anErr != noErr) return anErr;
+
+	theIndex->decodedSample = theSample;
+	theIndex->statistics.samplesDecoded++;
+
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUSeekIndexGetFrame - Decode the video frame shown at a movie time.
+
+pascal OSErr QTUSeekIndexGetFrame(QTUSeekIndex theIndex, TimeValue theMovieTime, GWorldPtr *theFrame)
+
+theIndex					the index of the movie
+theMovieTime				the time of the frame
+theFrame					will contain a 32-bit GWorld with the frame
+
+DESCRIPTION
+	QTUSeekIndexGetFrame decodes only the samples from the sync sample (or from the frame decoded
+	last, if that's closer) to the one at theMovieTime. The last few frames it returned are kept,
+	asking for one of them again costs nothing.
+
+	The GWorld belongs to the index, it stays valid until kQTUSeekCacheFrames other frames were
+	asked for or the index is disposed. Only the video track is drawn, without the movie's matrix or
+	the other tracks.
+*/
+
+pascal OSErr QTUSeekIndexGetFrame(QTUSeekIndex theIndex, TimeValue theMovieTime, GWorldPtr *theFrame)
+{
+	OSErr	anErr = noErr;
+	long	aSample;
+	long	aFirstSample;
+	long	anOldest = 0;
+	long	index;
+
+	DebugAssert(theIndex != NULL); if(theIndex == NULL) return paramErr;
+	DebugAssert(theFrame != NULL); if(theFrame == NULL) return paramErr;
+
+	aSample = QTUSeekIndexFindSample(theIndex, theMovieTime);
+	if(aSample < 0) return paramErr;
+
+	theIndex->statistics.framesFetched++;
+	theIndex->cacheClock++;
+
+	for(index = 0; index < kQTUSeekCacheFrames; index++)
+	{
+		if(theIndex->cacheSamples[index] == aSample)
+		{
+			theIndex->statistics.cacheHits++;
+			theIndex->cacheUses[index] = theIndex->cacheClock;
+			*theFrame = theIndex->cacheGWorlds[index];
+			return noErr;
+		}
+
+		if(theIndex->cacheUses[index] < theIndex->cacheUses[anOldest])
+			anOldest = index;
+	}
+
+	for(aFirstSample = QTUSeekIndexFirstSampleToDecode(theIndex, aSample); aFirstSample <= aSample; aFirstSample++)
+	{
+		anErr = QTUSeekIndexDecodeSample(theIndex, aFirstSample);
+		if(anErr != noErr) return anErr;
+	}
+
+	// Keep a copy, the next decode draws over the index's GWorld.
+	if(theIndex->cacheGWorlds[anOldest] == NULL)
+	{
+		anErr = NewGWorld(&theIndex->cacheGWorlds[anOldest], 32, &theIndex->bounds, NULL, NULL, 0); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+		LockPixels(GetGWorldPixMap(theIndex->cacheGWorlds[anOldest]));
+	}
+
+	CopyBits((BitMap *)*GetGWorldPixMap(theIndex->gWorld), (BitMap *)*GetGWorldPixMap(theIndex->cacheGWorlds[anOldest]),
+				&theIndex->bounds, &theIndex->bounds, srcCopy, NULL);
+	theIndex->cacheSamples[anOldest] = aSample;
+	theIndex->cacheUses[anOldest] = theIndex->cacheClock;
+
+	*theFrame = theIndex->cacheGWorlds[anOldest];
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUSeekIndexGetSeekCost - What getting a frame would cost right now.
+
+pascal long QTUSeekIndexGetSeekCost(QTUSeekIndex theIndex, TimeValue theMovieTime, long *theSyncSample, long *theDataSize)
+
+theIndex					the index of the movie
+theMovieTime				the time of the frame
+theSyncSample				will contain the number of the sync sample the frame depends on (from 0), could be NULL
+theDataSize					will contain the bytes QTUSeekIndexGetFrame would read, could be NULL
+
+DESCRIPTION
+	QTUSeekIndexGetSeekCost returns how many samples QTUSeekIndexGetFrame would decode for the
+	frame, 0 for a frame it still has, or -1 if the track shows nothing at that time. Frames with the
+	same sync sample are cheapest fetched together in time order, the sync sample tells which ones
+	those are.
+*/
+
+pascal long QTUSeekIndexGetSeekCost(QTUSeekIndex theIndex, TimeValue theMovieTime, long *theSyncSample, long *theDataSize)
+{
+	long	aSample;
+	long	aFirstSample;
+	long	aDataSize = 0;
+	long	index;
+
+	DebugAssert(theIndex != NULL); if(theIndex == NULL) return -1;
+
+	aSample = QTUSeekIndexFindSample(theIndex, theMovieTime);
+	if(aSample < 0) return -1;
+
+	if(theSyncSample) *theSyncSample = theIndex->samples[aSample].syncSample;
+	if(theDataSize) *theDataSize = 0;
+
+	for(index = 0; index < kQTUSeekCacheFrames; index++)
+	{
+		if(theIndex->cacheSamples[index] == aSample)
+			return 0;
+	}
+
+	aFirstSample = QTUSeekIndexFirstSampleToDecode(theIndex, aSample);
+	for(index = aFirstSample; index <= aSample; index++)
+		aDataSize += theIndex->samples[index].dataSize;
+
+	if(theDataSize) *theDataSize = aDataSize;
+	return aSample - aFirstSample + 1;
+}
+
+
+/*______________________________________________________________________
+	QTUSeekIndexGetStatistics - Return what the index saved so far.
+
+pascal void QTUSeekIndexGetStatistics(QTUSeekIndex theIndex, QTUSeekIndexStatistics *theStatistics)
+*/
+
+pascal void QTUSeekIndexGetStatistics(QTUSeekIndex theIndex, QTUSeekIndexStatistics *theStatistics)
+{
+	DebugAssert(theIndex != NULL); if(theIndex == NULL) return;
+
+	*theStatistics = theIndex->statistics;
+	theStatistics->sampleCount = theIndex->header.sampleCount;
+	theStatistics->syncSampleCount = theIndex->header.syncSampleCount;
+}
+
+
+/*______________________________________________________________________
+	QTUDisposeSeekIndex - Dispose a seek index and the frames it keeps.
+
+pascal void QTUDisposeSeekIndex(QTUSeekIndex theIndex)
+*/
+
+pascal void QTUDisposeSeekIndex(QTUSeekIndex theIndex)
+{
+	long index;
+
+	if(theIndex == NULL)
+		return;
+
+	if(theIndex->decompressor) CDSequenceEnd(theIndex->decompressor);
+	if(theIndex->gWorld) DisposeGWorld(theIndex->gWorld);
+	for(index = 0; index < kQTUSeekCacheFrames; index++)
+	{
+		if(theIndex->cacheGWorlds[index]) DisposeGWorld(theIndex->cacheGWorlds[index]);
+	}
+
+	if(theIndex->description) DisposeHandle((Handle)theIndex->description);
+	if(theIndex->sampleData) DisposeHandle(theIndex->sampleData);
+	if(theIndex->samples) DisposePtr((Ptr)theIndex->samples);
+
+	DisposePtr((Ptr)theIndex);
+}
+
+
+// READ-AHEAD FUNCTIONS
+
+#define kQTUPrefetchReadSize		(256L * 1024L)
+#define kQTUPrefetchMaxReads		32
+#define kQTUPrefetchMaxGap			(64L * 1024L)
+#define kQTUPrefetchPriority		(50L << 16)			// of 100, the data is wanted but not needed yet
+
+typedef struct QTUPrefetchRead {
+	Ptr							buffer;
+	DataHandler					dataHandler;
+	DataHScheduleRecord			schedule;
+	TimeValue					endTime;				// the buffer is free once the render position got here
+	volatile Boolean			inFlight;
+} QTUPrefetchRead;
+
+struct QTUPrefetcherRecord {
+	Track						track;
+	Media						media;
+	TimeValue					leadTime;				// in the media time scale
+	long						readCount;
+	QTUPrefetchRead				reads[kQTUPrefetchMaxReads];
+	DataHCompletionUPP			readCompletion;
+	TimeValue					renderTime;				// media time of the last update
+	TimeValue					renderMovieTime;
+	TimeValue					nextTime;				// the samples from here on are not read yet
+	long						updates;
+
+	// The read being collected, up to kQTUPrefetchReadSize of the data file.
+	DataHandler					readHandler;
+	long						readOffset;
+	long						readSize;
+	TimeValue					readStartTime;
+	TimeValue					readEndTime;
+
+	// The data handler of the sample description the samples use.
+	long						descriptionIndex;
+	SampleDescriptionHandle		description;
+	DataHandler					dataHandler;
+
+	QTUPrefetcherStatistics		statistics;
+};
+
+
+/*______________________________________________________________________
+	QTUNewPrefetcher - Create a read-ahead for the samples of a track.
+
+pascal OSErr QTUNewPrefetcher(Track theTrack, TimeValue theLeadTime, long theMaxBytes, QTUPrefetcher *thePrefetcher)
+
+theTrack					the track to read ahead
+theLeadTime					how far ahead of the render position to read, in the movie time scale
+theMaxBytes					the most memory the read-ahead takes
+thePrefetcher				will contain the new prefetcher
+
+DESCRIPTION
+	When a movie is rendered frame by frame the media handler reads every sample as the frame is drawn, 
+	and on network storage each of these small reads is a round trip. The prefetcher walks the sample 
+	table of the track ahead of the render position, and reads the sample data in large sequential 
+	reads (samples close together in the file are read with one read, the gap as well). The reads are 
+	scheduled with the data handler and run asynchronously, when the movie toolbox asks for a sample it 
+	comes out of the file system cache.
+
+	The reads go into theMaxBytes of buffers, a buffer is used again when the render position passed 
+	the samples it read, so the read-ahead never gets more than theMaxBytes ahead even if theLeadTime
+	would allow it.
+
+EXAMPLE
+	anErr = QTUNewPrefetcher(aTrack, 2 * GetMovieTimeScale(aMovie), 8L * 1024L * 1024L, &aPrefetcher);
+	anErr = QTUPrefetcherUpdate(aPrefetcher, aMovieTime);			// before every frame is rendered
+	QTUDisposePrefetcher(aPrefetcher);
+*/
+
+static pascal void QTUPrefetchReadDone(Ptr theRequest, long theRefCon, OSErr theErr);
+
+pascal OSErr QTUNewPrefetcher(Track theTrack, TimeValue theLeadTime, long theMaxBytes, QTUPrefetcher *thePrefetcher)
+{
+	OSErr			anErr = noErr;
+	QTUPrefetcher	aPrefetcher = NULL;
+	long			aReadCount;
+	long			index;
+
+	DebugAssert(theTrack != NULL); if(theTrack == NULL) return invalidTrack;
+	DebugAssert(thePrefetcher != NULL); if(thePrefetcher == NULL) return paramErr;
+	*thePrefetcher = NULL;
+
+	aReadCount = theMaxBytes / kQTUPrefetchReadSize;
+	if(aReadCount < 1) aReadCount = 1;
+	if(aReadCount > kQTUPrefetchMaxReads) aReadCount = kQTUPrefetchMaxReads;
+
+	aPrefetcher = (QTUPrefetcher)NewPtrClear(sizeof(struct QTUPrefetcherRecord)); DebugAssert(aPrefetcher != NULL);
+	if(aPrefetcher == NULL) return memFullErr;
+
+	aPrefetcher->track = theTrack;
+	aPrefetcher->media = GetTrackMedia(theTrack);
+	aPrefetcher->leadTime = theLeadTime * GetMediaTimeScale(aPrefetcher->media) / GetMovieTimeScale(GetTrackMovie(theTrack));
+	aPrefetcher->descriptionIndex = -1;
+
+	aPrefetcher->description = (SampleDescriptionHandle)NewHandle(0); DebugAssert(aPrefetcher->description != NULL);
+	aPrefetcher->readCompletion = NewDataHCompletionUPP(QTUPrefetchReadDone); DebugAssert(aPrefetcher->readCompletion != NULL);
+	if(aPrefetcher->description == NULL || aPrefetcher->readCompletion == NULL)
+	{
+		anErr = memFullErr;
+		goto Closure;
+	}
+
+	for(index = 0; index < aReadCount; index++)
+	{
+		aPrefetcher->reads[index].buffer = NewPtr(kQTUPrefetchReadSize); DebugAssert(aPrefetcher->reads[index].buffer != NULL);
+		if(aPrefetcher->reads[index].buffer == NULL)
+		{
+			anErr = memFullErr;
+			goto Closure;
+		}
+		aPrefetcher->readCount++;
+	}
+
+	*thePrefetcher = aPrefetcher;
+	return noErr;
+
+Closure:
+	QTUDisposePrefetcher(aPrefetcher);
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUPrefetchReadDone - Completion routine of the reads.
+
+static pascal void QTUPrefetchReadDone(Ptr theRequest, long theRefCon, OSErr theErr)
+
+DESCRIPTION
+	QTUPrefetchReadDone could be called at deferred task time, it only marks the read done, there is
+	nothing to do about a read that failed, the movie toolbox reads the samples again anyway.
+*/
+
+static pascal void QTUPrefetchReadDone(Ptr theRequest, long theRefCon, OSErr theErr)
+{
+#pragma unused(theRequest, theErr)
+	QTUPrefetchRead *aRead = (QTUPrefetchRead*)theRefCon;
+
+	aRead->inFlight = false;
+}
+
+
+/*______________________________________________________________________
+	QTUPrefetcherStartRead - Start the read collected so far.
+
+static Boolean QTUPrefetcherStartRead(QTUPrefetcher thePrefetcher)
+
+DESCRIPTION
+	QTUPrefetcherStartRead schedules the read of the collected range into a free buffer, and returns
+	false if all the buffers are in use, then the read stays collected for the next update.
+*/
+
+static Boolean QTUPrefetcherStartRead(QTUPrefetcher thePrefetcher)
+{
+	QTUPrefetchRead		*aRead = NULL;
+	OSErr				anErr = noErr;
+	Movie				aMovie = GetTrackMovie(thePrefetcher->track);
+	TimeValue			aNeededBy = thePrefetcher->renderMovieTime;
+	long				index;
+
+	for(index = 0; index < thePrefetcher->readCount; index++)
+	{
+		QTUPrefetchRead *aCandidate = &thePrefetcher->reads[index];
+
+		if(!aCandidate->inFlight && aCandidate->endTime <= thePrefetcher->renderTime)
+		{
+			aRead = aCandidate;
+			break;
+		}
+	}
+
+	if(aRead == NULL)
+	{
+		thePrefetcher->statistics.buffersFull++;
+		return false;
+	}
+
+	// The data is needed when the render position gets to the first samples of the read.
+	if(thePrefetcher->readStartTime > thePrefetcher->renderTime)
+		aNeededBy += (thePrefetcher->readStartTime - thePrefetcher->renderTime) * GetMovieTimeScale(aMovie) / 
+						GetMediaTimeScale(thePrefetcher->media);
+
+	aRead->schedule.timeNeededBy.value.hi = 0;
+	aRead->schedule.timeNeededBy.value.lo = aNeededBy;
+	aRead->schedule.timeNeededBy.scale = GetMovieTimeScale(aMovie);
+	aRead->schedule.timeNeededBy.base = GetMovieTimeBase(aMovie);
+	aRead->schedule.extendedID = 0;
+	aRead->schedule.extendedVers = 0;
+	aRead->schedule.priority = kQTUPrefetchPriority;
+
+	aRead->dataHandler = thePrefetcher->readHandler;
+	aRead->endTime = thePrefetcher->readEndTime;
+	aRead->inFlight = true;
+
+	anErr = DataHScheduleData(aRead->dataHandler, aRead->buffer, thePrefetcher->readOffset, thePrefetcher->readSize, (long)aRead, 
+									&aRead->schedule, thePrefetcher->readCompletion);
+	if(anErr == noErr)
+	{
+		thePrefetcher->statistics.reads++;
+		thePrefetcher->statistics.bytesRead += thePrefetcher->readSize;
+	}
+	else
+	{
+		aRead->inFlight = false;
+		aRead->endTime = 0;
+	}
+
+	thePrefetcher->readSize = 0;
+	return true;
+}
+
+
+/*______________________________________________________________________
+	QTUPrefetcherAddRange - Add the data of samples to the read being collected.
+
+static Boolean QTUPrefetcherAddRange(QTUPrefetcher thePrefetcher, DataHandler theHandler, long theOffset, long theSize, 
+										TimeValue theStartTime, TimeValue theEndTime)
+
+DESCRIPTION
+	QTUPrefetcherAddRange adds the range to the read collected so far if it's in the same file, after 
+	it and close enough, otherwise the read is started first and the range starts a new one. A range 
+	bigger than one read is split. Returns false when no buffer was free, part of the range might be
+	in the collected read then.
+*/
+
+static Boolean QTUPrefetcherAddRange(QTUPrefetcher thePrefetcher, DataHandler theHandler, long theOffset, long theSize, 
+										TimeValue theStartTime, TimeValue theEndTime)
+{
+	while(theSize > 0)
+	{
+		long anEnd = thePrefetcher->readOffset + thePrefetcher->readSize;
+		long aPieceSize;
+
+		if( thePrefetcher->readSize > 0 && 
+			(theHandler != thePrefetcher->readHandler || theOffset < anEnd || theOffset - anEnd > kQTUPrefetchMaxGap ||
+			theOffset - thePrefetcher->readOffset >= kQTUPrefetchReadSize) )
+		{
+			if(!QTUPrefetcherStartRead(thePrefetcher))
+				return false;
+		}
+
+		if(thePrefetcher->readSize == 0)
+		{
+			thePrefetcher->readHandler = theHandler;
+			thePrefetcher->readOffset = theOffset;
+			thePrefetcher->readStartTime = theStartTime;
+		}
+
+		aPieceSize = kQTUPrefetchReadSize - (theOffset - thePrefetcher->readOffset);
+		if(aPieceSize > theSize) aPieceSize = theSize;
+
+		thePrefetcher->readSize = theOffset + aPieceSize - thePrefetcher->readOffset;
+		thePrefetcher->readEndTime = theEndTime;
+		theOffset += aPieceSize;
+		theSize -= aPieceSize;
+	}
+
+	return true;
+}
+
+
+/*______________________________________________________________________
+	QTUPrefetcherGetDataHandler - Return the data handler of a sample description.
+
+static DataHandler QTUPrefetcherGetDataHandler(QTUPrefetcher thePrefetcher, long theDescriptionIndex)
+
+DESCRIPTION
+	Every sample description names the data reference its samples are in, QTUPrefetcherGetDataHandler
+	returns the data handler the media opened for it, or NULL if it's not open.
+*/
+
+static DataHandler QTUPrefetcherGetDataHandler(QTUPrefetcher thePrefetcher, long theDescriptionIndex)
+{
+	if(theDescriptionIndex != thePrefetcher->descriptionIndex)
+	{
+		thePrefetcher->descriptionIndex = theDescriptionIndex;
+		thePrefetcher->dataHandler = NULL;
+
+		GetMediaSampleDescription(thePrefetcher->media, theDescriptionIndex, thePrefetcher->description);
+		if(GetMoviesError() == noErr && GetHandleSize((Handle)thePrefetcher->description) >= sizeof(SampleDescription))
+			thePrefetcher->dataHandler = GetMediaDataHandler(thePrefetcher->media, (**thePrefetcher->description).dataRefIndex);
+	}
+
+	return thePrefetcher->dataHandler;
+}
+
+
+/*______________________________________________________________________
+	QTUPrefetcherUpdate - Tell the prefetcher where the rendering is.
+
+pascal OSErr QTUPrefetcherUpdate(QTUPrefetcher thePrefetcher, TimeValue theMovieTime)
+
+thePrefetcher				the prefetcher
+theMovieTime				the movie time about to be rendered
+
+DESCRIPTION
+	QTUPrefetcherUpdate frees the buffers of the samples before theMovieTime, and starts reads for the 
+	samples up to the lead time ahead, as many as there are free buffers. It never waits for a read.
+
+	If theMovieTime went back, or past what was read ahead (a seek, an edit, or frames skipped when 
+	the frame rate is resampled), the read-ahead starts over at theMovieTime. Reads already started
+	can't be taken back, their buffers are free again once they are done.
+*/
+
+pascal OSErr QTUPrefetcherUpdate(QTUPrefetcher thePrefetcher, TimeValue theMovieTime)
+{
+	OSErr					anErr = noErr;
+	SampleReferenceRecord	aSamples[kQTUSampleReferenceBatch];
+	TimeValue				aMediaTime;
+	TimeValue				anEndTime;
+	long					index;
+
+	DebugAssert(thePrefetcher != NULL); if(thePrefetcher == NULL) return paramErr;
+
+	aMediaTime = TrackTimeToMediaTime(theMovieTime, thePrefetcher->track);
+	if(aMediaTime < 0)
+		return noErr;							// an empty edit, nothing to read
+
+	// Going on from behind the render position is no use, but only a jump is counted as a seek, not the rendering
+	// running ahead of the reads.
+	if(aMediaTime < thePrefetcher->renderTime || aMediaTime > thePrefetcher->nextTime)
+	{
+		if(thePrefetcher->updates > 0 && 
+			(aMediaTime < thePrefetcher->renderTime || aMediaTime > thePrefetcher->nextTime + thePrefetcher->leadTime))
+			thePrefetcher->statistics.seeks++;
+
+		thePrefetcher->nextTime = aMediaTime;
+		thePrefetcher->readSize = 0;
+		for(index = 0; index < thePrefetcher->readCount; index++)
+			thePrefetcher->reads[index].endTime = 0;
+	}
+	thePrefetcher->renderTime = aMediaTime;
+	thePrefetcher->renderMovieTime = theMovieTime;
+	thePrefetcher->updates++;
+
+	// Let the data handlers call the completion routines of the reads that are done.
+	for(index = 0; index < thePrefetcher->readCount; index++)
+		if(thePrefetcher->reads[index].inFlight)
+			DataHTask(thePrefetcher->reads[index].dataHandler);
+
+	anEndTime = aMediaTime + thePrefetcher->leadTime;
+	if(anEndTime > GetMediaDuration(thePrefetcher->media))
+		anEndTime = GetMediaDuration(thePrefetcher->media);
+
+	while(thePrefetcher->nextTime < anEndTime)
+	{
+		TimeValue	aSampleTime;
+		long		aDescriptionIndex;
+		long		aSampleCount = 0;
+		DataHandler	aDataHandler;
+
+		anErr = GetMediaSampleReferences(thePrefetcher->media, thePrefetcher->nextTime, &aSampleTime, NULL, &aDescriptionIndex,
+												kQTUSampleReferenceBatch, &aSampleCount, aSamples);
+		if(anErr != noErr || aSampleCount == 0)
+			break;
+
+		aDataHandler = QTUPrefetcherGetDataHandler(thePrefetcher, aDescriptionIndex);
+
+		for(index = 0; index < aSampleCount && aSampleTime < anEndTime; index++)
+		{
+			TimeValue aSamplesEnd = aSampleTime + aSamples[index].durationPerSample * aSamples[index].numberOfSamples;
+
+			// Samples in a data reference we can't get at are left to the media handler.
+			if(aDataHandler != NULL && aSamples[index].dataOffset >= 0)
+			{
+				if(!QTUPrefetcherAddRange(thePrefetcher, aDataHandler, aSamples[index].dataOffset,
+												aSamples[index].dataSize * aSamples[index].numberOfSamples, aSampleTime, aSamplesEnd))
+					return noErr;				// all the buffers are in use, go on with the next update
+			}
+
+			aSampleTime = aSamplesEnd;
+			thePrefetcher->nextTime = aSampleTime;
+		}
+
+		if(index < aSampleCount)
+			break;
+	}
+
+	// Everything up to the lead time is collected, don't keep the last read waiting for more.
+	if(thePrefetcher->readSize > 0)
+		QTUPrefetcherStartRead(thePrefetcher);
+
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUPrefetcherGetStatistics - Return what the prefetcher did.
+
+pascal void QTUPrefetcherGetStatistics(QTUPrefetcher thePrefetcher, QTUPrefetcherStatistics *theStatistics)
+
+thePrefetcher				the prefetcher
+theStatistics				will contain the read counters
+
+DESCRIPTION
+	QTUPrefetcherGetStatistics returns the reads started so far, buffersFull tells how often the
+	read-ahead stopped at the memory limit before it got to the lead time.
+*/
+
+pascal void QTUPrefetcherGetStatistics(QTUPrefetcher thePrefetcher, QTUPrefetcherStatistics *theStatistics)
+{
+	DebugAssert(thePrefetcher != NULL);
+	if(thePrefetcher != NULL)
+		*theStatistics = thePrefetcher->statistics;
+}
+
+
+/*______________________________________________________________________
+	QTUDisposePrefetcher - Dispose a prefetcher.
+
+pascal void QTUDisposePrefetcher(QTUPrefetcher thePrefetcher)
+
+thePrefetcher				the prefetcher
+
+DESCRIPTION
+	QTUDisposePrefetcher waits for the reads in flight, their buffers can't go away before, and 
+	disposes the prefetcher.
+*/
+
+pascal void QTUDisposePrefetcher(QTUPrefetcher thePrefetcher)
+{
+	long index;
+
+	if(thePrefetcher == NULL) return;
+
+	for(index = 0; index < thePrefetcher->readCount; index++)
+	{
+		QTUPrefetchRead *aRead = &thePrefetcher->reads[index];
+
+		while(aRead->inFlight)
+			DataHTask(aRead->dataHandler);
+	}
+
+	for(index = 0; index < kQTUPrefetchMaxReads; index++)
+		if(thePrefetcher->reads[index].buffer != NULL)
+			DisposePtr(thePrefetcher->reads[index].buffer);
+
+	if(thePrefetcher->readCompletion) DisposeDataHCompletionUPP(thePrefetcher->readCompletion);
+	if(thePrefetcher->description) DisposeHandle((Handle)thePrefetcher->description);
+
+	DisposePtr((Ptr)thePrefetcher);
+}
+
+
+#define kQTUWindowLoadSteps			8					// the window is loaded in steps of this part of it
+
+typedef struct QTUWindowTrack {
+	Track						track;
+	TimeValue					trackEnd;				// in movie time, there is nothing to load after it
+	TimeValue					loadedStart;			// the movie time range kept in RAM
+	TimeValue					loadedEnd;
+	long						loadedBytes;
+} QTUWindowTrack;
+
+struct QTUWindowLoaderRecord {
+	Movie						movie;
+	TimeValue					window;
+	long						maxBytes;
+	long						loadedBytes;			// of all the tracks
+	long						trackCount;
+	QTUWindowTrack				*tracks;
+	QTUWindowLoaderStatistics	statistics;
+};
+
+
+/*______________________________________________________________________
+	QTUNewWindowLoader - Create a loader that keeps a window of a movie in RAM.
+
+pascal OSErr QTUNewWindowLoader(Movie theMovie, TimeValue theWindow, long theMaxBytes, QTUWindowLoader *theLoader)
+
+theMovie					the movie to load
+theWindow					how much of the movie to keep loaded ahead of the playhead, in the movie time scale
+theMaxBytes					the most media data to keep loaded, for all the tracks together
+theLoader					will contain the new loader
+
+DESCRIPTION
+	QTULoadWholeMovieToRAM works for small movies only, a long one doesn't fit or ends up paged out. The
+	window loader keeps the time range from the playhead to theWindow ahead of it loaded for every 
+	enabled track, and unloads what the playhead left behind, so a long movie is read from RAM with a 
+	bounded amount of memory. If the window doesn't fit in theMaxBytes, less of it is loaded.
+
+	Call QTUWindowLoaderUpdate with the playhead before every frame (or every few), the loading is done 
+	in steps of a part of the window, and the tracks are loaded evenly in time.
+
+EXAMPLE
+	anErr = QTUNewWindowLoader(aMovie, 10 * GetMovieTimeScale(aMovie), 32L * 1024L * 1024L, &aLoader);
+	anErr = QTUWindowLoaderUpdate(aLoader, GetMovieTime(aMovie, NULL));
+	QTUDisposeWindowLoader(aLoader);
+*/
+
+pascal OSErr QTUNewWindowLoader(Movie theMovie, TimeValue theWindow, long theMaxBytes, QTUWindowLoader *theLoader)
+{
+	QTUWindowLoader	aLoader = NULL;
+	long			aTrackCount;
+	long			index;
+
+	DebugAssert(theMovie != NULL); if(theMovie == NULL) return invalidMovie;
+	DebugAssert(theLoader != NULL); if(theLoader == NULL) return paramErr;
+	*theLoader = NULL;
+
+	aLoader = (QTUWindowLoader)NewPtrClear(sizeof(struct QTUWindowLoaderRecord)); DebugAssert(aLoader != NULL);
+	if(aLoader == NULL) return memFullErr;
+
+	aLoader->movie = theMovie;
+	aLoader->window = (theWindow > 0) ? theWindow : 1;
+	aLoader->maxBytes = theMaxBytes;
+
+	aTrackCount = GetMovieTrackCount(theMovie);
+	aLoader->tracks = (QTUWindowTrack*)NewPtrClear(sizeof(QTUWindowTrack) * (aTrackCount + 1)); DebugAssert(aLoader->tracks != NULL);
+	if(aLoader->tracks == NULL)
+	{
+		DisposePtr((Ptr)aLoader);
+		return memFullErr;
+	}
+
+	// Disabled tracks are not played, so they are not read either.
+	for(index = 1; index <= aTrackCount; index++)
+	{
+		Track aTrack = GetMovieIndTrack(theMovie, index);
+
+		if(aTrack != NULL && GetTrackEnabled(aTrack))
+		{
+			aLoader->tracks[aLoader->trackCount].track = aTrack;
+			aLoader->tracks[aLoader->trackCount].trackEnd = GetTrackOffset(aTrack) + GetTrackDuration(aTrack);
+			aLoader->trackCount++;
+		}
+	}
+
+	*theLoader = aLoader;
+	return noErr;
+}
+
+
+/*______________________________________________________________________
+	QTUWindowLoaderUnload - Unload the start of the range a track keeps loaded.
+
+static void QTUWindowLoaderUnload(QTUWindowLoader theLoader, QTUWindowTrack *theTrack, TimeValue theEndTime)
+
+DESCRIPTION
+	QTUWindowLoaderUnload lets the media data from loadedStart up to theEndTime go, the range left 
+	loaded starts at theEndTime.
+*/
+
+static void QTUWindowLoaderUnload(QTUWindowLoader theLoader, QTUWindowTrack *theTrack, TimeValue theEndTime)
+{
+	long aSize;
+
+	if(theEndTime > theTrack->loadedEnd) theEndTime = theTrack->loadedEnd;
+	if(theEndTime <= theTrack->loadedStart) return;
+
+	aSize = GetTrackDataSize(theTrack->track, theTrack->loadedStart, theEndTime - theTrack->loadedStart);
+	if(aSize > theTrack->loadedBytes) aSize = theTrack->loadedBytes;
+
+	LoadTrackIntoRam(theTrack->track, theTrack->loadedStart, theEndTime - theTrack->loadedStart, unkeepInRam | flushFromRam);
+
+	theTrack->loadedStart = theEndTime;
+	theTrack->loadedBytes -= aSize;
+	theLoader->loadedBytes -= aSize;
+	theLoader->statistics.bytesUnloaded += aSize;
+}
+
+
+/*______________________________________________________________________
+	QTUWindowLoaderUpdate - Move the loaded window with the playhead.
+
+pascal OSErr QTUWindowLoaderUpdate(QTUWindowLoader theLoader, TimeValue theMovieTime)
+
+theLoader					the window loader
+theMovieTime				the playhead
+
+DESCRIPTION
+	QTUWindowLoaderUpdate counts a hit if theMovieTime is loaded for all the tracks, and a miss if not.
+	It unloads what is behind theMovieTime, and loads ahead of it until the window is loaded, or until 
+	the next step doesn't fit in the byte budget (or in memory), always the track that is loaded the
+	shortest time ahead first. A playhead outside the loaded range (a seek) unloads the whole range.
+
+	The error returned is the one from LoadTrackIntoRam, other than memFullErr, running out of memory 
+	only means less is loaded.
+*/
+
+pascal OSErr QTUWindowLoaderUpdate(QTUWindowLoader theLoader, TimeValue theMovieTime)
+{
+	OSErr			anErr = noErr;
+	TimeValue		anEndTime;
+	TimeValue		aStep;
+	Boolean			isLoaded = true;
+	long			index;
+
+	DebugAssert(theLoader != NULL); if(theLoader == NULL) return paramErr;
+
+	for(index = 0; index < theLoader->trackCount; index++)
+	{
+		QTUWindowTrack *aTrack = &theLoader->tracks[index];
+
+		if(theMovieTime < aTrack->loadedStart || theMovieTime >= aTrack->loadedEnd)
+		{
+			if(theMovieTime < aTrack->trackEnd)
+				isLoaded = false;
+
+			// Out of the range, nothing of it is any use.
+			QTUWindowLoaderUnload(theLoader, aTrack, aTrack->loadedEnd);
+			aTrack->loadedStart = aTrack->loadedEnd = theMovieTime;
+		}
+		else
+			QTUWindowLoaderUnload(theLoader, aTrack, theMovieTime);
+	}
+
+	if(isLoaded) 
+		theLoader->statistics.hits++;
+	else 
+		theLoader->statistics.misses++;
+
+	anEndTime = theMovieTime + theLoader->window;
+	if(anEndTime > GetMovieDuration(theLoader->movie))
+		anEndTime = GetMovieDuration(theLoader->movie);
+
+	aStep = theLoader->window / kQTUWindowLoadSteps;
+	if(aStep < 1) aStep = 1;
+
+	for(;;)
+	{
+		QTUWindowTrack	*aTrack = NULL;
+		TimeValue		aDuration;
+		long			aSize;
+
+		for(index = 0; index < theLoader->trackCount; index++)
+		{
+			QTUWindowTrack *aCandidate = &theLoader->tracks[index];
+
+			if( aCandidate->loadedEnd < anEndTime && aCandidate->loadedEnd < aCandidate->trackEnd &&
+				(aTrack == NULL || aCandidate->loadedEnd < aTrack->loadedEnd) )
+				aTrack = aCandidate;
+		}
+		if(aTrack == NULL)
+			break;											// the window is loaded
+
+		aDuration = ((anEndTime < aTrack->trackEnd) ? anEndTime : aTrack->trackEnd) - aTrack->loadedEnd;
+		if(aDuration > aStep) aDuration = aStep;
+
+		aSize = GetTrackDataSize(aTrack->track, aTrack->loadedEnd, aDuration);
+		if(theLoader->loadedBytes + aSize > theLoader->maxBytes)
+		{
+			theLoader->statistics.overBudget++;
+			break;
+		}
+
+		anErr = LoadTrackIntoRam(aTrack->track, aTrack->loadedEnd, aDuration, keepInRam);
+		if(anErr != noErr)
+		{
+			DebugAssert(anErr == memFullErr);
+			if(anErr == memFullErr) 
+			{
+				anErr = noErr;
+				theLoader->statistics.overBudget++;
+			}
+			break;
+		}
+
+		aTrack->loadedEnd += aDuration;
+		aTrack->loadedBytes += aSize;
+		theLoader->loadedBytes += aSize;
+		theLoader->statistics.bytesLoaded += aSize;
+	}
+
+	theLoader->statistics.loadedBytes = theLoader->loadedBytes;
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUWindowLoaderGetStatistics - Return what the window loader did.
+
+pascal void QTUWindowLoaderGetStatistics(QTUWindowLoader theLoader, QTUWindowLoaderStatistics *theStatistics)
+
+theLoader					the window loader
+theStatistics				will contain the hit and miss counts and the bytes loaded
+
+DESCRIPTION
+	QTUWindowLoaderGetStatistics returns the counters since the loader was created, loadedBytes is what
+	is loaded now.
+*/
+
+pascal void QTUWindowLoaderGetStatistics(QTUWindowLoader theLoader, QTUWindowLoaderStatistics *theStatistics)
+{
+	DebugAssert(theLoader != NULL);
+	if(theLoader != NULL)
+		*theStatistics = theLoader->statistics;
+}
+
+
+/*______________________________________________________________________
+	QTUDisposeWindowLoader - Unload the window and dispose the loader.
+
+pascal void QTUDisposeWindowLoader(QTUWindowLoader theLoader)
+
+theLoader					the window loader
+
+DESCRIPTION
+	QTUDisposeWindowLoader lets go of all the media data the loader kept in RAM, call it before the
+	movie is disposed.
+*/
+
+pascal void QTUDisposeWindowLoader(QTUWindowLoader theLoader)
+{
+	long index;
+
+	if(theLoader == NULL) return;
+
+	for(index = 0; index < theLoader->trackCount; index++)
+		QTUWindowLoaderUnload(theLoader, &theLoader->tracks[index], theLoader->tracks[index].loadedEnd);
+
+	if(theLoader->tracks) DisposePtr((Ptr)theLoader->tracks);
+	DisposePtr((Ptr)theLoader);
+}
+
+
+// FILE FUNCTIONS
+
+#define kQTUFileBufferSize		(256L * 1024L)
+#define kQTUMaxPathSize			1024
+
+/*______________________________________________________________________
+	QTUStartHash - Start a new data hash.
+
+pascal void QTUStartHash(UInt32 theHash[2])
+
+theHash						the hash to initialize
+
+DESCRIPTION
+	The hash is two independent 32-bit lanes (FNV-1a and djb2a), together good enough to tell
+	files apart by content without reading them byte by byte against each other. Start with
+	QTUStartHash, then add data with QTUHashData as many times as needed.
+*/
+
+pascal void QTUStartHash(UInt32 theHash[2])
+{
+	theHash[0] = 2166136261UL;
+	theHash[1] = 5381UL;
+}
+
+
+/*______________________________________________________________________
+	QTUHashData - Add data to a hash.
+
+pascal void QTUHashData(UInt32 theHash[2], const void *theData, long theDataSize)
+
+theHash						a hash started with QTUStartHash
+theData						the data to add
+theDataSize					size of the data in bytes
+
+DESCRIPTION
+	QTUHashData adds the bytes to both lanes of the hash. Hashing the same data in one call or in
+	several pieces gives the same result.
+*/
+
+pascal void QTUHashData(UInt32 theHash[2], const void *theData, long theDataSize)
+{
+	const UInt8		*aByte = (const UInt8 *)theData;
+	UInt32			aHash0 = theHash[0];
+	UInt32			aHash1 = theHash[1];
+
+	while(theDataSize-- > 0)
+	{
+		aHash0 = (aHash0 ^ *aByte) * 16777619UL;
+		aHash1 = (aHash1 * 33) ^ *aByte;
+		aByte++;
+	}
+
+	theHash[0] = aHash0;
+	theHash[1] = aHash1;
+}
+
+
+/*______________________________________________________________________
+	QTUHashFork - Add the contents of an open fork to a hash.
+
+static OSErr QTUHashFork(short theRefNum, UInt32 theHash[2], Ptr theBuffer)
+
+DESCRIPTION
+	QTUHashFork reads the fork from the start in kQTUFileBufferSize pieces, the fork length is
+	hashed first so the data of two forks can't run into each other.
+*/
+
+static OSErr QTUHashFork(short theRefNum, UInt32 theHash[2], Ptr theBuffer)
+{
+	OSErr	anErr = noErr;
+	long	aForkSize;
+	long	aCount;
+
+	anErr = GetEOF(theRefNum, &aForkSize); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+
+	QTUHashData(theHash, &aForkSize, sizeof(aForkSize));
+
+	anErr = SetFPos(theRefNum, fsFromStart, 0);
+	while(anErr == noErr)
+	{
+		aCount = kQTUFileBufferSize;
+		anErr = FSRead(theRefNum, &aCount, theBuffer);
+		QTUHashData(theHash, theBuffer, aCount);
+	}
+
+	return (anErr == eofErr) ? noErr : anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUHashFile - Hash the contents of a file.
+
+pascal OSErr QTUHashFile(const FSSpec *theFile, UInt32 theHash[2])
+
+theFile						the file
+theHash						will contain the hash of the file
+
+DESCRIPTION
+	QTUHashFile hashes both the data and the resource fork, a movie could have its movie resource
+	in the resource fork and its media data in the data fork. Only the contents count, not the name
+	or the dates of the file, so a copy of a file has the same hash as the original.
+*/
+
+pascal OSErr QTUHashFile(const FSSpec *theFile, UInt32 theHash[2])
+{
+	OSErr	anErr = noErr;
+	Ptr		aBuffer = NULL;
+	short	aRefNum;
+
+	aBuffer = NewPtr(kQTUFileBufferSize); DebugAssert(aBuffer != NULL);
+	if(aBuffer == NULL) return memFullErr;
+
+	QTUStartHash(theHash);
+
+	anErr = FSpOpenDF(theFile, fsRdPerm, &aRefNum); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+
+	anErr = QTUHashFork(aRefNum, theHash, aBuffer);
+	FSClose(aRefNum);
+	if(anErr != noErr) goto Closure;
+
+	// No resource fork at all is the same as an empty one.
+	if(FSpOpenRF(theFile, fsRdPerm, &aRefNum) == noErr)
+	{
+		anErr = QTUHashFork(aRefNum, theHash, aBuffer);
+		FSClose(aRefNum);
+	}
+
+Closure:
+	DisposePtr(aBuffer);
+	return anErr;
+}
+
+
+/*______________________________________________________________________
+	QTUCopyFork - Copy an open fork to another open fork.
+
+static OSErr QTUCopyFork(short theSourceRefNum, short theDestinationRefNum, Ptr theBuffer)
+
+DESCRIPTION
+	QTUCopyFork copies everything from the start of the source fork to the current position of the
+	destination fork.
+*/
+
+static OSErr QTUCopyFork(short theSourceRefNum, short theDestinationRefNum, Ptr theBuffer)
+{
+	OSErr	anErr = noErr;
+	OSErr	aReadErr = noErr;
+	long	aCount;
+
+	aReadErr = SetFPos(theSourceRefNum, fsFromStart, 0);
+	while(aReadErr == noErr)
+	{
+		aCount = kQTUFileBufferSize;
+		aReadErr = FSRead(theSourceRefNum, &aCount, theBuffer);
+		if(aReadErr != noErr && aReadErr != eofErr)
+			return aReadErr;
+
+		anErr = FSWrite(theDestinationRefNum, &aCount, theBuffer); DebugAssert(anErr == noErr);
+		if(anErr != noErr) return anErr;
+	}
+
+	return noErr;
+}
 
 
 /*______________________________________________________________________
-	QTUPlayMovieWithMC - Play a specific movie when using movie controllers.
+	QTULinkOrCopyFile - Make a file have the same contents as another file.
 
-pascal OSErr QTUPlayMovieWithMC( MovieController mc)
+pascal OSErr QTULinkOrCopyFile(const FSSpec *theSource, const FSSpec *theDestination)
 
-mc						specified movie controller to be used
+theSource					the file with the contents
+theDestination				the file to create, an existing file with this name is replaced
 
 DESCRIPTION
-	Playmovie will start a movie using a moviecontroller and a specified movie. Note that it also  
-	does a preroll of the movie for performance reasons. 
+	On Mac OS X QTULinkOrCopyFile makes the destination a hard link to the source, so no data is
+	copied at all. If that's not possible (Mac OS 9, Windows, the files are on different volumes)
+	the data and resource forks are copied, together with the file type and creator.
 
+	Note that a hard link means both names share the same data, anything that changes the file in
+	place changes both. Replacing the file (delete and create, as CreateMovieFile and
+	QTUFlattenMovieFile do) is safe.
 */
 
-pascal OSErr QTUPlayMovieWithMC(MovieController mc)
+pascal OSErr QTULinkOrCopyFile(const FSSpec *theSource, const FSSpec *theDestination)
 {
-// Play normal speed forward, taking into account the possibility 
-// of a movie with a nonstandard PreferredRate.
 	OSErr	anErr = noErr;
-	Fixed 	aRate;
-	Movie	aMovie;
+	FInfo	aFileInfo;
+	Ptr		aBuffer = NULL;
+	short	aSourceRefNum = 0;
+	short	aDestinationRefNum = 0;
 
-	aMovie = MCGetMovie(mc);
+	anErr = FSpGetFInfo(theSource, &aFileInfo); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
 
-	aRate= GetMoviePreferredRate(aMovie);
-	anErr = QTUPrerollMovie(aMovie);  // Important: Preroll the movie here.
-	DebugAssert(anErr == noErr);
+	FSpDelete(theDestination);		// if there's one
 
-	if(anErr == noErr)
+	anErr = FSpCreate(theDestination, aFileInfo.fdCreator, aFileInfo.fdType, smSystemScript); DebugAssert(anErr == noErr);
+	if(anErr != noErr) return anErr;
+
+#if TARGET_RT_MAC_MACHO
 	{
-		MCDoAction(mc, mcActionPlay, (void *)aRate);  // note last value
+		FSRef	aSourceRef, aDestinationRef;
+		UInt8	aSourcePath[kQTUMaxPathSize], aDestinationPath[kQTUMaxPathSize];
+
+		// The empty destination file was only created so we can get its path, the link replaces it.
+		if(FSpMakeFSRef(theSource, &aSourceRef) == noErr && FSpMakeFSRef(theDestination, &aDestinationRef) == noErr &&
+			FSRefMakePath(&aSourceRef, aSourcePath, kQTUMaxPathSize) == noErr &&
+			FSRefMakePath(&aDestinationRef, aDestinationPath, kQTUMaxPathSize) == noErr &&
+			unlink((const char *)aDestinationPath) == 0)
+		{
+			if(link((const char *)aSourcePath, (const char *)aDestinationPath) == 0)
+				return noErr;
+
+			anErr = FSpCreate(theDestination, aFileInfo.fdCreator, aFileInfo.fdType, smSystemScript); DebugAssert(anErr == noErr);
+			if(anErr != noErr) return anErr;
+		}
 	}
-	
+#endif
+
+	aBuffer = NewPtr(kQTUFileBufferSize); DebugAssert(aBuffer != NULL);
+	if(aBuffer == NULL) { anErr = memFullErr; goto Closure; }
+
+	// Data fork.
+	anErr = FSpOpenDF(theSource, fsRdPerm, &aSourceRefNum); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+
+	anErr = FSpOpenDF(theDestination, fsRdWrPerm, &aDestinationRefNum); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+
+	anErr = QTUCopyFork(aSourceRefNum, aDestinationRefNum, aBuffer);
+	FSClose(aSourceRefNum); aSourceRefNum = 0;
+	FSClose(aDestinationRefNum); aDestinationRefNum = 0;
+	if(anErr != noErr) goto Closure;
+
+	// Resource fork, if the source has one.
+	if(FSpOpenRF(theSource, fsRdPerm, &aSourceRefNum) == noErr)
+	{
+		anErr = FSpOpenRF(theDestination, fsRdWrPerm, &aDestinationRefNum); DebugAssert(anErr == noErr);
+		if(anErr != noErr) goto Closure;
+
+		anErr = QTUCopyFork(aSourceRefNum, aDestinationRefNum, aBuffer);
+	}
+
+Closure:
+	if(aSourceRefNum) FSClose(aSourceRefNum);
+	if(aDestinationRefNum) FSClose(aDestinationRefNum);
+	if(aBuffer) DisposePtr(aBuffer);
+
+	if(anErr != noErr)
+		FSpDelete(theDestination);		// don't leave half a file behind
+
 	return anErr;
 }
 
 
+// TIMING FUNCTIONS
+
 /*______________________________________________________________________
-	QTUDoIgnoreMCDrags - Disable Drag and Drop facilities of the movie controller environment.
+	QTUStartTimer - Start a microsecond timer.
 
-pascal OSErr  QTUDoIgnoreMCDrags(MovieController  mc)
+pascal void QTUStartTimer(UnsignedWide *theTimer)
 
-mc						is the specified moviecontroller to be used
+theTimer					will contain the current time
 
 DESCRIPTION
-	QTUDoIgnoreMCDrags will ensure that the Drag and Drop functionality is not handled within 
-	the movie specified by the movie controller.
+	QTUStartTimer and QTUElapsedMicroseconds are a simple way of measuring how long something takes,
+	with a better resolution than the MBSTARTTIMER and MBSTOPTIMER tick macros (and without MacsBug).
 
-ISSUES
-	Note that this is a workaround in QT 2.0 (test for QT 2.0 or higher if you want to use
-	the drag-and-drop support in QT), and this function might not be needed in later QT versions.
+EXAMPLE
+	QTUStartTimer(&aTimer);
+	DoSomething();
+	aTime = QTUElapsedMicroseconds(&aTimer);
 */
 
-pascal OSErr QTUDoIgnoreMCDrags(MovieController  mc)
+pascal void QTUStartTimer(UnsignedWide *theTimer)
 {
-   OSErr   		anErr = noErr;
-   GWorldPtr  aTempGWorld;
-   Rect 			aTempRect = {0, 0, 20, 20};
-   CGrafPtr 	aPort;
-
-   // First create a 1-bit small 20x20 offscreen.
-   anErr = NewGWorld( &aTempGWorld, 1, &aTempRect, NULL, NULL, 0L );
-   DebugAssert(anErr == noErr);
-
-   if (anErr != noErr)
-   {
-   		aPort = MCGetControllerPort(mc);									// get the current port
-   		MCSetControllerPort(mc, (CGrafPtr)aTempGWorld );		// set mc port to new offscreen
-   		MCDoAction(mc, mcActionSetDragEnabled, (void *)false); // don't want dragging
-  		MCSetControllerPort(mc, aPort);										// restore mc port
-   		DisposeGWorld(aTempGWorld);											// dispose offscreen
-   }
-   return anErr;
+	Microseconds(theTimer);
 }
 
 
 /*______________________________________________________________________
-	QTUPointInMC - Test if a point is placed in the movie controller rect area or not.
+	QTUElapsedMicroseconds - Return the microseconds passed since QTUStartTimer.
 
-pascal Boolean QTUPointInMC(MovieController mc, WindowRef theWindow, Point where)
+pascal double QTUElapsedMicroseconds(const UnsignedWide *theTimer)
 
-mc							is the specified moviecontroller to be used
-theWindow				window used for testing for the hit point
-where						hit point
+theTimer					a timer started with QTUStartTimer
 
 DESCRIPTION
-	QTUPointInMC is a simple test to check where the mouse was clicked inside the window
-	with a movie controller, returns true of the mouse click was inside the movie controller
-	rect. See Peter Hoddie's article in develop# 18 for more details (code is from him as well).
+	QTUElapsedMicroseconds returns the time since the timer was started, as a double so we don't need
+	to care about the 64-bit math.
 */
 
-pascal Boolean QTUPointInMC(MovieController mc, WindowRef theWindow, Point where)
+pascal double QTUElapsedMicroseconds(const UnsignedWide *theTimer)
 {
-	RgnHandle		aRegion;
-	Boolean			result = false;
-	
-	aRegion = MCGetWindowRgn(mc, theWindow);
-   	DebugAssert(aRegion != NULL);
-	
-	if(aRegion != NULL)
-	{
-		result = PtInRgn(where, aRegion);
-		DisposeRgn(aRegion);
-	}
-	
-	return result;
+	UnsignedWide	aNow;
+	double			aStart, anEnd;
+
+	Microseconds(&aNow);
+
+	aStart = (double)theTimer->hi * 4294967296.0 + (double)theTimer->lo;
+	anEnd = (double)aNow.hi * 4294967296.0 + (double)aNow.lo;
+
+	return anEnd - aStart;
 }
 
 
-/*______________________________________________________________________
-	QTUSelectAllMovie - Select the whole movie time duration with the controller.
+// MEMORY FUNCTIONS
 
-pascal OSErr QTUSelectAllMovie(MovieController mc)
+/*______________________________________________________________________
+	QTUGetMemoryInUse - Return how much memory the application uses.
 
-mc						is the specified moviecontroller to be used
+pascal double QTUGetMemoryInUse(void)
 
 DESCRIPTION
-	QTUSelectAllMovie is an example how to select the whole movie duration using the movie
-	controller, this function could be used for Select All menu entries and similar cases.
+	QTUGetMemoryInUse returns the resident size of the task on Mac OS X. On Mac OS 9 it's the memory
+	free in the application heap and in temporary memory, negative, so only the difference of two calls
+	means anything there, which is what it's for: call it before and while doing something to know how
+	much memory that took.
+
+EXAMPLE
+	aStart = QTUGetMemoryInUse();
+	DoSomething();
+	aMemoryUsed = QTUGetMemoryInUse() - aStart;
 */
 
-pascal OSErr QTUSelectAllMovie(MovieController mc)
+pascal double QTUGetMemoryInUse(void)
 {
-	OSErr 			anErr = noErr;
-	TimeRecord  aTimeRecord;
-	Movie 			aMovie = NULL;
-	
-	DebugAssert(mc != NULL);
-	if(mc == NULL) return paramErr;
-	
-	aMovie = MCGetMovie(mc); DebugAssert(aMovie != NULL);
-	if(aMovie == NULL) return paramErr;
-	
-	aTimeRecord.value.hi = 0;
-	aTimeRecord.value.lo = 0;
-	aTimeRecord.base = 0;
-	
-	aTimeRecord.scale = GetMovieTimeScale(aMovie);
-	anErr = GetMoviesError(); DebugAssert(anErr == noErr);
-	if(anErr != noErr) return anErr;
-	
-	anErr = MCDoAction(mc, mcActionSetSelectionBegin, &aTimeRecord);
-	DebugAssert(anErr == noErr);
-	if(anErr != noErr) return anErr;
-	
-	aTimeRecord.value.lo = GetMovieDuration(aMovie);
-	anErr = GetMoviesError(); DebugAssert(anErr == noErr);
-	if(anErr != noErr) return anErr;
-	
-	anErr = MCDoAction(mc, mcActionSetSelectionDuration, &aTimeRecord);
-	DebugAssert(anErr == noErr);
-	
-	return anErr;
+#if TARGET_RT_MAC_MACHO
+	struct task_basic_info	anInfo;
+	mach_msg_type_number_t	aCount = TASK_BASIC_INFO_COUNT;
+
+	if(task_info(mach_task_self(), TASK_BASIC_INFO, (task_info_t)&anInfo, &aCount) != KERN_SUCCESS)
+		return 0;
+
+	return (double)anInfo.resident_size;
+#else
+	return -((double)FreeMem() + (double)TempFreeMem());
+#endif
 }
 
 
-/*______________________________________________________________________
-	 QTUResizeMCActionFilter - Example of a movie controller filter that will resize the window 
-	where the movie is placed when the controllers themself change. 
+// MULTIPROCESSING FUNCTIONS
 
-pascal Boolean QTUResizeMCActionFilter(MovieController mc, short action, void *params, long refCon)
+#define kQTUMaxPoolWorkers		32
 
-mc							specified moviecontroller to be used.
-action						the action for the mc action filter
-params						parameters passed with the action
-refCon  					additional long word that could be used for all kinds of purposes
+struct QTUWorkerPoolRecord {
+	long				workerCount;
+	Boolean				enterMoviesOnThread;						// workers register with the Movie Toolbox, QTUNewMoviesWorkerPool
+	MPQueueID			workQueue;										// work items waiting for a worker
+	MPQueueID			doneQueue;										// finished work items together with their result
+	MPQueueID			terminationQueue;							// notified by MP when a worker task exits
+	MPTaskID			workers[kQTUMaxPoolWorkers];
+};
+
+
+/*______________________________________________________________________
+	QTUCountProcessors - Return the number of processors available for worker tasks.
+
+pascal long QTUCountProcessors(void)
 
 DESCRIPTION
-	QTUResizeMCActionFilter is an example of how to create a nice movie controller filter that 
-	will handle resizing of the window with the movie, and this will happen every time the controllers
-	themselves change. It's also an example of how to write other kinds of movie controller filters.
+	QTUCountProcessors returns the number of processors Multiprocessing Services could schedule
+	tasks on. If the Multiprocessing library is not present we return 1, so the result could always
+	be used directly as a worker count.
 */
 
-pascal Boolean QTUResizeMCActionFilter(MovieController mc, short action, void* params , long refCon)
+pascal long QTUCountProcessors(void)
 {
-	#pragma unused (params)
-	Rect aMovieBounds;
-	
-	switch(action)
-	{
-		case mcActionControllerSizeChanged:
-			MCGetControllerBoundsRect(mc, &aMovieBounds);
-			SizeWindow((WindowPtr) refCon, aMovieBounds.right - aMovieBounds.left,
-								aMovieBounds.bottom - aMovieBounds.top, true);
-			break;
-	}
-		return false;
+	if(!MPLibraryIsLoaded())
+		return 1;
+
+	return MPProcessors();
 }
 
 
 /*______________________________________________________________________
-	QTUResizeMCWindow - Resize a window to either normal size, double size or  half of the movie rect size.
+	QTUCanUseMoviesOnThreads - Check if worker tasks could call the Movie Toolbox.
 
-pascal Boolean QTUResizeMCWindow(MovieController mc, WindowPtr theWindow, long theMovieSize, Rect originalSize)
-
-mc								specified moviecontroller to be used
-theWindow					window that will be resized
-theMovieSize				constant that defines what default size we are interested in,  kNormalSize, kHalfSize, kDoubleSize
-originalSize					the original size of the movie, we need to keep track of this one in order to handle the 
- 									ambient new sizes (half, double, normal).
+pascal Boolean QTUCanUseMoviesOnThreads(void)
 
 DESCRIPTION
-	QTUResizeMCWindow is an example of a function how to resize the movie window with the controllers.
-	The most common cases is half size, normal size or double size. But nothing hinders to add more sizes
-	into this function. Note that if the movie window is doubled, we will get pixel-doubling by the QuickTime
-	engine.
+	The Image Compression Manager and the codecs can be called from preemptive tasks only in Mach-O
+	code with QuickTime 6.4 or later, where a task can register with EnterMoviesOnThread. Anywhere
+	else they are not MP safe: calling them from a task doesn't fail, it can crash. Work that uses
+	them has to stay on the main thread if QTUCanUseMoviesOnThreads returns false.
 */
 
-pascal OSErr QTUResizeMCWindow(MovieController mc, WindowPtr theWindow, long theMovieSize, Rect originalSize)
+pascal Boolean QTUCanUseMoviesOnThreads(void)
 {
-	OSErr 		anErr = noErr;
-	Rect 			aMovieBounds;
-	GrafPtr 	aSavedPort;
-	
-	DebugAssert(mc != NULL); if(mc == NULL) return paramErr;
-	DebugAssert(theWindow != NULL); if(theWindow == NULL) return paramErr;
-	
-	GetPort(&aSavedPort);
-	SetPort((GrafPtr)theWindow);
-	
-	aMovieBounds.top = 0; aMovieBounds.left = 0;
-
-	switch(theMovieSize)
-	{
-		case kNormalMovieSize:
-				MCSetControllerBoundsRect(mc, &originalSize);
-				SizeWindow(theWindow, originalSize.right, originalSize.bottom, true);
-			break;
-		
-		case kHalfMovieSize:
-				aMovieBounds.right = (originalSize.right - originalSize.left) / 2;
-				aMovieBounds.bottom = (originalSize.bottom - originalSize.top) / 2;
-				MCSetControllerBoundsRect(mc, &aMovieBounds);
-				SizeWindow(theWindow, aMovieBounds.right, aMovieBounds.bottom, true);
-			break;
-		
-		case kDoubleMovieSize:
-				aMovieBounds.right = (originalSize.right - originalSize.left) * 2;
-				aMovieBounds.bottom = (originalSize.bottom - originalSize.top) * 2;
-				MCSetControllerBoundsRect(mc, &aMovieBounds);
-				SizeWindow(theWindow, aMovieBounds.right, aMovieBounds.bottom, true);
-			break;
-		
-		default:
-			SetPort(aSavedPort);
-			anErr = paramErr;
-	}
-	
-	SetPort(aSavedPort);
-	return anErr;
+#if TARGET_RT_MAC_MACHO
+	return MPLibraryIsLoaded() && (QTUGetQTVersion() >> 16) >= 0x0640;
+#else
+	return false;
+#endif
 }
 
 
 /*______________________________________________________________________
-	QTUResizeMCWindow -Change the movie rate using the movie controller. 
+	QTUWorkerPoolTask - The task function every pool worker is running.
 
-pascal OSErr QTUMCSetMovieRate(MovieController mc, long theRate)
+static OSStatus QTUWorkerPoolTask(void *theParameter)
 
-mc							specified moviecontroller to be used
-theRate						new rate value, we are using specific constants, see the eQTUMovieRates enum
-								in the DTSQTUtilities.h file concerning the values.
+theParameter				the QTUWorkerPool the worker belongs to
 
 DESCRIPTION
-	QTUMCSetMovieRate will use an existing movie controller and change the rate. This is a very 
-	simple function, but we do have a list of constants that shows the various values that could be used 
-	(eQTUMovieRates, DTSQTUtilities.h), and also it shows that if the rate changes from 0 to something 
-	else, then we need to preroll the movie. The Apple MM Tuner will make sure the movie is prerolled,
-	but we can't assume that every Mac has this extension installed, that's why it's still very important
-	to preroll.
-	
-ISSUES
-	Note that movies have stored preferred rates, so if you want to compensate for this factor you need
-	to read in this value as well before setting a double or half speed value.
+	QTUWorkerPoolTask waits on the work queue, runs the work function found there, and posts the work
+	item together with the result on the done queue. A NULL work function is the signal to quit.
+
+	Workers of a QTUNewMoviesWorkerPool are known by the Movie Toolbox, and they only use thread safe
+	components. If a codec is not thread safe the work function will get an error back, and the caller
+	could then redo the work on the main thread.
 */
 
-pascal OSErr QTUMCSetMovieRate(MovieController mc, long theRate)
+static OSStatus QTUWorkerPoolTask(void *theParameter)
 {
-	OSErr 	anErr = noErr;
-	Fixed 	aRate;
-	
-	DebugAssert(mc != NULL);  
-	if(mc == NULL)
+	QTUWorkerPool	aPool = (QTUWorkerPool)theParameter;
+	void			*aWorkProc, *aWorkItem, *unused;
+	OSStatus		aResult;
+
+#if TARGET_RT_MAC_MACHO
+	if(aPool->enterMoviesOnThread)
 	{
-		anErr = paramErr; goto Closure;
+		EnterMoviesOnThread(0);
+		CSSetComponentsThreadMode(kCSAcceptThreadSafeComponentsOnlyMode);
 	}
-	
-	// Test if the playrate changes from 0 to a non-zero value, if so then preroll the movie.
-	MCDoAction(mc, mcActionGetPlayRate, &aRate);
-	if( (aRate == 0) && (theRate != 0) )
+#endif
+
+	while(MPWaitOnQueue(aPool->workQueue, &aWorkProc, &aWorkItem, &unused, kDurationForever) == noErr)
 	{
-		anErr = QTUPrerollMovie(MCGetMovie(mc));			// we are using the DTSQTUtilities function
-		DebugAssert(anErr == noErr);
-		if(anErr != noErr) return anErr;
+		if(aWorkProc == NULL)
+			break;			// asked to quit
+
+		aResult = ((QTUWorkProcPtr)aWorkProc)(aWorkItem);
+		MPNotifyQueue(aPool->doneQueue, aWorkItem, (void *)aResult, NULL);
 	}
-		
-	anErr = MCDoAction(mc, mcActionPlay, (Ptr) theRate); DebugAssert(anErr == noErr);
 
-Closure:	
-	return anErr;
+#if TARGET_RT_MAC_MACHO
+	if(aPool->enterMoviesOnThread)
+		ExitMoviesOnThread();
+#endif
+
+	return noErr;
 }
 
-// SEQUENCE GRABBER FUNCTIONS
+
 /*______________________________________________________________________
-	QTUCreateSequenceGrabber - Create an instance of a sequence grabber for specified window.
+	QTUCreateWorkerPool - Create the tasks of a worker pool.
 
-pascal SeqGrabComponent QTUCreateSequenceGrabber(WindowPtr theWindow)
+static OSErr QTUCreateWorkerPool(long theWorkerCount, Boolean theEnterMovies, QTUWorkerPool *thePool)
+*/
 
-theWindow					window where the sequence grabber will operate
+static OSErr QTUCreateWorkerPool(long theWorkerCount, Boolean theEnterMovies, QTUWorkerPool *thePool)
+{
+	OSErr				anErr = noErr;
+	QTUWorkerPool		aPool = NULL;
+	long				index;
 
-DESCRIPTION
-	QTUCreateSequenceGrabber will try to open the default sequence grabber component and 
-	make sure this component will work in the GWorld of a specified window. 
+	DebugAssert(thePool != NULL); if(thePool == NULL) return paramErr;
+	*thePool = NULL;
 
-	If we don't find a suitable sequence grabber, or if we encounter problems, we will return NULL.
-*/
+	if(!MPLibraryIsLoaded())
+		return unimpErr;
 
+	if(theWorkerCount <= 0)
+		theWorkerCount = QTUCountProcessors();
+	if(theWorkerCount > kQTUMaxPoolWorkers)
+		theWorkerCount = kQTUMaxPoolWorkers;
 
-pascal SeqGrabComponent QTUCreateSequenceGrabber(WindowPtr theWindow)
-{
-	OSErr anErr = noErr;
-	SeqGrabComponent s = NULL;
+	aPool = (QTUWorkerPool)NewPtrClear(sizeof(struct QTUWorkerPoolRecord)); DebugAssert(aPool != NULL);
+	if(aPool == NULL) return memFullErr;
 
-	DebugAssert(theWindow != NULL); if(theWindow == NULL) goto Closure;
+	aPool->enterMoviesOnThread = theEnterMovies;
 
-	s = OpenDefaultComponent(SeqGrabComponentType, 0);
+	anErr = MPCreateQueue(&aPool->workQueue); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+	anErr = MPCreateQueue(&aPool->doneQueue); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
+	anErr = MPCreateQueue(&aPool->terminationQueue); DebugAssert(anErr == noErr);
+	if(anErr != noErr) goto Closure;
 
-	if(s) // we got a valid one
+	for(index = 0; index < theWorkerCount; index++)
 	{
-		anErr = SGInitialize(s); DebugAssert(anErr == noErr);
+		anErr = MPCreateTask(QTUWorkerPoolTask, aPool, 0, aPool->terminationQueue, NULL, NULL, 0,
+									&aPool->workers[index]); DebugAssert(anErr == noErr);
 		if(anErr != noErr) goto Closure;
 
-		anErr = SGSetGWorld(s, (CGrafPtr)theWindow, NULL); DebugAssert(anErr == noErr);
-		if(anErr != noErr) goto Closure;
+		aPool->workerCount++;
 	}
 
-	return s;
+	*thePool = aPool;
+	return noErr;
+
 Closure:
-	return NULL;
+	QTUDisposeWorkerPool(aPool);
+	return anErr;
 }
 
-/*______________________________________________________________________
-	QTUCreateSGGrabChannels - Create SG channels, video and audio.
 
-pascal OSErr QTUCreateSGGrabChannels(SeqGrabComponent s, const Rect *theBounds, long theUsage,
-																SGChannel *theVideoChannel, SGChannel *theSoundChannel)
+/*______________________________________________________________________
+	QTUNewWorkerPool - Create a pool of preemptive worker tasks.
 
-s							current active sequence grabber component instance
-theBounds				the size of the video channel sequence grabber area
-theUsage				any additional flags for the video SG
-theVideoChannel	pointer to the video channel we will receive
-theSoundChannel	pointer to the audio channel we will receive
+pascal OSErr QTUNewWorkerPool(long theWorkerCount, QTUWorkerPool *thePool)
 
+theWorkerCount				the amount of workers, 0 means one worker per processor
+thePool						will contain the new pool when the function exits
 
 DESCRIPTION
-	QTUCreateSGGrabChannels will create video and audio SG channels (SGChannels) using the specified
-	default SG component.
+	QTUNewWorkerPool creates a set of Multiprocessing Services tasks that are sharing one work queue.
+	Work is handed to the pool with QTUWorkerPoolSubmit, and the results are collected with
+	QTUWorkerPoolWaitForItem, in the order the workers finish them (not in the order they were
+	submitted, the caller has to sort that out if order matters). The workers of this pool must not
+	call the Movie Toolbox or the Image Compression Manager, use QTUNewMoviesWorkerPool for that.
 
-ISSUES
-	We will terminate whenever we can't properly create  a channel (sound, audio), if you still want to
-	retrieve a valid channel (let's say the sound one is OK while the we can't open an audio one), you
-	could slightly rewrite this code.
+EXAMPLE
+	anErr = QTUNewWorkerPool(0, &aPool);
+	anErr = QTUWorkerPoolSubmit(aPool, MyWorkProc, &myItem);
+	anErr = QTUWorkerPoolWaitForItem(aPool, &anItem, &aResult);
+	QTUDisposeWorkerPool(aPool);
 */
 
-pascal OSErr QTUCreateSGGrabChannels(SeqGrabComponent s, const Rect *theBounds, long theUsage,
-																SGChannel *theVideoChannel, SGChannel *theSoundChannel)
+pascal OSErr QTUNewWorkerPool(long theWorkerCount, QTUWorkerPool *thePool)
 {
-	OSErr 	anErr = noErr;
-	long		sgUsage = seqGrabPreview;	// default at least this flag	
+	return QTUCreateWorkerPool(theWorkerCount, false, thePool);
+}
 
-	DebugAssert(s != NULL); if(s == NULL) return badSGChannel;
 
-	sgUsage |= theUsage;						// add any other usage flag info now
+/*______________________________________________________________________
+	QTUNewMoviesWorkerPool - Create a pool of worker tasks that could compress and decompress.
 
-	// Create Video Channel.
-	anErr = SGNewChannel(s, VideoMediaType, theVideoChannel); DebugAssert(anErr == noErr);
-	if(anErr != noErr) goto FailureHandling;
-	
-	anErr = SGSetChannelBounds(*theVideoChannel, theBounds); DebugAssert(anErr == noErr);
-	if(anErr != noErr) goto FailureHandling;
+pascal OSErr QTUNewMoviesWorkerPool(long theWorkerCount, QTUWorkerPool *thePool)
 
-	anErr = SGSetChannelUsage(*theVideoChannel, sgUsage); DebugAssert(anErr == noErr);
-	if(anErr != noErr) goto FailureHandling;
+theWorkerCount				the amount of workers, 0 means one worker per processor
+thePool						will contain the new pool when the function exits
 
-	// Create Sound Channel.
-	anErr = SGNewChannel(s, SoundMediaType, theSoundChannel); DebugAssert(anErr == noErr);
-	if(anErr != noErr) goto FailureHandling;
+DESCRIPTION
+	QTUNewMoviesWorkerPool is QTUNewWorkerPool for workers that call the Image Compression Manager,
+	every worker registers with the Movie Toolbox. It returns unimpErr if that's not possible (see
+	QTUCanUseMoviesOnThreads), the work has to be done on the main thread then.
+*/
 
-	anErr = SGSetChannelUsage(*theSoundChannel, sgUsage); DebugAssert(anErr == noErr);
-	if(anErr != noErr) goto FailureHandling;
+pascal OSErr QTUNewMoviesWorkerPool(long theWorkerCount, QTUWorkerPool *thePool)
+{
+	DebugAssert(thePool != NULL); if(thePool == NULL) return paramErr;
+	*thePool = NULL;
 
+	if(!QTUCanUseMoviesOnThreads())
+		return unimpErr;
 
-	return anErr;
+	return QTUCreateWorkerPool(theWorkerCount, true, thePool);
+}
 
-FailureHandling:
-	SGDisposeChannel(s, *theVideoChannel); *theVideoChannel = NULL;
-	SGDisposeChannel(s, *theSoundChannel); *theSoundChannel = NULL;
+
+/*______________________________________________________________________
+	QTUWorkerPoolSubmit - Queue a work item for the worker pool.
+
+pascal OSErr QTUWorkerPoolSubmit(QTUWorkerPool thePool, QTUWorkProcPtr theWorkProc, void *theWorkItem)
+
+thePool						the pool that should do the work
+theWorkProc					the function that will be called (on a worker task) with the work item
+theWorkItem					the work item, it's also what QTUWorkerPoolWaitForItem will return later
+
+DESCRIPTION
+	QTUWorkerPoolSubmit hands a work item to the first worker that is idle. Note that the work
+	function is running preemptively, so it should not call anything that is not MP safe.
+*/
+
+pascal OSErr QTUWorkerPoolSubmit(QTUWorkerPool thePool, QTUWorkProcPtr theWorkProc, void *theWorkItem)
+{
+	OSErr anErr = noErr;
+
+	DebugAssert(thePool != NULL); if(thePool == NULL) return paramErr;
+	DebugAssert(theWorkProc != NULL); if(theWorkProc == NULL) return paramErr;
+
+	anErr = MPNotifyQueue(thePool->workQueue, (void *)theWorkProc, theWorkItem, NULL); DebugAssert(anErr == noErr);
 
 	return anErr;
 }
 
 
 /*______________________________________________________________________
-	QTUDoesVDIGReceiveVideo - Test if vdig receives a live incoming video signal.
+	QTUWorkerPoolWaitForItem - Wait for the next work item the pool has finished.
 
-pascal Boolean QTUDoesVDIGReceiveVideo(SeqGrabComponent s)
+pascal OSErr QTUWorkerPoolWaitForItem(QTUWorkerPool thePool, void **theWorkItem, OSStatus *theWorkResult)
 
-s					our sequence grabber component instance
+thePool						the pool doing the work
+theWorkItem					will contain the finished work item
+theWorkResult				will contain the value the work function returned
 
 DESCRIPTION
-	QTUDoesVDIGReceiveVideo test if the currently active vdig is receiving an incoming, live 
-	video signal. We assume that all well behaved vdigs set the digiInSignalLock flag.
-
+	QTUWorkerPoolWaitForItem blocks until a worker is done with an item. Make sure there is something
+	submitted before calling this one, otherwise we will wait forever.
 */
-pascal Boolean QTUDoesVDIGReceiveVideo(SeqGrabComponent s)
-{
-	OSErr		anErr = noErr;
-	long		inputFlags, outFlags;
 
-	DebugAssert(s != NULL); if(s == NULL) goto Closure;
+pascal OSErr QTUWorkerPoolWaitForItem(QTUWorkerPool thePool, void **theWorkItem, OSStatus *theWorkResult)
+{
+	OSErr	anErr = noErr;
+	void	*aResult, *unused;
 
-	anErr = VDGetCurrentFlags(s, &inputFlags, &outFlags); DebugAssert(anErr == noErr);
-	if(anErr != noErr) goto Closure;
+	DebugAssert(thePool != NULL); if(thePool == NULL) return paramErr;
 
-	if(inputFlags & digiInSignalLock)
-		return true;
+	anErr = MPWaitOnQueue(thePool->doneQueue, theWorkItem, &aResult, &unused, kDurationForever); DebugAssert(anErr == noErr);
+	if(anErr == noErr && theWorkResult != NULL)
+		*theWorkResult = (OSStatus)aResult;
 
-Closure:
-	return false;
+	return anErr;
 }
 
 
 /*______________________________________________________________________
-	QTUChangeSGWindowSize - Change window size of the video sequence grabber window.
+	QTUDisposeWorkerPool - Stop all the workers and dispose the worker pool.
 
-pascal OSErr QTUChangeSGWindowSize(SeqGrabComponent s, SGChannel videoChannel, 
-							WindowPtr theWindow, long width, long height)
+pascal void QTUDisposeWorkerPool(QTUWorkerPool thePool)
 
-s			our sequence grabber component instance
-videoChannel	the specified (currently used) video channel
-theWindow		window used for the digitizing sequence
-width			new width of the digitizer rect
-height			new height of the digitizer rect
+thePool						the pool to get rid of
 
 DESCRIPTION
-	QTUChangeSGWindowSize shows how to change the window size for the current digitizing sequence
-	taking place in the window. This is more of an example function as there might be other issues
-	to be taken into account (such as preference settings and similar issues) while changing the
-	bounds of the digitizing rect.
-
+	QTUDisposeWorkerPool tells every worker to quit, and waits until all of them have exited before
+	deleting the queues. Collect all the submitted work items before calling this function, any
+	results still waiting in the done queue are lost.
 */
 
-pascal OSErr QTUChangeSGWindowSize(SeqGrabComponent s, SGChannel videoChannel, WindowPtr theWindow, long width, long height)
+pascal void QTUDisposeWorkerPool(QTUWorkerPool thePool)
 {
-	OSErr		anErr = noErr;
-    Rect		portRect;
-         
-	DebugAssert(theWindow != NULL); if(theWindow == NULL) return paramErr;
-	DebugAssert(s != NULL); if(s == NULL) return badSGChannel;
-	DebugAssert(videoChannel != NULL); if(videoChannel == NULL) return badSGChannel;
+	long	index;
+	void	*unused1, *unused2, *unused3;
 
-	anErr = SGPause(s, true); DebugAssert(anErr == noErr); if(anErr != noErr) goto Closure;
+	if(thePool == NULL) return;
 
-	SizeWindow(theWindow, width, height, false);
-#if TARGET_OS_WIN32
-	anErr = SGSetChannelBounds(videoChannel, &theWindow->portRect); DebugAssert(anErr == noErr);
-#else
-	GetWindowBounds(theWindow, kWindowContentRgn, &portRect);
-	anErr = SGSetChannelBounds(videoChannel, &portRect); DebugAssert(anErr == noErr);
-#endif
-	if(anErr != noErr) goto Closure;
+	for(index = 0; index < thePool->workerCount; index++)
+		MPNotifyQueue(thePool->workQueue, NULL, NULL, NULL);
 
-	anErr = SGPause(s, false); DebugAssert(anErr == noErr); 
+	for(index = 0; index < thePool->workerCount; index++)
+		MPWaitOnQueue(thePool->terminationQueue, &unused1, &unused2, &unused3, kDurationForever);
 
-Closure:
-	return anErr;
+	if(thePool->workQueue) MPDeleteQueue(thePool->workQueue);
+	if(thePool->doneQueue) MPDeleteQueue(thePool->doneQueue);
+	if(thePool->terminationQueue) MPDeleteQueue(thePool->terminationQueue);
+
+	DisposePtr((Ptr)thePool);
 }
 
 
+// The ring is lock free for one producer and one consumer: only the producer moves the head and only the consumer
+// moves the tail, the barriers make sure an item is in its slot before the other side sees the new count.
+struct QTURingRecord {
+	UInt32				capacity;						// a power of two
+	volatile UInt32		head;								// items pushed so far
+	volatile UInt32		tail;								// items popped so far
+	void				* volatile *items;
+};
 
-// COMPONENT FUNCTIONS
 
 /*______________________________________________________________________
-	QTUDoGetComponent - Get a specific component based on component type and component sub-type.
+	QTUNewRing - Create a lock free ring of pointers between two tasks.
 
-pascal Component QTUDoGetComponent(OSType theComponentType, OSType theSpecificComponent)
+pascal OSErr QTUNewRing(long theCapacity, QTURing *theRing)
 
-theComponentType					the component type we are interested in
-theSpecificComponent				the specific component sub-type we are interested int
+theCapacity					the amount of items the ring holds at least
+theRing						will contain the new ring when the function exits
 
 DESCRIPTION
-	QTUDoGetComponent will get a specific component based on the component type and sub-type.  We have 
-	special code for particular components (for instance movieImporttype and movieExporttype), so
-	if we specify such types, the function will narrow down the search further for the right components.
-	
-	The specificComponent is just the special component we want to search for, if the component type is 
-	NULL, then the Specific component is the one and only we are interested in. Note that we don't care 
-	about the manufacturer information in this function. 
-	
-	If we don't find a suitable component we will return NULL.
+	A QTURing hands items from one task (the producer, the only one calling QTURingPush) to one
+	other task (the consumer, the only one calling QTURingPop) without locks or MP queues, so
+	neither side ever blocks. A sequence grabber data proc can push frames into it while a worker
+	task is compressing them. The capacity is rounded up to a power of two.
 */
 
-pascal Component QTUDoGetComponent(OSType theComponentType, OSType theSpecificComponent)
+pascal OSErr QTUNewRing(long theCapacity, QTURing *theRing)
 {
-	ComponentDescription 	aCD;
-	Component 					aComponent = NULL;
-	
-	aCD.componentType = theComponentType;
-	aCD.componentSubType = theSpecificComponent;
-	aCD.componentManufacturer = 0;
-	
-	// The following code is inserted for special handling of some known cases.
-	if(theComponentType == MovieImportType)
-	{
-		aCD.componentFlags = canMovieImportFiles;
-		aCD.componentFlagsMask = canMovieImportFiles;
-	}
-	else if(theComponentType == MovieExportType)
+	QTURing		aRing;
+	UInt32		aCapacity = 1;
+
+	DebugAssert(theRing != NULL); if(theRing == NULL) return paramErr;
+	*theRing = NULL;
+
+	if(theCapacity <= 0) return paramErr;
+	while(aCapacity < (UInt32)theCapacity)
+		aCapacity <<= 1;
+
+	aRing = (QTURing)NewPtrClear(sizeof(struct QTURingRecord)); DebugAssert(aRing != NULL);
+	if(aRing == NULL) return memFullErr;
+
+	aRing->items = (void * volatile *)NewPtrClear(aCapacity * sizeof(void *)); DebugAssert(aRing->items != NULL);
+	if(aRing->items == NULL)
 	{
-		aCD.componentFlags = canMovieExportFiles;
-		aCD.componentFlagsMask = canMovieExportFiles;
+		DisposePtr((Ptr)aRing);
+		return memFullErr;
 	}
+	aRing->capacity = aCapacity;
 
-	// OK, get the component.
-	aComponent = FindNextComponent((Component)0, &aCD);
-	
-	return aComponent;
+	*theRing = aRing;
+	return noErr;
 }
 
 
 /*______________________________________________________________________
-	QTUHasComponentType -Query for a specific component based on component type and 
-	component sub-type.
+	QTURingPush - Add an item to a ring, only called by the producer.
 
-pascal Boolean QTUHasComponentType(OSType theComponentType, OSType theSpecificComponent)
+pascal Boolean QTURingPush(QTURing theRing, void *theItem)
 
-theComponentType					the component type we are interested in
-theSpecificComponent				the specific component sub-type we are interested int
+DESCRIPTION
+	Returns false if the ring is full, the item was not added then.
+*/
+
+pascal Boolean QTURingPush(QTURing theRing, void *theItem)
+{
+	UInt32 aHead = theRing->head;
+
+	if(aHead - theRing->tail >= theRing->capacity)
+		return false;
+
+	theRing->items[aHead & (theRing->capacity - 1)] = theItem;
+	QTUMemoryBarrier();							// the item first, then the count
+	theRing->head = aHead + 1;
+
+	return true;
+}
+
+
+/*______________________________________________________________________
+	QTURingPop - Take the oldest item from a ring, only called by the consumer.
+
+pascal Boolean QTURingPop(QTURing theRing, void **theItem)
 
 DESCRIPTION
-	QTUDoGetComponent will query for a specific component based on the component type and sub-type.  
-	We have special code for particular components (for instance movieImporttype and movieExporttype),
-    so if we query for such types, the function will narrow down the search further for the right 
-	components.
-	
-	The specificComponent is just the special component we want to search for, if the component 
-	type is NULL, then the Specific component is the one and only we are interested in. Note that we 
-	don't care about the manufacturer information in this function. 
-	
-	If we don't find a suitable component we will return false, otherwise we will return true.
+	Returns false if the ring is empty.
 */
 
-pascal Boolean QTUHasComponentType(OSType theComponentType, OSType theSpecificComponent)
+pascal Boolean QTURingPop(QTURing theRing, void **theItem)
 {
-	ComponentDescription aCD;
-	
-	aCD.componentType = theComponentType;
-	aCD.componentSubType = theSpecificComponent;
-	aCD.componentManufacturer = 0;
-	
-	if(theComponentType == MovieImportType)
-	{
-		aCD.componentFlags = canMovieImportFiles;
-		aCD.componentFlagsMask = canMovieImportFiles;
-	}
-	else if(theComponentType == MovieExportType)
-	{
-		aCD.componentFlags = canMovieExportFiles;
-		aCD.componentFlagsMask = canMovieExportFiles;
-	}
+	UInt32 aTail = theRing->tail;
 
-	if(FindNextComponent((Component)0, &aCD) != NULL)
-		return true;
-	else
+	if(aTail == theRing->head)
 		return false;
+
+	QTUMemoryBarrier();							// the count first, then the item
+	*theItem = theRing->items[aTail & (theRing->capacity - 1)];
+	QTUMemoryBarrier();							// done with the slot before the producer gets it back
+	theRing->tail = aTail + 1;
+
+	return true;
+}
+
+
+/*______________________________________________________________________
+	QTURingCount - Return the amount of items in a ring.
+
+pascal long QTURingCount(QTURing theRing)
+
+DESCRIPTION
+	Either side could call this, the count could be out of date as soon as it's returned.
+*/
+
+pascal long QTURingCount(QTURing theRing)
+{
+	return (long)(theRing->head - theRing->tail);
+}
+
+
+/*______________________________________________________________________
+	QTUDisposeRing - Dispose a ring, the items in it are not touched.
+
+pascal void QTUDisposeRing(QTURing theRing)
+*/
+
+pascal void QTUDisposeRing(QTURing theRing)
+{
+	if(theRing == NULL) return;
+
+	DisposePtr((Ptr)theRing->items);
+	DisposePtr((Ptr)theRing);
 }
 
 
@@ -62,6 +62,7 @@
 #include <Components.h>
 #include <QuickTimeComponents.h>
 #include <FixMath.h>
+#include <Multiprocessing.h>
 
 #include <stdio.h>
 
@@ -91,6 +92,14 @@ enum eQTUMovieRates {	kNoSpeed = 0x00000000,  kFwdSpeed = 0x00010000,
 enum eQTUPICTPrinting { kPrintFrame = 1, kPrintPoster };
 
 
+// Filters used by QTUNewResampler.
+enum eQTUResampleFilter { kQTUResampleBox = 0, kQTUResampleBilinear, kQTUResampleLanczos };
+
+
+// Transitions made by QTUNewCompositor.
+enum eQTUTransition { kQTUTransitionScroll = 1, kQTUTransitionWipe };
+
+
 // MACROS
 #if DEBUG
 static char gDebugString[256];
@@ -136,6 +145,7 @@ pascal Movie 			QTUGetMovie(FSSpec *theFSSpec, short *theRefNum, short *theResID
 pascal OSErr 			QTUSimpleGetMovie(Movie *theMovie);																		// Simpler version of querying for a movie and return it.
 pascal OSErr 			QTUSaveMovie(Movie theMovie);																					// Save the movie (standard dialog box).
 pascal OSErr			QTUFlattenMovieFile(Movie theMovie, FSSpec *theFile);												// Takes a movie and a file and flattens the movie into the file.
+pascal OSErr			QTUFlattenAndDisposeMovie(Movie *theMovie, FSSpec *theFile);										// Flatten a movie into a file, clear the movie once it's disposed.
 pascal OSErr			QTUPrintMoviePICT(Movie theMovie, short x, short y, long PICTUsed);   						// Print the movie poster.
 pascal OSErr			QTUCalculateMovieMemorySize(Movie theMovie, long *theSize);									// Return the size of the movie in memory.
 pascal OSErr			QTULoadWholeMovieToRAM(Movie theMovie);																// Load the whole movie to RAM.
@@ -146,14 +156,81 @@ pascal OSErr 			QTUScrollToNextVideoSample(Movie theMovie, TimeValue fromTimePoi
 pascal OSErr 			QTUGetStartPointOfFirstVideoSample(Movie theMovie,TimeValue *startPoint);				// Get time value of first sample in the movie.
 
 // TRACK & MEDIA
+typedef struct QTUMediaSampleStatistics {
+	long				sampleCount;					// samples in the media
+	long				syncSampleCount;				// key frames, from the sync sample table
+	TimeValue			duration;						// media duration
+	TimeScale			timeScale;						// media time scale
+	double				totalDataSize;					// bytes of sample data
+	long				minDataSize;					// smallest sample
+	long				maxDataSize;					// largest sample
+	double				meanDataSize;					// bytes per sample
+	long				tableEntries;					// sample references read from the table
+} QTUMediaSampleStatistics;
+
+typedef struct QTUTrackInfo {
+	Track				track;
+	long				trackID;
+	OSType				mediaType;
+	Boolean				enabled;
+	TimeValue			duration;						// track duration, in the movie time scale
+	TimeScale			timeScale;						// media time scale
+	TimeValue			mediaDuration;
+	Fixed				width;							// track dimensions
+	Fixed				height;
+	long				dataSize;						// bytes of media data
+	long				sampleCount;
+	long				sampleDescriptionCount;
+	OSType				dataFormat;						// first sample description: codec or sound format
+	short				depth;							// video
+	Fixed				sampleRate;						// sound
+	short				channels;
+	short				sampleSize;
+} QTUTrackInfo;
+
+typedef struct QTUTrackCatalog {
+	Movie				movie;
+	long				modificationTime;				// of the movie when the catalog was built
+	long				trackCount;
+	QTUTrackInfo		tracks[1];						// trackCount of them, in movie track order
+} QTUTrackCatalog;
+
+pascal OSErr			QTUGetTrackCatalog(Movie theMovie, QTUTrackCatalog **theCatalog);								// Get what's in every track of a movie.
+pascal QTUTrackInfo *	QTUFindTrackInfo(QTUTrackCatalog *theCatalog, OSType theMediaType, long theIndex);				// Find a track of a media type in a catalog.
+pascal void				QTUForgetTrackCatalog(Movie theMovie);															// Drop the catalog of a movie before disposing it.
 pascal Boolean 			QTUMediaTypeInTrack(Movie theMovie, OSType theMediaType);									// Check if a Media type is present in a track of a movie.
 pascal OSErr			QTUGetTrackRect(Track theTrack, Rect *theRect);														// Get the track rect of a possible video track
 pascal short 			QTUGetVideoMediaPixelDepth(Media theMedia, short index);											// Get the pixel depth of a video media.
 pascal long				QTUCountMediaSamples(Movie theMovie, OSType theMediaType);									// Count frames in a movie based on defined media.
+pascal OSErr			QTUGetMediaSampleStatistics(Media theMedia, QTUMediaSampleStatistics *theStatistics);		// Count samples and sizes from the sample table.
+pascal OSErr			QTUHashMovieContent(Movie theMovie, long theSampledCount, UInt32 theHash[2]);				// Fingerprint a movie by its sample tables and some samples.
+pascal OSErr			QTUTimeMediaSampleCounting(Movie theMovie, OSType theMediaType, double *theByTimeMicroseconds,
+											double *theByTableMicroseconds, Boolean *theSameCount);						// Benchmark the two ways of counting samples.
 pascal TimeValue  		QTUGetDurationOfFirstMovieSample(Movie theMovie, OSType theMediaType)	;				// Get duration of first sample in the track
 pascal OSErr 			QTUCountMaxSoundRate(Movie theMovie,long *theMaxSoundRate);								// Return max sound rate from a sound track in a movie.
 pascal long 				QTUGetMovieFrameCount(Movie theMovie, long theFrameRate);										// Return frames based on frame rate and movie.
 pascal OSErr 			QTUCopySoundTracks(Movie theSrcMovie, Movie theDestMovie);									// Copy sound tracks from source movie to destination movie
+pascal OSErr 			QTUCopySoundTrackSegments(Movie theSrcMovie, Movie theDestMovie, TimeValue theStartTime, TimeValue theDuration);	// Copy a part of the sound tracks
+
+// Sample writer, appends samples to a media in chunk sized batches.
+typedef struct QTUSampleWriterRecord *QTUSampleWriter;
+
+typedef struct QTUSampleWriterStatistics {
+	long				samplesWritten;
+	long				chunksWritten;								// one data write and one sample table update each
+	long				bytesWritten;
+	long				writeWaits;									// times the caller waited for a chunk write in flight
+	double				writeWaitMicroseconds;
+} QTUSampleWriterStatistics;
+
+pascal OSErr			QTUNewSampleWriter(Media theMedia, TimeValue theChunkDuration, long theChunkSize, QTUSampleWriter *theWriter);	// Create a batching sample writer.
+pascal OSErr			QTUSampleWriterAddSample(QTUSampleWriter theWriter, Ptr theData, long theDataSize, TimeValue theDuration,
+											SampleDescriptionHandle theDescription, short theSampleFlags);		// Add a sample, written when the chunk is full.
+pascal OSErr			QTUSampleWriterFlush(QTUSampleWriter theWriter);													// Write the chunk collected so far.
+pascal OSErr			QTUSampleWriterSetWriteBehind(QTUSampleWriter theWriter, long theWritesInFlight);				// Let the chunk writes run behind the caller.
+pascal OSErr			QTUSampleWriterSync(QTUSampleWriter theWriter);													// Wait for the chunk writes, flush them to disk.
+pascal void				QTUSampleWriterGetStatistics(QTUSampleWriter theWriter, QTUSampleWriterStatistics *theStatistics);
+pascal OSErr			QTUDisposeSampleWriter(QTUSampleWriter theWriter);												// Flush and dispose the sample writer.
 
 
 // IMAGE COMPRESSION MANAGER
@@ -183,6 +260,208 @@ pascal OSErr 			QTUChangeSGWindowSize(SeqGrabComponent s,SGChannel videoChannel,
 pascal Component 		QTUDoGetComponent(OSType theComponentType, OSType theSpecificComponent);
 pascal Boolean 			QTUHasComponentType(OSType theComponentType, OSType theSpecificComponent);
 
+// Capability registry, what the installed codecs and components can do, kept between launches.
+typedef struct QTUCodecCapability {
+	CodecType			cType;
+	long				formatFlags;					// codecInfoDepth16 and so on, from GetCodecInfo
+	long				compressFlags;
+	Boolean				doesTemporal;
+	unsigned short		losslessDepths;					// a bit for each of the depths 1, 2, 4, 8, 16, 24, 32, 34, 36, 40
+} QTUCodecCapability;
+
+typedef struct QTUComponentCapability {
+	OSType				componentType;
+	OSType				componentSubType;
+	OSType				componentManufacturer;
+	unsigned long		componentFlags;
+} QTUComponentCapability;
+
+typedef struct QTUCapabilityStatistics {
+	Boolean				fromCache;						// read from the cache file, not asked from the toolbox
+	long				codecCount;
+	long				componentCount;
+	double				microseconds;					// the time reading or building the registry took
+} QTUCapabilityStatistics;
+
+pascal OSErr			QTUInitCapabilityRegistry(const FSSpec *theCacheFile, OSType theCreator);					// Answer questions about codecs and components from a registry.
+pascal QTUCodecCapability *	QTUFindCodecCapability(CodecType theCodec);												// Look up a codec in the registry.
+pascal void				QTUGetCapabilityStatistics(QTUCapabilityStatistics *theStatistics);
+pascal void				QTUDisposeCapabilityRegistry(void);
+
+
+// BUFFER POOL FUNCTIONS
+typedef struct QTUBufferPoolRecord *QTUBufferPool;
+
+typedef struct QTUBufferPoolStatistics {
+	long				bufferSize;
+	long				buffersInUse;
+	long				peakBuffersInUse;
+	long				heapAllocations;							// times the pool had to go to the Memory Manager
+	long				buffersHeld;								// in use or free, the pool keeps them until it's disposed
+} QTUBufferPoolStatistics;
+
+pascal OSErr			QTUNewBufferPool(long theBufferSize, long theBufferCount, long theAlignment, QTUBufferPool *thePool);	// Create a pool of same sized buffers.
+pascal Ptr				QTUBufferPoolGet(QTUBufferPool thePool);																// Get a buffer from the pool.
+pascal void				QTUBufferPoolRelease(QTUBufferPool thePool, Ptr theBuffer);									// Give a buffer back to the pool.
+pascal long				QTUBufferPoolGetBufferSize(QTUBufferPool thePool);
+pascal void				QTUBufferPoolGetStatistics(QTUBufferPool thePool, QTUBufferPoolStatistics *theStatistics);
+pascal void				QTUDisposeBufferPool(QTUBufferPool thePool);														// Dispose the pool and all its buffers.
+
+
+// RESAMPLING FUNCTIONS
+typedef struct QTUResamplerRecord *QTUResampler;
+
+pascal OSErr			QTUNewResampler(short theSourceWidth, short theSourceHeight, short theDestinationWidth, short theDestinationHeight,
+											short theFilter, long theBandCount, QTUResampler *theResampler);				// Prepare to scale 32-bit frames.
+pascal OSErr			QTUResamplePixMap(QTUResampler theResampler, PixMapHandle theSource, const Rect *theSourceRect,
+											PixMapHandle theDestination, const Rect *theDestinationRect);						// Scale a frame.
+pascal void				QTUDisposeResampler(QTUResampler theResampler);
+
+
+// COMPOSITING FUNCTIONS
+typedef struct QTUCompositorRecord *QTUCompositor;
+
+pascal OSErr			QTUNewCompositor(PixMapHandle theFrom, PixMapHandle theTo, const Rect *theRect, short theTransition,
+											QTUCompositor *theCompositor);													// Prepare a transition between two frames.
+pascal OSErr			QTUCompositorRenderStep(QTUCompositor theCompositor, long theOffset, PixMapHandle *theFrame,
+											Rect *theDirtyRect);																// Build one frame of the transition.
+pascal void				QTUDisposeCompositor(QTUCompositor theCompositor);
+pascal OSErr			QTUTimeScrollTransition(GWorldPtr theFrom, GWorldPtr theTo, short theStep, double *theCopyBitsMicroseconds,
+											double *theCompositorMicroseconds, Boolean *theSameOutput);					// Compositor against ScrollRect and CopyBits.
+
+
+// PICTURE ANALYSIS FUNCTIONS
+#define kQTUSceneThumbnailSize		32
+#define kQTUSceneHistogramBins		16
+
+typedef struct QTUSceneSignature {
+	UInt8				luma[kQTUSceneThumbnailSize * kQTUSceneThumbnailSize];
+	long				histogram[kQTUSceneHistogramBins];
+} QTUSceneSignature;
+
+pascal OSErr			QTUFindActiveRect(PixMapHandle thePixMap, const Rect *theRect, short theBlackLevel, Rect *theActiveRect);	// Find the picture inside black borders.
+pascal OSErr			QTUGetSceneSignature(PixMapHandle thePixMap, const Rect *theRect, QTUSceneSignature *theSignature);		// Reduce a frame for scene cut detection.
+pascal void				QTUCompareSceneSignatures(const QTUSceneSignature *theFirst, const QTUSceneSignature *theSecond,
+											long *theLumaDifference, long *theHistogramDifference);							// How different two frames are.
+
+
+// Quality meter, scores decoded frames against the frames they were compressed from.
+#define kQTUMaxPSNR				100.0
+
+typedef struct QTUQualityMeterRecord *QTUQualityMeter;
+
+typedef struct QTUFrameQuality {
+	double				mse;										// mean squared error of red, green and blue
+	double				psnr;										// in dB, kQTUMaxPSNR for identical frames
+	double				ssim;										// mean SSIM of the luma blocks, 1 for identical frames
+} QTUFrameQuality;
+
+typedef struct QTUQualityStatistics {
+	long				frames;
+	double				meanPSNR;
+	double				minPSNR;
+	double				meanSSIM;
+	double				minSSIM;
+	double				microseconds;								// time spent comparing
+} QTUQualityStatistics;
+
+pascal OSErr			QTUNewQualityMeter(long theWidth, long theHeight, long theWorkerCount, QTUQualityMeter *theMeter);	// Score frames by PSNR and SSIM.
+pascal OSErr			QTUQualityMeterCompare(QTUQualityMeter theMeter, PixMapHandle theReference, const Rect *theReferenceRect,
+											PixMapHandle theFrame, const Rect *theFrameRect, QTUFrameQuality *theQuality);	// Score a decoded frame.
+pascal void				QTUQualityMeterGetStatistics(QTUQualityMeter theMeter, QTUQualityStatistics *theStatistics);
+pascal void				QTUDisposeQualityMeter(QTUQualityMeter theMeter);
+
+// SEEK INDEX FUNCTIONS
+typedef struct QTUSeekIndexRecord *QTUSeekIndex;
+
+typedef struct QTUSeekIndexStatistics {
+	long				sampleCount;
+	long				syncSampleCount;
+	long				framesFetched;
+	long				cacheHits;									// frames returned without decoding anything
+	long				samplesDecoded;
+} QTUSeekIndexStatistics;
+
+pascal OSErr			QTUNewSeekIndex(Movie theMovie, QTUSeekIndex *theIndex);											// Index the video samples of a movie.
+pascal OSErr			QTUWriteSeekIndex(QTUSeekIndex theIndex, const FSSpec *theFile);									// Keep an index in a sidecar file.
+pascal OSErr			QTUReadSeekIndex(Movie theMovie, const FSSpec *theFile, QTUSeekIndex *theIndex);				// Read an index kept in a file.
+pascal OSErr			QTUGetSeekIndex(Movie theMovie, const FSSpec *theMovieFile, QTUSeekIndex *theIndex);		// Read the sidecar of a movie file, or build it.
+pascal OSErr			QTUSeekIndexGetFrame(QTUSeekIndex theIndex, TimeValue theMovieTime, GWorldPtr *theFrame);	// Decode a frame from the nearest sync sample.
+pascal long				QTUSeekIndexGetSeekCost(QTUSeekIndex theIndex, TimeValue theMovieTime, long *theSyncSample,
+											long *theDataSize);																		// Samples to decode for a frame.
+pascal void				QTUSeekIndexGetStatistics(QTUSeekIndex theIndex, QTUSeekIndexStatistics *theStatistics);
+pascal void				QTUDisposeSeekIndex(QTUSeekIndex theIndex);
+
+
+// READ-AHEAD FUNCTIONS
+typedef struct QTUPrefetcherRecord *QTUPrefetcher;
+
+typedef struct QTUPrefetcherStatistics {
+	long				reads;
+	double				bytesRead;
+	long				seeks;										// the render position went back, or past the data read ahead
+	long				buffersFull;								// times the read-ahead stopped at the memory limit
+} QTUPrefetcherStatistics;
+
+pascal OSErr			QTUNewPrefetcher(Track theTrack, TimeValue theLeadTime, long theMaxBytes, QTUPrefetcher *thePrefetcher);	// Read the samples of a track ahead.
+pascal OSErr			QTUPrefetcherUpdate(QTUPrefetcher thePrefetcher, TimeValue theMovieTime);							// Read ahead of the render position.
+pascal void				QTUPrefetcherGetStatistics(QTUPrefetcher thePrefetcher, QTUPrefetcherStatistics *theStatistics);
+pascal void				QTUDisposePrefetcher(QTUPrefetcher thePrefetcher);
+
+// Window loader, keeps the part of a movie ahead of the playhead in RAM.
+typedef struct QTUWindowLoaderRecord *QTUWindowLoader;
+
+typedef struct QTUWindowLoaderStatistics {
+	long				hits;										// updates with the playhead loaded for all the tracks
+	long				misses;
+	long				overBudget;									// times the window was cut short by the byte budget
+	double				bytesLoaded;
+	double				bytesUnloaded;
+	long				loadedBytes;								// loaded right now
+} QTUWindowLoaderStatistics;
+
+pascal OSErr			QTUNewWindowLoader(Movie theMovie, TimeValue theWindow, long theMaxBytes, QTUWindowLoader *theLoader);	// Keep a window of a movie in RAM.
+pascal OSErr			QTUWindowLoaderUpdate(QTUWindowLoader theLoader, TimeValue theMovieTime);							// Move the window with the playhead.
+pascal void				QTUWindowLoaderGetStatistics(QTUWindowLoader theLoader, QTUWindowLoaderStatistics *theStatistics);
+pascal void				QTUDisposeWindowLoader(QTUWindowLoader theLoader);
+
+
+// FILE FUNCTIONS
+pascal void				QTUStartHash(UInt32 theHash[2]);																	// Start a new 64-bit data hash.
+pascal void				QTUHashData(UInt32 theHash[2], const void *theData, long theDataSize);						// Add data to a hash.
+pascal OSErr			QTUHashFile(const FSSpec *theFile, UInt32 theHash[2]);										// Hash the data and resource fork of a file.
+pascal OSErr			QTULinkOrCopyFile(const FSSpec *theSource, const FSSpec *theDestination);					// Hard link a file, or copy it if we can't.
+
+
+// TIMING FUNCTIONS
+pascal void				QTUStartTimer(UnsignedWide *theTimer);																// Remember the current time in microseconds.
+pascal double			QTUElapsedMicroseconds(const UnsignedWide *theTimer);											// Microseconds passed since QTUStartTimer.
+
+
+// MEMORY FUNCTIONS
+pascal double			QTUGetMemoryInUse(void);																			// Memory the application uses, for differences.
+
+
+// MULTIPROCESSING FUNCTIONS
+typedef OSStatus		(*QTUWorkProcPtr)(void *theWorkItem);											// Work function run on a pool worker.
+typedef struct QTUWorkerPoolRecord *QTUWorkerPool;
+
+pascal long				QTUCountProcessors(void);																			// Number of processors we could run workers on.
+pascal Boolean			QTUCanUseMoviesOnThreads(void);																	// Could workers call the ICM and codecs.
+pascal OSErr			QTUNewWorkerPool(long theWorkerCount, QTUWorkerPool *thePool);								// Create a pool of MP worker tasks.
+pascal OSErr			QTUNewMoviesWorkerPool(long theWorkerCount, QTUWorkerPool *thePool);						// Create a pool of workers that could compress.
+pascal OSErr			QTUWorkerPoolSubmit(QTUWorkerPool thePool, QTUWorkProcPtr theWorkProc, void *theWorkItem);	// Queue a work item for the pool.
+pascal OSErr			QTUWorkerPoolWaitForItem(QTUWorkerPool thePool, void **theWorkItem, OSStatus *theWorkResult);	// Wait for the next finished work item.
+pascal void				QTUDisposeWorkerPool(QTUWorkerPool thePool);														// Stop the workers and dispose the pool.
+
+typedef struct QTURingRecord *QTURing;
+
+pascal OSErr			QTUNewRing(long theCapacity, QTURing *theRing);													// Lock free ring for one producer and one consumer.
+pascal Boolean			QTURingPush(QTURing theRing, void *theItem);														// Producer only, false if full.
+pascal Boolean			QTURingPop(QTURing theRing, void **theItem);														// Consumer only, false if empty.
+pascal long				QTURingCount(QTURing theRing);
+pascal void				QTUDisposeRing(QTURing theRing);
+
 
 #ifdef __cplusplus
 }